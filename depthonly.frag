@@ -0,0 +1,9 @@
+// Depth prepass: only the depth of the nearest surface is wanted and color
+// writes are off, so this does as little as a fragment shader can. The
+// parallax shader then runs in a second pass on the pixels whose depth
+// matches (see drawScene() in main.cpp).
+
+void main()
+{
+	gl_FragColor = vec4(0.0);
+}
@@ -0,0 +1,396 @@
+
+#include "bc_encode.h"
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Block rows handed to one parallel_for task at a time
+#define BLOCK_ROWS_PER_TASK 4
+
+static int block_bytes(int format) {
+  return format == BC_FORMAT_BC5 ? 16 : 8;
+}
+
+size_t bc_encoded_size(int format, int width, int height) {
+  size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  return blocksX * blocksY * block_bytes(format);
+}
+
+// Gathers a 4x4 block as RGBA, replicating the last row/column for blocks
+// that hang over the edge. One channel is treated as grey, two as RG.
+static void fetch_block(const unsigned char *pixels, int width, int height, int channels,
+                        int bx, int by, unsigned char block[16][4]) {
+  int x, y;
+
+  for( y = 0 ; y < 4 ; y++ ){
+    int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+    for( x = 0 ; x < 4 ; x++ ){
+      int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+      const unsigned char *p = pixels + ((size_t)sy * width + sx) * channels;
+      unsigned char *b = block[y * 4 + x];
+
+      switch( channels ){
+      case 1:
+        b[0] = b[1] = b[2] = p[0];
+        break;
+      case 2:
+        b[0] = p[0]; b[1] = p[1]; b[2] = 0;
+        break;
+      default:
+        b[0] = p[0]; b[1] = p[1]; b[2] = p[2];
+        break;
+      }
+      b[3] = 0;
+    }
+  }
+}
+
+
+// BC1
+
+static unsigned short pack_565(const int c[3]) {
+  return (unsigned short)(((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255));
+}
+
+static void unpack_565(unsigned short v, int c[3]) {
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// Projects every texel onto 'dir'. Texels are RGB0 bytes.
+static void project_block(const unsigned char block[16][4], const int dir[3], int dots[16]) {
+  int i;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i d = _mm_setr_epi16(dir[0], dir[1], dir[2], 0, dir[0], dir[1], dir[2], 0);
+
+  for( i = 0 ; i < 16 ; i += 4 ){
+    __m128i px = _mm_loadu_si128((const __m128i*)block[i]);
+    // Two texels per register as 16-bit RGB0, madd gives r*dr+g*dg and b*db per texel
+    __m128i m0 = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), d);
+    __m128i m1 = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), d);
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm_storeu_si128((__m128i*)(dots + i), _mm_add_epi32(even, odd));
+  }
+#else
+  for( i = 0 ; i < 16 ; i++ )
+    dots[i] = block[i][0] * dir[0] + block[i][1] * dir[1] + block[i][2] * dir[2];
+#endif
+}
+
+static void bc1_encode_block(const unsigned char block[16][4], unsigned char *out) {
+  static const int bucketToIndex[4] = { 0, 2, 3, 1 };
+  float mean[3] = { 0, 0, 0 }, cov[6] = { 0, 0, 0, 0, 0, 0 }, axis[3], len;
+  int dir[3], dots[16], minC[3], maxC[3], p0[3], p1[3];
+  int i, k, iter, minI = 0, maxI = 0;
+  unsigned short c0, c1;
+  unsigned int indices = 0;
+
+  // Principal axis of the colours
+  for( i = 0 ; i < 16 ; i++ )
+    for( k = 0 ; k < 3 ; k++ )
+      mean[k] += block[i][k] / 16.0f;
+
+  for( i = 0 ; i < 16 ; i++ ){
+    float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  axis[0] = axis[1] = axis[2] = 1.0f;
+  for( iter = 0 ; iter < 4 ; iter++ ){
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    len = fabsf(x) > fabsf(y) ? fabsf(x) : fabsf(y);
+    len = fabsf(z) > len ? fabsf(z) : len;
+    if( len < 1e-6f )
+      break;
+    axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+  }
+
+  // The extreme texels along the axis become the endpoints
+  for( k = 0 ; k < 3 ; k++ )
+    dir[k] = (int)(axis[k] * 255.0f);
+  project_block(block, dir, dots);
+  for( i = 1 ; i < 16 ; i++ ){
+    if( dots[i] < dots[minI] ) minI = i;
+    if( dots[i] > dots[maxI] ) maxI = i;
+  }
+  for( k = 0 ; k < 3 ; k++ ){
+    minC[k] = block[minI][k];
+    maxC[k] = block[maxI][k];
+  }
+
+  c0 = pack_565(maxC);
+  c1 = pack_565(minC);
+
+  if( c0 == c1 ){
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    memset(out + 4, 0, 4);
+    return;
+  }
+
+  // c0 > c1 selects the four colour mode
+  if( c0 < c1 ){
+    unsigned short t = c0; c0 = c1; c1 = t;
+  }
+
+  unpack_565(c0, p0);
+  unpack_565(c1, p1);
+  for( k = 0 ; k < 3 ; k++ )
+    dir[k] = p0[k] - p1[k];
+
+  // Position of each texel between p1 (0) and p0 (1), bucketed at
+  // 1/6, 3/6 and 5/6, which are the midpoints between palette entries
+  project_block(block, dir, dots);
+  {
+    int d1 = p1[0] * dir[0] + p1[1] * dir[1] + p1[2] * dir[2];
+    int range = p0[0] * dir[0] + p0[1] * dir[1] + p0[2] * dir[2] - d1;
+    int buckets[16];
+
+#ifdef __SSE2__
+    const __m128i r1 = _mm_set1_epi32(range), r3 = _mm_set1_epi32(range * 3), r5 = _mm_set1_epi32(range * 5);
+    const __m128i base = _mm_set1_epi32(d1);
+    for( i = 0 ; i < 16 ; i += 4 ){
+      __m128i s = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(dots + i)), base);
+      s = _mm_add_epi32(_mm_slli_epi32(s, 2), _mm_slli_epi32(s, 1));  // * 6
+      __m128i b = _mm_add_epi32(_mm_add_epi32(_mm_cmplt_epi32(s, r1), _mm_cmplt_epi32(s, r3)), _mm_cmplt_epi32(s, r5));
+      _mm_storeu_si128((__m128i*)(buckets + i), _mm_sub_epi32(_mm_setzero_si128(), b));
+    }
+#else
+    for( i = 0 ; i < 16 ; i++ ){
+      int s = (dots[i] - d1) * 6;
+      buckets[i] = (s < range) + (s < range * 3) + (s < range * 5);
+    }
+#endif
+
+    for( i = 15 ; i >= 0 ; i-- )
+      indices = (indices << 2) | bucketToIndex[buckets[i]];
+  }
+
+  out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+  out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+  out[4] = indices & 0xFF;
+  out[5] = (indices >> 8) & 0xFF;
+  out[6] = (indices >> 16) & 0xFF;
+  out[7] = (indices >> 24) & 0xFF;
+}
+
+static void bc1_decode_block(const unsigned char *in, unsigned char block[16][4]) {
+  unsigned short c0 = in[0] | in[1] << 8, c1 = in[2] | in[3] << 8;
+  unsigned int indices = in[4] | in[5] << 8 | in[6] << 16 | (unsigned int)in[7] << 24;
+  int palette[4][3], i, k;
+
+  unpack_565(c0, palette[0]);
+  unpack_565(c1, palette[1]);
+  for( k = 0 ; k < 3 ; k++ ){
+    if( c0 > c1 ){
+      palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+      palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+    } else {
+      palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+      palette[3][k] = 0;
+    }
+  }
+
+  for( i = 0 ; i < 16 ; i++, indices >>= 2 )
+    for( k = 0 ; k < 3 ; k++ )
+      block[i][k] = (unsigned char)palette[indices & 3][k];
+}
+
+
+// BC4, used once for BC4 and twice for BC5
+
+static void bc4_encode_channel(const unsigned char block[16][4], int channel, unsigned char *out) {
+  unsigned char values[16];
+  int indices[16], minV, maxV, i;
+  unsigned long long bits = 0;
+
+  for( i = 0 ; i < 16 ; i++ )
+    values[i] = block[i][channel];
+
+#ifdef __SSE2__
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*)values);
+    __m128i mn = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+    __m128i mx = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 2));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 2));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 1));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 1));
+    minV = _mm_cvtsi128_si32(mn) & 0xFF;
+    maxV = _mm_cvtsi128_si32(mx) & 0xFF;
+  }
+#else
+  minV = maxV = values[0];
+  for( i = 1 ; i < 16 ; i++ ){
+    if( values[i] < minV ) minV = values[i];
+    if( values[i] > maxV ) maxV = values[i];
+  }
+#endif
+
+  out[0] = (unsigned char)maxV;
+  out[1] = (unsigned char)minV;
+
+  if( maxV == minV ){
+    memset(out + 2, 0, 6);
+    return;
+  }
+
+  // Eight value mode: index 0 is max, 1 is min, 2-7 step from max to min
+#ifdef __SSE2__
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(7.0f / (maxV - minV));
+    const __m128 offset = _mm_set1_ps((float)minV);
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128i v = _mm_loadu_si128((const __m128i*)values);
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+    __m128i quarters[4];
+
+    quarters[0] = _mm_unpacklo_epi16(lo, zero);
+    quarters[1] = _mm_unpackhi_epi16(lo, zero);
+    quarters[2] = _mm_unpacklo_epi16(hi, zero);
+    quarters[3] = _mm_unpackhi_epi16(hi, zero);
+    for( i = 0 ; i < 4 ; i++ ){
+      __m128 f = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(quarters[i]), offset), scale), half);
+      _mm_storeu_si128((__m128i*)(indices + i * 4), _mm_cvttps_epi32(f));
+    }
+  }
+#else
+  for( i = 0 ; i < 16 ; i++ )
+    indices[i] = (int)((values[i] - minV) * 7.0f / (maxV - minV) + 0.5f);
+#endif
+
+  for( i = 15 ; i >= 0 ; i-- ){
+    int t = indices[i];
+    int index = t >= 7 ? 0 : t <= 0 ? 1 : 8 - t;
+    bits = (bits << 3) | index;
+  }
+
+  for( i = 0 ; i < 6 ; i++ )
+    out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+static void bc4_decode_channel(const unsigned char *in, int channel, unsigned char block[16][4]) {
+  int palette[8], i;
+  unsigned long long bits = 0;
+
+  palette[0] = in[0];
+  palette[1] = in[1];
+  for( i = 2 ; i < 8 ; i++ ){
+    if( in[0] > in[1] )
+      palette[i] = ((8 - i) * in[0] + (i - 1) * in[1]) / 7;
+    else
+      palette[i] = i < 6 ? ((6 - i) * in[0] + (i - 1) * in[1]) / 5 : (i == 6 ? 0 : 255);
+  }
+
+  for( i = 0 ; i < 6 ; i++ )
+    bits |= (unsigned long long)in[2 + i] << (8 * i);
+
+  for( i = 0 ; i < 16 ; i++, bits >>= 3 )
+    block[i][channel] = (unsigned char)palette[bits & 7];
+}
+
+
+typedef struct {
+  int format;
+  const unsigned char *pixels;
+  int width, height, channels;
+  unsigned char *out;
+} encode_job_t;
+
+static void encode_block_rows(int begin, int end, void *arg) {
+  const encode_job_t *job = (const encode_job_t*)arg;
+  const int blocksX = (job->width + 3) / 4;
+  const int bytes = block_bytes(job->format);
+  unsigned char block[16][4];
+  int bx, by;
+
+  for( by = begin ; by < end ; by++ ){
+    unsigned char *out = job->out + (size_t)by * blocksX * bytes;
+    for( bx = 0 ; bx < blocksX ; bx++, out += bytes ){
+      fetch_block(job->pixels, job->width, job->height, job->channels, bx, by, block);
+      switch( job->format ){
+      case BC_FORMAT_BC1:
+        bc1_encode_block(block, out);
+        break;
+      case BC_FORMAT_BC4:
+        bc4_encode_channel(block, 0, out);
+        break;
+      case BC_FORMAT_BC5:
+        bc4_encode_channel(block, 0, out);
+        bc4_encode_channel(block, 1, out + 8);
+        break;
+      }
+    }
+  }
+}
+
+void bc_encode_image(int format, const unsigned char *pixels, int width, int height, int channels,
+                     unsigned char *out, thread_pool_t *pool) {
+  encode_job_t job;
+
+  job.format = format;
+  job.pixels = pixels;
+  job.width = width;
+  job.height = height;
+  job.channels = channels;
+  job.out = out;
+
+  parallel_for(pool, (height + 3) / 4, BLOCK_ROWS_PER_TASK, encode_block_rows, &job);
+}
+
+double bc_psnr(int format, const unsigned char *pixels, int width, int height, int channels,
+               const unsigned char *encoded) {
+  const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  const int bytes = block_bytes(format);
+  const int numChannels = format == BC_FORMAT_BC1 ? 3 : format == BC_FORMAT_BC5 ? 2 : 1;
+  unsigned char original[16][4], decoded[16][4];
+  double squaredError = 0.0, mse;
+  size_t count = 0;
+  int bx, by, x, y, k;
+
+  for( by = 0 ; by < blocksY ; by++ )
+    for( bx = 0 ; bx < blocksX ; bx++, encoded += bytes ){
+      fetch_block(pixels, width, height, channels, bx, by, original);
+
+      switch( format ){
+      case BC_FORMAT_BC1:
+        bc1_decode_block(encoded, decoded);
+        break;
+      case BC_FORMAT_BC4:
+        bc4_decode_channel(encoded, 0, decoded);
+        break;
+      case BC_FORMAT_BC5:
+        bc4_decode_channel(encoded, 0, decoded);
+        bc4_decode_channel(encoded + 8, 1, decoded);
+        break;
+      }
+
+      // Only texels inside the image count
+      for( y = 0 ; y < 4 && by * 4 + y < height ; y++ )
+        for( x = 0 ; x < 4 && bx * 4 + x < width ; x++ )
+          for( k = 0 ; k < numChannels ; k++ ){
+            double e = (double)original[y * 4 + x][k] - decoded[y * 4 + x][k];
+            squaredError += e * e;
+            count++;
+          }
+    }
+
+  mse = squaredError / (count ? count : 1);
+  if( mse <= 0.0 )
+    return 99.0;
+  return 10.0 * log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,40 @@
+
+#ifndef _BC_ENCODE_
+#define _BC_ENCODE_
+
+#include <stddef.h>
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Block compression of 4x4 texel blocks:
+  //   BC1 (DXT1)  RGB,  8 bytes per block, for diffuse maps
+  //   BC4 (RGTC1) R,    8 bytes per block, for height maps
+  //   BC5 (RGTC2) RG,  16 bytes per block, for normal maps (x and y only)
+  // Images are read in the same row order they are stored, so a bottom-up
+  // buffer yields blocks in the order glCompressedTexImage2D expects.
+
+  enum {
+    BC_FORMAT_BC1 = 0,
+    BC_FORMAT_BC4,
+    BC_FORMAT_BC5
+  };
+
+  size_t bc_encoded_size(int format, int width, int height);
+
+  // Encodes 'pixels' (with 1-4 interleaved channels) into 'out', which must
+  // hold bc_encoded_size() bytes. Block rows are spread over the pool.
+  void bc_encode_image(int format, const unsigned char *pixels, int width, int height, int channels,
+                       unsigned char *out, thread_pool_t *pool);
+
+  // Decodes 'encoded' and returns the PSNR in dB against the channels of
+  // 'pixels' that the format stores
+  double bc_psnr(int format, const unsigned char *pixels, int width, int height, int channels,
+                 const unsigned char *encoded);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,110 @@
+#include "bvh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  bvh_t *bvh;
+  const aabb_t *boxes;
+  float *centres;     // 3 per box
+  int leafSize;
+} build_ctx_t;
+
+static void box_union(aabb_t *out, const aabb_t *box) {
+  int a;
+
+  for( a = 0 ; a < 3 ; a++ ){
+    if( box->min[a] < out->min[a] ) out->min[a] = box->min[a];
+    if( box->max[a] > out->max[a] ) out->max[a] = box->max[a];
+  }
+}
+
+// Fills in the node for items[first .. first + count) and its subtree
+static void build_node(build_ctx_t *ctx, int nodeIndex, int first, int count) {
+  bvh_t *bvh = ctx->bvh;
+  bvh_node_t *node = &bvh->nodes[nodeIndex];
+  float centreMin[3], centreMax[3], split;
+  int i, a, axis = 0, mid;
+
+  node->first = first;
+  node->count = count;
+  node->left = -1;
+  node->bounds = ctx->boxes[bvh->items[first]];
+  for( a = 0 ; a < 3 ; a++ )
+    centreMin[a] = centreMax[a] = ctx->centres[bvh->items[first] * 3 + a];
+
+  for( i = first + 1 ; i < first + count ; i++ ){
+    const float *centre = ctx->centres + bvh->items[i] * 3;
+    box_union(&node->bounds, &ctx->boxes[bvh->items[i]]);
+    for( a = 0 ; a < 3 ; a++ ){
+      if( centre[a] < centreMin[a] ) centreMin[a] = centre[a];
+      if( centre[a] > centreMax[a] ) centreMax[a] = centre[a];
+    }
+  }
+
+  if( count <= ctx->leafSize )
+    return;
+
+  for( a = 1 ; a < 3 ; a++ )
+    if( centreMax[a] - centreMin[a] > centreMax[axis] - centreMin[axis] )
+      axis = a;
+  split = 0.5f * (centreMin[axis] + centreMax[axis]);
+
+  // Partition in place around the split
+  mid = first;
+  for( i = first ; i < first + count ; i++ )
+    if( ctx->centres[bvh->items[i] * 3 + axis] < split ){
+      int item = bvh->items[i];
+      bvh->items[i] = bvh->items[mid];
+      bvh->items[mid++] = item;
+    }
+
+  // All centres in one place; any split is as good as another
+  if( mid == first || mid == first + count )
+    mid = first + count / 2;
+
+  node->left = bvh->numNodes;
+  bvh->numNodes += 2;
+  build_node(ctx, node->left, first, mid - first);
+  build_node(ctx, bvh->nodes[nodeIndex].left + 1, mid, first + count - mid);
+}
+
+int bvh_build(bvh_t *bvh, const aabb_t *boxes, int count, int leafSize) {
+  build_ctx_t ctx;
+  int i, a;
+
+  memset(bvh, 0, sizeof(*bvh));
+  if( count <= 0 ){
+    fprintf( stderr, "Can't build a BVH over %d boxes.\n", count );
+    return 0;
+  }
+
+  // A binary tree with leaves of at least one item has under 2n nodes
+  bvh->nodes = (bvh_node_t*)malloc(sizeof(bvh_node_t) * 2 * count);
+  bvh->items = (int*)malloc(sizeof(int) * count);
+  bvh->numItems = count;
+  for( i = 0 ; i < count ; i++ )
+    bvh->items[i] = i;
+
+  ctx.bvh = bvh;
+  ctx.boxes = boxes;
+  ctx.leafSize = leafSize < 1 ? 1 : leafSize;
+  ctx.centres = (float*)malloc(sizeof(float) * 3 * count);
+  for( i = 0 ; i < count ; i++ )
+    for( a = 0 ; a < 3 ; a++ )
+      ctx.centres[i * 3 + a] = 0.5f * (boxes[i].min[a] + boxes[i].max[a]);
+
+  bvh->numNodes = 1;
+  build_node(&ctx, 0, 0, count);
+
+  free(ctx.centres);
+  return 1;
+}
+
+void bvh_free(bvh_t *bvh) {
+  free(bvh->nodes);
+  free(bvh->items);
+  bvh->nodes = NULL;
+  bvh->items = NULL;
+  bvh->numNodes = bvh->numItems = 0;
+}
@@ -0,0 +1,37 @@
+
+#ifndef _BVH_
+#define _BVH_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct {
+    float min[3], max[3];
+  } aabb_t;
+
+  // Every node covers a contiguous range of the reordered items, internal
+  // nodes too, so a whole subtree can be taken without visiting it
+  typedef struct {
+    aabb_t bounds;
+    int first, count;   // items[first .. first + count)
+    int left;           // Children at left and left + 1, -1 for leaves
+  } bvh_node_t;
+
+  // Bounding volume hierarchy over boxes, node 0 is the root
+  typedef struct {
+    bvh_node_t *nodes;
+    int numNodes;
+    int *items;         // Indices of the boxes it was built from
+    int numItems;
+  } bvh_t;
+
+  // Splits at the middle of the longest axis of the box centres until at
+  // most 'leafSize' boxes are left. Returns 0 on failure.
+  int bvh_build(bvh_t *bvh, const aabb_t *boxes, int count, int leafSize);
+  void bvh_free(bvh_t *bvh);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,267 @@
+#include "cone_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ROWS_PER_TASK 4
+#define MAX_RATIO CONE_MAP_MAX_RATIO
+#define MAX_PYRAMID_LEVELS 32
+
+// Maximum heights; a texel of level l covers 2^l x 2^l texels of level 0.
+// Sizes round up so the last row and column of a level cover what's left.
+typedef struct {
+  int numLevels;
+  int width[MAX_PYRAMID_LEVELS], height[MAX_PYRAMID_LEVELS];
+  unsigned char *levels[MAX_PYRAMID_LEVELS];
+} max_pyramid_t;
+
+typedef struct {
+  const max_pyramid_t *pyramid;
+  unsigned char *cones;
+  float invWidth, invHeight;
+} cone_job_t;
+
+typedef struct {
+  int level, x, y;
+  float bound;    // Narrowest cone this node could still give
+} cone_node_t;
+
+static void build_pyramid(max_pyramid_t *pyramid, const unsigned char *heights, int width, int height, int channels) {
+  size_t i, n = (size_t)width * height;
+  int l, x, y;
+
+  pyramid->levels[0] = (unsigned char*)malloc(n);
+  for( i = 0 ; i < n ; i++ )
+    pyramid->levels[0][i] = heights[i * channels];
+  pyramid->width[0] = width;
+  pyramid->height[0] = height;
+
+  for( l = 1 ; pyramid->width[l - 1] > 1 || pyramid->height[l - 1] > 1 ; l++ ){
+    int sw = pyramid->width[l - 1], sh = pyramid->height[l - 1];
+    int dw = (sw + 1) / 2, dh = (sh + 1) / 2;
+    const unsigned char *src = pyramid->levels[l - 1];
+    unsigned char *dst = (unsigned char*)malloc((size_t)dw * dh);
+
+    for( y = 0 ; y < dh ; y++ ){
+      const unsigned char *row0 = src + (size_t)(2 * y) * sw;
+      const unsigned char *row1 = 2 * y + 1 < sh ? row0 + sw : row0;
+      for( x = 0 ; x < dw ; x++ ){
+        int x1 = 2 * x + 1 < sw ? 2 * x + 1 : 2 * x;
+        unsigned char m = row0[2 * x] > row0[x1] ? row0[2 * x] : row0[x1];
+        unsigned char m1 = row1[2 * x] > row1[x1] ? row1[2 * x] : row1[x1];
+        dst[(size_t)y * dw + x] = m > m1 ? m : m1;
+      }
+    }
+
+    pyramid->levels[l] = dst;
+    pyramid->width[l] = dw;
+    pyramid->height[l] = dh;
+  }
+  pyramid->numLevels = l;
+}
+
+static void free_pyramid(max_pyramid_t *pyramid) {
+  int l;
+  for( l = 0 ; l < pyramid->numLevels ; l++ )
+    free(pyramid->levels[l]);
+}
+
+// Distance in texels from p to the nearest of the texels [lo, hi] on a
+// wrapping axis of 'size' texels
+static int wrapped_distance(int p, int lo, int hi, int size) {
+  int before, after;
+
+  if( p >= lo && p <= hi )
+    return 0;
+
+  before = lo - p;
+  if( before < 0 ) before += size;
+  after = p - hi;
+  if( after < 0 ) after += size;
+  return before < after ? before : after;
+}
+
+// Cone ratio bounds of the four children of a node for the texel (px, py)
+// of height hp. A child that can't be higher than hp gets a bound of
+// infinity, as does a child outside the map.
+static void child_bounds(const cone_job_t *job, const cone_node_t *node, int px, int py, int hp, float bounds[4]) {
+  const max_pyramid_t *pyramid = job->pyramid;
+  int level = node->level - 1;
+  int w = pyramid->width[level], h = pyramid->height[level];
+  int W = pyramid->width[0], H = pyramid->height[0];
+  const unsigned char *heights = pyramid->levels[level];
+  float dx[4], dy[4], dh[4];
+  int c;
+
+  for( c = 0 ; c < 4 ; c++ ){
+    int cx = 2 * node->x + (c & 1), cy = 2 * node->y + (c >> 1);
+
+    if( cx >= w || cy >= h ){
+      dx[c] = dy[c] = dh[c] = 0.0f;
+      continue;
+    }
+
+    dh[c] = (float)(heights[(size_t)cy * w + cx] - hp);
+    dx[c] = (float)wrapped_distance(px, cx << level, ((cx + 1) << level) - 1, W);
+    dy[c] = (float)wrapped_distance(py, cy << level, ((cy + 1) << level) - 1, H);
+  }
+
+#ifdef __SSE2__
+  {
+    __m128 x = _mm_mul_ps(_mm_loadu_ps(dx), _mm_set1_ps(job->invWidth));
+    __m128 y = _mm_mul_ps(_mm_loadu_ps(dy), _mm_set1_ps(job->invHeight));
+    __m128 rise = _mm_mul_ps(_mm_loadu_ps(dh), _mm_set1_ps(1.0f / 255.0f));
+    __m128 higher = _mm_cmpgt_ps(rise, _mm_setzero_ps());
+    __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+    // Lanes that aren't higher divide by 1 and are then replaced
+    __m128 ratio = _mm_div_ps(dist, _mm_or_ps(_mm_and_ps(higher, rise), _mm_andnot_ps(higher, _mm_set1_ps(1.0f))));
+    ratio = _mm_or_ps(_mm_and_ps(higher, ratio), _mm_andnot_ps(higher, _mm_set1_ps(INFINITY)));
+    _mm_storeu_ps(bounds, ratio);
+  }
+#else
+  for( c = 0 ; c < 4 ; c++ ){
+    if( dh[c] > 0.0f ){
+      float x = dx[c] * job->invWidth, y = dy[c] * job->invHeight;
+      bounds[c] = sqrtf(x * x + y * y) / (dh[c] * (1.0f / 255.0f));
+    } else
+      bounds[c] = INFINITY;
+  }
+#endif
+}
+
+// Narrowest cone over all higher texels, searched best-first through the
+// pyramid. Nodes whose bound is already wider than the best cone are skipped.
+static float cone_ratio(const cone_job_t *job, int px, int py) {
+  const max_pyramid_t *pyramid = job->pyramid;
+  int top = pyramid->numLevels - 1;
+  int hp = pyramid->levels[0][(size_t)py * pyramid->width[0] + px];
+  cone_node_t stack[4 * MAX_PYRAMID_LEVELS];
+  int sp = 0, c, i, order[4];
+  float best = MAX_RATIO, bounds[4];
+
+  if( hp >= pyramid->levels[top][0] )
+    return best;      // Nothing is higher
+
+  // The 1x1 top level has the whole map below it
+  stack[sp].level = top;
+  stack[sp].x = stack[sp].y = 0;
+  stack[sp].bound = 0.0f;
+  sp++;
+
+  while( sp > 0 ){
+    cone_node_t node = stack[--sp];
+    if( node.bound >= best )
+      continue;
+
+    child_bounds(job, &node, px, py, hp, bounds);
+
+    if( node.level == 1 ){
+      for( c = 0 ; c < 4 ; c++ )
+        if( bounds[c] < best )
+          best = bounds[c];
+      continue;
+    }
+
+    // Push the most promising child last so it is searched first
+    for( c = 0 ; c < 4 ; c++ ){
+      order[c] = c;
+      for( i = c ; i > 0 && bounds[order[i - 1]] < bounds[order[i]] ; i-- ){
+        int tmp = order[i];
+        order[i] = order[i - 1];
+        order[i - 1] = tmp;
+      }
+    }
+    for( c = 0 ; c < 4 ; c++ ){
+      int child = order[c];
+      if( bounds[child] >= best )
+        continue;
+      stack[sp].level = node.level - 1;
+      stack[sp].x = 2 * node.x + (child & 1);
+      stack[sp].y = 2 * node.y + (child >> 1);
+      stack[sp].bound = bounds[child];
+      sp++;
+    }
+  }
+
+  return best;
+}
+
+// Rounds down so the stored cone is never wider than the real one
+static unsigned char encode_ratio(float ratio) {
+  float e = sqrtf(ratio / MAX_RATIO) * 255.0f;
+  return e >= 255.0f ? 255 : (unsigned char)e;
+}
+
+float cone_map_decode(unsigned char encoded) {
+  float e = encoded / 255.0f;
+  return e * e * MAX_RATIO;
+}
+
+static void build_rows(int begin, int end, void *arg) {
+  cone_job_t *job = (cone_job_t*)arg;
+  int width = job->pyramid->width[0];
+  int x, y;
+
+  for( y = begin ; y < end ; y++ )
+    for( x = 0 ; x < width ; x++ )
+      job->cones[(size_t)y * width + x] = encode_ratio(cone_ratio(job, x, y));
+}
+
+void cone_map_build(const unsigned char *heights, int width, int height, int channels,
+                    unsigned char *cones, thread_pool_t *pool) {
+  max_pyramid_t pyramid;
+  cone_job_t job;
+
+  if( width <= 0 || height <= 0 )
+    return;
+
+  // A single texel has no neighbours to search
+  if( width == 1 && height == 1 ){
+    cones[0] = encode_ratio(MAX_RATIO);
+    return;
+  }
+
+  build_pyramid(&pyramid, heights, width, height, channels);
+
+  job.pyramid = &pyramid;
+  job.cones = cones;
+  job.invWidth = 1.0f / width;
+  job.invHeight = 1.0f / height;
+  parallel_for(pool, height, ROWS_PER_TASK, build_rows, &job);
+
+  free_pyramid(&pyramid);
+}
+
+void cone_map_build_reference(const unsigned char *heights, int width, int height, int channels,
+                              unsigned char *cones) {
+  int px, py, qx, qy;
+
+  for( py = 0 ; py < height ; py++ ){
+    for( px = 0 ; px < width ; px++ ){
+      int hp = heights[((size_t)py * width + px) * channels];
+      float best = MAX_RATIO;
+
+      for( qy = 0 ; qy < height ; qy++ ){
+        for( qx = 0 ; qx < width ; qx++ ){
+          int hq = heights[((size_t)qy * width + qx) * channels];
+          float x, y, ratio;
+
+          if( hq <= hp )
+            continue;
+
+          x = wrapped_distance(px, qx, qx, width) / (float)width;
+          y = wrapped_distance(py, qy, qy, height) / (float)height;
+          ratio = sqrtf(x * x + y * y) / ((hq - hp) / 255.0f);
+          if( ratio < best )
+            best = ratio;
+        }
+      }
+
+      cones[(size_t)py * width + px] = encode_ratio(best);
+    }
+  }
+}
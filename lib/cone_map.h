@@ -0,0 +1,43 @@
+
+#ifndef _CONE_MAP_
+#define _CONE_MAP_
+
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Wider cones hardly shorten the march but widen the search a lot. With
+  // the shader's depth of 0.03 texture widths this allows cones of up to 59
+  // degrees from the vertical. Also used to decode the map in the shader.
+#define CONE_MAP_MAX_RATIO 0.05f
+
+  // Cone step mapping needs, for every texel of a height map, the widest
+  // upward cone with its apex on the surface that contains no higher
+  // texel. The ratio is horizontal distance in texture coordinates per unit
+  // of height (heights in [0,1]), capped at CONE_MAP_MAX_RATIO.
+  //
+  // The map wraps around like GL_REPEAT. The search walks a maximum
+  // pyramid of the heights from the top and skips every node that can't
+  // narrow the cone found so far, so it visits only a few texels per
+  // output instead of all of them.
+
+  // Builds the cone map of the first channel of 'heights'. One byte per
+  // texel is written to 'cones': sqrt(ratio / CONE_MAP_MAX_RATIO) * 255,
+  // rounded down so the
+  // cones never get wider. Rows are spread over the pool (NULL runs serially).
+  void cone_map_build(const unsigned char *heights, int width, int height, int channels,
+                      unsigned char *cones, thread_pool_t *pool);
+
+  // The brute force O(n^2) search over every texel pair, for testing
+  void cone_map_build_reference(const unsigned char *heights, int width, int height, int channels,
+                                unsigned char *cones);
+
+  // The ratio an encoded texel stands for; never more than the real one
+  float cone_map_decode(unsigned char encoded);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
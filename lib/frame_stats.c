@@ -0,0 +1,140 @@
+#include "frame_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+struct frame_stats {
+  const char *const *columns;
+  int numColumns;
+
+  double *values;     // numColumns per row
+  int numRows, capacity;
+
+  FILE *csv;
+};
+
+frame_stats_t *frame_stats_create(const char *csvFile, const char *const *columns, int numColumns) {
+  frame_stats_t *stats = (frame_stats_t*)calloc(1, sizeof(frame_stats_t));
+  int c;
+
+  stats->columns = columns;
+  stats->numColumns = numColumns;
+
+  if( csvFile ){
+    stats->csv = fopen(csvFile, "w");
+    if( !stats->csv ){
+      fprintf( stderr, "Can't open '%s' for writing.\n", csvFile );
+      free(stats);
+      return NULL;
+    }
+
+    fprintf(stats->csv, "frame");
+    for( c = 0 ; c < numColumns ; c++ )
+      fprintf(stats->csv, ",%s", columns[c]);
+    fprintf(stats->csv, "\n");
+  }
+
+  return stats;
+}
+
+void frame_stats_destroy(frame_stats_t *stats) {
+  if( !stats )
+    return;
+
+  if( stats->csv )
+    fclose(stats->csv);
+  free(stats->values);
+  free(stats);
+}
+
+void frame_stats_add(frame_stats_t *stats, int frame, const double *values) {
+  int c;
+
+  if( stats->numRows == stats->capacity ){
+    stats->capacity = stats->capacity ? stats->capacity * 2 : 1024;
+    stats->values = (double*)realloc(stats->values, sizeof(double) * stats->numColumns * stats->capacity);
+  }
+  memcpy(stats->values + (size_t)stats->numRows * stats->numColumns, values, sizeof(double) * stats->numColumns);
+  stats->numRows++;
+
+  if( stats->csv ){
+    fprintf(stats->csv, "%d", frame);
+    for( c = 0 ; c < stats->numColumns ; c++ ){
+      if( isnan(values[c]) )
+        fprintf(stats->csv, ",");
+      else
+        fprintf(stats->csv, ",%.4f", values[c]);
+    }
+    fprintf(stats->csv, "\n");
+  }
+}
+
+int frame_stats_count(const frame_stats_t *stats) {
+  return stats->numRows;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Copies the non-missing values of a column and sorts them
+static double *sorted_column(const frame_stats_t *stats, int column, int *count) {
+  double *sorted = (double*)malloc(sizeof(double) * (stats->numRows + 1));
+  int r, n = 0;
+
+  for( r = 0 ; r < stats->numRows ; r++ ){
+    double v = stats->values[(size_t)r * stats->numColumns + column];
+    if( !isnan(v) )
+      sorted[n++] = v;
+  }
+  qsort(sorted, n, sizeof(double), compare_doubles);
+
+  *count = n;
+  return sorted;
+}
+
+static double nearest_rank(const double *sorted, int count, double p) {
+  int rank;
+
+  if( count == 0 )
+    return NAN;
+
+  rank = (int)ceil(p / 100.0 * count);
+  if( rank < 1 ) rank = 1;
+  if( rank > count ) rank = count;
+  return sorted[rank - 1];
+}
+
+double frame_stats_percentile(const frame_stats_t *stats, int column, double p) {
+  int count;
+  double *sorted = sorted_column(stats, column, &count);
+  double result = nearest_rank(sorted, count, p);
+
+  free(sorted);
+  return result;
+}
+
+void frame_stats_print_summary(const frame_stats_t *stats, FILE *out) {
+  char title[32];
+  int c, i, count;
+
+  snprintf(title, sizeof(title), "%d frames", stats->numRows);
+  fprintf(out, "%-18s %9s %9s %9s %9s %9s\n", title, "mean", "p50", "p95", "p99", "max");
+
+  for( c = 0 ; c < stats->numColumns ; c++ ){
+    double *sorted = sorted_column(stats, c, &count);
+    double sum = 0.0;
+
+    if( count == 0 ){
+      fprintf(out, "  %-16s (no samples)\n", stats->columns[c]);
+    } else {
+      for( i = 0 ; i < count ; i++ )
+        sum += sorted[i];
+      fprintf(out, "  %-16s %9.3f %9.3f %9.3f %9.3f %9.3f\n", stats->columns[c], sum / count,
+              nearest_rank(sorted, count, 50.0), nearest_rank(sorted, count, 95.0),
+              nearest_rank(sorted, count, 99.0), sorted[count - 1]);
+    }
+    free(sorted);
+  }
+}
@@ -0,0 +1,35 @@
+
+#ifndef _FRAME_STATS_
+#define _FRAME_STATS_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Per-frame timings in named columns (e.g. "cpu_ms", "gpu_scene_ms").
+  // Every row is kept for the percentile summary and, if a file name is
+  // given, streamed to a CSV file as it comes in.
+  typedef struct frame_stats frame_stats_t;
+
+  // 'columns' must stay valid for the lifetime of the stats. Returns NULL
+  // if the CSV file can't be created.
+  frame_stats_t *frame_stats_create(const char *csvFile, const char *const *columns, int numColumns);
+  void frame_stats_destroy(frame_stats_t *stats);
+
+  // One value per column; NAN marks a missing value (e.g. no GPU timer)
+  void frame_stats_add(frame_stats_t *stats, int frame, const double *values);
+
+  int frame_stats_count(const frame_stats_t *stats);
+
+  // p in [0, 100], nearest rank over the non-missing values. NAN if empty.
+  double frame_stats_percentile(const frame_stats_t *stats, int column, double p);
+
+  // Mean, p50, p95, p99 and max of every column
+  void frame_stats_print_summary(const frame_stats_t *stats, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
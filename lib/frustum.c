@@ -0,0 +1,211 @@
+#include "frustum.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Subtrees per thread; more even out the uneven ones
+#define TASKS_PER_THREAD 8
+
+// A subtree to cull, or to take whole when 'inside' is set
+typedef struct {
+  int node;
+  int inside;
+  int first;      // The node's first item, where its results go
+  int count;      // Items it found visible
+} cull_task_t;
+
+typedef struct {
+  const frustum_t *frustum;
+  const bvh_t *bvh;
+  const aabb_t *boxes;
+  int *visible;
+  cull_task_t *tasks;
+} cull_ctx_t;
+
+void frustum_from_matrix(frustum_t *frustum, const mat4_t *clip) {
+  const float *m = clip->m;
+  int p;
+
+  // Gribb and Hartmann: w +- x, w +- y and w +- z with the rows of the
+  // matrix, which are strided in column-major storage
+  for( p = 0 ; p < 6 ; p++ ){
+    int row = p / 2;
+    float sign = p % 2 ? -1.0f : 1.0f;
+    float a = m[3] + sign * m[row];
+    float b = m[7] + sign * m[4 + row];
+    float c = m[11] + sign * m[8 + row];
+    float d = m[15] + sign * m[12 + row];
+    float length = sqrtf(a * a + b * b + c * c);
+
+    if( length > 0.0f ){
+      a /= length;
+      b /= length;
+      c /= length;
+      d /= length;
+    }
+    frustum->a[p] = a;
+    frustum->b[p] = b;
+    frustum->c[p] = c;
+    frustum->d[p] = d;
+  }
+  for( p = 6 ; p < 8 ; p++ ){
+    frustum->a[p] = frustum->b[p] = frustum->c[p] = 0.0f;
+    frustum->d[p] = 1.0f;
+  }
+}
+
+// The box is outside a plane when even its corner furthest along the
+// normal is behind it, and inside when its nearest corner is in front.
+// With centre and half extents: distance of the centre +- the extents
+// projected onto the absolute normal.
+#ifdef __SSE2__
+
+int frustum_test_aabb(const frustum_t *frustum, const aabb_t *box) {
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 signBits = _mm_set1_ps(-0.0f);
+  __m128 cx = _mm_set1_ps(box->min[0] + box->max[0]), ex = _mm_set1_ps(box->max[0] - box->min[0]);
+  __m128 cy = _mm_set1_ps(box->min[1] + box->max[1]), ey = _mm_set1_ps(box->max[1] - box->min[1]);
+  __m128 cz = _mm_set1_ps(box->min[2] + box->max[2]), ez = _mm_set1_ps(box->max[2] - box->min[2]);
+  int outside = 0, intersects = 0, i;
+
+  cx = _mm_mul_ps(cx, half); ex = _mm_mul_ps(ex, half);
+  cy = _mm_mul_ps(cy, half); ey = _mm_mul_ps(ey, half);
+  cz = _mm_mul_ps(cz, half); ez = _mm_mul_ps(ez, half);
+
+  for( i = 0 ; i < 8 ; i += 4 ){
+    __m128 a = _mm_loadu_ps(frustum->a + i), b = _mm_loadu_ps(frustum->b + i);
+    __m128 c = _mm_loadu_ps(frustum->c + i), d = _mm_loadu_ps(frustum->d + i);
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+                                 _mm_add_ps(_mm_mul_ps(c, cz), d));
+    __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signBits, a), ex),
+                                          _mm_mul_ps(_mm_andnot_ps(signBits, b), ey)),
+                               _mm_mul_ps(_mm_andnot_ps(signBits, c), ez));
+
+    outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+    intersects |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+  }
+
+  if( outside )
+    return FRUSTUM_OUTSIDE;
+  return intersects ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+}
+
+#else
+
+int frustum_test_aabb(const frustum_t *frustum, const aabb_t *box) {
+  int result = FRUSTUM_INSIDE, p;
+
+  for( p = 0 ; p < 6 ; p++ ){
+    float distance = frustum->d[p], radius = 0.0f;
+    const float normal[3] = { frustum->a[p], frustum->b[p], frustum->c[p] };
+    int a;
+
+    for( a = 0 ; a < 3 ; a++ ){
+      distance += normal[a] * 0.5f * (box->min[a] + box->max[a]);
+      radius += fabsf(normal[a]) * 0.5f * (box->max[a] - box->min[a]);
+    }
+    if( distance + radius < 0.0f )
+      return FRUSTUM_OUTSIDE;
+    if( distance - radius < 0.0f )
+      result = FRUSTUM_INTERSECTS;
+  }
+  return result;
+}
+
+#endif
+
+// Appends the visible items of a subtree to 'out', returns how many
+static int cull_subtree(const cull_ctx_t *ctx, int nodeIndex, int inside, int *out) {
+  const bvh_t *bvh = ctx->bvh;
+  const bvh_node_t *node = &bvh->nodes[nodeIndex];
+  int state = inside ? FRUSTUM_INSIDE : frustum_test_aabb(ctx->frustum, &node->bounds);
+  int count = 0, i;
+
+  if( state == FRUSTUM_OUTSIDE )
+    return 0;
+
+  if( state == FRUSTUM_INSIDE ){
+    memcpy(out, bvh->items + node->first, sizeof(int) * node->count);
+    return node->count;
+  }
+
+  if( node->left < 0 ){
+    for( i = node->first ; i < node->first + node->count ; i++ )
+      if( frustum_test_aabb(ctx->frustum, &ctx->boxes[bvh->items[i]]) != FRUSTUM_OUTSIDE )
+        out[count++] = bvh->items[i];
+    return count;
+  }
+
+  count = cull_subtree(ctx, node->left, 0, out);
+  return count + cull_subtree(ctx, node->left + 1, 0, out + count);
+}
+
+static void cull_tasks(int begin, int end, void *arg) {
+  cull_ctx_t *ctx = (cull_ctx_t*)arg;
+  int i;
+
+  for( i = begin ; i < end ; i++ ){
+    cull_task_t *task = &ctx->tasks[i];
+    task->first = ctx->bvh->nodes[task->node].first;
+    task->count = cull_subtree(ctx, task->node, task->inside, ctx->visible + task->first);
+  }
+}
+
+static int compare_tasks(const void *a, const void *b) {
+  return ((const cull_task_t*)a)->first - ((const cull_task_t*)b)->first;
+}
+
+int frustum_cull_bvh(const frustum_t *frustum, const bvh_t *bvh, const aabb_t *boxes,
+                     int *visible, thread_pool_t *pool) {
+  int target = pool ? (thread_pool_size(pool) + 1) * TASKS_PER_THREAD : 1;
+  cull_task_t *tasks = (cull_task_t*)malloc(sizeof(cull_task_t) * (target * 2 + 2));
+  int numTasks = 0, head = 0, total = 0, i;
+  cull_ctx_t ctx;
+
+  // Open up the top of the tree until there are enough
+  // subtrees. Leaves and subtrees found inside stay tasks as they are.
+  tasks[numTasks].node = 0;
+  tasks[numTasks++].inside = 0;
+  while( head < numTasks && numTasks < target ){
+    const bvh_node_t *node = &bvh->nodes[tasks[head].node];
+    int state = frustum_test_aabb(frustum, &node->bounds);
+
+    if( state == FRUSTUM_INTERSECTS && node->left >= 0 ){
+      tasks[head] = tasks[--numTasks];      // Replaced by its children
+      tasks[numTasks].node = node->left;
+      tasks[numTasks++].inside = 0;
+      tasks[numTasks].node = node->left + 1;
+      tasks[numTasks++].inside = 0;
+      continue;
+    }
+
+    if( state == FRUSTUM_OUTSIDE )
+      tasks[head] = tasks[--numTasks];
+    else {
+      tasks[head].inside = state == FRUSTUM_INSIDE;
+      head++;
+    }
+  }
+
+  ctx.frustum = frustum;
+  ctx.bvh = bvh;
+  ctx.boxes = boxes;
+  ctx.visible = visible;
+  ctx.tasks = tasks;
+  parallel_for(pool, numTasks, 1, cull_tasks, &ctx);
+
+  // Every task wrote to the start of its own range of items; pack the
+  // results down in the order of the ranges
+  qsort(tasks, numTasks, sizeof(cull_task_t), compare_tasks);
+  for( i = 0 ; i < numTasks ; i++ ){
+    memmove(visible + total, visible + tasks[i].first, sizeof(int) * tasks[i].count);
+    total += tasks[i].count;
+  }
+
+  free(tasks);
+  return total;
+}
@@ -0,0 +1,42 @@
+
+#ifndef _FRUSTUM_
+#define _FRUSTUM_
+
+#include "mat4.h"
+#include "bvh.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // The six planes of a view frustum, a x + b y + c z + d >= 0 on the inside.
+  // Stored by component so that SSE tests four planes at once; the last two
+  // of the eight are padding that culls nothing.
+  typedef struct {
+    float a[8], b[8], c[8], d[8];
+  } frustum_t;
+
+  enum {
+    FRUSTUM_OUTSIDE = 0,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+  };
+
+  // The planes of the clip space cube in the space 'clip' transforms from
+  // (e.g. world space for projection * view)
+  void frustum_from_matrix(frustum_t *frustum, const mat4_t *clip);
+
+  int frustum_test_aabb(const frustum_t *frustum, const aabb_t *box);
+
+  // Writes the items whose boxes aren't outside the frustum to 'visible'
+  // (room for bvh->numItems), in BVH order, and returns how many there
+  // are. Subtrees wholly inside are taken without further tests. The top
+  // of the tree is split into subtrees that are culled in parallel.
+  int frustum_cull_bvh(const frustum_t *frustum, const bvh_t *bvh, const aabb_t *boxes,
+                       int *visible, thread_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
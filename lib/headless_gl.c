@@ -0,0 +1,145 @@
+#include "headless_gl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(USE_EGL)
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+
+static int has_extension(const char *extensions, const char *name) {
+  size_t len = strlen(name);
+  const char *p = extensions;
+
+  while( p && (p = strstr(p, name)) != NULL ){
+    if( (p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0') )
+      return 1;
+    p += len;
+  }
+  return 0;
+}
+
+static EGLDisplay open_display(void) {
+  const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+  if( getPlatformDisplay && has_extension(clientExtensions, "EGL_MESA_platform_surfaceless") )
+    return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+int headless_gl_init(void) {
+  // EGL_SURFACE_TYPE defaults to windows, which a headless display has none of
+  static const EGLint configAttribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+    EGL_NONE
+  };
+  static const EGLint pbufferSize[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+  EGLConfig config;
+  EGLint major, minor, numConfigs;
+  int surfaceless;
+
+  display = open_display();
+  if( display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) ){
+    fprintf( stderr, "Can't initialize an EGL display.\n" );
+    return 0;
+  }
+
+  if( !eglBindAPI(EGL_OPENGL_API) ){
+    fprintf( stderr, "EGL %d.%d has no desktop OpenGL.\n", major, minor );
+    headless_gl_shutdown();
+    return 0;
+  }
+
+  // Without surfaceless contexts a dummy pbuffer has to be current
+  surfaceless = has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+  if( !eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1 ){
+    fprintf( stderr, "No suitable EGL config.\n" );
+    headless_gl_shutdown();
+    return 0;
+  }
+
+  if( !surfaceless ){
+    surface = eglCreatePbufferSurface(display, config, pbufferSize);
+    if( surface == EGL_NO_SURFACE ){
+      fprintf( stderr, "Can't create an EGL pbuffer.\n" );
+      headless_gl_shutdown();
+      return 0;
+    }
+  }
+
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+  if( context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context) ){
+    fprintf( stderr, "Can't create an EGL context.\n" );
+    headless_gl_shutdown();
+    return 0;
+  }
+
+  return 1;
+}
+
+void headless_gl_shutdown(void) {
+  if( display == EGL_NO_DISPLAY )
+    return;
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if( context != EGL_NO_CONTEXT )
+    eglDestroyContext(display, context);
+  if( surface != EGL_NO_SURFACE )
+    eglDestroySurface(display, surface);
+  eglTerminate(display);
+
+  display = EGL_NO_DISPLAY;
+  context = EGL_NO_CONTEXT;
+  surface = EGL_NO_SURFACE;
+}
+
+#elif defined(USE_OSMESA)
+
+#include <GL/osmesa.h>
+
+static OSMesaContext context = NULL;
+static unsigned char buffer[4];   // OSMesa wants a buffer; all drawing goes to FBOs
+
+int headless_gl_init(void) {
+  context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL);
+  if( !context ){
+    fprintf( stderr, "Can't create an OSMesa context.\n" );
+    return 0;
+  }
+
+  if( !OSMesaMakeCurrent(context, buffer, GL_UNSIGNED_BYTE, 1, 1) ){
+    fprintf( stderr, "Can't make the OSMesa context current.\n" );
+    headless_gl_shutdown();
+    return 0;
+  }
+
+  return 1;
+}
+
+void headless_gl_shutdown(void) {
+  if( context )
+    OSMesaDestroyContext(context);
+  context = NULL;
+}
+
+#else
+
+int headless_gl_init(void) {
+  fprintf( stderr, "Built without headless support, rebuild with -DUSE_EGL or -DUSE_OSMESA.\n" );
+  return 0;
+}
+
+void headless_gl_shutdown(void) {
+}
+
+#endif
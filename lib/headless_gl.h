@@ -0,0 +1,22 @@
+
+#ifndef _HEADLESS_GL_
+#define _HEADLESS_GL_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Creates an OpenGL context that needs no window or display and makes it
+  // current on the calling thread. Rendering has to go to a framebuffer
+  // object since there is no default framebuffer to draw to.
+  //
+  // Built with -DUSE_EGL it uses EGL, preferring Mesa's surfaceless
+  // platform, which runs on llvmpipe without any display server. Built with
+  // -DUSE_OSMESA it uses OSMesa instead. Without either it always fails.
+  int headless_gl_init(void);
+  void headless_gl_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,183 @@
+#include "height_pyramid.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Rows handed to one parallel_for task at a time
+#define ROWS_PER_TASK 16
+
+typedef struct {
+  const mip_level_t *src;
+  mip_level_t *dst;
+  int x0, x1;         // Columns of dst to rebuild
+  int y0;             // Row of dst that task row 0 stands for
+} reduce_job_t;
+
+typedef struct {
+  const unsigned char *heights;
+  int channels, stride;
+  mip_level_t *dst;
+  int x, y, width;
+} copy_job_t;
+
+// First texel of the level below that dst texel k covers, and one past the
+// last. For an even source that's 2k and 2k + 2, for an odd one it can be
+// three texels.
+static int footprint_begin(int k, int srcSize, int dstSize) {
+  return (int)((long long)k * srcSize / dstSize);
+}
+
+static int footprint_end(int k, int srcSize, int dstSize) {
+  return (int)(((long long)(k + 1) * srcSize + dstSize - 1) / dstSize);
+}
+
+static void reduce_rows(int begin, int end, void *arg) {
+  const reduce_job_t *job = (const reduce_job_t*)arg;
+  const mip_level_t *src = job->src;
+  mip_level_t *dst = job->dst;
+  int x, y, sx, sy;
+
+  for( y = begin + job->y0 ; y < end + job->y0 ; y++ ){
+    int sy0 = footprint_begin(y, src->height, dst->height);
+    int sy1 = footprint_end(y, src->height, dst->height);
+    unsigned char *out = dst->data + ((size_t)y * dst->width + job->x0) * 2;
+
+    for( x = job->x0 ; x < job->x1 ; x++, out += 2 ){
+      int sx0 = footprint_begin(x, src->width, dst->width);
+      int sx1 = footprint_end(x, src->width, dst->width);
+      unsigned char hi = 0, lo = 255;
+
+      for( sy = sy0 ; sy < sy1 ; sy++ ){
+        const unsigned char *in = src->data + ((size_t)sy * src->width + sx0) * 2;
+        for( sx = sx0 ; sx < sx1 ; sx++, in += 2 ){
+          if( in[0] > hi ) hi = in[0];
+          if( in[1] < lo ) lo = in[1];
+        }
+      }
+
+      out[0] = hi;
+      out[1] = lo;
+    }
+  }
+}
+
+static void copy_rows(int begin, int end, void *arg) {
+  const copy_job_t *job = (const copy_job_t*)arg;
+  int x, y;
+
+  for( y = begin ; y < end ; y++ ){
+    const unsigned char *in = job->heights + (size_t)y * job->stride * job->channels;
+    unsigned char *out = job->dst->data + ((size_t)(job->y + y) * job->dst->width + job->x) * 2;
+
+    for( x = 0 ; x < job->width ; x++, in += job->channels, out += 2 )
+      out[0] = out[1] = *in;
+  }
+}
+
+// Grows a dirty rectangle to also hold [x0, x1) x [y0, y1)
+static void add_dirty(height_rect_t *rect, int x0, int y0, int x1, int y1) {
+  if( rect->width > 0 && rect->height > 0 ){
+    if( rect->x < x0 ) x0 = rect->x;
+    if( rect->y < y0 ) y0 = rect->y;
+    if( rect->x + rect->width > x1 ) x1 = rect->x + rect->width;
+    if( rect->y + rect->height > y1 ) y1 = rect->y + rect->height;
+  }
+  rect->x = x0;
+  rect->y = y0;
+  rect->width = x1 - x0;
+  rect->height = y1 - y0;
+}
+
+void height_pyramid_build(height_pyramid_t *pyramid, const unsigned char *heights, int width, int height,
+                          int channels, thread_pool_t *pool) {
+  mip_chain_t *chain = &pyramid->chain;
+  copy_job_t copy;
+  reduce_job_t job;
+  int l;
+
+  chain->channels = 2;
+  chain->numLevels = mip_count_levels(width, height);
+
+  for( l = 0 ; l < chain->numLevels ; l++ ){
+    mip_level_t *level = &chain->levels[l];
+    level->width = l == 0 ? width : chain->levels[l - 1].width > 1 ? chain->levels[l - 1].width / 2 : 1;
+    level->height = l == 0 ? height : chain->levels[l - 1].height > 1 ? chain->levels[l - 1].height / 2 : 1;
+    level->data = (unsigned char*)malloc((size_t)level->width * level->height * 2);
+  }
+
+  copy.heights = heights;
+  copy.channels = channels;
+  copy.stride = width;
+  copy.dst = &chain->levels[0];
+  copy.x = copy.y = 0;
+  copy.width = width;
+  parallel_for(pool, height, ROWS_PER_TASK, copy_rows, &copy);
+
+  for( l = 1 ; l < chain->numLevels ; l++ ){
+    job.src = &chain->levels[l - 1];
+    job.dst = &chain->levels[l];
+    job.x0 = 0;
+    job.x1 = job.dst->width;
+    job.y0 = 0;
+    parallel_for(pool, job.dst->height, ROWS_PER_TASK, reduce_rows, &job);
+  }
+
+  height_pyramid_clear_dirty(pyramid);
+}
+
+void height_pyramid_free(height_pyramid_t *pyramid) {
+  int l;
+  for( l = 0 ; l < pyramid->chain.numLevels ; l++ )
+    free(pyramid->chain.levels[l].data);
+  pyramid->chain.numLevels = 0;
+}
+
+void height_pyramid_update(height_pyramid_t *pyramid, const unsigned char *heights, int channels, int stride,
+                           int x, int y, int width, int height, thread_pool_t *pool) {
+  mip_chain_t *chain = &pyramid->chain;
+  int x0 = x, y0 = y, x1 = x + width, y1 = y + height;
+  copy_job_t copy;
+  reduce_job_t job;
+  int l;
+
+  if( x0 < 0 ) x0 = 0;
+  if( y0 < 0 ) y0 = 0;
+  if( x1 > chain->levels[0].width ) x1 = chain->levels[0].width;
+  if( y1 > chain->levels[0].height ) y1 = chain->levels[0].height;
+  if( x0 >= x1 || y0 >= y1 )
+    return;
+
+  copy.heights = heights + ((size_t)(y0 - y) * stride + (x0 - x)) * channels;
+  copy.channels = channels;
+  copy.stride = stride;
+  copy.dst = &chain->levels[0];
+  copy.x = x0;
+  copy.y = y0;
+  copy.width = x1 - x0;
+  parallel_for(pool, y1 - y0, ROWS_PER_TASK, copy_rows, &copy);
+  add_dirty(&pyramid->dirty[0], x0, y0, x1, y1);
+
+  // Only the texels whose footprint overlaps the changed ones. With the
+  // sizes swapped the footprint rounding gives exactly those.
+  for( l = 1 ; l < chain->numLevels ; l++ ){
+    const mip_level_t *src = &chain->levels[l - 1];
+    mip_level_t *dst = &chain->levels[l];
+
+    x0 = footprint_begin(x0, dst->width, src->width);
+    y0 = footprint_begin(y0, dst->height, src->height);
+    x1 = footprint_end(x1 - 1, dst->width, src->width);
+    y1 = footprint_end(y1 - 1, dst->height, src->height);
+
+    job.src = src;
+    job.dst = dst;
+    job.x0 = x0;
+    job.x1 = x1;
+    job.y0 = y0;
+    parallel_for(pool, y1 - y0, ROWS_PER_TASK, reduce_rows, &job);
+
+    add_dirty(&pyramid->dirty[l], x0, y0, x1, y1);
+  }
+}
+
+void height_pyramid_clear_dirty(height_pyramid_t *pyramid) {
+  memset(pyramid->dirty, 0, sizeof(pyramid->dirty));
+}
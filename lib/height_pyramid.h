@@ -0,0 +1,56 @@
+
+#ifndef _HEIGHT_PYRAMID_
+#define _HEIGHT_PYRAMID_
+
+#include <stddef.h>
+#include "mipmap.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Min/max quadtree of a height map ("maximum mipmap"). Every level holds
+  // two channels per texel, the maximum height in the first and the minimum
+  // in the second, over all texels of level 0 it covers. Level sizes are
+  // those of a GL mip chain, so the chain can be uploaded as is and sampled
+  // with GL_NEAREST_MIPMAP_NEAREST. Where a size is odd a texel covers three
+  // texels of the level below instead of two, which keeps the bounds
+  // conservative for texture coordinates on every level.
+
+  typedef struct {
+    int x, y, width, height;    // Empty if width or height is 0
+  } height_rect_t;
+
+  typedef struct {
+    mip_chain_t chain;          // Two channels, every level is owned
+
+    // Texels changed by height_pyramid_update() since the last
+    // height_pyramid_clear_dirty(), one rectangle per level
+    height_rect_t dirty[MIP_MAX_LEVELS];
+  } height_pyramid_t;
+
+  // Builds the pyramid from the first channel of 'heights'. Rows of each
+  // level are spread over the pool (NULL runs serially).
+  void height_pyramid_build(height_pyramid_t *pyramid, const unsigned char *heights, int width, int height,
+                            int channels, thread_pool_t *pool);
+  void height_pyramid_free(height_pyramid_t *pyramid);
+
+  // Replaces the heights of a rectangle of level 0 and rebuilds only the
+  // texels above it on every level. 'heights' points at the rectangle's
+  // first texel and has 'stride' texels per row; only its first channel is
+  // read. The rectangle is clipped to the map.
+  void height_pyramid_update(height_pyramid_t *pyramid, const unsigned char *heights, int channels, int stride,
+                             int x, int y, int width, int height, thread_pool_t *pool);
+
+  void height_pyramid_clear_dirty(height_pyramid_t *pyramid);
+
+  // The maximum height of a level 0 texel
+  static inline unsigned char height_pyramid_height(const height_pyramid_t *pyramid, int x, int y) {
+    return pyramid->chain.levels[0].data[((size_t)y * pyramid->chain.levels[0].width + x) * 2];
+  }
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,90 @@
+#include "image_decoder.h"
+#include "jpeg_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Bytes read to tell the formats apart
+#define MAGIC_BYTES 8
+
+static int is_png(const unsigned char *magic, size_t size) {
+  return size >= MAGIC_BYTES && png_sig_cmp((png_bytep)magic, 0, MAGIC_BYTES) == 0;
+}
+
+// The last one is the fallback
+static const image_decoder_t decoders[] = {
+  { "JPEG", is_jpeg, read_jpeg, read_jpeg_into, read_jpeg_header, NULL },
+  { "PNG",  is_png,  read_png,  read_png_into,  read_png_header,  read_png16 }
+};
+
+#define NUM_DECODERS (int)(sizeof(decoders) / sizeof(decoders[0]))
+
+const image_decoder_t *image_find_decoder(char *filename) {
+  unsigned char magic[MAGIC_BYTES];
+  size_t size;
+  int i;
+
+  FILE *fp = fopen(filename, "rb");
+  if( !fp ){
+    fprintf( stderr, "Can't open image file '%s'.\n", filename );
+    return NULL;
+  }
+  size = fread(magic, 1, MAGIC_BYTES, fp);
+  fclose(fp);
+
+  for( i = 0 ; i < NUM_DECODERS - 1 ; i++ )
+    if( decoders[i].sniff(magic, size) )
+      break;
+  return &decoders[i];
+}
+
+png_data_t *read_image(char *filename) {
+  const image_decoder_t *decoder = image_find_decoder(filename);
+  return decoder ? decoder->decode(filename) : NULL;
+}
+
+png_data_t *read_image_into(char *filename, unsigned char *buffer, size_t bufferSize) {
+  const image_decoder_t *decoder = image_find_decoder(filename);
+  return decoder ? decoder->decode_into(filename, buffer, bufferSize) : NULL;
+}
+
+int read_image_header(char *filename, int *width, int *height, int *channels) {
+  const image_decoder_t *decoder = image_find_decoder(filename);
+  return decoder ? decoder->read_header(filename, width, height, channels) : 0;
+}
+
+png_data_t *read_image_gray16(char *filename) {
+  const image_decoder_t *decoder = image_find_decoder(filename);
+  png_data_t *image, *gray;
+  unsigned short *out;
+  size_t i, n;
+
+  if( !decoder )
+    return NULL;
+  image = decoder->decode16 ? decoder->decode16(filename) : decoder->decode(filename);
+  if( !image )
+    return NULL;
+
+  n = (size_t)image->width * image->height;
+  out = (unsigned short*)malloc( n * sizeof(unsigned short) );
+  if( image->bit_depth == 16 ){
+    const unsigned short *in = (const unsigned short*)image->pixelData;
+    for( i = 0 ; i < n ; i++ )
+      out[i] = in[i * image->channels];
+  } else {
+    // 255 * 257 = 65535, so white stays white
+    for( i = 0 ; i < n ; i++ )
+      out[i] = (unsigned short)(image->pixelData[i * image->channels] * 257);
+  }
+
+  gray = (png_data_t*)malloc( sizeof(png_data_t) );
+  gray->pixelData = (unsigned char*)out;
+  gray->width = image->width;
+  gray->height = image->height;
+  gray->channels = 1;
+  gray->has_alpha = 0;
+  gray->bit_depth = 16;
+  gray->owns_pixels = 1;
+
+  free_png(image);
+  return gray;
+}
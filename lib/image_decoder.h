@@ -0,0 +1,49 @@
+
+#ifndef _IMAGE_DECODER_
+#define _IMAGE_DECODER_
+
+#include <stddef.h>
+#include "png_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Picks an image decoder by the first bytes of a file rather than its
+  // name. Every decoder hands back a png_data_t with 8 bits per channel
+  // (unless asked to keep 16), bottom row first, as read_png() does.
+  // Files no decoder recognizes go to the PNG one, which says why it
+  // can't read them.
+
+  typedef struct {
+    const char *name;
+    // Nonzero if the file starts with this format's signature
+    int (*sniff)(const unsigned char *magic, size_t size);
+    png_data_t *(*decode)(char *filename);
+    png_data_t *(*decode_into)(char *filename, unsigned char *buffer, size_t bufferSize);
+    int (*read_header)(char *filename, int *width, int *height, int *channels);
+    // Keeps 16-bit samples; NULL if the format has no more than 8 bits
+    png_data_t *(*decode16)(char *filename);
+  } image_decoder_t;
+
+  // NULL if the file can't be opened
+  const image_decoder_t *image_find_decoder(char *filename);
+
+  png_data_t *read_image(char *filename);
+
+  // Decodes straight into a caller-owned buffer of at least
+  // width * height * channels bytes. Fails if the buffer is too small.
+  png_data_t *read_image_into(char *filename, unsigned char *buffer, size_t bufferSize);
+
+  // The first channel of any format at 16 bits per texel, e.g. for height
+  // maps. 16-bit PNGs keep all their bits, anything else is widened so
+  // 255 becomes 65535. 'bit_depth' is 16 and 'channels' 1.
+  png_data_t *read_image_gray16(char *filename);
+
+  // Reads only the header, e.g. to size a buffer for read_image_into()
+  int read_image_header(char *filename, int *width, int *height, int *channels);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
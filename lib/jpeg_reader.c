@@ -0,0 +1,169 @@
+#include "jpeg_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+// Scanlines handed to libjpeg per call, it may return fewer
+#define ROWS_PER_READ 16
+
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+} jpeg_error_t;
+
+// libjpeg's default handler exits the program, so jump back instead
+static void on_error(j_common_ptr cinfo) {
+  jpeg_error_t *error = (jpeg_error_t*)cinfo->err;
+  char message[JMSG_LENGTH_MAX];
+
+  error->pub.format_message(cinfo, message);
+  fprintf( stderr, "JPEG error: %s\n", message );
+  longjmp(error->jump, 1);
+}
+
+// Warnings about corrupt data are worth a line, trace messages aren't
+static void on_message(j_common_ptr cinfo, int level) {
+  if( level < 0 && cinfo->err->num_warnings++ == 0 ){
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    fprintf( stderr, "JPEG warning: %s\n", message );
+  }
+}
+
+int is_jpeg(const unsigned char *magic, size_t size) {
+  return size >= 3 && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF;
+}
+
+// Opens the file and reads the header up to the point where the output
+// size is known. Greyscale stays one channel, everything else comes out
+// as RGB; CMYK isn't supported.
+static FILE *open_jpeg(char *filename, struct jpeg_decompress_struct *cinfo, jpeg_error_t *error) {
+
+  FILE *fp = fopen(filename, "rb");
+  if( !fp ){
+    fprintf( stderr, "Can't open JPEG texture file '%s'.\n", filename );
+    return 0;
+  }
+
+  cinfo->err = jpeg_std_error(&error->pub);
+  error->pub.error_exit = on_error;
+  error->pub.emit_message = on_message;
+  jpeg_create_decompress(cinfo);
+
+  if( setjmp(error->jump) ){
+    jpeg_destroy_decompress(cinfo);
+    fclose(fp);
+    fprintf( stderr, "Exception occurred while reading JPEG file: %s\n", filename );
+    return 0;
+  }
+
+  jpeg_stdio_src(cinfo, fp);
+  jpeg_read_header(cinfo, TRUE);
+
+  if( cinfo->jpeg_color_space == JCS_CMYK || cinfo->jpeg_color_space == JCS_YCCK ){
+    fprintf( stderr, "Can't handle CMYK JPEG files: %s\n", filename );
+    jpeg_destroy_decompress(cinfo);
+    fclose(fp);
+    return 0;
+  }
+
+  cinfo->out_color_space = cinfo->num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_calc_output_dimensions(cinfo);
+
+  return fp;
+}
+
+static png_data_t *decode_jpeg(char *filename, unsigned char *buffer, size_t bufferSize) {
+
+  png_data_t * volatile pd = NULL;
+  unsigned char * volatile pixels = NULL;
+  struct jpeg_decompress_struct cinfo;
+  jpeg_error_t error;
+  JSAMPROW rows[ROWS_PER_READ];
+  size_t rowbytes;
+  int width, height, numChannels, r;
+
+  FILE *fp = open_jpeg(filename, &cinfo, &error);
+  if( !fp )
+    return 0;
+
+  if( setjmp(error.jump) ){
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    if( pixels != buffer )
+      free(pixels);
+    free(pd);
+    fprintf( stderr, "Exception occurred while reading JPEG file: %s\n", filename );
+    return 0;
+  }
+
+  width = cinfo.output_width;
+  height = cinfo.output_height;
+  numChannels = cinfo.output_components;
+  rowbytes = (size_t)width * numChannels;
+
+  if( buffer && bufferSize < rowbytes * height ){
+    fprintf( stderr, "Buffer of %lu bytes is too small for JPEG file '%s' (%lu bytes).\n",
+             (unsigned long)bufferSize, filename, (unsigned long)(rowbytes * height) );
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return 0;
+  }
+
+  pd = (png_data_t*)malloc( sizeof(png_data_t) );
+  pd->channels = numChannels;
+  pd->width = width;
+  pd->height = height;
+  pd->has_alpha = 0;
+  pd->bit_depth = 8;
+  pd->owns_pixels = (buffer == NULL);
+
+  pixels = buffer ? buffer : (unsigned char*)malloc( rowbytes * height );
+
+  // OpenGL wants the bottom row first, so decode every scanline straight
+  // into its flipped place
+  jpeg_start_decompress(&cinfo);
+  while( cinfo.output_scanline < cinfo.output_height ){
+    int first = cinfo.output_scanline;
+    int count = height - first < ROWS_PER_READ ? height - first : ROWS_PER_READ;
+    for( r = 0 ; r < count ; r++ )
+      rows[r] = pixels + (size_t)(height - 1 - first - r) * rowbytes;
+    jpeg_read_scanlines(&cinfo, rows, count);
+  }
+  jpeg_finish_decompress(&cinfo);
+
+  pd->pixelData = pixels;
+
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+
+  return pd;
+}
+
+png_data_t *read_jpeg(char *filename) {
+  return decode_jpeg(filename, NULL, 0);
+}
+
+png_data_t *read_jpeg_into(char *filename, unsigned char *buffer, size_t bufferSize) {
+  return decode_jpeg(filename, buffer, bufferSize);
+}
+
+int read_jpeg_header(char *filename, int *width, int *height, int *channels) {
+
+  struct jpeg_decompress_struct cinfo;
+  jpeg_error_t error;
+
+  FILE *fp = open_jpeg(filename, &cinfo, &error);
+  if( !fp )
+    return 0;
+
+  *width = cinfo.output_width;
+  *height = cinfo.output_height;
+  *channels = cinfo.output_components;
+
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+
+  return 1;
+}
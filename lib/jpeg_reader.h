@@ -0,0 +1,31 @@
+
+#ifndef _JPEG_READER_
+#define _JPEG_READER_
+
+#include <stddef.h>
+#include "png_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // JPEG decoding with libjpeg, fast with libjpeg-turbo's SIMD code. The
+  // image comes back like read_png() returns it: 8 bits per channel,
+  // bottom row first, one channel for greyscale and three for colour.
+  // Usually reached through read_image() (lib/image_decoder.h).
+
+  // Nonzero if 'magic' starts with the JPEG start of image marker
+  int is_jpeg(const unsigned char *magic, size_t size);
+
+  png_data_t *read_jpeg(char *filename);
+
+  // Decodes straight into a caller-owned buffer of at least
+  // width * height * channels bytes. Fails if the buffer is too small.
+  png_data_t *read_jpeg_into(char *filename, unsigned char *buffer, size_t bufferSize);
+
+  int read_jpeg_header(char *filename, int *width, int *height, int *channels);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,127 @@
+#include "mat4.h"
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void mat4_identity(mat4_t *out) {
+  memset(out, 0, sizeof(*out));
+  out->m[0] = out->m[5] = out->m[10] = out->m[15] = 1.0f;
+}
+
+void mat4_translation(mat4_t *out, float x, float y, float z) {
+  mat4_identity(out);
+  out->m[12] = x;
+  out->m[13] = y;
+  out->m[14] = z;
+}
+
+void mat4_rotation_x(mat4_t *out, float angle) {
+  float c = cosf(angle), s = sinf(angle);
+
+  mat4_identity(out);
+  out->m[5] = c;
+  out->m[6] = s;
+  out->m[9] = -s;
+  out->m[10] = c;
+}
+
+void mat4_rotation_y(mat4_t *out, float angle) {
+  float c = cosf(angle), s = sinf(angle);
+
+  mat4_identity(out);
+  out->m[0] = c;
+  out->m[2] = -s;
+  out->m[8] = s;
+  out->m[10] = c;
+}
+
+void mat4_perspective(mat4_t *out, float frustumScale, float aspect, float zNear, float zFar) {
+  memset(out, 0, sizeof(*out));
+  out->m[0] = frustumScale / aspect;
+  out->m[5] = frustumScale;
+  out->m[10] = (zNear + zFar) / (zNear - zFar);
+  out->m[11] = -1.0f;
+  out->m[14] = 2.0f * zNear * zFar / (zNear - zFar);
+}
+
+#ifdef __SSE2__
+
+// Column c of a * b is a's columns weighted by column c of b
+static void multiply_sse(float *out, const __m128 a[4], const float *b) {
+  int c;
+
+  for( c = 0 ; c < 4 ; c++ ){
+    __m128 column = _mm_mul_ps(a[0], _mm_set1_ps(b[c * 4]));
+    column = _mm_add_ps(column, _mm_mul_ps(a[1], _mm_set1_ps(b[c * 4 + 1])));
+    column = _mm_add_ps(column, _mm_mul_ps(a[2], _mm_set1_ps(b[c * 4 + 2])));
+    column = _mm_add_ps(column, _mm_mul_ps(a[3], _mm_set1_ps(b[c * 4 + 3])));
+    _mm_storeu_ps(out + c * 4, column);
+  }
+}
+
+void mat4_multiply(mat4_t *out, const mat4_t *a, const mat4_t *b) {
+  __m128 columns[4];
+  float result[16];
+  int c;
+
+  for( c = 0 ; c < 4 ; c++ )
+    columns[c] = _mm_loadu_ps(a->m + c * 4);
+  multiply_sse(result, columns, b->m);
+  memcpy(out->m, result, sizeof(result));
+}
+
+void mat4_multiply_many(mat4_t *out, const mat4_t *a, const mat4_t *b, size_t count) {
+  __m128 columns[4];
+  float result[16];
+  size_t i;
+  int c;
+
+  for( c = 0 ; c < 4 ; c++ )
+    columns[c] = _mm_loadu_ps(a->m + c * 4);
+  for( i = 0 ; i < count ; i++ ){
+    multiply_sse(result, columns, b[i].m);
+    memcpy(out[i].m, result, sizeof(result));
+  }
+}
+
+void mat4_transform(float out[4], const mat4_t *m, const float v[4]) {
+  __m128 r = _mm_mul_ps(_mm_loadu_ps(m->m), _mm_set1_ps(v[0]));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m->m + 4), _mm_set1_ps(v[1])));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m->m + 8), _mm_set1_ps(v[2])));
+  r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m->m + 12), _mm_set1_ps(v[3])));
+  _mm_storeu_ps(out, r);
+}
+
+#else
+
+void mat4_multiply(mat4_t *out, const mat4_t *a, const mat4_t *b) {
+  float result[16];
+  int r, c;
+
+  for( c = 0 ; c < 4 ; c++ )
+    for( r = 0 ; r < 4 ; r++ )
+      result[c * 4 + r] = a->m[r] * b->m[c * 4] + a->m[4 + r] * b->m[c * 4 + 1] +
+                          a->m[8 + r] * b->m[c * 4 + 2] + a->m[12 + r] * b->m[c * 4 + 3];
+  memcpy(out->m, result, sizeof(result));
+}
+
+void mat4_multiply_many(mat4_t *out, const mat4_t *a, const mat4_t *b, size_t count) {
+  size_t i;
+
+  for( i = 0 ; i < count ; i++ )
+    mat4_multiply(&out[i], a, &b[i]);
+}
+
+void mat4_transform(float out[4], const mat4_t *m, const float v[4]) {
+  float result[4];
+  int r;
+
+  for( r = 0 ; r < 4 ; r++ )
+    result[r] = m->m[r] * v[0] + m->m[4 + r] * v[1] + m->m[8 + r] * v[2] + m->m[12 + r] * v[3];
+  memcpy(out, result, sizeof(result));
+}
+
+#endif
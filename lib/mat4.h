@@ -0,0 +1,41 @@
+
+#ifndef _MAT4_
+#define _MAT4_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // 4x4 float matrices, column-major as OpenGL takes them: m[column * 4 + row].
+  // Products use SSE where available, one column of the result per
+  // four multiply-adds.
+  typedef struct {
+    float m[16];
+  } mat4_t;
+
+  void mat4_identity(mat4_t *out);
+  void mat4_translation(mat4_t *out, float x, float y, float z);
+
+  // Right-handed rotations, the rotX and rotY vs.vert used to build
+  void mat4_rotation_x(mat4_t *out, float angle);
+  void mat4_rotation_y(mat4_t *out, float angle);
+
+  // frustumScale = 1 / tan(fov / 2), aspect = width / height. Maps the
+  // camera's -z axis from zNear to zFar onto [-1, 1].
+  void mat4_perspective(mat4_t *out, float frustumScale, float aspect, float zNear, float zFar);
+
+  // out = a * b. out may be a or b.
+  void mat4_multiply(mat4_t *out, const mat4_t *a, const mat4_t *b);
+
+  // out[i] = a * b[i], for many matrices sharing the left-hand side
+  void mat4_multiply_many(mat4_t *out, const mat4_t *a, const mat4_t *b, size_t count);
+
+  // out = m * v for a column vector of 4 floats
+  void mat4_transform(float out[4], const mat4_t *m, const float v[4]);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,62 @@
+
+#include "material_pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROWS_PER_TASK 32
+
+typedef struct {
+  const png_data_t *normal, *height;
+  unsigned char *out;
+} pack_job_t;
+
+static void pack_rows(int begin, int end, void *arg) {
+  const pack_job_t *job = (const pack_job_t*)arg;
+  const int width = job->normal->width;
+  const int nc = job->normal->channels, hc = job->height->channels;
+  int x, y;
+
+  for( y = begin ; y < end ; y++ ){
+    const unsigned char *n = job->normal->pixelData + (size_t)y * width * nc;
+    const unsigned char *h = job->height->pixelData + (size_t)y * width * hc;
+    unsigned char *out = job->out + (size_t)y * width * 4;
+
+    for( x = 0 ; x < width ; x++, n += nc, h += hc, out += 4 ){
+      out[0] = n[0];
+      out[1] = n[1];
+      out[2] = n[2];
+      out[3] = h[0];
+    }
+  }
+}
+
+png_data_t *pack_normal_height(const png_data_t *normal, const png_data_t *height, thread_pool_t *pool) {
+  png_data_t *pd;
+  pack_job_t job;
+
+  if( normal->width != height->width || normal->height != height->height ){
+    fprintf( stderr, "Can't pack a %dx%d normal map with a %dx%d height map.\n",
+             normal->width, normal->height, height->width, height->height );
+    return NULL;
+  }
+  if( normal->channels < 3 ){
+    fprintf( stderr, "Can't pack a normal map with %d channels, it needs x, y and z.\n", normal->channels );
+    return NULL;
+  }
+
+  pd = (png_data_t*)malloc( sizeof(png_data_t) );
+  pd->width = normal->width;
+  pd->height = normal->height;
+  pd->channels = 4;
+  pd->has_alpha = 1;
+  pd->bit_depth = 8;
+  pd->owns_pixels = 1;
+  pd->pixelData = (unsigned char*)malloc( (size_t)pd->width * pd->height * 4 );
+
+  job.normal = normal;
+  job.height = height;
+  job.out = pd->pixelData;
+  parallel_for(pool, pd->height, ROWS_PER_TASK, pack_rows, &job);
+
+  return pd;
+}
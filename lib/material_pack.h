@@ -0,0 +1,21 @@
+
+#ifndef _MATERIAL_PACK_
+#define _MATERIAL_PACK_
+
+#include "png_reader.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Packs the xyz of a normal map and the first channel of a height map
+  // into one RGBA image, so the parallax shader can read height and normal
+  // from a single texture. Both inputs must have the same size.
+  // Returns NULL if they don't.
+  png_data_t *pack_normal_height(const png_data_t *normal, const png_data_t *height, thread_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
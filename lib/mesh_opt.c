@@ -0,0 +1,223 @@
+#include "mesh_opt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NO_VERTEX (~0u)
+
+// Scoring of Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+#define CACHE_DECAY_POWER   1.5f
+#define LAST_TRI_SCORE      0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+static unsigned int hash_bytes(const unsigned char *bytes, size_t size) {
+  unsigned int hash = 2166136261u;    // FNV-1a
+  size_t i;
+
+  for( i = 0 ; i < size ; i++ )
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+size_t mesh_weld(const void *vertices, size_t count, size_t stride, void *unique, unsigned int *indices) {
+  const unsigned char *src = (const unsigned char*)vertices;
+  unsigned char *dst = (unsigned char*)unique;
+  size_t tableSize = 1, numUnique = 0, i;
+  unsigned int *table;
+
+  while( tableSize < count * 2 )
+    tableSize *= 2;
+  table = (unsigned int*)malloc(sizeof(unsigned int) * tableSize);
+  memset(table, 0xff, sizeof(unsigned int) * tableSize);
+
+  for( i = 0 ; i < count ; i++ ){
+    const unsigned char *vertex = src + i * stride;
+    size_t slot = hash_bytes(vertex, stride) & (tableSize - 1);
+
+    // Linear probing; the table is never more than half full
+    while( table[slot] != NO_VERTEX && memcmp(dst + table[slot] * stride, vertex, stride) != 0 )
+      slot = (slot + 1) & (tableSize - 1);
+
+    if( table[slot] == NO_VERTEX ){
+      memcpy(dst + numUnique * stride, vertex, stride);
+      table[slot] = (unsigned int)numUnique++;
+    }
+    indices[i] = table[slot];
+  }
+
+  free(table);
+  return numUnique;
+}
+
+static float vertex_score(int cachePosition, unsigned int remainingTriangles) {
+  float score = 0.0f;
+
+  if( remainingTriangles == 0 )
+    return -1.0f;
+
+  if( cachePosition >= 0 ){
+    // The last triangle's vertices score the same so it doesn't matter
+    // which of them the next triangle shares
+    if( cachePosition < 3 )
+      score = LAST_TRI_SCORE;
+    else
+      score = powf(1.0f - (cachePosition - 3) * (1.0f / (MESH_CACHE_SIZE - 3)), CACHE_DECAY_POWER);
+  }
+
+  // Vertices with few triangles left are finished off first
+  return score + VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+}
+
+void mesh_optimize_vertex_cache(unsigned int *indices, size_t indexCount, size_t vertexCount) {
+  size_t triangleCount = indexCount / 3, emittedCount = 0, cursor = 0, i, v;
+  unsigned int *remaining = (unsigned int*)calloc(vertexCount, sizeof(unsigned int));
+  unsigned int *offsets = (unsigned int*)malloc(sizeof(unsigned int) * (vertexCount + 1));
+  unsigned int *adjacency = (unsigned int*)malloc(sizeof(unsigned int) * indexCount);
+  float *vertexScores = (float*)malloc(sizeof(float) * vertexCount);
+  float *triangleScores = (float*)malloc(sizeof(float) * triangleCount);
+  unsigned char *emitted = (unsigned char*)calloc(triangleCount, 1);
+  unsigned int *output = (unsigned int*)malloc(sizeof(unsigned int) * indexCount);
+  unsigned int cache[MESH_CACHE_SIZE + 3], newCache[MESH_CACHE_SIZE + 3];
+  int cacheCount = 0;
+  long bestTriangle = -1;
+
+  // Triangles of every vertex, in one array
+  for( i = 0 ; i < triangleCount * 3 ; i++ )
+    remaining[indices[i]]++;
+  offsets[0] = 0;
+  for( v = 0 ; v < vertexCount ; v++ )
+    offsets[v + 1] = offsets[v] + remaining[v];
+  memset(remaining, 0, sizeof(unsigned int) * vertexCount);
+  for( i = 0 ; i < triangleCount * 3 ; i++ ){
+    unsigned int vertex = indices[i];
+    adjacency[offsets[vertex] + remaining[vertex]++] = (unsigned int)(i / 3);
+  }
+
+  for( v = 0 ; v < vertexCount ; v++ )
+    vertexScores[v] = vertex_score(-1, remaining[v]);
+  for( i = 0 ; i < triangleCount ; i++ ){
+    triangleScores[i] = vertexScores[indices[i * 3]] + vertexScores[indices[i * 3 + 1]] +
+                        vertexScores[indices[i * 3 + 2]];
+    if( bestTriangle < 0 || triangleScores[i] > triangleScores[bestTriangle] )
+      bestTriangle = (long)i;
+  }
+
+  while( emittedCount < triangleCount ){
+    const unsigned int *corners;
+    int newCount = 0, c, k;
+    float bestScore = -1.0f;
+
+    // Nothing in the cache has triangles left; take the next unused one
+    if( bestTriangle < 0 ){
+      while( emitted[cursor] )
+        cursor++;
+      bestTriangle = (long)cursor;
+    }
+
+    corners = indices + bestTriangle * 3;
+    memcpy(output + emittedCount * 3, corners, sizeof(unsigned int) * 3);
+    emitted[bestTriangle] = 1;
+    emittedCount++;
+
+    // Take the triangle off its vertices' lists
+    for( c = 0 ; c < 3 ; c++ ){
+      unsigned int vertex = corners[c];
+      unsigned int *list = adjacency + offsets[vertex];
+      unsigned int n = remaining[vertex];
+      for( k = 0 ; k < (int)n ; k++ )
+        if( list[k] == (unsigned int)bestTriangle ){
+          list[k] = list[n - 1];
+          break;
+        }
+      remaining[vertex] = n - 1;
+    }
+
+    // The triangle's vertices move to the front of the LRU cache
+    for( c = 0 ; c < 3 ; c++ )
+      newCache[newCount++] = corners[c];
+    for( k = 0 ; k < cacheCount ; k++ )
+      if( cache[k] != corners[0] && cache[k] != corners[1] && cache[k] != corners[2] )
+        newCache[newCount++] = cache[k];
+
+    // Rescore everything that was or is in the cache. Entries past the
+    // cache size have just been pushed out.
+    bestTriangle = -1;
+    for( k = 0 ; k < newCount ; k++ ){
+      unsigned int vertex = newCache[k];
+      int position = k < MESH_CACHE_SIZE ? k : -1;
+      float score = vertex_score(position, remaining[vertex]);
+      float delta = score - vertexScores[vertex];
+      unsigned int t;
+
+      vertexScores[vertex] = score;
+
+      for( t = 0 ; t < remaining[vertex] ; t++ ){
+        unsigned int triangle = adjacency[offsets[vertex] + t];
+        triangleScores[triangle] += delta;
+        if( position >= 0 && triangleScores[triangle] > bestScore ){
+          bestScore = triangleScores[triangle];
+          bestTriangle = (long)triangle;
+        }
+      }
+    }
+
+    cacheCount = newCount < MESH_CACHE_SIZE ? newCount : MESH_CACHE_SIZE;
+    memcpy(cache, newCache, sizeof(unsigned int) * cacheCount);
+  }
+
+  memcpy(indices, output, sizeof(unsigned int) * triangleCount * 3);
+
+  free(remaining);
+  free(offsets);
+  free(adjacency);
+  free(vertexScores);
+  free(triangleScores);
+  free(emitted);
+  free(output);
+}
+
+size_t mesh_optimize_vertex_fetch(void *vertices, size_t vertexCount, size_t stride,
+                                  unsigned int *indices, size_t indexCount) {
+  unsigned int *remap = (unsigned int*)malloc(sizeof(unsigned int) * vertexCount);
+  unsigned char *reordered = (unsigned char*)malloc(vertexCount * stride);
+  size_t next = 0, i;
+
+  memset(remap, 0xff, sizeof(unsigned int) * vertexCount);
+
+  for( i = 0 ; i < indexCount ; i++ ){
+    unsigned int vertex = indices[i];
+    if( remap[vertex] == NO_VERTEX ){
+      memcpy(reordered + next * stride, (unsigned char*)vertices + vertex * stride, stride);
+      remap[vertex] = (unsigned int)next++;
+    }
+    indices[i] = remap[vertex];
+  }
+
+  memcpy(vertices, reordered, next * stride);
+
+  free(reordered);
+  free(remap);
+  return next;
+}
+
+mesh_cache_stats_t mesh_cache_stats(const unsigned int *indices, size_t indexCount, size_t vertexCount) {
+  // The miss count at which each vertex last entered the FIFO, 0 if never
+  unsigned int *inserted = (unsigned int*)calloc(vertexCount, sizeof(unsigned int));
+  unsigned int misses = 0;
+  mesh_cache_stats_t stats;
+  size_t i;
+
+  for( i = 0 ; i < indexCount ; i++ ){
+    unsigned int vertex = indices[i];
+    if( inserted[vertex] == 0 || misses - inserted[vertex] >= MESH_FIFO_SIZE ){
+      misses++;
+      inserted[vertex] = misses;
+    }
+  }
+  free(inserted);
+
+  stats.acmr = indexCount >= 3 ? misses / (double)(indexCount / 3) : 0.0;
+  stats.atvr = vertexCount > 0 ? misses / (double)vertexCount : 0.0;
+  return stats;
+}
@@ -0,0 +1,45 @@
+
+#ifndef _MESH_OPT_
+#define _MESH_OPT_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Index buffer tools for triangle lists. Vertices are opaque blocks of
+  // 'stride' bytes, so they work on any vertex layout.
+
+  // Post-transform cache size the orderings aim for, and the FIFO size
+  // the statistics simulate
+#define MESH_CACHE_SIZE 32
+#define MESH_FIFO_SIZE  16
+
+  // Merges bitwise identical vertices. Writes the unique vertices to
+  // 'unique' (room for 'count') and one index per input vertex to
+  // 'indices'. Returns the number of unique vertices.
+  size_t mesh_weld(const void *vertices, size_t count, size_t stride, void *unique, unsigned int *indices);
+
+  // Reorders the triangles so vertices are reused while still in the
+  // post-transform cache (Forsyth's linear-speed algorithm)
+  void mesh_optimize_vertex_cache(unsigned int *indices, size_t indexCount, size_t vertexCount);
+
+  // Reorders the vertices in the order the triangles first use them, so
+  // fetches walk the vertex buffer forwards. Unused vertices are dropped.
+  // Returns the number of vertices left.
+  size_t mesh_optimize_vertex_fetch(void *vertices, size_t vertexCount, size_t stride,
+                                    unsigned int *indices, size_t indexCount);
+
+  typedef struct {
+    double acmr;    // Vertex shader runs per triangle, 0.5 at best
+    double atvr;    // Vertex shader runs per vertex, 1 at best
+  } mesh_cache_stats_t;
+
+  // Simulates a FIFO post-transform cache of MESH_FIFO_SIZE entries
+  mesh_cache_stats_t mesh_cache_stats(const unsigned int *indices, size_t indexCount, size_t vertexCount);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,493 @@
+
+#include "mipmap.h"
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rows handed to one parallel_for task at a time
+#define ROWS_PER_TASK 16
+
+// sRGB <-> linear conversion tables
+#define LINEAR_TO_SRGB_SIZE 4096
+static float srgbToLinear[256];
+static unsigned char linearToSrgb[LINEAR_TO_SRGB_SIZE];
+static float normalDecode[256];
+static float unormDecode[256];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+static void init_tables(void) {
+  int i;
+
+  for( i = 0 ; i < 256 ; i++ ){
+    float c = i / 255.0f;
+    srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    normalDecode[i] = i / 127.5f - 1.0f;
+    unormDecode[i] = c;
+  }
+
+  for( i = 0 ; i < LINEAR_TO_SRGB_SIZE ; i++ ){
+    float l = i / (float)(LINEAR_TO_SRGB_SIZE - 1);
+    float s = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+    linearToSrgb[i] = (unsigned char)(s * 255.0f + 0.5f);
+  }
+}
+
+int mip_count_levels(int width, int height) {
+  int levels = 1;
+  while( (width > 1 || height > 1) && levels < MIP_MAX_LEVELS ){
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+    levels++;
+  }
+  return levels;
+}
+
+typedef struct {
+  const mip_level_t *src;
+  mip_level_t *dst;
+  int channels;
+  int filter;
+} downsample_job_t;
+
+// Number of output texels at the start of a row whose 2x2 footprint lies
+// fully inside the source, i.e. that need no edge clamping
+static int unclamped_width(const downsample_job_t *job) {
+  int w = job->src->width / 2;
+  return w < job->dst->width ? w : job->dst->width;
+}
+
+
+// BOX: vertical sums into 16-bit lanes, then pairwise horizontal sums
+
+static void box_row(const downsample_job_t *job, const unsigned char *row0, const unsigned char *row1,
+                    unsigned char *out, unsigned short *sum) {
+  const int c = job->channels;
+  const int n = job->src->width * c;
+  const int srcWidth = job->src->width;
+  int i = 0, x = 0, k;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+  const int simdWidth = unclamped_width(job);
+
+  for( ; i + 16 <= n ; i += 16 ){
+    __m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+    _mm_storeu_si128((__m128i*)(sum + i), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+    _mm_storeu_si128((__m128i*)(sum + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+  }
+#endif
+  for( ; i < n ; i++ )
+    sum[i] = (unsigned short)(row0[i] + row1[i]);
+
+#ifdef __SSE2__
+  // Each iteration reads 32 sums and writes 16 bytes
+  if( c == 1 ){
+    const __m128i ones = _mm_set1_epi16(1);
+    for( ; x + 16 <= simdWidth ; x += 16 ){
+      const __m128i *s = (const __m128i*)(sum + x * 2);
+      __m128i a = _mm_packs_epi32(_mm_madd_epi16(_mm_loadu_si128(s), ones), _mm_madd_epi16(_mm_loadu_si128(s + 1), ones));
+      __m128i b = _mm_packs_epi32(_mm_madd_epi16(_mm_loadu_si128(s + 2), ones), _mm_madd_epi16(_mm_loadu_si128(s + 3), ones));
+      a = _mm_srli_epi16(_mm_add_epi16(a, two), 2);
+      b = _mm_srli_epi16(_mm_add_epi16(b, two), 2);
+      _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(a, b));
+    }
+  }
+  else if( c == 2 ){
+    for( ; x + 8 <= simdWidth ; x += 8 ){
+      const __m128i *s = (const __m128i*)(sum + x * 4);
+      // Move even pixels to the low half and odd pixels to the high half
+      __m128i s0 = _mm_shuffle_epi32(_mm_loadu_si128(s), _MM_SHUFFLE(3, 1, 2, 0));
+      __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128(s + 1), _MM_SHUFFLE(3, 1, 2, 0));
+      __m128i s2 = _mm_shuffle_epi32(_mm_loadu_si128(s + 2), _MM_SHUFFLE(3, 1, 2, 0));
+      __m128i s3 = _mm_shuffle_epi32(_mm_loadu_si128(s + 3), _MM_SHUFFLE(3, 1, 2, 0));
+      __m128i a = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+      __m128i b = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+      a = _mm_srli_epi16(_mm_add_epi16(a, two), 2);
+      b = _mm_srli_epi16(_mm_add_epi16(b, two), 2);
+      _mm_storeu_si128((__m128i*)(out + x * 2), _mm_packus_epi16(a, b));
+    }
+  }
+  else if( c == 4 ){
+    for( ; x + 4 <= simdWidth ; x += 4 ){
+      const __m128i *s = (const __m128i*)(sum + x * 8);
+      __m128i s0 = _mm_loadu_si128(s), s1 = _mm_loadu_si128(s + 1);
+      __m128i s2 = _mm_loadu_si128(s + 2), s3 = _mm_loadu_si128(s + 3);
+      __m128i a = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+      __m128i b = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+      a = _mm_srli_epi16(_mm_add_epi16(a, two), 2);
+      b = _mm_srli_epi16(_mm_add_epi16(b, two), 2);
+      _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(a, b));
+    }
+  }
+#endif
+
+  for( ; x < job->dst->width ; x++ ){
+    int x0 = x * 2 * c;
+    int x1 = (x * 2 + 1 < srcWidth ? x * 2 + 1 : x * 2) * c;
+    for( k = 0 ; k < c ; k++ )
+      out[x * c + k] = (unsigned char)((sum[x0 + k] + sum[x1 + k] + 2) >> 2);
+  }
+}
+
+
+// MAX: vertical maximum, then pairwise horizontal maximum
+
+static void max_row(const downsample_job_t *job, const unsigned char *row0, const unsigned char *row1,
+                    unsigned char *out, unsigned char *vmax) {
+  const int c = job->channels;
+  const int n = job->src->width * c;
+  const int srcWidth = job->src->width;
+  int i = 0, x = 0, k;
+
+#ifdef __SSE2__
+  const int simdWidth = unclamped_width(job);
+
+  for( ; i + 16 <= n ; i += 16 ){
+    __m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+    _mm_storeu_si128((__m128i*)(vmax + i), _mm_max_epu8(a, b));
+  }
+#endif
+  for( ; i < n ; i++ )
+    vmax[i] = row0[i] > row1[i] ? row0[i] : row1[i];
+
+#ifdef __SSE2__
+  if( c == 1 ){
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    for( ; x + 16 <= simdWidth ; x += 16 ){
+      __m128i a = _mm_loadu_si128((const __m128i*)(vmax + x * 2));
+      __m128i b = _mm_loadu_si128((const __m128i*)(vmax + x * 2 + 16));
+      a = _mm_and_si128(_mm_max_epu8(a, _mm_srli_epi16(a, 8)), lowBytes);
+      b = _mm_and_si128(_mm_max_epu8(b, _mm_srli_epi16(b, 8)), lowBytes);
+      _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(a, b));
+    }
+  }
+  else if( c == 4 ){
+    for( ; x + 4 <= simdWidth ; x += 4 ){
+      __m128i a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(vmax + x * 8)), _MM_SHUFFLE(3, 1, 2, 0));
+      __m128i b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(vmax + x * 8 + 16)), _MM_SHUFFLE(3, 1, 2, 0));
+      a = _mm_max_epu8(a, _mm_srli_si128(a, 8));
+      b = _mm_max_epu8(b, _mm_srli_si128(b, 8));
+      _mm_storeu_si128((__m128i*)(out + x * 4), _mm_unpacklo_epi64(a, b));
+    }
+  }
+#endif
+
+  for( ; x < job->dst->width ; x++ ){
+    int x0 = x * 2 * c;
+    int x1 = (x * 2 + 1 < srcWidth ? x * 2 + 1 : x * 2) * c;
+    for( k = 0 ; k < c ; k++ )
+      out[x * c + k] = vmax[x0 + k] > vmax[x1 + k] ? vmax[x0 + k] : vmax[x1 + k];
+  }
+}
+
+
+// SRGB and NORMAL: decode both rows to float, add them vertically, then
+// finish each output texel from the two horizontal neighbours
+
+typedef struct {
+  float *sum;         // Vertical sums, one per source channel
+  float *nx, *ny, *nz; // Unnormalized output normals (NORMAL only)
+} float_scratch_t;
+
+static int is_alpha_channel(int channel, int channels) {
+  return (channels == 4 && channel == 3) || (channels == 2 && channel == 1);
+}
+
+static void decode_sum_rows(const downsample_job_t *job, const unsigned char *row0, const unsigned char *row1,
+                            float *sum) {
+  const int c = job->channels;
+  const int n = job->src->width * c;
+  const float *tables[4];
+  int i, k;
+
+  for( k = 0 ; k < c ; k++ )
+    tables[k] = is_alpha_channel(k, c) ? unormDecode : job->filter == MIP_FILTER_SRGB ? srgbToLinear : normalDecode;
+
+  // Table lookups are gathers, which SSE2 has no instruction for
+  for( i = 0 ; i < n ; i += c )
+    for( k = 0 ; k < c ; k++ )
+      sum[i + k] = tables[k][row0[i + k]] + tables[k][row1[i + k]];
+}
+
+static unsigned char encode_unorm(float v) {
+  if( v <= 0.0f ) return 0;
+  if( v >= 1.0f ) return 255;
+  return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+static void srgb_row(const downsample_job_t *job, const unsigned char *row0, const unsigned char *row1,
+                     unsigned char *out, float_scratch_t *scratch) {
+  const int c = job->channels;
+  const int srcWidth = job->src->width;
+  float *sum = scratch->sum;
+  int x, k;
+
+  decode_sum_rows(job, row0, row1, sum);
+
+  for( x = 0 ; x < job->dst->width ; x++ ){
+    int x0 = x * 2 * c;
+    int x1 = (x * 2 + 1 < srcWidth ? x * 2 + 1 : x * 2) * c;
+    for( k = 0 ; k < c ; k++ ){
+      float v = (sum[x0 + k] + sum[x1 + k]) * 0.25f;
+      if( is_alpha_channel(k, c) )
+        out[x * c + k] = encode_unorm(v);
+      else
+        out[x * c + k] = linearToSrgb[(int)(v * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+    }
+  }
+}
+
+static void normal_row(const downsample_job_t *job, const unsigned char *row0, const unsigned char *row1,
+                       unsigned char *out, float_scratch_t *scratch) {
+  const int c = job->channels;
+  const int srcWidth = job->src->width;
+  const int dstWidth = job->dst->width;
+  float *sum = scratch->sum;
+  int x = 0, k;
+
+  decode_sum_rows(job, row0, row1, sum);
+
+  // Sum of the four vectors; the length does not matter yet
+  for( x = 0 ; x < dstWidth ; x++ ){
+    int x0 = x * 2 * c;
+    int x1 = (x * 2 + 1 < srcWidth ? x * 2 + 1 : x * 2) * c;
+    scratch->nx[x] = sum[x0 + 0] + sum[x1 + 0];
+    scratch->ny[x] = sum[x0 + 1] + sum[x1 + 1];
+    scratch->nz[x] = sum[x0 + 2] + sum[x1 + 2];
+  }
+
+  // Renormalize. Vectors that cancel out become (0, 0, 1).
+  x = 0;
+#ifdef __SSE2__
+  {
+    const __m128 eps = _mm_set1_ps(1e-8f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 threeHalves = _mm_set1_ps(1.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for( ; x + 4 <= dstWidth ; x += 4 ){
+      __m128 vx = _mm_loadu_ps(scratch->nx + x);
+      __m128 vy = _mm_loadu_ps(scratch->ny + x);
+      __m128 vz = _mm_loadu_ps(scratch->nz + x);
+      __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+      __m128 degenerate = _mm_cmplt_ps(len2, eps);
+      __m128 inv = _mm_rsqrt_ps(_mm_max_ps(len2, eps));
+
+      // One Newton-Raphson step brings rsqrt to full 8-bit accuracy and then some
+      inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, len2), _mm_mul_ps(inv, inv))));
+
+      vx = _mm_andnot_ps(degenerate, _mm_mul_ps(vx, inv));
+      vy = _mm_andnot_ps(degenerate, _mm_mul_ps(vy, inv));
+      vz = _mm_or_ps(_mm_andnot_ps(degenerate, _mm_mul_ps(vz, inv)), _mm_and_ps(degenerate, one));
+
+      _mm_storeu_ps(scratch->nx + x, vx);
+      _mm_storeu_ps(scratch->ny + x, vy);
+      _mm_storeu_ps(scratch->nz + x, vz);
+    }
+  }
+#endif
+  for( ; x < dstWidth ; x++ ){
+    float len2 = scratch->nx[x] * scratch->nx[x] + scratch->ny[x] * scratch->ny[x] + scratch->nz[x] * scratch->nz[x];
+    if( len2 < 1e-8f ){
+      scratch->nx[x] = scratch->ny[x] = 0.0f;
+      scratch->nz[x] = 1.0f;
+    } else {
+      float inv = 1.0f / sqrtf(len2);
+      scratch->nx[x] *= inv;
+      scratch->ny[x] *= inv;
+      scratch->nz[x] *= inv;
+    }
+  }
+
+  for( x = 0 ; x < dstWidth ; x++ ){
+    int x0 = x * 2 * c;
+    int x1 = (x * 2 + 1 < srcWidth ? x * 2 + 1 : x * 2) * c;
+    out[x * c + 0] = encode_unorm(scratch->nx[x] * 0.5f + 0.5f);
+    out[x * c + 1] = encode_unorm(scratch->ny[x] * 0.5f + 0.5f);
+    out[x * c + 2] = encode_unorm(scratch->nz[x] * 0.5f + 0.5f);
+    for( k = 3 ; k < c ; k++ )
+      out[x * c + k] = encode_unorm((sum[x0 + k] + sum[x1 + k]) * 0.25f);
+  }
+}
+
+
+static void downsample_rows(int begin, int end, void *arg) {
+  const downsample_job_t *job = (const downsample_job_t*)arg;
+  const mip_level_t *src = job->src;
+  const mip_level_t *dst = job->dst;
+  const int c = job->channels;
+  size_t rowSize = (size_t)src->width * c;
+  float_scratch_t scratch;
+  void *temp;
+  int y;
+
+  if( job->filter == MIP_FILTER_SRGB || job->filter == MIP_FILTER_NORMAL ){
+    temp = malloc(sizeof(float) * (rowSize + 3 * dst->width));
+    scratch.sum = (float*)temp;
+    scratch.nx = scratch.sum + rowSize;
+    scratch.ny = scratch.nx + dst->width;
+    scratch.nz = scratch.ny + dst->width;
+  } else {
+    temp = malloc(sizeof(unsigned short) * rowSize);
+    scratch.sum = scratch.nx = scratch.ny = scratch.nz = NULL;
+  }
+
+  for( y = begin ; y < end ; y++ ){
+    int y0 = y * 2;
+    int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+    const unsigned char *row0 = src->data + (size_t)y0 * rowSize;
+    const unsigned char *row1 = src->data + (size_t)y1 * rowSize;
+    unsigned char *out = dst->data + (size_t)y * dst->width * c;
+
+    switch( job->filter ){
+    case MIP_FILTER_SRGB:
+      srgb_row(job, row0, row1, out, &scratch);
+      break;
+    case MIP_FILTER_NORMAL:
+      normal_row(job, row0, row1, out, &scratch);
+      break;
+    case MIP_FILTER_MAX:
+      max_row(job, row0, row1, out, (unsigned char*)temp);
+      break;
+    default:
+      box_row(job, row0, row1, out, (unsigned short*)temp);
+      break;
+    }
+  }
+
+  free(temp);
+}
+
+void mip_chain_build(mip_chain_t *chain, unsigned char *base, int width, int height, int channels,
+                     int filter, thread_pool_t *pool) {
+  downsample_job_t job;
+  int i;
+
+  pthread_once(&tablesOnce, init_tables);
+
+  // Normal maps need at least xyz
+  if( filter == MIP_FILTER_NORMAL && channels < 3 )
+    filter = MIP_FILTER_BOX;
+
+  chain->channels = channels;
+  chain->numLevels = mip_count_levels(width, height);
+  chain->levels[0].data = base;
+  chain->levels[0].width = width;
+  chain->levels[0].height = height;
+
+  for( i = 1 ; i < chain->numLevels ; i++ ){
+    mip_level_t *src = &chain->levels[i - 1];
+    mip_level_t *dst = &chain->levels[i];
+
+    dst->width = src->width > 1 ? src->width / 2 : 1;
+    dst->height = src->height > 1 ? src->height / 2 : 1;
+    dst->data = (unsigned char*)malloc( (size_t)dst->width * dst->height * channels );
+
+    job.src = src;
+    job.dst = dst;
+    job.channels = channels;
+    job.filter = filter;
+    parallel_for(pool, dst->height, ROWS_PER_TASK, downsample_rows, &job);
+  }
+}
+
+// BOX16: one channel of 16-bit texels, summed in 32 bits
+
+static void box16_rows(int begin, int end, void *arg) {
+  const downsample_job_t *job = (const downsample_job_t*)arg;
+  const mip_level_t *src = job->src;
+  const mip_level_t *dst = job->dst;
+  const int srcWidth = src->width;
+  int x, y;
+
+  for( y = begin ; y < end ; y++ ){
+    int y0 = y * 2;
+    int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+    const unsigned short *row0 = (const unsigned short*)src->data + (size_t)y0 * srcWidth;
+    const unsigned short *row1 = (const unsigned short*)src->data + (size_t)y1 * srcWidth;
+    unsigned short *out = (unsigned short*)dst->data + (size_t)y * dst->width;
+    x = 0;
+
+#ifdef __SSE2__
+    {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i two = _mm_set1_epi32(2);
+      const __m128i bias = _mm_set1_epi32(32768);
+      const __m128i flip = _mm_set1_epi16((short)0x8000);
+      const int simdWidth = unclamped_width(job);
+
+      // Each iteration reads 16 texels of both rows and writes 8
+      for( ; x + 8 <= simdWidth ; x += 8 ){
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 2));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 2 + 8));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 2));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 2 + 8));
+        __m128i s0 = _mm_add_epi32(_mm_unpacklo_epi16(a0, zero), _mm_unpacklo_epi16(b0, zero));
+        __m128i s1 = _mm_add_epi32(_mm_unpackhi_epi16(a0, zero), _mm_unpackhi_epi16(b0, zero));
+        __m128i s2 = _mm_add_epi32(_mm_unpacklo_epi16(a1, zero), _mm_unpacklo_epi16(b1, zero));
+        __m128i s3 = _mm_add_epi32(_mm_unpackhi_epi16(a1, zero), _mm_unpackhi_epi16(b1, zero));
+        // Even texels plus odd texels, through the float shuffle
+        __m128i lo = _mm_add_epi32(
+          _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(s0), _mm_castsi128_ps(s1), _MM_SHUFFLE(2, 0, 2, 0))),
+          _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(s0), _mm_castsi128_ps(s1), _MM_SHUFFLE(3, 1, 3, 1))));
+        __m128i hi = _mm_add_epi32(
+          _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(s2), _mm_castsi128_ps(s3), _MM_SHUFFLE(2, 0, 2, 0))),
+          _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(s2), _mm_castsi128_ps(s3), _MM_SHUFFLE(3, 1, 3, 1))));
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, two), 2);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, two), 2);
+        // SSE2 only packs signed 32-bit lanes, so pack around zero and flip back
+        _mm_storeu_si128((__m128i*)(out + x),
+          _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias)), flip));
+      }
+    }
+#endif
+
+    for( ; x < dst->width ; x++ ){
+      int x0 = x * 2;
+      int x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+      out[x] = (unsigned short)(((unsigned int)row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2);
+    }
+  }
+}
+
+void mip_chain_build16(mip_chain_t *chain, unsigned short *base, int width, int height, thread_pool_t *pool) {
+  downsample_job_t job;
+  int i;
+
+  chain->channels = 1;
+  chain->numLevels = mip_count_levels(width, height);
+  chain->levels[0].data = (unsigned char*)base;
+  chain->levels[0].width = width;
+  chain->levels[0].height = height;
+
+  for( i = 1 ; i < chain->numLevels ; i++ ){
+    mip_level_t *src = &chain->levels[i - 1];
+    mip_level_t *dst = &chain->levels[i];
+
+    dst->width = src->width > 1 ? src->width / 2 : 1;
+    dst->height = src->height > 1 ? src->height / 2 : 1;
+    dst->data = (unsigned char*)malloc( (size_t)dst->width * dst->height * sizeof(unsigned short) );
+
+    job.src = src;
+    job.dst = dst;
+    job.channels = 1;
+    job.filter = MIP_FILTER_BOX;
+    parallel_for(pool, dst->height, ROWS_PER_TASK, box16_rows, &job);
+  }
+}
+
+void mip_chain_free(mip_chain_t *chain) {
+  int i;
+  for( i = 1 ; i < chain->numLevels ; i++ ){
+    free(chain->levels[i].data);
+    chain->levels[i].data = NULL;
+  }
+  chain->numLevels = 0;
+}
@@ -0,0 +1,49 @@
+
+#ifndef _MIPMAP_
+#define _MIPMAP_
+
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIP_MAX_LEVELS 16
+
+  // How texels are combined into the next level
+  enum {
+    MIP_FILTER_BOX = 0,   // Plain 2x2 average, e.g. height maps
+    MIP_FILTER_SRGB,      // 2x2 average in linear space, for sRGB colour maps
+    MIP_FILTER_NORMAL,    // Average of the decoded vectors, renormalized
+    MIP_FILTER_MAX        // 2x2 maximum, for conservative height bounds
+  };
+
+  typedef struct {
+    unsigned char *data;
+    int width, height;
+  } mip_level_t;
+
+  typedef struct {
+    int channels;
+    int numLevels;
+    mip_level_t levels[MIP_MAX_LEVELS];
+  } mip_chain_t;
+
+  // Builds the full chain down to 1x1. Level 0 points at 'base' and is not
+  // copied; the smaller levels are allocated and released by mip_chain_free().
+  // Rows of each level are spread over the pool (NULL runs serially).
+  void mip_chain_build(mip_chain_t *chain, unsigned char *base, int width, int height, int channels,
+                       int filter, thread_pool_t *pool);
+
+  // The same for one channel of 16-bit texels, box filtered: every level's
+  // 'data' then holds unsigned shorts. Released by mip_chain_free() too.
+  void mip_chain_build16(mip_chain_t *chain, unsigned short *base, int width, int height, thread_pool_t *pool);
+
+  void mip_chain_free(mip_chain_t *chain);
+
+  int mip_count_levels(int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,120 @@
+#include "normal_map.h"
+#include <stddef.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rows handed to one parallel_for task at a time
+#define ROWS_PER_TASK 16
+
+typedef struct {
+  const unsigned short *heights;
+  unsigned char *normals;
+  int width, height;
+  float outer, inner;   // Kernel weights of the side rows and the middle one
+  float scale;          // From weighted height differences to slope in texels
+} normal_job_t;
+
+static unsigned char encode_normal(float v) {
+  return (unsigned char)(v * 127.5f + 128.0f);
+}
+
+// One texel, with any neighbour index wrapped by the caller
+static void normal_texel(const normal_job_t *job, const unsigned short *below, const unsigned short *row,
+                         const unsigned short *above, int left, int x, int right, unsigned char *out) {
+  float gx = job->outer * ((float)below[right] - below[left] + above[right] - above[left]) +
+             job->inner * ((float)row[right] - row[left]);
+  float gy = job->outer * ((float)above[left] - below[left] + above[right] - below[right]) +
+             job->inner * ((float)above[x] - below[x]);
+  float nx = -gx * job->scale, ny = -gy * job->scale;
+  float invLength = 1.0f / sqrtf(nx * nx + ny * ny + 1.0f);
+
+  out[0] = encode_normal(nx * invLength);
+  out[1] = encode_normal(ny * invLength);
+  out[2] = encode_normal(invLength);
+}
+
+#ifdef __SSE2__
+// Four heights widened to floats
+static __m128 load_heights(const unsigned short *p) {
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()));
+}
+#endif
+
+static void normal_rows(int begin, int end, void *arg) {
+  const normal_job_t *job = (const normal_job_t*)arg;
+  const int w = job->width, h = job->height;
+  int x, y;
+
+  for( y = begin ; y < end ; y++ ){
+    const unsigned short *below = job->heights + (size_t)((y + h - 1) % h) * w;
+    const unsigned short *row = job->heights + (size_t)y * w;
+    const unsigned short *above = job->heights + (size_t)((y + 1) % h) * w;
+    unsigned char *out = job->normals + (size_t)y * w * 3;
+
+    normal_texel(job, below, row, above, (w - 1) % w, 0, 1 % w, out);
+    x = 1;
+
+#ifdef __SSE2__
+    {
+      const __m128 outer = _mm_set1_ps(job->outer), inner = _mm_set1_ps(job->inner);
+      const __m128 scale = _mm_set1_ps(-job->scale), one = _mm_set1_ps(1.0f);
+      const __m128 encodeScale = _mm_set1_ps(127.5f), encodeBias = _mm_set1_ps(128.0f);
+      int nx[4], ny[4], nz[4], k;
+
+      // Four texels at a time while x + 4 stays inside the row
+      for( ; x + 4 < w ; x += 4 ){
+        __m128 bl = load_heights(below + x - 1), bc = load_heights(below + x), br = load_heights(below + x + 1);
+        __m128 ml = load_heights(row + x - 1), mr = load_heights(row + x + 1);
+        __m128 al = load_heights(above + x - 1), ac = load_heights(above + x), ar = load_heights(above + x + 1);
+
+        __m128 gx = _mm_add_ps(_mm_mul_ps(outer, _mm_add_ps(_mm_sub_ps(br, bl), _mm_sub_ps(ar, al))),
+                               _mm_mul_ps(inner, _mm_sub_ps(mr, ml)));
+        __m128 gy = _mm_add_ps(_mm_mul_ps(outer, _mm_add_ps(_mm_sub_ps(al, bl), _mm_sub_ps(ar, br))),
+                               _mm_mul_ps(inner, _mm_sub_ps(ac, bc)));
+        __m128 vx = _mm_mul_ps(gx, scale), vy = _mm_mul_ps(gy, scale);
+        __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), one)));
+
+        _mm_storeu_si128((__m128i*)nx, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(vx, invLength), encodeScale), encodeBias)));
+        _mm_storeu_si128((__m128i*)ny, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(vy, invLength), encodeScale), encodeBias)));
+        _mm_storeu_si128((__m128i*)nz, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(invLength, encodeScale), encodeBias)));
+
+        // Interleaving three channels has no cheap SSE2 shuffle
+        for( k = 0 ; k < 4 ; k++ ){
+          out[(x + k) * 3] = (unsigned char)nx[k];
+          out[(x + k) * 3 + 1] = (unsigned char)ny[k];
+          out[(x + k) * 3 + 2] = (unsigned char)nz[k];
+        }
+      }
+    }
+#endif
+
+    for( ; x < w ; x++ )
+      normal_texel(job, below, row, above, x - 1, x, (x + 1) % w, out + x * 3);
+  }
+}
+
+void normal_map_build(const unsigned short *heights, int width, int height, float strength, int kernel,
+                      unsigned char *normals, thread_pool_t *pool) {
+  normal_job_t job;
+
+  job.heights = heights;
+  job.normals = normals;
+  job.width = width;
+  job.height = height;
+
+  if( kernel == NORMAL_KERNEL_SOBEL ){
+    job.outer = 1.0f;
+    job.inner = 2.0f;
+  } else {
+    job.outer = 3.0f;
+    job.inner = 10.0f;
+  }
+
+  // The weights sum to 2 * outer + inner over a difference two texels wide
+  job.scale = strength / (65535.0f * 2.0f * (2.0f * job.outer + job.inner));
+
+  parallel_for(pool, height, ROWS_PER_TASK, normal_rows, &job);
+}
@@ -0,0 +1,35 @@
+
+#ifndef _NORMAL_MAP_
+#define _NORMAL_MAP_
+
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Kernels for the height gradient. Both are a central difference across
+  // three rows; Scharr's weights keep the gradient's direction closer to
+  // the true one on diagonals.
+  enum {
+    NORMAL_KERNEL_SOBEL = 0,   // 1 2 1
+    NORMAL_KERNEL_SCHARR       // 3 10 3
+  };
+
+  // Derives a tangent space normal map from a 16-bit height map, so a
+  // material needs no normal map file of its own. Heights in [0,65535]
+  // stand for [0,1] upwards; 'strength' is how many texels that range
+  // spans, i.e. the shader's depth scale times the map's width. Larger
+  // values give steeper normals.
+  //
+  // Rows are stored bottom first, as the readers return them, so +y is +t.
+  // The map wraps around like GL_REPEAT. Three bytes per texel are written
+  // to 'normals', each 127.5 * (n + 1). Rows are spread over the pool
+  // (NULL runs serially).
+  void normal_map_build(const unsigned short *heights, int width, int height, float strength, int kernel,
+                        unsigned char *normals, thread_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,703 @@
+#include "obj_loader.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHUNK_SIZE      (1 << 20)   // Bytes of the file per parse task
+#define CORNER_BLOCK    65536       // Corners per task when remapping indices
+#define MAX_PARTITIONS  64
+#define NO_INDEX        (~0u)
+
+enum { ATTR_POSITION, ATTR_TEXCOORD, ATTR_NORMAL, NUM_ATTRIBUTES };
+
+static const int attributeSize[NUM_ATTRIBUTES] = { 3, 2, 3 };
+
+// A face corner as its chunk saw it. Bit a of 'relative' is set when
+// index[a] counts from the start of the chunk's own list (a negative index
+// in the file, so it may point into an earlier chunk); otherwise index[a]
+// is 0-based over the whole file, or -1 when the corner doesn't have it.
+typedef struct {
+  long index[NUM_ATTRIBUTES];
+  int relative;
+} raw_corner_t;
+
+typedef struct {
+  float *data;
+  size_t count, capacity;   // In floats
+} float_list_t;
+
+typedef struct {
+  const char *begin, *end;
+  float_list_t lists[NUM_ATTRIBUTES];
+  raw_corner_t *corners;
+  size_t numCorners, cornerCapacity;
+  size_t base[NUM_ATTRIBUTES], cornerBase;   // Offsets in the merged arrays
+  const char *errorLine;                     // First line that didn't parse
+  int badIndex;
+  size_t cornersWithoutNormal;
+} obj_chunk_t;
+
+typedef struct {
+  unsigned int index[NUM_ATTRIBUTES];
+} corner_key_t;
+
+// The corners one partition welded
+typedef struct {
+  size_t first, numMembers;    // Its corners in obj_loader_t::order
+  corner_key_t *keys;
+  size_t numUnique, base;
+  float boundsMin[3], boundsMax[3];
+} obj_partition_t;
+
+typedef struct {
+  obj_chunk_t *chunks;
+  int numChunks;
+  float *lists[NUM_ATTRIBUTES];
+  size_t listSize[NUM_ATTRIBUTES];      // In items
+  corner_key_t *corners;
+  unsigned int *hashes;
+  unsigned int *localIds;
+  unsigned int *order;                  // Corners grouped by partition
+  size_t numCorners;
+  obj_partition_t partitions[MAX_PARTITIONS];
+  int numPartitions;
+  const float *positionNormals;
+  obj_mesh_t *mesh;
+} obj_loader_t;
+
+static int is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while( p < end && is_blank(*p) )
+    p++;
+  return p;
+}
+
+// Decimal with optional fraction and exponent. Good to float precision,
+// which is all that is kept. Returns NULL when there is no number.
+static const char *parse_float(const char *p, const char *end, float *value) {
+  static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  uint64_t mantissa = 0;
+  int negative = 0, digits = 0, anyDigits = 0, exponent = 0;
+  double result;
+
+  if( p < end && (*p == '-' || *p == '+') )
+    negative = *p++ == '-';
+
+  for( ; p < end && *p >= '0' && *p <= '9' ; p++ ){
+    anyDigits = 1;
+    if( digits < 19 ){
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    }
+    else
+      exponent++;
+  }
+  if( p < end && *p == '.' ){
+    for( p++ ; p < end && *p >= '0' && *p <= '9' ; p++ ){
+      anyDigits = 1;
+      if( digits < 19 ){
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if( !anyDigits )
+    return NULL;
+
+  if( p < end && (*p == 'e' || *p == 'E') ){
+    int exponentNegative = 0, e = 0;
+    p++;
+    if( p < end && (*p == '-' || *p == '+') )
+      exponentNegative = *p++ == '-';
+    for( ; p < end && *p >= '0' && *p <= '9' ; p++ )
+      if( e < 1000 )
+        e = e * 10 + (*p - '0');
+    exponent += exponentNegative ? -e : e;
+  }
+
+  result = (double)mantissa;
+  if( exponent < 0 )
+    result = exponent >= -22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+  else if( exponent > 0 )
+    result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+
+  *value = (float)(negative ? -result : result);
+  return p;
+}
+
+static const char *parse_int(const char *p, const char *end, long *value) {
+  long result = 0;
+  int negative = 0;
+  const char *digits;
+
+  if( p < end && (*p == '-' || *p == '+') )
+    negative = *p++ == '-';
+  for( digits = p ; p < end && *p >= '0' && *p <= '9' ; p++ )
+    result = result * 10 + (*p - '0');
+  if( p == digits )
+    return NULL;
+
+  *value = negative ? -result : result;
+  return p;
+}
+
+static void float_list_push(float_list_t *list, const float *values, int count) {
+  if( list->count + count > list->capacity ){
+    list->capacity = list->capacity ? list->capacity * 2 : 3 * 4096;
+    list->data = (float*)realloc(list->data, sizeof(float) * list->capacity);
+  }
+  memcpy(list->data + list->count, values, sizeof(float) * count);
+  list->count += count;
+}
+
+static void push_corner(obj_chunk_t *chunk, const raw_corner_t *corner) {
+  if( chunk->numCorners == chunk->cornerCapacity ){
+    chunk->cornerCapacity = chunk->cornerCapacity ? chunk->cornerCapacity * 2 : 3 * 4096;
+    chunk->corners = (raw_corner_t*)realloc(chunk->corners, sizeof(raw_corner_t) * chunk->cornerCapacity);
+  }
+  chunk->corners[chunk->numCorners++] = *corner;
+}
+
+// One v/vt/vn reference: a, a/b, a//c or a/b/c
+static const char *parse_corner(const char *p, const char *end, const obj_chunk_t *chunk, raw_corner_t *corner) {
+  int a;
+
+  corner->relative = 0;
+  for( a = 0 ; a < NUM_ATTRIBUTES ; a++ ){
+    long value;
+
+    corner->index[a] = -1;
+    if( a > 0 ){
+      if( p >= end || *p != '/' )
+        continue;
+      p++;
+      if( p < end && *p == '/' )   // Empty texture coordinate
+        continue;
+    }
+
+    p = parse_int(p, end, &value);
+    if( !p || value == 0 )
+      return NULL;
+
+    if( value > 0 )
+      corner->index[a] = value - 1;
+    else {
+      corner->index[a] = (long)(chunk->lists[a].count / attributeSize[a]) + value;
+      corner->relative |= 1 << a;
+    }
+  }
+  return p;
+}
+
+// Polygons become fans around their first corner
+static const char *parse_face(const char *p, const char *end, obj_chunk_t *chunk) {
+  raw_corner_t first, previous, corner;
+  int count = 0;
+
+  for( p = skip_blanks(p, end) ; p < end ; p = skip_blanks(p, end) ){
+    p = parse_corner(p, end, chunk, &corner);
+    if( !p || (p < end && !is_blank(*p)) )
+      return NULL;
+
+    if( corner.index[ATTR_NORMAL] < 0 )
+      chunk->cornersWithoutNormal++;
+    if( count >= 2 ){
+      push_corner(chunk, &first);
+      push_corner(chunk, &previous);
+      push_corner(chunk, &corner);
+    }
+    if( count == 0 )
+      first = corner;
+    previous = corner;
+    count++;
+  }
+  return count >= 3 ? p : NULL;
+}
+
+static const char *parse_floats(const char *p, const char *end, float_list_t *list, int count, int required) {
+  float values[3] = { 0.0f, 0.0f, 0.0f };
+  int i;
+
+  for( i = 0 ; i < count ; i++ ){
+    const char *next;
+
+    p = skip_blanks(p, end);
+    next = parse_float(p, end, &values[i]);
+    if( !next ){
+      if( i < required )
+        return NULL;
+      break;
+    }
+    p = next;
+  }
+  float_list_push(list, values, count);
+  return p;
+}
+
+static void parse_chunk(obj_chunk_t *chunk) {
+  const char *p = chunk->begin, *end = chunk->end;
+
+  while( p < end ){
+    const char *lineEnd = (const char*)memchr(p, '\n', end - p);
+    const char *line = p, *ok = p;
+
+    if( !lineEnd )
+      lineEnd = end;
+    p = skip_blanks(p, lineEnd);
+
+    // Extra values (w, vertex colours) are ignored
+    if( lineEnd - p >= 2 && p[0] == 'v' && is_blank(p[1]) )
+      ok = parse_floats(p + 1, lineEnd, &chunk->lists[ATTR_POSITION], 3, 3);
+    else if( lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && is_blank(p[2]) )
+      ok = parse_floats(p + 2, lineEnd, &chunk->lists[ATTR_TEXCOORD], 2, 1);
+    else if( lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && is_blank(p[2]) )
+      ok = parse_floats(p + 2, lineEnd, &chunk->lists[ATTR_NORMAL], 3, 3);
+    else if( lineEnd - p >= 2 && p[0] == 'f' && is_blank(p[1]) )
+      ok = parse_face(p + 1, lineEnd, chunk);
+
+    if( !ok ){
+      chunk->errorLine = line;
+      return;
+    }
+    p = lineEnd + 1;
+  }
+}
+
+static void parse_chunks(int begin, int end, void *arg) {
+  obj_loader_t *loader = (obj_loader_t*)arg;
+  int i;
+
+  for( i = begin ; i < end ; i++ )
+    parse_chunk(&loader->chunks[i]);
+}
+
+static unsigned int hash_key(const corner_key_t *key) {
+  unsigned int hash = 2166136261u;
+  int a;
+
+  for( a = 0 ; a < NUM_ATTRIBUTES ; a++ )
+    hash = (hash ^ key->index[a]) * 16777619u;
+  return hash ^ (hash >> 15);
+}
+
+// Partition from the high bits, table slot from the low ones
+static int partition_of(unsigned int hash, int numPartitions) {
+  return (int)(((uint64_t)(hash >> 16) * numPartitions) >> 16);
+}
+
+// Copies the chunk's lists into the merged ones and makes its corners
+// global, then frees what the chunk parsed
+static void resolve_chunks(int begin, int end, void *arg) {
+  obj_loader_t *loader = (obj_loader_t*)arg;
+  int i, a;
+
+  for( i = begin ; i < end ; i++ ){
+    obj_chunk_t *chunk = &loader->chunks[i];
+    size_t c;
+
+    for( a = 0 ; a < NUM_ATTRIBUTES ; a++ ){
+      if( chunk->lists[a].count > 0 )
+        memcpy(loader->lists[a] + chunk->base[a] * attributeSize[a], chunk->lists[a].data,
+               sizeof(float) * chunk->lists[a].count);
+      free(chunk->lists[a].data);
+      chunk->lists[a].data = NULL;
+    }
+
+    for( c = 0 ; c < chunk->numCorners ; c++ ){
+      const raw_corner_t *raw = &chunk->corners[c];
+      corner_key_t *key = &loader->corners[chunk->cornerBase + c];
+
+      for( a = 0 ; a < NUM_ATTRIBUTES ; a++ ){
+        long index = raw->index[a];
+
+        if( raw->relative & (1 << a) )
+          index += (long)chunk->base[a];
+        else if( index < 0 ){
+          key->index[a] = NO_INDEX;
+          continue;
+        }
+        if( index < 0 || (size_t)index >= loader->listSize[a] ){
+          chunk->badIndex = 1;
+          index = 0;
+        }
+        key->index[a] = (unsigned int)index;
+      }
+      loader->hashes[chunk->cornerBase + c] = hash_key(key);
+    }
+    free(chunk->corners);
+    chunk->corners = NULL;
+  }
+}
+
+// Counting sort of the corners by partition
+static void group_corners(obj_loader_t *loader) {
+  size_t next[MAX_PARTITIONS], first = 0, c;
+  int p;
+
+  for( c = 0 ; c < loader->numCorners ; c++ )
+    loader->partitions[partition_of(loader->hashes[c], loader->numPartitions)].numMembers++;
+  for( p = 0 ; p < loader->numPartitions ; p++ ){
+    loader->partitions[p].first = next[p] = first;
+    first += loader->partitions[p].numMembers;
+  }
+  for( c = 0 ; c < loader->numCorners ; c++ )
+    loader->order[next[partition_of(loader->hashes[c], loader->numPartitions)]++] = (unsigned int)c;
+}
+
+// Every partition has its own table, so no locking is needed
+static void weld_partitions(int begin, int end, void *arg) {
+  obj_loader_t *loader = (obj_loader_t*)arg;
+  int p;
+
+  for( p = begin ; p < end ; p++ ){
+    obj_partition_t *partition = &loader->partitions[p];
+    size_t tableSize = 1, m;
+    unsigned int *table;
+
+    while( tableSize < partition->numMembers * 2 )
+      tableSize *= 2;
+    table = (unsigned int*)malloc(sizeof(unsigned int) * tableSize);
+    memset(table, 0xff, sizeof(unsigned int) * tableSize);
+    partition->keys = (corner_key_t*)malloc(sizeof(corner_key_t) * (partition->numMembers ? partition->numMembers : 1));
+    partition->numUnique = 0;
+
+    for( m = 0 ; m < partition->numMembers ; m++ ){
+      size_t c = loader->order ? loader->order[partition->first + m] : m;
+      const corner_key_t *key = &loader->corners[c];
+      size_t slot = loader->hashes[c] & (tableSize - 1);
+
+      // Linear probing; the table is never more than half full
+      while( table[slot] != NO_INDEX && memcmp(&partition->keys[table[slot]], key, sizeof(*key)) != 0 )
+        slot = (slot + 1) & (tableSize - 1);
+
+      if( table[slot] == NO_INDEX ){
+        partition->keys[partition->numUnique] = *key;
+        table[slot] = (unsigned int)partition->numUnique++;
+      }
+      loader->localIds[c] = table[slot];
+    }
+
+    free(table);
+  }
+}
+
+static void remap_indices(int begin, int end, void *arg) {
+  obj_loader_t *loader = (obj_loader_t*)arg;
+  size_t first = (size_t)begin * CORNER_BLOCK, last = (size_t)end * CORNER_BLOCK, c;
+
+  if( last > loader->numCorners )
+    last = loader->numCorners;
+  for( c = first ; c < last ; c++ ){
+    const obj_partition_t *partition = &loader->partitions[partition_of(loader->hashes[c], loader->numPartitions)];
+    loader->mesh->indices[c] = (unsigned int)(partition->base + loader->localIds[c]);
+  }
+}
+
+static void build_vertices(int begin, int end, void *arg) {
+  obj_loader_t *loader = (obj_loader_t*)arg;
+  int p, i;
+
+  for( p = begin ; p < end ; p++ ){
+    obj_partition_t *partition = &loader->partitions[p];
+    size_t u;
+
+    for( i = 0 ; i < 3 ; i++ ){
+      partition->boundsMin[i] = HUGE_VALF;
+      partition->boundsMax[i] = -HUGE_VALF;
+    }
+
+    for( u = 0 ; u < partition->numUnique ; u++ ){
+      const corner_key_t *key = &partition->keys[u];
+      mesh_vertex_t *vertex = &loader->mesh->vertices[partition->base + u];
+      unsigned int position = key->index[ATTR_POSITION];
+
+      memcpy(vertex->position, loader->lists[ATTR_POSITION] + (size_t)position * 3, sizeof(vertex->position));
+
+      if( key->index[ATTR_TEXCOORD] != NO_INDEX )
+        memcpy(vertex->texCoord, loader->lists[ATTR_TEXCOORD] + (size_t)key->index[ATTR_TEXCOORD] * 2,
+               sizeof(vertex->texCoord));
+      else
+        vertex->texCoord[0] = vertex->texCoord[1] = 0.0f;
+
+      if( key->index[ATTR_NORMAL] != NO_INDEX )
+        memcpy(vertex->normal, loader->lists[ATTR_NORMAL] + (size_t)key->index[ATTR_NORMAL] * 3,
+               sizeof(vertex->normal));
+      else
+        memcpy(vertex->normal, loader->positionNormals + (size_t)position * 3, sizeof(vertex->normal));
+
+      for( i = 0 ; i < 3 ; i++ ){
+        if( vertex->position[i] < partition->boundsMin[i] ) partition->boundsMin[i] = vertex->position[i];
+        if( vertex->position[i] > partition->boundsMax[i] ) partition->boundsMax[i] = vertex->position[i];
+      }
+    }
+  }
+}
+
+// The face normals around every position, weighted by area (the cross
+// product is twice the area), normalized
+static float *position_normals(const obj_loader_t *loader) {
+  size_t numPositions = loader->listSize[ATTR_POSITION], t, v;
+  float *normals = (float*)calloc(numPositions * 3, sizeof(float));
+  const float *positions = loader->lists[ATTR_POSITION];
+  int c, i;
+
+  for( t = 0 ; t + 2 < loader->numCorners ; t += 3 ){
+    const float *p0 = positions + (size_t)loader->corners[t].index[ATTR_POSITION] * 3;
+    const float *p1 = positions + (size_t)loader->corners[t + 1].index[ATTR_POSITION] * 3;
+    const float *p2 = positions + (size_t)loader->corners[t + 2].index[ATTR_POSITION] * 3;
+    float e1[3], e2[3], n[3];
+
+    for( i = 0 ; i < 3 ; i++ ){
+      e1[i] = p1[i] - p0[i];
+      e2[i] = p2[i] - p0[i];
+    }
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    for( c = 0 ; c < 3 ; c++ ){
+      float *normal = normals + (size_t)loader->corners[t + c].index[ATTR_POSITION] * 3;
+      for( i = 0 ; i < 3 ; i++ )
+        normal[i] += n[i];
+    }
+  }
+
+  for( v = 0 ; v < numPositions ; v++ ){
+    float *normal = normals + v * 3;
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if( length > 0.0f ){
+      for( i = 0 ; i < 3 ; i++ )
+        normal[i] /= length;
+    }
+    else
+      normal[2] = 1.0f;
+  }
+  return normals;
+}
+
+// Chunks end just after a line end, except the last one
+static int split_chunks(obj_loader_t *loader, const char *data, size_t size) {
+  int numChunks = (int)(size / CHUNK_SIZE) + 1, count = 0, i;
+  const char *begin = data;
+
+  loader->chunks = (obj_chunk_t*)calloc(numChunks, sizeof(obj_chunk_t));
+  for( i = 0 ; i < numChunks && begin < data + size ; i++ ){
+    const char *end = i == numChunks - 1 ? data + size : data + (size * (i + 1)) / numChunks;
+
+    if( end < begin )
+      end = begin;
+    while( end < data + size && end[-1] != '\n' )
+      end++;
+
+    loader->chunks[count].begin = begin;
+    loader->chunks[count].end = end;
+    count++;
+    begin = end;
+  }
+  loader->numChunks = count;
+  return count;
+}
+
+static void free_loader(obj_loader_t *loader) {
+  int i, a;
+
+  for( i = 0 ; i < loader->numChunks ; i++ ){
+    for( a = 0 ; a < NUM_ATTRIBUTES ; a++ )
+      free(loader->chunks[i].lists[a].data);
+    free(loader->chunks[i].corners);
+  }
+  free(loader->chunks);
+  for( a = 0 ; a < NUM_ATTRIBUTES ; a++ )
+    free(loader->lists[a]);
+  for( i = 0 ; i < loader->numPartitions ; i++ )
+    free(loader->partitions[i].keys);
+  free(loader->corners);
+  free(loader->hashes);
+  free(loader->localIds);
+  free(loader->order);
+  free((void*)loader->positionNormals);
+}
+
+static int load_mapped(const char *filename, const char *data, size_t size, obj_mesh_t *mesh,
+                       obj_stats_t *stats, thread_pool_t *pool) {
+  obj_loader_t loader;
+  size_t cornersWithoutNormal = 0, total[NUM_ATTRIBUTES] = { 0 }, numCorners = 0, numVertices = 0;
+  double start = timer_now_ms();
+  int i, a, numThreads = pool ? thread_pool_size(pool) + 1 : 1;
+
+  memset(&loader, 0, sizeof(loader));
+  loader.mesh = mesh;
+
+  split_chunks(&loader, data, size);
+  parallel_for(pool, loader.numChunks, 1, parse_chunks, &loader);
+
+  // Where every chunk's lists go once merged
+  for( i = 0 ; i < loader.numChunks ; i++ ){
+    obj_chunk_t *chunk = &loader.chunks[i];
+
+    if( chunk->errorLine ){
+      const char *p;
+      size_t line = 1;
+      for( p = data ; p < chunk->errorLine ; p++ )
+        line += *p == '\n';
+      fprintf( stderr, "Can't parse line %lu of '%s'.\n", (unsigned long)line, filename );
+      free_loader(&loader);
+      return 0;
+    }
+
+    for( a = 0 ; a < NUM_ATTRIBUTES ; a++ ){
+      chunk->base[a] = total[a];
+      total[a] += chunk->lists[a].count / attributeSize[a];
+    }
+    chunk->cornerBase = numCorners;
+    numCorners += chunk->numCorners;
+    cornersWithoutNormal += chunk->cornersWithoutNormal;
+  }
+  if( stats ){
+    stats->parseMs = timer_now_ms() - start;
+    start = timer_now_ms();
+  }
+
+  if( numCorners == 0 ){
+    fprintf( stderr, "'%s' has no faces.\n", filename );
+    free_loader(&loader);
+    return 0;
+  }
+  if( numCorners > NO_INDEX ){
+    fprintf( stderr, "'%s' has too many faces.\n", filename );
+    free_loader(&loader);
+    return 0;
+  }
+
+  for( a = 0 ; a < NUM_ATTRIBUTES ; a++ ){
+    loader.listSize[a] = total[a];
+    loader.lists[a] = (float*)malloc(sizeof(float) * attributeSize[a] * (total[a] ? total[a] : 1));
+  }
+  loader.numCorners = numCorners;
+  loader.corners = (corner_key_t*)malloc(sizeof(corner_key_t) * numCorners);
+  loader.hashes = (unsigned int*)malloc(sizeof(unsigned int) * numCorners);
+  loader.localIds = (unsigned int*)malloc(sizeof(unsigned int) * numCorners);
+
+  parallel_for(pool, loader.numChunks, 1, resolve_chunks, &loader);
+
+  for( i = 0 ; i < loader.numChunks ; i++ )
+    if( loader.chunks[i].badIndex ){
+      fprintf( stderr, "'%s' has a face that refers to a vertex that doesn't exist.\n", filename );
+      free_loader(&loader);
+      return 0;
+    }
+  if( stats ){
+    stats->resolveMs = timer_now_ms() - start;
+    start = timer_now_ms();
+  }
+
+  // A few partitions per thread so uneven ones even out
+  loader.numPartitions = numThreads == 1 ? 1 : numThreads * 4;
+  if( loader.numPartitions > MAX_PARTITIONS )
+    loader.numPartitions = MAX_PARTITIONS;
+  if( loader.numPartitions > 1 ){
+    loader.order = (unsigned int*)malloc(sizeof(unsigned int) * numCorners);
+    group_corners(&loader);
+  }
+  else
+    loader.partitions[0].numMembers = numCorners;   // In file order, no grouping needed
+  parallel_for(pool, loader.numPartitions, 1, weld_partitions, &loader);
+
+  for( i = 0 ; i < loader.numPartitions ; i++ ){
+    loader.partitions[i].base = numVertices;
+    numVertices += loader.partitions[i].numUnique;
+  }
+
+  if( cornersWithoutNormal > 0 )
+    loader.positionNormals = position_normals(&loader);
+
+  mesh->numVertices = numVertices;
+  mesh->numIndices = numCorners;
+  mesh->vertices = (mesh_vertex_t*)malloc(sizeof(mesh_vertex_t) * numVertices);
+  mesh->indices = (unsigned int*)malloc(sizeof(unsigned int) * numCorners);
+
+  parallel_for(pool, (int)((numCorners + CORNER_BLOCK - 1) / CORNER_BLOCK), 1, remap_indices, &loader);
+  parallel_for(pool, loader.numPartitions, 1, build_vertices, &loader);
+
+  for( i = 0 ; i < 3 ; i++ ){
+    mesh->boundsMin[i] = HUGE_VALF;
+    mesh->boundsMax[i] = -HUGE_VALF;
+  }
+  for( a = 0 ; a < loader.numPartitions ; a++ ){
+    const obj_partition_t *partition = &loader.partitions[a];
+    if( partition->numUnique == 0 )
+      continue;
+    for( i = 0 ; i < 3 ; i++ ){
+      if( partition->boundsMin[i] < mesh->boundsMin[i] ) mesh->boundsMin[i] = partition->boundsMin[i];
+      if( partition->boundsMax[i] > mesh->boundsMax[i] ) mesh->boundsMax[i] = partition->boundsMax[i];
+    }
+  }
+
+  if( stats ){
+    stats->weldMs = timer_now_ms() - start;
+    stats->positions = total[ATTR_POSITION];
+    stats->texCoords = total[ATTR_TEXCOORD];
+    stats->normals = total[ATTR_NORMAL];
+    stats->triangles = numCorners / 3;
+  }
+
+  free_loader(&loader);
+  return 1;
+}
+
+int obj_load(const char *filename, obj_mesh_t *mesh, obj_stats_t *stats, thread_pool_t *pool) {
+  double start = timer_now_ms();
+  struct stat st;
+  void *data;
+  int fd, ok;
+
+  memset(mesh, 0, sizeof(*mesh));
+  if( stats )
+    memset(stats, 0, sizeof(*stats));
+
+  fd = open(filename, O_RDONLY);
+  if( fd < 0 ){
+    fprintf( stderr, "Can't open mesh '%s'.\n", filename );
+    return 0;
+  }
+  if( fstat(fd, &st) != 0 || st.st_size == 0 ){
+    fprintf( stderr, "Mesh '%s' is empty.\n", filename );
+    close(fd);
+    return 0;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( data == MAP_FAILED ){
+    fprintf( stderr, "Can't map mesh '%s'.\n", filename );
+    return 0;
+  }
+
+  ok = load_mapped(filename, (const char*)data, (size_t)st.st_size, mesh, stats, pool);
+  munmap(data, st.st_size);
+
+  if( stats ){
+    stats->fileSize = (size_t)st.st_size;
+    stats->totalMs = timer_now_ms() - start;
+  }
+  return ok;
+}
+
+void obj_free(obj_mesh_t *mesh) {
+  free(mesh->vertices);
+  free(mesh->indices);
+  mesh->vertices = NULL;
+  mesh->indices = NULL;
+}
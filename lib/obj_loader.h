@@ -0,0 +1,48 @@
+
+#ifndef _OBJ_LOADER_
+#define _OBJ_LOADER_
+
+#include <stddef.h>
+#include "vertex_format.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Wavefront OBJ meshes: v, vt, vn and f (polygons become triangle fans,
+  // negative indices count back from the current line). Everything else
+  // (groups, materials, smoothing, ...) is skipped.
+  //
+  // The file is mapped and split at line ends into chunks that are parsed
+  // in parallel. Face corners are then welded on their v/vt/vn triple:
+  // the corners are partitioned by hash and each partition gets its own
+  // hash map, so the partitions are welded in parallel too.
+
+  typedef struct {
+    mesh_vertex_t *vertices;
+    size_t numVertices;
+    unsigned int *indices;    // Three per triangle, counter-clockwise as in the file
+    size_t numIndices;
+    float boundsMin[3], boundsMax[3];
+  } obj_mesh_t;
+
+  typedef struct {
+    size_t fileSize;
+    size_t positions, texCoords, normals, triangles;
+    double parseMs;       // Chunks parsed into local arrays
+    double resolveMs;     // Indices made global and merged
+    double weldMs;        // Corners welded, vertices built
+    double totalMs;       // All of the above, mapping and normal generation
+  } obj_stats_t;
+
+  // Returns 0 and prints why on failure. Corners without a normal get the
+  // area-weighted average of the faces around their position, corners
+  // without a texture coordinate get (0, 0). 'stats' may be NULL.
+  int obj_load(const char *filename, obj_mesh_t *mesh, obj_stats_t *stats, thread_pool_t *pool);
+  void obj_free(obj_mesh_t *mesh);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -8,18 +8,17 @@
 
 #define PNG_BYTES_TO_CHECK 8
 
-png_data_t *read_png(char *filename) {
-  
-  png_data_t *pd;
-  unsigned char *pb;
-  
-  png_structp png_ptr;
-  png_infop info_ptr;
-  unsigned int sig_read = 0;
+// PNG stores 16-bit samples big endian
+static int is_little_endian(void) {
+  const unsigned short one = 1;
+  return *(const unsigned char*)&one == 1;
+}
+
+// Opens the file, checks the signature and sets up libpng with the
+// transforms that turn every supported PNG into 8 bits per channel.
+static FILE *open_png(char *filename, png_structp *png_ptr, png_infop *info_ptr) {
+
   char header[PNG_BYTES_TO_CHECK];
-  int numChannels;
-  
-  int r;
   
   FILE *fp = fopen(filename, "rb");
   if( !fp ){
@@ -27,31 +26,54 @@ png_data_t *read_png(char *filename) {
     return 0;
   }
 
-  fread( header, 1, PNG_BYTES_TO_CHECK, fp );
-  if( png_sig_cmp( (png_byte*) &header[0], 0, PNG_BYTES_TO_CHECK) ){
+  if( fread( header, 1, PNG_BYTES_TO_CHECK, fp ) != PNG_BYTES_TO_CHECK ||
+      png_sig_cmp( (png_byte*) &header[0], 0, PNG_BYTES_TO_CHECK) ){
     fprintf( stderr, "Texture file '%s' is not in PNG format.\n", filename );
     fclose(fp);
     return 0;
   }
 
-  png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
-  if( png_ptr == NULL ){
+  *png_ptr = png_create_read_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+  if( *png_ptr == NULL ){
     fprintf( stderr, "Can't initialize PNG file for reading: %s\n", filename );
     fclose(fp);
     return 0;
   }
 
-  info_ptr = png_create_info_struct(png_ptr);
-  if( info_ptr == NULL ){
+  *info_ptr = png_create_info_struct(*png_ptr);
+  if( *info_ptr == NULL ){
     fclose(fp);
-    png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+    png_destroy_read_struct(png_ptr, (png_infopp)NULL, (png_infopp)NULL);
     fprintf( stderr, "Can't allocate memory to read PNG file: %s\n", filename );
     return 0;
   }
+
+  return fp;
+}
+
+// With 'keep16' 16-bit files keep their precision, in native byte order
+static png_data_t *decode_png(char *filename, unsigned char *buffer, size_t bufferSize, int keep16) {
+  
+  png_data_t * volatile pd = NULL;
+  unsigned char * volatile pixels = NULL;
+  png_bytep * volatile row_pointers = NULL;
+  
+  png_structp png_ptr;
+  png_infop info_ptr;
+  int numChannels, width, height, bitDepth, r;
+  size_t rowbytes;
+  
+  FILE *fp = open_png(filename, &png_ptr, &info_ptr);
+  if( !fp )
+    return 0;
   
   if( setjmp(png_jmpbuf(png_ptr)) ){
     png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
     fclose(fp);
+    free(row_pointers);
+    if( pixels != buffer )
+      free(pixels);
+    free(pd);
     fprintf( stderr, "Exception occurred while reading PNG file: %s\n", filename );
     return 0;
   }
@@ -60,64 +82,185 @@ png_data_t *read_png(char *filename) {
 
   png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
 
-  png_read_png( png_ptr, info_ptr,
-                PNG_TRANSFORM_STRIP_16 |
-                PNG_TRANSFORM_PACKING |
-                PNG_TRANSFORM_EXPAND, NULL );
+  png_read_info(png_ptr, info_ptr);
+
+  // Same result as PNG_TRANSFORM_STRIP_16 | PNG_TRANSFORM_PACKING | PNG_TRANSFORM_EXPAND
+  if( !keep16 )
+    png_set_strip_16(png_ptr);
+  else if( is_little_endian() )
+    png_set_swap(png_ptr);
+  png_set_packing(png_ptr);
+  png_set_expand(png_ptr);
+  png_set_interlace_handling(png_ptr);
+  png_read_update_info(png_ptr, info_ptr);
 
   numChannels = png_get_channels(png_ptr, info_ptr);
+  width = png_get_image_width(png_ptr, info_ptr);
+  height = png_get_image_height(png_ptr, info_ptr);
+  rowbytes = png_get_rowbytes(png_ptr, info_ptr);
   
-  if( png_get_bit_depth(png_ptr, info_ptr) != 8 ){
+  bitDepth = png_get_bit_depth(png_ptr, info_ptr);
+  if( bitDepth != 8 && !(keep16 && bitDepth == 16) ){
     fprintf( stderr, "Can't handle PNG files with bit depth other than 8.  '%s' has %d bits per pixel.\n",
-             filename, png_get_bit_depth(png_ptr, info_ptr) );
+             filename, bitDepth );
+    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
     fclose(fp);
     return 0;
   }
-  if( numChannels == 2 ){
-    fprintf( stderr, "Can't handle a two-channel PNG file: %s.\n", filename );
+  if( buffer && bufferSize < rowbytes * height ){
+    fprintf( stderr, "Buffer of %lu bytes is too small for PNG file '%s' (%lu bytes).\n",
+             (unsigned long)bufferSize, filename, (unsigned long)(rowbytes * height) );
+    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
     fclose(fp);
     return 0;
   }
   
   pd = (png_data_t*)malloc( sizeof(png_data_t) );
   pd->channels = numChannels;
-  
-  pd->width = png_get_image_width(png_ptr,info_ptr);
-  pd->height = png_get_image_height(png_ptr,info_ptr);
-
-  pd->pixelData = pb = (unsigned char*)malloc( sizeof(unsigned char)*( numChannels * pd->width * pd->height ) );
-
-  for( r = (int)info_ptr->height - 1 ; r >= 0 ; r-- ){
-    png_bytep row = info_ptr->row_pointers[r];
-    int rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    int c;
-    for( c = 0 ; c < rowbytes ; c++ )
-      switch( numChannels ){
-      case 1:
-        *(pb)++ = row[c];
-        break;
-      case 2:
-        fprintf( stderr, "Can't handle a two-channel PNG file: %s\n", filename );
-        free(pd);
-        fclose(fp);
-        return 0;
-      case 3:
-      case 4:
-        *(pb)++ = row[c];
-        break;
-      }
-  }
+  pd->width = width;
+  pd->height = height;
+  pd->bit_depth = bitDepth;
+  // Grey + alpha comes through as two channels, e.g. the x and y of a normal map
+  pd->has_alpha = (numChannels == 2 || numChannels == 4);
+  pd->owns_pixels = (buffer == NULL);
+
+  pixels = buffer ? buffer : (unsigned char*)malloc( rowbytes * height );
+
+  // OpenGL wants the bottom row first, so point libpng's rows into the
+  // final buffer in reverse order and let it decode in place
+  row_pointers = (png_bytep*)malloc( sizeof(png_bytep) * height );
+  for( r = 0 ; r < height ; r++ )
+    row_pointers[r] = pixels + (size_t)(height - 1 - r) * rowbytes;
+
+  png_read_image(png_ptr, row_pointers);
+  png_read_end(png_ptr, NULL);
 
-  pd->has_alpha = (numChannels == 4);
+  pd->pixelData = pixels;
 
+  free(row_pointers);
   png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
   fclose(fp);
   
   return pd;
 }
 
+png_data_t *read_png(char *filename) {
+  return decode_png(filename, NULL, 0, 0);
+}
+
+png_data_t *read_png_into(char *filename, unsigned char *buffer, size_t bufferSize) {
+  return decode_png(filename, buffer, bufferSize, 0);
+}
+
+png_data_t *read_png16(char *filename) {
+  return decode_png(filename, NULL, 0, 1);
+}
+
+int read_png_header(char *filename, int *width, int *height, int *channels) {
+
+  png_structp png_ptr;
+  png_infop info_ptr;
+  
+  FILE *fp = open_png(filename, &png_ptr, &info_ptr);
+  if( !fp )
+    return 0;
+  
+  if( setjmp(png_jmpbuf(png_ptr)) ){
+    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+    fclose(fp);
+    fprintf( stderr, "Exception occurred while reading PNG file: %s\n", filename );
+    return 0;
+  }
+
+  png_init_io(png_ptr, fp);
+  png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
+  png_read_info(png_ptr, info_ptr);
+
+  png_set_strip_16(png_ptr);
+  png_set_packing(png_ptr);
+  png_set_expand(png_ptr);
+  png_read_update_info(png_ptr, info_ptr);
+
+  *width = png_get_image_width(png_ptr, info_ptr);
+  *height = png_get_image_height(png_ptr, info_ptr);
+  *channels = png_get_channels(png_ptr, info_ptr);
+
+  png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+  fclose(fp);
+
+  return 1;
+}
+
+int write_png(char *filename, png_data_t *pd) {
+
+  static const int colorTypes[5] = { 0, PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA,
+                                     PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA };
+  png_structp png_ptr;
+  png_infop info_ptr;
+  png_bytep * volatile row_pointers = NULL;
+  size_t rowbytes = (size_t)pd->width * pd->channels;
+  int r;
+
+  if( pd->channels < 1 || pd->channels > 4 ){
+    fprintf( stderr, "Can't write a PNG file with %d channels: %s\n", pd->channels, filename );
+    return 0;
+  }
+
+  FILE *fp = fopen(filename, "wb");
+  if( !fp ){
+    fprintf( stderr, "Can't open PNG file '%s' for writing.\n", filename );
+    return 0;
+  }
+
+  png_ptr = png_create_write_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+  if( png_ptr == NULL ){
+    fprintf( stderr, "Can't initialize PNG file for writing: %s\n", filename );
+    fclose(fp);
+    return 0;
+  }
+
+  info_ptr = png_create_info_struct(png_ptr);
+  if( info_ptr == NULL ){
+    png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
+    fclose(fp);
+    fprintf( stderr, "Can't allocate memory to write PNG file: %s\n", filename );
+    return 0;
+  }
+
+  if( setjmp(png_jmpbuf(png_ptr)) ){
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    fclose(fp);
+    free(row_pointers);
+    fprintf( stderr, "Exception occurred while writing PNG file: %s\n", filename );
+    return 0;
+  }
+
+  png_init_io(png_ptr, fp);
+  png_set_IHDR(png_ptr, info_ptr, pd->width, pd->height, 8, colorTypes[pd->channels],
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png_ptr, info_ptr);
+
+  // PNG stores the top row first
+  row_pointers = (png_bytep*)malloc( sizeof(png_bytep) * pd->height );
+  for( r = 0 ; r < pd->height ; r++ )
+    row_pointers[r] = pd->pixelData + (size_t)(pd->height - 1 - r) * rowbytes;
+
+  png_write_image(png_ptr, row_pointers);
+  png_write_end(png_ptr, NULL);
+
+  free(row_pointers);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+  fclose(fp);
+
+  return 1;
+}
+
 
 void free_png(png_data_t *pd){
+  if( !pd )
+    return;
+  if( pd->owns_pixels )
+    free(pd->pixelData);
   free(pd);
 }
 
@@ -3,6 +3,7 @@
 #define _PNG_READER_
 
 #include <libpng12/png.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,10 +14,27 @@ extern "C" {
     int width, height;
     int channels;
     int has_alpha;
+    int bit_depth;      // 8, or 16 from read_png16(): pixelData holds native unsigned shorts
+    int owns_pixels;    // pixelData is freed by free_png()
   } png_data_t;
   
   
   png_data_t *read_png(char *filename);
+
+  // Decodes straight into a caller-owned buffer of at least
+  // width * height * channels bytes. Fails if the buffer is too small.
+  png_data_t *read_png_into(char *filename, unsigned char *buffer, size_t bufferSize);
+
+  // Like read_png(), but 16-bit files keep all their bits; 'bit_depth'
+  // says which it was. For height maps, where 8 bits show as terraces.
+  png_data_t *read_png16(char *filename);
+
+  // Reads only the header, e.g. to size a buffer for read_png_into()
+  int read_png_header(char *filename, int *width, int *height, int *channels);
+
+  // Writes 8-bit pixels stored bottom row first, as read_png() returns them
+  int write_png(char *filename, png_data_t *pd);
+
   void free_png(png_data_t *pd);
   void print_png(png_data_t *pd);
   
@@ -0,0 +1,105 @@
+#include "program_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;       // Guards against a file renamed or copied by hand
+  uint32_t format;    // The GLenum binaryFormat
+  uint32_t size;
+} program_cache_header_t;
+
+uint64_t program_cache_key(const char *const *strings, int count) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  int i;
+
+  for( i = 0 ; i < count ; i++ ){
+    const unsigned char *s = (const unsigned char*)strings[i];
+
+    if( s == NULL )
+      continue;
+    do {
+      hash ^= *s;
+      hash *= 0x100000001b3ull;
+    } while( *s++ );
+  }
+  return hash;
+}
+
+static void cache_path(char *path, size_t length, const char *dir, uint64_t key, const char *suffix) {
+  snprintf(path, length, "%s/%016llx.bin%s", dir, (unsigned long long)key, suffix);
+}
+
+void *program_cache_load(const char *dir, uint64_t key, uint32_t *format, size_t *size) {
+  program_cache_header_t header;
+  char path[1024];
+  void *data;
+  FILE *fp;
+
+  cache_path(path, sizeof(path), dir, key, "");
+  fp = fopen(path, "rb");
+  if( fp == NULL )
+    return NULL;
+
+  if( fread(&header, sizeof(header), 1, fp) != 1 ||
+      header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION ||
+      header.key != key || header.size == 0 ){
+    fprintf( stderr, "Ignoring the damaged program binary '%s'.\n", path );
+    fclose(fp);
+    return NULL;
+  }
+
+  data = malloc(header.size);
+  if( fread(data, 1, header.size, fp) != header.size ){
+    fprintf( stderr, "Ignoring the truncated program binary '%s'.\n", path );
+    free(data);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+
+  *format = header.format;
+  *size = header.size;
+  return data;
+}
+
+int program_cache_store(const char *dir, uint64_t key, uint32_t format, const void *data, size_t size) {
+  program_cache_header_t header;
+  char path[1024], tempPath[1024];
+  FILE *fp;
+  int ok;
+
+  if( mkdir(dir, 0755) != 0 && errno != EEXIST ){
+    fprintf( stderr, "Can't create the program cache directory '%s'.\n", dir );
+    return 0;
+  }
+
+  cache_path(path, sizeof(path), dir, key, "");
+  cache_path(tempPath, sizeof(tempPath), dir, key, ".tmp");
+  fp = fopen(tempPath, "wb");
+  if( fp == NULL ){
+    fprintf( stderr, "Can't write '%s'.\n", tempPath );
+    return 0;
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.magic = PROGRAM_CACHE_MAGIC;
+  header.version = PROGRAM_CACHE_VERSION;
+  header.key = key;
+  header.format = format;
+  header.size = (uint32_t)size;
+
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(data, 1, size, fp) == size;
+  ok = fclose(fp) == 0 && ok;
+  if( !ok || rename(tempPath, path) != 0 ){
+    fprintf( stderr, "Can't write '%s'.\n", path );
+    unlink(tempPath);
+    return 0;
+  }
+  return 1;
+}
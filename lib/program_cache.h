@@ -0,0 +1,35 @@
+
+#ifndef _PROGRAM_CACHE_
+#define _PROGRAM_CACHE_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Linked shader programs on disk as glGetProgramBinary() gives them, one
+  // file per program named after its key. The key covers everything that
+  // goes into the binary: the sources, the #defines and the driver, so a
+  // changed shader or a driver update simply misses.
+  #define PROGRAM_CACHE_MAGIC   0x4E494250  // "PBIN"
+  #define PROGRAM_CACHE_VERSION 1
+
+  // 64-bit FNV-1a over the strings, NULL entries skipped. Each string is
+  // hashed with its terminator so ("ab", "c") and ("a", "bc") differ.
+  uint64_t program_cache_key(const char *const *strings, int count);
+
+  // Reads the binary stored under 'key' in 'dir'. Returns the data (free()
+  // it) and its format and size, or NULL if there is none or it is damaged.
+  void *program_cache_load(const char *dir, uint64_t key, uint32_t *format, size_t *size);
+
+  // Stores a binary under 'key', creating 'dir' if needed. Writes to a
+  // temporary file first so a reader never sees half a binary. Returns 0 on
+  // failure.
+  int program_cache_store(const char *dir, uint64_t key, uint32_t format, const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
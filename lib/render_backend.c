@@ -0,0 +1,250 @@
+#include "render_backend.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Nothing is ever bound under this name, so a reset state never matches
+#define UNKNOWN 0xFFFFFFFFu
+
+typedef struct {
+  GLuint program;
+  GLuint vertexArray;
+  GLuint arrayBuffer;
+  GLenum activeUnit;
+  GLenum depthFunc;
+  GLuint depthWrite;
+  GLuint colorWrite;
+  GLenum targets[RENDER_MAX_TEXTURE_UNITS];
+  GLuint textures[RENDER_MAX_TEXTURE_UNITS];
+} render_state_t;
+
+// Textures start with no target, which matches no bind
+static render_state_t state = { UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, { 0 }, { 0 } };
+static render_counters_t counters;
+
+void render_state_reset(void) {
+  int i;
+
+  state.program = state.vertexArray = state.arrayBuffer = UNKNOWN;
+  state.activeUnit = state.depthFunc = state.depthWrite = state.colorWrite = UNKNOWN;
+  for( i = 0 ; i < RENDER_MAX_TEXTURE_UNITS ; i++ ){
+    state.targets[i] = 0;
+    state.textures[i] = UNKNOWN;
+  }
+}
+
+void render_counters_reset(void) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+const render_counters_t *render_get_counters(void) {
+  return &counters;
+}
+
+void render_use_program(GLuint program) {
+  if( state.program == program ){
+    counters.redundant++;
+    return;
+  }
+  glUseProgram(program);
+  state.program = program;
+  counters.calls++;
+  counters.stateChanges++;
+}
+
+void render_bind_vertex_array(GLuint vertexArray) {
+  if( state.vertexArray == vertexArray ){
+    counters.redundant++;
+    return;
+  }
+  glBindVertexArray(vertexArray);
+  state.vertexArray = vertexArray;
+  counters.calls++;
+  counters.stateChanges++;
+}
+
+void render_bind_texture(GLenum unit, GLenum target, GLuint texture) {
+  unsigned int index = unit - GL_TEXTURE0;
+
+  if( index < RENDER_MAX_TEXTURE_UNITS && state.textures[index] == texture && state.targets[index] == target ){
+    counters.redundant++;
+    return;
+  }
+
+  if( state.activeUnit != unit ){
+    glActiveTexture(unit);
+    state.activeUnit = unit;
+    counters.calls++;
+  }
+  glBindTexture(target, texture);
+  counters.calls++;
+  counters.stateChanges++;
+
+  if( index < RENDER_MAX_TEXTURE_UNITS ){
+    state.targets[index] = target;
+    state.textures[index] = texture;
+  }
+}
+
+void render_bind_buffer(GLenum target, GLuint buffer) {
+  if( target == GL_ARRAY_BUFFER ){
+    if( state.arrayBuffer == buffer ){
+      counters.redundant++;
+      return;
+    }
+    state.arrayBuffer = buffer;
+  }
+  glBindBuffer(target, buffer);
+  counters.calls++;
+  counters.stateChanges++;
+}
+
+void render_stream_buffer(GLenum target, GLuint buffer, GLsizeiptr capacity, GLsizeiptr size, const void *data) {
+  render_bind_buffer(target, buffer);
+  glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+  counters.calls++;
+  if( size > 0 ){
+    glBufferSubData(target, 0, size, data);
+    counters.calls++;
+  }
+}
+
+void render_uniform_1f(GLint location, float value) {
+  if( location < 0 ){
+    counters.redundant++;
+    return;
+  }
+  glUniform1f(location, value);
+  counters.calls++;
+}
+
+void render_clear(GLbitfield mask) {
+  glClear(mask);
+  counters.calls++;
+}
+
+void render_depth_state(GLenum func, GLboolean write) {
+  if( state.depthFunc != func ){
+    glDepthFunc(func);
+    state.depthFunc = func;
+    counters.calls++;
+    counters.stateChanges++;
+  }
+  else
+    counters.redundant++;
+
+  if( state.depthWrite != write ){
+    glDepthMask(write);
+    state.depthWrite = write;
+    counters.calls++;
+    counters.stateChanges++;
+  }
+  else
+    counters.redundant++;
+}
+
+void render_color_write(GLboolean write) {
+  if( state.colorWrite == write ){
+    counters.redundant++;
+    return;
+  }
+  glColorMask(write, write, write, write);
+  state.colorWrite = write;
+  counters.calls++;
+  counters.stateChanges++;
+}
+
+void render_material_set_texture(render_material_t *material, GLenum unit, GLenum target, GLuint texture) {
+  int i;
+
+  for( i = 0 ; i < material->numTextures ; i++ )
+    if( material->units[i] == unit )
+      break;
+
+  if( i == material->numTextures ){
+    if( i == RENDER_MAX_MATERIAL_TEXTURES )
+      return;
+    material->numTextures++;
+  }
+  material->units[i] = unit;
+  material->targets[i] = target;
+  material->textures[i] = texture;
+}
+
+void render_list_init(render_list_t *list) {
+  list->commands = NULL;
+  list->count = list->capacity = 0;
+}
+
+void render_list_free(render_list_t *list) {
+  free(list->commands);
+  render_list_init(list);
+}
+
+void render_list_clear(render_list_t *list) {
+  list->count = 0;
+}
+
+render_command_t *render_list_add(render_list_t *list) {
+  render_command_t *command;
+
+  if( list->count == list->capacity ){
+    list->capacity = list->capacity ? list->capacity * 2 : 64;
+    list->commands = (render_command_t*)realloc(list->commands, sizeof(render_command_t) * list->capacity);
+  }
+
+  command = &list->commands[list->count];
+  memset(command, 0, sizeof(*command));
+  command->material = -1;
+  command->order = list->count++;
+  return command;
+}
+
+static int compare_commands(const void *a, const void *b) {
+  const render_command_t *x = (const render_command_t*)a;
+  const render_command_t *y = (const render_command_t*)b;
+
+  if( x->program != y->program )
+    return x->program < y->program ? -1 : 1;
+  if( x->material != y->material )
+    return x->material < y->material ? -1 : 1;
+  if( x->vertexArray != y->vertexArray )
+    return x->vertexArray < y->vertexArray ? -1 : 1;
+  return x->order - y->order;
+}
+
+void render_list_submit(render_list_t *list, const render_material_t *materials) {
+  int i, t, c, lastMaterial = -1;
+
+  qsort(list->commands, list->count, sizeof(render_command_t), compare_commands);
+
+  for( i = 0 ; i < list->count ; i++ ){
+    const render_command_t *command = &list->commands[i];
+
+    render_use_program(command->program);
+    // Sorted, so a material's draws come together and it is bound once
+    if( command->material >= 0 && command->material != lastMaterial ){
+      const render_material_t *material = &materials[command->material];
+      for( t = 0 ; t < material->numTextures ; t++ )
+        render_bind_texture(material->units[t], material->targets[t], material->textures[t]);
+    }
+    lastMaterial = command->material;
+    render_bind_vertex_array(command->vertexArray);
+
+    if( command->matrix ){
+      for( c = 0 ; c < 4 ; c++ )
+        glVertexAttrib4fv(command->matrixAttrib + c, command->matrix + 4 * c);
+      counters.calls += 4;
+    }
+    if( command->layer ){
+      glVertexAttrib1f(command->layerAttrib, *command->layer);
+      counters.calls++;
+    }
+
+    if( command->instances > 0 )
+      glDrawElementsInstancedARB(GL_TRIANGLES, command->indexCount, command->indexType, 0, command->instances);
+    else
+      glDrawElements(GL_TRIANGLES, command->indexCount, command->indexType, 0);
+    counters.calls++;
+    counters.draws++;
+  }
+}
@@ -0,0 +1,107 @@
+
+#ifndef _RENDER_BACKEND_
+#define _RENDER_BACKEND_
+
+#include <GL/glew.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // A thin layer over the GL calls a frame makes. It remembers the bound
+  // program, vertex array, array buffer and textures and drops binds that
+  // change nothing, and it counts what gets through so the driver overhead
+  // of a frame can be watched as the number of draws grows.
+  //
+  // The cache assumes every bind goes through here. After code that binds
+  // directly (e.g. loading), render_state_reset() makes it forget.
+
+  #define RENDER_MAX_TEXTURE_UNITS 16
+  #define RENDER_MAX_MATERIAL_TEXTURES 8
+
+  typedef struct {
+    unsigned int calls;           // GL calls made
+    unsigned int stateChanges;    // Binds that changed something
+    unsigned int redundant;       // Binds and calls dropped as no-ops
+    unsigned int draws;
+  } render_counters_t;
+
+  void render_state_reset(void);
+
+  void render_counters_reset(void);
+  const render_counters_t *render_get_counters(void);
+
+  void render_use_program(GLuint program);
+  void render_bind_vertex_array(GLuint vertexArray);
+
+  // 'unit' is GL_TEXTURE0 + i. Only switches the active unit when the
+  // binding changes.
+  void render_bind_texture(GLenum unit, GLenum target, GLuint texture);
+
+  // Cached for GL_ARRAY_BUFFER only; the element array binding belongs to
+  // the vertex array, so other targets are always bound
+  void render_bind_buffer(GLenum target, GLuint buffer);
+
+  // Replaces the contents of a buffer with orphaning, so the GPU may keep
+  // reading the old ones while the new ones are written
+  void render_stream_buffer(GLenum target, GLuint buffer, GLsizeiptr capacity, GLsizeiptr size, const void *data);
+
+  // Skipped for location -1, which the program doesn't have. Sets the
+  // uniform of the bound program.
+  void render_uniform_1f(GLint location, float value);
+
+  void render_clear(GLbitfield mask);
+
+  // The depth test function and whether depth and color are written. The
+  // depth test is enabled by the caller.
+  void render_depth_state(GLenum func, GLboolean write);
+  void render_color_write(GLboolean write);
+
+  // Textures bound together for a draw
+  typedef struct {
+    int numTextures;
+    GLenum units[RENDER_MAX_MATERIAL_TEXTURES];
+    GLenum targets[RENDER_MAX_MATERIAL_TEXTURES];
+    GLuint textures[RENDER_MAX_MATERIAL_TEXTURES];
+  } render_material_t;
+
+  // Sets the texture of a unit, replacing the one the material had there
+  void render_material_set_texture(render_material_t *material, GLenum unit, GLenum target, GLuint texture);
+
+  // One indexed draw from the element buffer of a vertex array
+  typedef struct {
+    GLuint program;
+    int material;                 // Index into the materials, -1 for none
+    GLuint vertexArray;
+    GLenum indexType;
+    GLsizei indexCount;
+    GLsizei instances;            // 0 draws once without instancing
+    GLuint matrixAttrib;          // With 'matrix': four attributes set to its
+    const float *matrix;          // columns before the draw, NULL for none
+    GLuint layerAttrib;           // With 'layer': set to it before the draw,
+    const float *layer;           // e.g. a texture array layer, NULL for none
+    int order;                    // Set by render_list_add()
+  } render_command_t;
+
+  // The draws of a frame. Submitting sorts them by program, material and
+  // vertex array so each state is bound once, keeping the order they were
+  // added in otherwise.
+  typedef struct {
+    render_command_t *commands;
+    int count;
+    int capacity;
+  } render_list_t;
+
+  void render_list_init(render_list_t *list);
+  void render_list_free(render_list_t *list);
+  void render_list_clear(render_list_t *list);
+
+  // A zeroed command with no material or matrix, valid until the next add
+  render_command_t *render_list_add(render_list_t *list);
+
+  void render_list_submit(render_list_t *list, const render_material_t *materials);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
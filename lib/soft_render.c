@@ -0,0 +1,741 @@
+#include "soft_render.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TILE_SIZE 32            // Pixels, must be even so quads never straddle tiles
+#define TRIANGLES_PER_TASK 64
+#define MAX_CLIPPED 3           // A triangle clipped by two planes becomes up to 3
+#define POM_DEPTH_SCALE 0.03f   // pomDepthScale of parallaxmapping.frag
+
+// Varyings of vs.vert, in this order: tc.st, n.xyz, vec2Camera.xyz, t.xyzw
+#define NUM_VARYINGS 12
+#define VARY_TC 0
+#define VARY_N 2
+#define VARY_CAM 5
+#define VARY_T 8
+
+typedef struct {
+  float clip[4];
+  float v[NUM_VARYINGS];
+} clip_vertex_t;
+
+typedef struct {
+  // Edge functions E(x, y) = a*x + b*y + c, positive inside. Edge i is
+  // opposite vertex i, so E_i / area is the barycentric weight of vertex i.
+  float a[3], b[3], c[3];
+  int topLeft[3];               // Pixels exactly on the edge belong to it
+  float invArea;
+  float invW[3];
+  float v[3][NUM_VARYINGS];     // Varyings divided by w
+  int minX, minY, maxX, maxY;   // Pixel bounds, clamped to the framebuffer
+} setup_triangle_t;
+
+typedef struct {
+  sr_framebuffer_t *fb;
+  const sr_vertex_t *vertices;
+  const sr_material_t *material;
+  int vertexTangents;
+  int parallaxLod;
+  float parallaxLodPixels[2];
+  float modelView[16];
+  float perspective[16];
+
+  setup_triangle_t *triangles;  // MAX_CLIPPED slots per input triangle
+  int *numSetup;                // Used slots per input triangle
+
+  int tilesX, tilesY;
+  int *binStart;                // numTiles + 1 offsets into binTriangles
+  int *binTriangles;
+  sr_stats_t *tileStats;
+} draw_ctx_t;
+
+
+int sr_framebuffer_init(sr_framebuffer_t *fb, int width, int height) {
+  fb->width = width;
+  fb->height = height;
+  fb->color = (unsigned char*)malloc((size_t)width * height * 4);
+  return fb->color != NULL;
+}
+
+void sr_framebuffer_free(sr_framebuffer_t *fb) {
+  free(fb->color);
+  fb->color = NULL;
+}
+
+static unsigned char to_unorm8(float f) {
+  if( f <= 0.0f ) return 0;
+  if( f >= 1.0f ) return 255;
+  return (unsigned char)(f * 255.0f + 0.5f);
+}
+
+void sr_clear(sr_framebuffer_t *fb, float r, float g, float b, float a) {
+  unsigned char rgba[4] = { to_unorm8(r), to_unorm8(g), to_unorm8(b), to_unorm8(a) };
+  size_t i, n = (size_t)fb->width * fb->height;
+
+  for( i = 0 ; i < n ; i++ )
+    memcpy(fb->color + i * 4, rgba, 4);
+}
+
+void sr_perspective(float *mat, float fovDeg, float aspect, float zNear, float zFar) {
+  // Same constants as CalcFrustumScale() in main.cpp
+  float frustumScale = 1.0f / tanf(fovDeg * (3.14159f * 2.0f / 360.0f) / 2.0f);
+
+  memset(mat, 0, sizeof(float) * 16);
+  mat[0] = frustumScale / aspect;
+  mat[5] = frustumScale;
+  mat[10] = (zNear + zFar) / (zNear - zFar);
+  mat[11] = 2.0f * zNear * zFar / (zNear - zFar);
+  mat[14] = -1.0f;
+}
+
+// Row-major 4x4 product
+static void mat4_mul(float *out, const float *a, const float *b) {
+  int r, c;
+  for( r = 0 ; r < 4 ; r++ )
+    for( c = 0 ; c < 4 ; c++ )
+      out[r * 4 + c] = a[r * 4 + 0] * b[0 * 4 + c] + a[r * 4 + 1] * b[1 * 4 + c] +
+                       a[r * 4 + 2] * b[2 * 4 + c] + a[r * 4 + 3] * b[3 * 4 + c];
+}
+
+static void mat4_transform(float *out, const float *m, const float *v) {
+  int r;
+  for( r = 0 ; r < 4 ; r++ )
+    out[r] = m[r * 4 + 0] * v[0] + m[r * 4 + 1] * v[1] + m[r * 4 + 2] * v[2] + m[r * 4 + 3] * v[3];
+}
+
+// offset * rotY * rotX from vs.vert, written out row-major
+static void vs_model_view(float *mv, float time, float loopDuration) {
+  float timeScale = 3.14159f * 2.0f / loopDuration;
+  float currTime = time - loopDuration * floorf(time / loopDuration);   // GLSL mod()
+  float c = cosf(currTime * timeScale), s = sinf(currTime * timeScale);
+
+  float offset[16] = { 1, 0, 0, 0,   0, 1, 0, 0,   0, 0, 1, -2,   0, 0, 0, 1 };
+  float rotY[16] = { c, 0, s, 0,   0, 1, 0, 0,   -s, 0, c, 0,   0, 0, 0, 1 };
+  float rotX[16] = { 1, 0, 0, 0,   0, c, -s, 0,   0, s, c, 0,   0, 0, 0, 1 };
+  float tmp[16];
+
+  mat4_mul(tmp, offset, rotY);
+  mat4_mul(mv, tmp, rotX);
+}
+
+static void run_vertex_shader(const draw_ctx_t *ctx, const sr_vertex_t *in, clip_vertex_t *out) {
+  const float *mv = ctx->modelView;
+  float cam[4], n[3], len;
+  int i;
+
+  mat4_transform(cam, mv, in->position);
+  mat4_transform(out->clip, ctx->perspective, cam);
+
+  out->v[VARY_TC + 0] = in->texCoord[0];
+  out->v[VARY_TC + 1] = in->texCoord[1];
+
+  for( i = 0 ; i < 3 ; i++ )
+    n[i] = mv[i * 4 + 0] * in->normal[0] + mv[i * 4 + 1] * in->normal[1] + mv[i * 4 + 2] * in->normal[2];
+  len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  for( i = 0 ; i < 3 ; i++ ){
+    out->v[VARY_N + i] = len > 0.0f ? n[i] / len : 0.0f;
+    out->v[VARY_CAM + i] = -cam[i];
+    // Not normalized, like vs.vert
+    out->v[VARY_T + i] = mv[i * 4 + 0] * in->tangent[0] + mv[i * 4 + 1] * in->tangent[1] + mv[i * 4 + 2] * in->tangent[2];
+  }
+  out->v[VARY_T + 3] = in->tangent[3];
+}
+
+static void lerp_vertex(clip_vertex_t *out, const clip_vertex_t *a, const clip_vertex_t *b, float t) {
+  int i;
+  for( i = 0 ; i < 4 ; i++ )
+    out->clip[i] = a->clip[i] + (b->clip[i] - a->clip[i]) * t;
+  for( i = 0 ; i < NUM_VARYINGS ; i++ )
+    out->v[i] = a->v[i] + (b->v[i] - a->v[i]) * t;
+}
+
+// Clips a polygon against the near (z > -w) and far (z < w) planes. X and Y
+// need no clipping since rasterization is limited to the framebuffer.
+static int clip_polygon(clip_vertex_t *poly, int count) {
+  clip_vertex_t tmp[MAX_CLIPPED + 2];
+  int plane, i, n;
+
+  for( plane = 0 ; plane < 2 && count > 0 ; plane++ ){
+    float sign = plane == 0 ? 1.0f : -1.0f;
+    n = 0;
+    for( i = 0 ; i < count ; i++ ){
+      const clip_vertex_t *a = &poly[i], *b = &poly[(i + 1) % count];
+      float da = a->clip[3] + sign * a->clip[2];
+      float db = b->clip[3] + sign * b->clip[2];
+
+      if( da >= 0.0f )
+        tmp[n++] = *a;
+      if( (da >= 0.0f) != (db >= 0.0f) )
+        lerp_vertex(&tmp[n++], a, b, da / (da - db));
+    }
+    memcpy(poly, tmp, sizeof(clip_vertex_t) * n);
+    count = n;
+  }
+  return count;
+}
+
+static int is_top_left(float ax, float ay, float bx, float by) {
+  // With y up and counter-clockwise winding the inside is left of a->b:
+  // left edges run downwards, top edges run right to left
+  return by < ay || (by == ay && bx < ax);
+}
+
+// Viewport transform, back-face culling (GL_CCW front faces) and edge setup
+static int setup_triangle(const sr_framebuffer_t *fb, const clip_vertex_t *v0,
+                          const clip_vertex_t *v1, const clip_vertex_t *v2, setup_triangle_t *tri) {
+  const clip_vertex_t *verts[3] = { v0, v1, v2 };
+  float x[3], y[3], area, minX, minY, maxX, maxY;
+  int i, k;
+
+  for( i = 0 ; i < 3 ; i++ ){
+    float invW = 1.0f / verts[i]->clip[3];
+    x[i] = (verts[i]->clip[0] * invW * 0.5f + 0.5f) * fb->width;
+    y[i] = (verts[i]->clip[1] * invW * 0.5f + 0.5f) * fb->height;
+    tri->invW[i] = invW;
+    for( k = 0 ; k < NUM_VARYINGS ; k++ )
+      tri->v[i][k] = verts[i]->v[k] * invW;
+  }
+
+  area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if( !(area > 0.0f) )
+    return 0;
+  tri->invArea = 1.0f / area;
+
+  for( i = 0 ; i < 3 ; i++ ){
+    int a = (i + 1) % 3, b = (i + 2) % 3;
+    tri->a[i] = -(y[b] - y[a]);
+    tri->b[i] = x[b] - x[a];
+    tri->c[i] = (y[b] - y[a]) * x[a] - (x[b] - x[a]) * y[a];
+    tri->topLeft[i] = is_top_left(x[a], y[a], x[b], y[b]);
+  }
+
+  minX = fminf(x[0], fminf(x[1], x[2]));
+  maxX = fmaxf(x[0], fmaxf(x[1], x[2]));
+  minY = fminf(y[0], fminf(y[1], y[2]));
+  maxY = fmaxf(y[0], fmaxf(y[1], y[2]));
+
+  tri->minX = minX < 0.0f ? 0 : (int)minX;
+  tri->minY = minY < 0.0f ? 0 : (int)minY;
+  tri->maxX = maxX >= fb->width ? fb->width - 1 : (int)maxX;
+  tri->maxY = maxY >= fb->height ? fb->height - 1 : (int)maxY;
+
+  return tri->minX <= tri->maxX && tri->minY <= tri->maxY;
+}
+
+static void process_triangles(int begin, int end, void *arg) {
+  draw_ctx_t *ctx = (draw_ctx_t*)arg;
+  clip_vertex_t poly[MAX_CLIPPED + 2];
+  int t, i, count, n;
+
+  for( t = begin ; t < end ; t++ ){
+    setup_triangle_t *out = &ctx->triangles[t * MAX_CLIPPED];
+
+    for( i = 0 ; i < 3 ; i++ )
+      run_vertex_shader(ctx, &ctx->vertices[t * 3 + i], &poly[i]);
+
+    count = clip_polygon(poly, 3);
+    n = 0;
+    for( i = 2 ; i < count ; i++ )
+      if( setup_triangle(ctx->fb, &poly[0], &poly[i - 1], &poly[i], &out[n]) )
+        n++;
+    ctx->numSetup[t] = n;
+  }
+}
+
+
+// Pixels of a quad are numbered 0 = (x, y), 1 = (x+1, y), 2 = (x, y+1),
+// 3 = (x+1, y+1). Quad values are evaluated for all four pixels, covered
+// or not, because the derivatives need them.
+typedef float quad_float_t[4];
+
+// Coarse derivatives, as most GPUs compute them: one value per quad
+static float ddx(const quad_float_t q) { return q[1] - q[0]; }
+static float ddy(const quad_float_t q) { return q[2] - q[0]; }
+
+// Returns the coverage mask of the quad at (x, y) and, if any pixel is
+// covered, the perspective correct varyings of all four pixels
+static int interpolate_quad(const setup_triangle_t *tri, int x, int y, quad_float_t *varyings) {
+  int mask, i, k;
+
+#ifdef __SSE2__
+  __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_setr_ps(0.5f, 1.5f, 0.5f, 1.5f));
+  __m128 py = _mm_add_ps(_mm_set1_ps((float)y), _mm_setr_ps(0.5f, 0.5f, 1.5f, 1.5f));
+  __m128 zero = _mm_setzero_ps();
+  __m128 e[3], inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  __m128 oneOverW, w;
+
+  for( i = 0 ; i < 3 ; i++ ){
+    __m128 in;
+    e[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri->a[i]), px),
+                                 _mm_mul_ps(_mm_set1_ps(tri->b[i]), py)), _mm_set1_ps(tri->c[i]));
+    in = _mm_cmpgt_ps(e[i], zero);
+    if( tri->topLeft[i] )
+      in = _mm_or_ps(in, _mm_cmpeq_ps(e[i], zero));
+    inside = _mm_and_ps(inside, in);
+  }
+
+  mask = _mm_movemask_ps(inside);
+  if( !mask )
+    return 0;
+
+  for( i = 0 ; i < 3 ; i++ )
+    e[i] = _mm_mul_ps(e[i], _mm_set1_ps(tri->invArea));
+
+  oneOverW = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], _mm_set1_ps(tri->invW[0])),
+                                   _mm_mul_ps(e[1], _mm_set1_ps(tri->invW[1]))),
+                        _mm_mul_ps(e[2], _mm_set1_ps(tri->invW[2])));
+  w = _mm_div_ps(_mm_set1_ps(1.0f), oneOverW);
+
+  for( k = 0 ; k < NUM_VARYINGS ; k++ ){
+    __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], _mm_set1_ps(tri->v[0][k])),
+                                     _mm_mul_ps(e[1], _mm_set1_ps(tri->v[1][k]))),
+                          _mm_mul_ps(e[2], _mm_set1_ps(tri->v[2][k])));
+    _mm_storeu_ps(varyings[k], _mm_mul_ps(v, w));
+  }
+#else
+  float e[3][4];
+  int p;
+
+  mask = 0;
+  for( p = 0 ; p < 4 ; p++ ){
+    float px = x + (p & 1) + 0.5f, py = y + (p >> 1) + 0.5f;
+    int in = 1;
+    for( i = 0 ; i < 3 ; i++ ){
+      e[i][p] = tri->a[i] * px + tri->b[i] * py + tri->c[i];
+      in &= e[i][p] > 0.0f || (e[i][p] == 0.0f && tri->topLeft[i]);
+    }
+    mask |= in << p;
+  }
+  if( !mask )
+    return 0;
+
+  for( p = 0 ; p < 4 ; p++ ){
+    float l0 = e[0][p] * tri->invArea, l1 = e[1][p] * tri->invArea, l2 = e[2][p] * tri->invArea;
+    float w = 1.0f / (l0 * tri->invW[0] + l1 * tri->invW[1] + l2 * tri->invW[2]);
+    for( k = 0 ; k < NUM_VARYINGS ; k++ )
+      varyings[k][p] = (l0 * tri->v[0][k] + l1 * tri->v[1][k] + l2 * tri->v[2][k]) * w;
+  }
+#endif
+
+  return mask;
+}
+
+
+// GL_REPEAT; texture sizes are nearly always powers of two
+static int wrap(int i, int size) {
+  if( (size & (size - 1)) == 0 )
+    return i & (size - 1);
+  i %= size;
+  return i < 0 ? i + size : i;
+}
+
+static int floor_int(float f) {
+  int i = (int)f;
+  return f < (float)i ? i - 1 : i;
+}
+
+static void load_texel(const unsigned char *t, int channels, float *rgba) {
+  rgba[0] = t[0];
+  rgba[1] = channels > 1 ? t[1] : 0.0f;
+  rgba[2] = channels > 2 ? t[2] : 0.0f;
+  rgba[3] = channels > 3 ? t[3] : 255.0f;
+}
+
+static void sample_bilinear(const mip_level_t *level, int channels, float s, float t, float *rgba) {
+  float x = s * level->width - 0.5f, y = t * level->height - 0.5f;
+  int xi = floor_int(x), yi = floor_int(y);
+  float fx = x - xi, fy = y - yi;
+  int x0 = wrap(xi, level->width), y0 = wrap(yi, level->height);
+  int x1 = x0 + 1 < level->width ? x0 + 1 : 0, y1 = y0 + 1 < level->height ? y0 + 1 : 0;
+  const unsigned char *row0 = level->data + (size_t)y0 * level->width * channels;
+  const unsigned char *row1 = level->data + (size_t)y1 * level->width * channels;
+  float t00[4], t10[4], t01[4], t11[4];
+
+  load_texel(row0 + x0 * channels, channels, t00);
+  load_texel(row0 + x1 * channels, channels, t10);
+  load_texel(row1 + x0 * channels, channels, t01);
+  load_texel(row1 + x1 * channels, channels, t11);
+
+#ifdef __SSE2__
+  {
+    __m128 a = _mm_loadu_ps(t00), b = _mm_loadu_ps(t10);
+    __m128 c = _mm_loadu_ps(t01), d = _mm_loadu_ps(t11);
+    __m128 wx = _mm_set1_ps(fx), wy = _mm_set1_ps(fy);
+    __m128 bottom = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), wx));
+    __m128 top = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), wx));
+    __m128 texel = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), wy));
+    _mm_storeu_ps(rgba, _mm_mul_ps(texel, _mm_set1_ps(1.0f / 255.0f)));
+  }
+#else
+  {
+    int i;
+    for( i = 0 ; i < 4 ; i++ ){
+      float bottom = t00[i] + (t10[i] - t00[i]) * fx;
+      float top = t01[i] + (t11[i] - t01[i]) * fx;
+      rgba[i] = (bottom + (top - bottom) * fy) * (1.0f / 255.0f);
+    }
+  }
+#endif
+}
+
+// The LOD of a texture for the spread of the quad's coordinates, like on
+// the GPU
+static float quad_lod(const mip_chain_t *tex, const quad_float_t s, const quad_float_t t) {
+  const mip_level_t *base = &tex->levels[0];
+  float dsdx = ddx(s) * base->width, dtdx = ddx(t) * base->height;
+  float dsdy = ddy(s) * base->width, dtdy = ddy(t) * base->height;
+  float rho2 = fmaxf(dsdx * dsdx + dtdx * dtdx, dsdy * dsdy + dtdy * dtdy);
+  return rho2 > 0.0f ? 0.5f * log2f(rho2) : 0.0f;
+}
+
+// texture2DGradARB() for a whole quad, with the LOD from quad_lod() of
+// other coordinates
+static void sample_quad_lod(const mip_chain_t *tex, const quad_float_t s, const quad_float_t t, float lambda,
+                            float rgba[4][4]) {
+  const mip_level_t *base = &tex->levels[0];
+  float maxLevel = (float)(tex->numLevels - 1);
+  int p, i;
+
+  if( lambda <= 0.0f || tex->numLevels == 1 ){
+    for( p = 0 ; p < 4 ; p++ )
+      sample_bilinear(base, tex->channels, s[p], t[p], rgba[p]);
+    return;
+  }
+
+  if( lambda > maxLevel )
+    lambda = maxLevel;
+
+  {
+    int level = (int)lambda;
+    float frac = lambda - level;
+    float fine[4], coarse[4];
+
+    for( p = 0 ; p < 4 ; p++ ){
+      sample_bilinear(&tex->levels[level], tex->channels, s[p], t[p], fine);
+      if( frac > 0.0f ){
+        sample_bilinear(&tex->levels[level + 1], tex->channels, s[p], t[p], coarse);
+        for( i = 0 ; i < 4 ; i++ )
+          fine[i] += (coarse[i] - fine[i]) * frac;
+      }
+      memcpy(rgba[p], fine, sizeof(fine));
+    }
+  }
+}
+
+// texture2D() for a whole quad
+static void sample_quad(const mip_chain_t *tex, const quad_float_t s, const quad_float_t t, float rgba[4][4]) {
+  sample_quad_lod(tex, s, t, quad_lod(tex, s, t), rgba);
+}
+
+static void normalize3(float *v) {
+  float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  if( len > 0.0f ){
+    v[0] /= len;
+    v[1] /= len;
+    v[2] /= len;
+  }
+}
+
+static float dot3(const float *a, const float *b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// calcNewTexCoords() applied to every pixel of the quad. The heights are
+// read at the LOD of the unshifted coordinates, as sampleHeightGrad() does.
+static void parallax_offset(const sr_material_t *material, quad_float_t s, quad_float_t t, const float ts[4][3],
+                            float lambda) {
+  const float surfaceThickness = 0.015f;
+  const float bias = surfaceThickness * -0.5f;
+  float height[4][4];
+  int p;
+
+  sample_quad_lod(material->displacementMap, s, t, lambda, height);
+  for( p = 0 ; p < 4 ; p++ ){
+    float heightSb = height[p][0] * surfaceThickness + bias;
+    s[p] += heightSb * ts[p][0];
+    t[p] += heightSb * ts[p][1];
+  }
+}
+
+// calcVertexTangentMatrix() of every pixel: the interpolated tangent and
+// handedness * cross(normal, tangent)
+static void vertex_tangent_frames(quad_float_t *varyings, const float normal[4][3],
+                                  float tangent[4][3], float cotangent[4][3]) {
+  int p, i;
+
+  for( p = 0 ; p < 4 ; p++ ){
+    const float *n = normal[p];
+    float w = varyings[VARY_T + 3][p];
+
+    for( i = 0 ; i < 3 ; i++ )
+      tangent[p][i] = varyings[VARY_T + i][p];
+    normalize3(tangent[p]);
+
+    cotangent[p][0] = w * (n[1] * tangent[p][2] - n[2] * tangent[p][1]);
+    cotangent[p][1] = w * (n[2] * tangent[p][0] - n[0] * tangent[p][2]);
+    cotangent[p][2] = w * (n[0] * tangent[p][1] - n[1] * tangent[p][0]);
+  }
+}
+
+// calcTangentMatrix(): one frame for the quad from the derivatives of
+// toCam = -vec2Camera and the texture coordinates
+static void derivative_tangent_frames(quad_float_t *varyings, float tangent[4][3], float cotangent[4][3]) {
+  float dpx[3], dpy[3], dtx[2], dty[2];
+  int p, i;
+
+  for( i = 0 ; i < 3 ; i++ ){
+    dpx[i] = -ddx(varyings[VARY_CAM + i]);
+    dpy[i] = -ddy(varyings[VARY_CAM + i]);
+  }
+  for( i = 0 ; i < 2 ; i++ ){
+    dtx[i] = ddx(varyings[VARY_TC + i]);
+    dty[i] = ddy(varyings[VARY_TC + i]);
+  }
+  for( i = 0 ; i < 3 ; i++ ){
+    tangent[0][i] = dpx[i] * dty[1] - dpy[i] * dtx[1];
+    cotangent[0][i] = -dpx[i] * dty[0] + dpy[i] * dtx[0];
+  }
+  normalize3(tangent[0]);
+  normalize3(cotangent[0]);
+
+  for( p = 1 ; p < 4 ; p++ ){
+    memcpy(tangent[p], tangent[0], sizeof(tangent[0]));
+    memcpy(cotangent[p], cotangent[0], sizeof(cotangent[0]));
+  }
+}
+
+static float smoothstep(float edge0, float edge1, float x) {
+  float t = (x - edge0) / (edge1 - edge0);
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  return t * t * (3.0f - 2.0f * t);
+}
+
+// calcParallaxWeight(): how much of the parallax to do, from the shift of
+// the deepest point on screen
+static float parallax_weight(const float *tsVec2Camera, float texCoordsPerPixel, const float *lodPixels) {
+  float view[3] = { tsVec2Camera[0], tsVec2Camera[1], tsVec2Camera[2] };
+  float shift;
+
+  normalize3(view);
+  shift = sqrtf(view[0] * view[0] + view[1] * view[1]) / fmaxf(view[2], 0.1f) * POM_DEPTH_SCALE;
+  return smoothstep(lodPixels[0], lodPixels[1], shift / fmaxf(texCoordsPerPixel, 1e-8f));
+}
+
+// parallaxmapping.frag for the four pixels of a quad
+static void shade_quad(const draw_ctx_t *ctx, quad_float_t *varyings, float color[4][4]) {
+  const sr_material_t *material = ctx->material;
+  static const float lightDir[3] = { -1.0f, 1.0f, 1.0f };
+  float tangent[4][3], cotangent[4][3];
+  float normal[4][3], tsVec2Camera[4][3];
+  float bump[4][4], diffuse[4][4];
+  quad_float_t s, t;
+  int p, i;
+
+  for( p = 0 ; p < 4 ; p++ ){
+    for( i = 0 ; i < 3 ; i++ )
+      normal[p][i] = varyings[VARY_N + i][p];
+    normalize3(normal[p]);
+  }
+
+  if( ctx->vertexTangents )
+    vertex_tangent_frames(varyings, normal, tangent, cotangent);
+  else
+    derivative_tangent_frames(varyings, tangent, cotangent);
+
+  for( p = 0 ; p < 4 ; p++ ){
+    float cam[3];
+    for( i = 0 ; i < 3 ; i++ )
+      cam[i] = varyings[VARY_CAM + i][p];
+
+    // TBNi * vec2Camera.xyz
+    tsVec2Camera[p][0] = dot3(tangent[p], cam);
+    tsVec2Camera[p][1] = dot3(cotangent[p], cam);
+    tsVec2Camera[p][2] = dot3(normal[p], cam);
+
+    s[p] = varyings[VARY_TC + 0][p];
+    t[p] = varyings[VARY_TC + 1][p];
+  }
+
+  {
+    // dFdx(tc) and dFdy(tc), before any shifting
+    float dsdx = ddx(s), dtdx = ddx(t), dsdy = ddy(s), dtdy = ddy(t);
+    float texCoordsPerPixel = fmaxf(sqrtf(dsdx * dsdx + dtdx * dtdx), sqrtf(dsdy * dsdy + dtdy * dtdy));
+    float lambda = quad_lod(material->displacementMap, s, t);
+    quad_float_t shiftedS, shiftedT;
+
+    memcpy(shiftedS, s, sizeof(s));
+    memcpy(shiftedT, t, sizeof(t));
+    for( i = 0 ; i < 4 ; i++ )
+      parallax_offset(material, shiftedS, shiftedT, tsVec2Camera, lambda);
+
+    // mix(tc, shiftedCoords, parallaxWeight)
+    for( p = 0 ; p < 4 ; p++ ){
+      float weight = ctx->parallaxLod ? parallax_weight(tsVec2Camera[p], texCoordsPerPixel, ctx->parallaxLodPixels) : 1.0f;
+      s[p] += (shiftedS[p] - s[p]) * weight;
+      t[p] += (shiftedT[p] - t[p]) * weight;
+    }
+  }
+
+  sample_quad(material->normalMap, s, t, bump);
+  sample_quad(material->diffuseMap, s, t, diffuse);
+
+  for( p = 0 ; p < 4 ; p++ ){
+    float b[3], n[3], NdotL;
+
+    for( i = 0 ; i < 3 ; i++ )
+      b[i] = 2.0f * bump[p][i] - 1.0f;
+
+    // normalize(TBNi * bump)
+    n[0] = dot3(tangent[p], b);
+    n[1] = dot3(cotangent[p], b);
+    n[2] = dot3(normal[p], b);
+    normalize3(n);
+
+    NdotL = fmaxf(dot3(n, lightDir), 0.0f);
+    for( i = 0 ; i < 4 ; i++ ){
+      float ambient = i < 3 ? 0.2f : 1.0f;
+      color[p][i] = NdotL * diffuse[p][i] * 0.8f + ambient * diffuse[p][i];
+    }
+  }
+}
+
+static void rasterize_tile(const draw_ctx_t *ctx, int tile, sr_stats_t *stats) {
+  sr_framebuffer_t *fb = ctx->fb;
+  int tileX = (tile % ctx->tilesX) * TILE_SIZE;
+  int tileY = (tile / ctx->tilesX) * TILE_SIZE;
+  quad_float_t varyings[NUM_VARYINGS];
+  float color[4][4];
+  int i, x, y, p;
+
+  for( i = ctx->binStart[tile] ; i < ctx->binStart[tile + 1] ; i++ ){
+    const setup_triangle_t *tri = &ctx->triangles[ctx->binTriangles[i]];
+    int x0 = tri->minX > tileX ? tri->minX : tileX;
+    int y0 = tri->minY > tileY ? tri->minY : tileY;
+    int x1 = tri->maxX < tileX + TILE_SIZE - 1 ? tri->maxX : tileX + TILE_SIZE - 1;
+    int y1 = tri->maxY < tileY + TILE_SIZE - 1 ? tri->maxY : tileY + TILE_SIZE - 1;
+
+    for( y = y0 & ~1 ; y <= y1 ; y += 2 ){
+      for( x = x0 & ~1 ; x <= x1 ; x += 2 ){
+        int mask = interpolate_quad(tri, x, y, varyings);
+        if( !mask )
+          continue;
+
+        shade_quad(ctx, varyings, color);
+        stats->quads++;
+
+        for( p = 0 ; p < 4 ; p++ ){
+          int px = x + (p & 1), py = y + (p >> 1);
+          unsigned char *dst;
+
+          if( !(mask & (1 << p)) || px >= fb->width || py >= fb->height )
+            continue;
+
+          dst = fb->color + ((size_t)py * fb->width + px) * 4;
+          dst[0] = to_unorm8(color[p][0]);
+          dst[1] = to_unorm8(color[p][1]);
+          dst[2] = to_unorm8(color[p][2]);
+          dst[3] = to_unorm8(color[p][3]);
+          stats->fragments++;
+        }
+      }
+    }
+  }
+}
+
+static void rasterize_tiles(int begin, int end, void *arg) {
+  draw_ctx_t *ctx = (draw_ctx_t*)arg;
+  int tile;
+
+  for( tile = begin ; tile < end ; tile++ )
+    rasterize_tile(ctx, tile, &ctx->tileStats[tile]);
+}
+
+// Sorts the set up triangles into per-tile lists, keeping submission order
+static void bin_triangles(draw_ctx_t *ctx, int numTriangles) {
+  int numTiles = ctx->tilesX * ctx->tilesY;
+  int *fill, pass, t, k, tx, ty;
+
+  ctx->binStart = (int*)calloc(numTiles + 1, sizeof(int));
+  fill = (int*)calloc(numTiles, sizeof(int));
+
+  // The first pass counts, the second fills
+  for( pass = 0 ; pass < 2 ; pass++ ){
+    for( t = 0 ; t < numTriangles ; t++ ){
+      for( k = 0 ; k < ctx->numSetup[t] ; k++ ){
+        int index = t * MAX_CLIPPED + k;
+        const setup_triangle_t *tri = &ctx->triangles[index];
+
+        for( ty = tri->minY / TILE_SIZE ; ty <= tri->maxY / TILE_SIZE ; ty++ ){
+          for( tx = tri->minX / TILE_SIZE ; tx <= tri->maxX / TILE_SIZE ; tx++ ){
+            int tile = ty * ctx->tilesX + tx;
+            if( pass == 0 )
+              ctx->binStart[tile + 1]++;
+            else
+              ctx->binTriangles[ctx->binStart[tile] + fill[tile]++] = index;
+          }
+        }
+      }
+    }
+
+    if( pass == 0 ){
+      for( t = 0 ; t < numTiles ; t++ )
+        ctx->binStart[t + 1] += ctx->binStart[t];
+      ctx->binTriangles = (int*)malloc(sizeof(int) * (ctx->binStart[numTiles] + 1));
+    }
+  }
+
+  free(fill);
+}
+
+void sr_draw(sr_framebuffer_t *fb, const sr_vertex_t *vertices, int count,
+             const sr_material_t *material, const sr_uniforms_t *uniforms,
+             thread_pool_t *pool, sr_stats_t *stats) {
+  draw_ctx_t ctx;
+  int numTriangles = count / 3, numTiles, t;
+
+  if( numTriangles <= 0 || fb->width <= 0 || fb->height <= 0 )
+    return;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.fb = fb;
+  ctx.vertices = vertices;
+  ctx.material = material;
+  ctx.vertexTangents = uniforms->vertexTangents;
+  ctx.parallaxLod = uniforms->parallaxLod;
+  memcpy(ctx.parallaxLodPixels, uniforms->parallaxLodPixels, sizeof(ctx.parallaxLodPixels));
+  vs_model_view(ctx.modelView, uniforms->time, uniforms->loopDuration);
+  memcpy(ctx.perspective, uniforms->perspectiveMatrix, sizeof(ctx.perspective));
+
+  ctx.triangles = (setup_triangle_t*)malloc(sizeof(setup_triangle_t) * numTriangles * MAX_CLIPPED);
+  ctx.numSetup = (int*)malloc(sizeof(int) * numTriangles);
+  parallel_for(pool, numTriangles, TRIANGLES_PER_TASK, process_triangles, &ctx);
+
+  ctx.tilesX = (fb->width + TILE_SIZE - 1) / TILE_SIZE;
+  ctx.tilesY = (fb->height + TILE_SIZE - 1) / TILE_SIZE;
+  numTiles = ctx.tilesX * ctx.tilesY;
+  bin_triangles(&ctx, numTriangles);
+
+  ctx.tileStats = (sr_stats_t*)calloc(numTiles, sizeof(sr_stats_t));
+  parallel_for(pool, numTiles, 1, rasterize_tiles, &ctx);
+
+  if( stats ){
+    stats->triangles += numTriangles;
+    for( t = 0 ; t < numTriangles ; t++ )
+      stats->rasterized += ctx.numSetup[t];
+    for( t = 0 ; t < numTiles ; t++ ){
+      stats->quads += ctx.tileStats[t].quads;
+      stats->fragments += ctx.tileStats[t].fragments;
+    }
+  }
+
+  free(ctx.tileStats);
+  free(ctx.binTriangles);
+  free(ctx.binStart);
+  free(ctx.numSetup);
+  free(ctx.triangles);
+}
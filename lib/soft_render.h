@@ -0,0 +1,77 @@
+
+#ifndef _SOFT_RENDER_
+#define _SOFT_RENDER_
+
+#include "thread_pool.h"
+#include "mipmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // A CPU implementation of the demo's pipeline: vs.vert followed by
+  // parallaxmapping.frag in offset mode with separate RGB normal and
+  // displacement maps. The tangent frame and the parallax LOD fade follow
+  // sr_uniforms_t; with the demo's defaults for both a frame matches the
+  // demo's own. Used to render golden images and to benchmark
+  // fragment throughput on machines without a GPU.
+  //
+  // The screen is split into tiles that are rasterized in parallel. Pixels
+  // are shaded in 2x2 quads like on a GPU, so dFdx/dFdy and the texture LOD
+  // come from the neighbouring pixels of the quad. There is no depth test,
+  // matching the demo; triangles are drawn in submission order.
+
+  typedef struct {
+    float position[4];
+    float texCoord[2];
+    float normal[3];
+    float tangent[4];     // w is the handedness, see lib/tangent_space.h
+  } sr_vertex_t;
+
+  // Textures are sampled with GL_LINEAR_MIPMAP_LINEAR and GL_REPEAT.
+  // A chain with one level is sampled bilinearly.
+  typedef struct {
+    const mip_chain_t *diffuseMap;
+    const mip_chain_t *normalMap;
+    const mip_chain_t *displacementMap;
+  } sr_material_t;
+
+  typedef struct {
+    float time;
+    float loopDuration;
+    float perspectiveMatrix[16];  // Row-major, see sr_perspective()
+    int vertexTangents;           // The demo's default; 0 rebuilds the frame from derivatives (-derivativetbn)
+    int parallaxLod;              // Fade the parallax out by its shift on screen; 0 is -nolod
+    float parallaxLodPixels[2];   // Where it fades, as the demo's quality tier has it
+  } sr_uniforms_t;
+
+  // RGBA8 pixels, bottom row first like glReadPixels
+  typedef struct {
+    int width, height;
+    unsigned char *color;
+  } sr_framebuffer_t;
+
+  typedef struct {
+    long long triangles;    // Submitted
+    long long rasterized;   // Left after clipping and culling
+    long long quads;        // 2x2 quads shaded, helper pixels included
+    long long fragments;    // Pixels written
+  } sr_stats_t;
+
+  int sr_framebuffer_init(sr_framebuffer_t *fb, int width, int height);
+  void sr_framebuffer_free(sr_framebuffer_t *fb);
+  void sr_clear(sr_framebuffer_t *fb, float r, float g, float b, float a);
+
+  // mat4_perspective() of lib/mat4.h, transposed
+  void sr_perspective(float *mat, float fovDeg, float aspect, float zNear, float zFar);
+
+  // Draws a triangle list. Tiles are spread over the pool (NULL runs
+  // serially). 'stats' may be NULL; counts are added to it.
+  void sr_draw(sr_framebuffer_t *fb, const sr_vertex_t *vertices, int count,
+               const sr_material_t *material, const sr_uniforms_t *uniforms,
+               thread_pool_t *pool, sr_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
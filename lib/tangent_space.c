@@ -0,0 +1,188 @@
+#include "tangent_space.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define TRIANGLE_GRAIN 4096
+#define VERTEX_GRAIN   4096
+
+// Which handedness a vertex's triangles have
+#define SIDE_POSITIVE 1
+#define SIDE_NEGATIVE 2
+
+typedef struct {
+  mesh_vertex_t *vertices;
+  const unsigned int *indices;
+  size_t numTriangles;
+  float *triangleTangents;        // 3 per triangle, not normalized
+  signed char *triangleSigns;     // +1, -1, or 0 without texture space area
+  const unsigned int *offsets;    // Corners of every vertex, in one array
+  const unsigned int *corners;
+  float *negativeTangents;        // 3 per vertex, for the split copies
+  unsigned char *sides;
+} tangent_job_t;
+
+static float dot3(const float a[3], const float b[3]) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// v minus its component along the unit vector n, normalized. Returns 0
+// when nothing is left.
+static int project_normalize(const float v[3], const float n[3], float out[3]) {
+  float d = dot3(v, n), length;
+  int i;
+
+  for( i = 0 ; i < 3 ; i++ )
+    out[i] = v[i] - n[i] * d;
+  length = sqrtf(dot3(out, out));
+  if( !(length > 1e-20f) )
+    return 0;
+  for( i = 0 ; i < 3 ; i++ )
+    out[i] /= length;
+  return 1;
+}
+
+static void triangle_tangents(int begin, int end, void *arg) {
+  tangent_job_t *job = (tangent_job_t*)arg;
+  int t, i;
+
+  for( t = begin ; t < end ; t++ ){
+    const mesh_vertex_t *v0 = &job->vertices[job->indices[t * 3]];
+    const mesh_vertex_t *v1 = &job->vertices[job->indices[t * 3 + 1]];
+    const mesh_vertex_t *v2 = &job->vertices[job->indices[t * 3 + 2]];
+    float *tangent = job->triangleTangents + (size_t)t * 3;
+    float s1 = v1->texCoord[0] - v0->texCoord[0], t1 = v1->texCoord[1] - v0->texCoord[1];
+    float s2 = v2->texCoord[0] - v0->texCoord[0], t2 = v2->texCoord[1] - v0->texCoord[1];
+    float area = s1 * t2 - t1 * s2;
+    int sign = area > 0.0f ? 1 : area < 0.0f ? -1 : 0;
+
+    // dP/du up to the positive factor 1 / |area|
+    for( i = 0 ; i < 3 ; i++ ){
+      float d1 = v1->position[i] - v0->position[i];
+      float d2 = v2->position[i] - v0->position[i];
+      tangent[i] = (t2 * d1 - t1 * d2) * sign;
+    }
+    job->triangleSigns[t] = (signed char)sign;
+  }
+}
+
+// The angle weighted average over the vertex's triangles, one for each
+// handedness. The positive one (or the only one) goes into the vertex.
+static void vertex_tangents(int begin, int end, void *arg) {
+  tangent_job_t *job = (tangent_job_t*)arg;
+  int v, i;
+
+  for( v = begin ; v < end ; v++ ){
+    mesh_vertex_t *vertex = &job->vertices[v];
+    float sum[2][3] = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+    unsigned char sides = 0;
+    unsigned int k;
+
+    for( k = job->offsets[v] ; k < job->offsets[v + 1] ; k++ ){
+      unsigned int corner = job->corners[k], triangle = corner / 3, c = corner % 3;
+      const float *p = vertex->position;
+      const float *next = job->vertices[job->indices[triangle * 3 + (c + 1) % 3]].position;
+      const float *prev = job->vertices[job->indices[triangle * 3 + (c + 2) % 3]].position;
+      int sign = job->triangleSigns[triangle], side;
+      float tangent[3], e1[3], e2[3], d1[3], d2[3], cosine, angle;
+
+      if( sign == 0 || !project_normalize(job->triangleTangents + (size_t)triangle * 3, vertex->normal, tangent) )
+        continue;
+
+      // The corner angle, measured in the tangent plane
+      for( i = 0 ; i < 3 ; i++ ){
+        d1[i] = next[i] - p[i];
+        d2[i] = prev[i] - p[i];
+      }
+      if( !project_normalize(d1, vertex->normal, e1) || !project_normalize(d2, vertex->normal, e2) )
+        continue;
+      cosine = dot3(e1, e2);
+      angle = acosf(cosine > 1.0f ? 1.0f : cosine < -1.0f ? -1.0f : cosine);
+
+      side = sign > 0 ? 0 : 1;
+      sides |= sign > 0 ? SIDE_POSITIVE : SIDE_NEGATIVE;
+      for( i = 0 ; i < 3 ; i++ )
+        sum[side][i] += tangent[i] * angle;
+    }
+
+    for( i = 0 ; i < 2 ; i++ ){
+      // Any direction in the tangent plane will do without a usable triangle
+      if( !project_normalize(sum[i], vertex->normal, sum[i]) ){
+        static const float axes[2][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+        if( !project_normalize(axes[0], vertex->normal, sum[i]) )
+          project_normalize(axes[1], vertex->normal, sum[i]);
+      }
+    }
+
+    if( sides == SIDE_NEGATIVE ){
+      memcpy(vertex->tangent, sum[1], sizeof(sum[1]));
+      vertex->tangent[3] = -1.0f;
+    }
+    else {
+      memcpy(vertex->tangent, sum[0], sizeof(sum[0]));
+      vertex->tangent[3] = 1.0f;
+    }
+    memcpy(job->negativeTangents + (size_t)v * 3, sum[1], sizeof(sum[1]));
+    job->sides[v] = sides;
+  }
+}
+
+size_t tangent_space_generate(mesh_vertex_t *vertices, size_t numVertices,
+                              unsigned int *indices, size_t numIndices, thread_pool_t *pool) {
+  tangent_job_t job;
+  size_t numTriangles = numIndices / 3, count = numVertices, i, v;
+  unsigned int *offsets = (unsigned int*)calloc(numVertices + 1, sizeof(unsigned int));
+  unsigned int *corners = (unsigned int*)malloc(sizeof(unsigned int) * (numTriangles * 3 + 1));
+  unsigned int *filled = (unsigned int*)calloc(numVertices, sizeof(unsigned int));
+
+  job.vertices = vertices;
+  job.indices = indices;
+  job.numTriangles = numTriangles;
+  job.triangleTangents = (float*)malloc(sizeof(float) * 3 * (numTriangles + 1));
+  job.triangleSigns = (signed char*)malloc(numTriangles + 1);
+  job.negativeTangents = (float*)malloc(sizeof(float) * 3 * (numVertices + 1));
+  job.sides = (unsigned char*)malloc(numVertices + 1);
+  job.offsets = offsets;
+  job.corners = corners;
+
+  parallel_for(pool, (int)numTriangles, TRIANGLE_GRAIN, triangle_tangents, &job);
+
+  // The corners of every vertex, in one array
+  for( i = 0 ; i < numTriangles * 3 ; i++ )
+    offsets[indices[i] + 1]++;
+  for( v = 0 ; v < numVertices ; v++ )
+    offsets[v + 1] += offsets[v];
+  for( i = 0 ; i < numTriangles * 3 ; i++ )
+    corners[offsets[indices[i]] + filled[indices[i]]++] = (unsigned int)i;
+
+  parallel_for(pool, (int)numVertices, VERTEX_GRAIN, vertex_tangents, &job);
+
+  // Mirrored triangles get their own copy of the vertices they share with
+  // the others. Seams are a small part of a mesh, so this stays serial.
+  for( v = 0 ; v < numVertices ; v++ ){
+    mesh_vertex_t *copy;
+    unsigned int k;
+
+    if( job.sides[v] != (SIDE_POSITIVE | SIDE_NEGATIVE) )
+      continue;
+
+    copy = &vertices[count];
+    *copy = vertices[v];
+    memcpy(copy->tangent, job.negativeTangents + v * 3, sizeof(float) * 3);
+    copy->tangent[3] = -1.0f;
+
+    for( k = offsets[v] ; k < offsets[v + 1] ; k++ )
+      if( job.triangleSigns[corners[k] / 3] < 0 )
+        indices[corners[k]] = (unsigned int)count;
+    count++;
+  }
+
+  free(offsets);
+  free(corners);
+  free(filled);
+  free(job.triangleTangents);
+  free(job.triangleSigns);
+  free(job.negativeTangents);
+  free(job.sides);
+  return count;
+}
@@ -0,0 +1,34 @@
+
+#ifndef _TANGENT_SPACE_
+#define _TANGENT_SPACE_
+
+#include <stddef.h>
+#include "vertex_format.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Per-vertex tangent frames for indexed triangle lists, generated the
+  // way MikkTSpace does so that normal maps baked against it line up:
+  //  - a triangle's tangent points along increasing u, its handedness is
+  //    the sign of its texture space area
+  //  - at every vertex the tangents of its triangles are projected onto
+  //    the vertex normal and averaged, weighted by the corner angle
+  //  - triangles of opposite handedness (mirrored texture coordinates)
+  //    are never averaged together
+  // The shader rebuilds the bitangent as w * cross(normal, tangent) from
+  // the interpolated, unnormalized vectors.
+  //
+  // Fills in mesh_vertex_t::tangent. A vertex shared by triangles of both
+  // handedness is split: the copy is appended and the mirrored triangles'
+  // indices changed to it. 'vertices' needs room for 2 * numVertices.
+  // Returns the new vertex count.
+  size_t tangent_space_generate(mesh_vertex_t *vertices, size_t numVertices,
+                                unsigned int *indices, size_t numIndices, thread_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,97 @@
+
+#include "texture_loader.h"
+#include "timer.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct {
+  texture_batch_t *batch;
+  int index;
+} texture_task_t;
+
+struct texture_batch {
+  pthread_mutex_t lock;
+  pthread_cond_t decoded;
+
+  texture_load_t *loads;
+  texture_task_t *tasks;
+  int count;
+
+  int *ready;       // Indices of decoded loads in completion order
+  int numReady;
+  int numHandedOut;
+};
+
+static void decode_task(void *arg) {
+  texture_task_t *task = (texture_task_t*)arg;
+  texture_batch_t *batch = task->batch;
+  texture_load_t *load = &batch->loads[task->index];
+  double start = timer_now_ms();
+
+  load->image = load->gray16 ? read_image_gray16((char*)load->fileName) : read_image((char*)load->fileName);
+  load->decodeMs = timer_now_ms() - start;
+
+  if( load->image && load->process ){
+    start = timer_now_ms();
+    load->process(load);
+    load->processMs = timer_now_ms() - start;
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  batch->ready[batch->numReady++] = task->index;
+  pthread_cond_signal(&batch->decoded);
+  pthread_mutex_unlock(&batch->lock);
+}
+
+texture_batch_t *texture_batch_begin(thread_pool_t *pool, texture_load_t *loads, int count) {
+  texture_batch_t *batch;
+  int i;
+
+  batch = (texture_batch_t*)calloc(1, sizeof(texture_batch_t));
+  pthread_mutex_init(&batch->lock, NULL);
+  pthread_cond_init(&batch->decoded, NULL);
+  batch->loads = loads;
+  batch->count = count;
+  batch->ready = (int*)malloc(sizeof(int) * (count > 0 ? count : 1));
+  batch->tasks = (texture_task_t*)malloc(sizeof(texture_task_t) * (count > 0 ? count : 1));
+
+  for( i = 0 ; i < count ; i++ ){
+    loads[i].image = NULL;
+    loads[i].decodeMs = 0.0;
+    loads[i].processMs = 0.0;
+    batch->tasks[i].batch = batch;
+    batch->tasks[i].index = i;
+    thread_pool_submit(pool, decode_task, &batch->tasks[i]);
+  }
+
+  return batch;
+}
+
+texture_load_t *texture_batch_next(texture_batch_t *batch) {
+  texture_load_t *load;
+
+  pthread_mutex_lock(&batch->lock);
+  if( batch->numHandedOut == batch->count ){
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+  }
+  while( batch->numReady == batch->numHandedOut )
+    pthread_cond_wait(&batch->decoded, &batch->lock);
+  load = &batch->loads[batch->ready[batch->numHandedOut++]];
+  pthread_mutex_unlock(&batch->lock);
+
+  return load;
+}
+
+void texture_batch_end(texture_batch_t *batch) {
+  pthread_mutex_lock(&batch->lock);
+  while( batch->numReady < batch->count )
+    pthread_cond_wait(&batch->decoded, &batch->lock);
+  pthread_mutex_unlock(&batch->lock);
+
+  pthread_cond_destroy(&batch->decoded);
+  pthread_mutex_destroy(&batch->lock);
+  free(batch->tasks);
+  free(batch->ready);
+  free(batch);
+}
@@ -0,0 +1,42 @@
+
+#ifndef _TEXTURE_LOADER_
+#define _TEXTURE_LOADER_
+
+#include "image_decoder.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct texture_load texture_load_t;
+
+  // Runs on the worker right after a successful decode
+  typedef void (*texture_process_fn)(texture_load_t *load);
+
+  struct texture_load {
+    const char *fileName;
+    int gray16;                   // Decode with read_image_gray16(), e.g. for 16-bit heights
+    texture_process_fn process;   // Optional
+    void *userData;               // For use by 'process'
+    png_data_t *image;    // NULL if decoding failed
+    double decodeMs;      // Time spent in the decoder for this file
+    double processMs;     // Time spent in 'process'
+  };
+
+  typedef struct texture_batch texture_batch_t;
+
+  // Start decoding all files on the pool. Returns immediately.
+  texture_batch_t *texture_batch_begin(thread_pool_t *pool, texture_load_t *loads, int count);
+
+  // Block until the next file has been decoded and return it, in completion
+  // order. Returns NULL once every load has been handed out.
+  texture_load_t *texture_batch_next(texture_batch_t *batch);
+
+  // Wait for outstanding decodes and release the batch (not the images)
+  void texture_batch_end(texture_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
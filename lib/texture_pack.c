@@ -0,0 +1,197 @@
+
+#include "texture_pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_LEVEL_SIZE (1u << (MIP_MAX_LEVELS - 1))
+
+int texpack_format_channels(uint32_t format) {
+  switch( format ){
+  case TEXPACK_FORMAT_R8:    return 1;
+  case TEXPACK_FORMAT_RG8:   return 2;
+  case TEXPACK_FORMAT_RGB8:  return 3;
+  case TEXPACK_FORMAT_RGBA8: return 4;
+  case TEXPACK_FORMAT_BC1:   return 3;
+  case TEXPACK_FORMAT_BC4:   return 1;
+  case TEXPACK_FORMAT_BC5:   return 2;
+  }
+  return 0;
+}
+
+int texpack_format_is_compressed(uint32_t format) {
+  return format == TEXPACK_FORMAT_BC1 || format == TEXPACK_FORMAT_BC4 || format == TEXPACK_FORMAT_BC5;
+}
+
+uint64_t texpack_level_size(uint32_t format, uint32_t width, uint32_t height) {
+  uint64_t blocks = (((uint64_t)width + 3) / 4) * (((uint64_t)height + 3) / 4);
+
+  switch( format ){
+  case TEXPACK_FORMAT_BC1:
+  case TEXPACK_FORMAT_BC4:
+    return blocks * 8;
+  case TEXPACK_FORMAT_BC5:
+    return blocks * 16;
+  }
+  return (uint64_t)width * height * texpack_format_channels(format);
+}
+
+static uint64_t align_up(uint64_t value) {
+  return (value + TEXPACK_ALIGNMENT - 1) & ~(uint64_t)(TEXPACK_ALIGNMENT - 1);
+}
+
+int texpack_write(const char *filename, const texpack_source_t *sources, int count) {
+  texpack_header_t header;
+  static const unsigned char padding[TEXPACK_ALIGNMENT] = { 0 };
+  uint64_t offset;
+  FILE *fp;
+  int i, l;
+
+  if( count > TEXPACK_MAX_ENTRIES ){
+    fprintf( stderr, "A texture pack holds at most %d maps, got %d.\n", TEXPACK_MAX_ENTRIES, count );
+    return 0;
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.magic = TEXPACK_MAGIC;
+  header.version = TEXPACK_VERSION;
+  header.numEntries = count;
+
+  // Lay out every level after the header
+  offset = align_up(sizeof(header));
+  for( i = 0 ; i < count ; i++ ){
+    const mip_chain_t *chain = sources[i].chain;
+    texpack_entry_t *entry = &header.entries[i];
+
+    entry->mapType = sources[i].mapType;
+    entry->format = sources[i].format;
+    entry->numLevels = chain->numLevels;
+
+    for( l = 0 ; l < chain->numLevels ; l++ ){
+      entry->levels[l].width = chain->levels[l].width;
+      entry->levels[l].height = chain->levels[l].height;
+      entry->levels[l].size = texpack_level_size(entry->format, entry->levels[l].width, entry->levels[l].height);
+      entry->levels[l].offset = offset;
+      offset = align_up(offset + entry->levels[l].size);
+    }
+  }
+
+  fp = fopen(filename, "wb");
+  if( !fp ){
+    fprintf( stderr, "Can't open texture pack '%s' for writing.\n", filename );
+    return 0;
+  }
+
+  fwrite(&header, sizeof(header), 1, fp);
+  fwrite(padding, 1, align_up(sizeof(header)) - sizeof(header), fp);
+
+  for( i = 0 ; i < count ; i++ ){
+    const texpack_entry_t *entry = &header.entries[i];
+    for( l = 0 ; l < (int)entry->numLevels ; l++ ){
+      fwrite(sources[i].chain->levels[l].data, 1, entry->levels[l].size, fp);
+      fwrite(padding, 1, align_up(entry->levels[l].size) - entry->levels[l].size, fp);
+    }
+  }
+
+  if( ferror(fp) ){
+    fprintf( stderr, "Error while writing texture pack '%s'.\n", filename );
+    fclose(fp);
+    return 0;
+  }
+
+  fclose(fp);
+  return 1;
+}
+
+texpack_t *texpack_open(const char *filename) {
+  const texpack_header_t *header;
+  texpack_t *pack;
+  struct stat st;
+  void *data;
+  uint32_t i, l;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if( fd < 0 )
+    return NULL;
+
+  if( fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(texpack_header_t) ){
+    fprintf( stderr, "Texture pack '%s' is truncated.\n", filename );
+    close(fd);
+    return NULL;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( data == MAP_FAILED ){
+    fprintf( stderr, "Can't map texture pack '%s'.\n", filename );
+    return NULL;
+  }
+
+  header = (const texpack_header_t*)data;
+  if( header->magic != TEXPACK_MAGIC || header->version != TEXPACK_VERSION ||
+      header->numEntries > TEXPACK_MAX_ENTRIES ){
+    fprintf( stderr, "'%s' is not a version %d texture pack.\n", filename, TEXPACK_VERSION );
+    munmap(data, st.st_size);
+    return NULL;
+  }
+
+  for( i = 0 ; i < header->numEntries ; i++ ){
+    const texpack_entry_t *entry = &header->entries[i];
+    if( entry->mapType >= TEXPACK_MAP_COUNT || entry->format >= TEXPACK_FORMAT_COUNT ||
+        entry->numLevels == 0 || entry->numLevels > MIP_MAX_LEVELS ){
+      fprintf( stderr, "Texture pack '%s' has a bad map entry.\n", filename );
+      munmap(data, st.st_size);
+      return NULL;
+    }
+    for( l = 0 ; l < entry->numLevels ; l++ ){
+      const texpack_level_t *level = &entry->levels[l];
+      // A chain of MIP_MAX_LEVELS starts at most this large, which also
+      // keeps the expected size from overflowing
+      if( level->width == 0 || level->height == 0 || level->width > MAX_LEVEL_SIZE || level->height > MAX_LEVEL_SIZE ||
+          level->size != texpack_level_size(entry->format, level->width, level->height) ){
+        fprintf( stderr, "Texture pack '%s' has a level of the wrong size.\n", filename );
+        munmap(data, st.st_size);
+        return NULL;
+      }
+      // Subtract rather than add, the sum could wrap around
+      if( level->offset > (uint64_t)st.st_size || level->size > (uint64_t)st.st_size - level->offset ){
+        fprintf( stderr, "Texture pack '%s' is truncated.\n", filename );
+        munmap(data, st.st_size);
+        return NULL;
+      }
+    }
+  }
+
+  // We are about to touch all of it
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  pack = (texpack_t*)malloc(sizeof(texpack_t));
+  pack->header = header;
+  pack->data = (const unsigned char*)data;
+  pack->size = st.st_size;
+  return pack;
+}
+
+void texpack_close(texpack_t *pack) {
+  if( !pack )
+    return;
+  munmap((void*)pack->data, pack->size);
+  free(pack);
+}
+
+const texpack_entry_t *texpack_find(const texpack_t *pack, uint32_t mapType) {
+  uint32_t i;
+  for( i = 0 ; i < pack->header->numEntries ; i++ )
+    if( pack->header->entries[i].mapType == mapType )
+      return &pack->header->entries[i];
+  return NULL;
+}
+
+const void *texpack_level_data(const texpack_t *pack, const texpack_entry_t *entry, int level) {
+  return pack->data + entry->levels[level].offset;
+}
@@ -0,0 +1,100 @@
+
+#ifndef _TEXTURE_PACK_
+#define _TEXTURE_PACK_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mipmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // A baked material: one file with a fixed-size header followed by the
+  // pixel data of every map and mip level, each laid out exactly as
+  // glTexImage2D expects it (bottom row first, tightly packed rows).
+
+#define TEXPACK_MAGIC       0x4B505854  // "TXPK"
+// Bumped whenever a map type or format is added, so older readers
+// refuse packs they can't make sense of. 2: RG8, BC1/4/5 and the
+// DISPLACEMENT_MAX, NORMAL_HEIGHT and CONE maps.
+#define TEXPACK_VERSION     2
+#define TEXPACK_MAX_ENTRIES 8
+#define TEXPACK_ALIGNMENT   16
+
+  enum {
+    TEXPACK_MAP_DIFFUSE = 0,
+    TEXPACK_MAP_NORMAL,
+    TEXPACK_MAP_DISPLACEMENT,
+    TEXPACK_MAP_DISPLACEMENT_MAX, // Same as DISPLACEMENT, mips hold the maximum
+    TEXPACK_MAP_NORMAL_HEIGHT,    // Normal in RGB, displacement in A
+    TEXPACK_MAP_CONE,             // Cone ratios of DISPLACEMENT, one level (lib/cone_map.h)
+    TEXPACK_MAP_COUNT
+  };
+
+  enum {
+    TEXPACK_FORMAT_R8 = 0,
+    TEXPACK_FORMAT_RG8,
+    TEXPACK_FORMAT_RGB8,
+    TEXPACK_FORMAT_RGBA8,
+    TEXPACK_FORMAT_BC1,     // See lib/bc_encode.h
+    TEXPACK_FORMAT_BC4,
+    TEXPACK_FORMAT_BC5,
+    TEXPACK_FORMAT_COUNT
+  };
+
+  typedef struct {
+    uint64_t offset;    // From the start of the file
+    uint64_t size;      // In bytes
+    uint32_t width, height;
+  } texpack_level_t;
+
+  typedef struct {
+    uint32_t mapType;
+    uint32_t format;
+    uint32_t numLevels;
+    uint32_t reserved;
+    texpack_level_t levels[MIP_MAX_LEVELS];
+  } texpack_entry_t;
+
+  typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t reserved;
+    texpack_entry_t entries[TEXPACK_MAX_ENTRIES];
+  } texpack_header_t;
+
+  typedef struct {
+    const texpack_header_t *header;
+    const unsigned char *data;    // The whole mapped file
+    size_t size;
+  } texpack_t;
+
+  // Input to the writer: one mip chain per map. For the block compressed
+  // formats the levels hold the encoded blocks.
+  typedef struct {
+    uint32_t mapType;
+    uint32_t format;
+    const mip_chain_t *chain;
+  } texpack_source_t;
+
+  int texpack_write(const char *filename, const texpack_source_t *sources, int count);
+
+  // Maps the file read-only. Returns NULL if it is missing or malformed:
+  // another version, an unknown map type or format, or a level whose size
+  // doesn't match its format and dimensions or that runs past the end.
+  texpack_t *texpack_open(const char *filename);
+  void texpack_close(texpack_t *pack);
+
+  const texpack_entry_t *texpack_find(const texpack_t *pack, uint32_t mapType);
+  const void *texpack_level_data(const texpack_t *pack, const texpack_entry_t *entry, int level);
+
+  int texpack_format_channels(uint32_t format);
+  int texpack_format_is_compressed(uint32_t format);
+  uint64_t texpack_level_size(uint32_t format, uint32_t width, uint32_t height);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
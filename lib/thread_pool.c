@@ -0,0 +1,245 @@
+
+#include "thread_pool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct thread_task {
+  thread_task_fn fn;
+  void *arg;
+  struct thread_task *next;
+} thread_task_t;
+
+struct thread_pool {
+  pthread_t *threads;
+  int numThreads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t taskAvailable;
+  pthread_cond_t allDone;
+
+  thread_task_t *head, *tail;
+  int pending;    // Queued + running tasks
+  int shutdown;
+};
+
+static void *worker_main(void *arg) {
+  thread_pool_t *pool = (thread_pool_t*)arg;
+  thread_task_t *task;
+
+  for(;;){
+    pthread_mutex_lock(&pool->lock);
+    while( pool->head == NULL && !pool->shutdown )
+      pthread_cond_wait(&pool->taskAvailable, &pool->lock);
+
+    if( pool->head == NULL && pool->shutdown ){
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+
+    task = pool->head;
+    pool->head = task->next;
+    if( pool->head == NULL )
+      pool->tail = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    task->fn(task->arg);
+    free(task);
+
+    pthread_mutex_lock(&pool->lock);
+    if( --pool->pending == 0 )
+      pthread_cond_broadcast(&pool->allDone);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+int thread_count_cores(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+thread_pool_t *thread_pool_create(int numThreads) {
+  thread_pool_t *pool;
+  int i;
+
+  if( numThreads <= 0 )
+    numThreads = thread_count_cores();
+
+  pool = (thread_pool_t*)calloc(1, sizeof(thread_pool_t));
+  pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * numThreads);
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->taskAvailable, NULL);
+  pthread_cond_init(&pool->allDone, NULL);
+
+  for( i = 0 ; i < numThreads ; i++ ){
+    if( pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0 ){
+      fprintf( stderr, "Can't create worker thread %d, continuing with %d.\n", i, i );
+      break;
+    }
+  }
+  pool->numThreads = i;
+
+  return pool;
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+  int i;
+
+  if( !pool )
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->taskAvailable);
+  pthread_mutex_unlock(&pool->lock);
+
+  for( i = 0 ; i < pool->numThreads ; i++ )
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->allDone);
+  pthread_cond_destroy(&pool->taskAvailable);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->threads);
+  free(pool);
+}
+
+void thread_pool_submit(thread_pool_t *pool, thread_task_fn fn, void *arg) {
+  thread_task_t *task;
+
+  // Without workers the task simply runs in place
+  if( !pool || pool->numThreads == 0 ){
+    fn(arg);
+    return;
+  }
+
+  task = (thread_task_t*)malloc(sizeof(thread_task_t));
+  task->fn = fn;
+  task->arg = arg;
+  task->next = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  if( pool->tail )
+    pool->tail->next = task;
+  else
+    pool->head = task;
+  pool->tail = task;
+  pool->pending++;
+  pthread_cond_signal(&pool->taskAvailable);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_wait(thread_pool_t *pool) {
+  if( !pool )
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  while( pool->pending > 0 )
+    pthread_cond_wait(&pool->allDone, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int thread_pool_size(thread_pool_t *pool) {
+  return pool ? pool->numThreads : 0;
+}
+
+
+// Shared between the caller of parallel_for() and its helper tasks. It is
+// reference counted because a helper may be scheduled after the caller has
+// already finished all chunks and returned.
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+  parallel_for_fn fn;
+  void *arg;
+  int count, grain;
+  int nextChunk, numChunks, chunksDone;
+  int refs;
+} parallel_for_ctx_t;
+
+static void parallel_for_release(parallel_for_ctx_t *ctx) {
+  int refs;
+
+  pthread_mutex_lock(&ctx->lock);
+  refs = --ctx->refs;
+  pthread_mutex_unlock(&ctx->lock);
+
+  if( refs == 0 ){
+    pthread_cond_destroy(&ctx->finished);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+  }
+}
+
+static void parallel_for_run(parallel_for_ctx_t *ctx) {
+  int chunk, begin, end;
+
+  for(;;){
+    pthread_mutex_lock(&ctx->lock);
+    chunk = ctx->nextChunk < ctx->numChunks ? ctx->nextChunk++ : -1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if( chunk < 0 )
+      return;
+
+    begin = chunk * ctx->grain;
+    end = begin + ctx->grain;
+    if( end > ctx->count )
+      end = ctx->count;
+    ctx->fn(begin, end, ctx->arg);
+
+    pthread_mutex_lock(&ctx->lock);
+    if( ++ctx->chunksDone == ctx->numChunks )
+      pthread_cond_broadcast(&ctx->finished);
+    pthread_mutex_unlock(&ctx->lock);
+  }
+}
+
+static void parallel_for_task(void *arg) {
+  parallel_for_ctx_t *ctx = (parallel_for_ctx_t*)arg;
+  parallel_for_run(ctx);
+  parallel_for_release(ctx);
+}
+
+void parallel_for(thread_pool_t *pool, int count, int grain, parallel_for_fn fn, void *arg) {
+  parallel_for_ctx_t *ctx;
+  int numChunks, numHelpers, i;
+
+  if( count <= 0 )
+    return;
+  if( grain < 1 )
+    grain = 1;
+
+  numChunks = (count + grain - 1) / grain;
+  numHelpers = thread_pool_size(pool);
+  if( numHelpers > numChunks - 1 )
+    numHelpers = numChunks - 1;
+
+  if( numHelpers <= 0 ){
+    fn(0, count, arg);
+    return;
+  }
+
+  ctx = (parallel_for_ctx_t*)calloc(1, sizeof(parallel_for_ctx_t));
+  pthread_mutex_init(&ctx->lock, NULL);
+  pthread_cond_init(&ctx->finished, NULL);
+  ctx->fn = fn;
+  ctx->arg = arg;
+  ctx->count = count;
+  ctx->grain = grain;
+  ctx->numChunks = numChunks;
+  ctx->refs = numHelpers + 1;
+
+  for( i = 0 ; i < numHelpers ; i++ )
+    thread_pool_submit(pool, parallel_for_task, ctx);
+
+  parallel_for_run(ctx);
+
+  pthread_mutex_lock(&ctx->lock);
+  while( ctx->chunksDone < ctx->numChunks )
+    pthread_cond_wait(&ctx->finished, &ctx->lock);
+  pthread_mutex_unlock(&ctx->lock);
+
+  parallel_for_release(ctx);
+}
@@ -0,0 +1,35 @@
+
+#ifndef _THREAD_POOL_
+#define _THREAD_POOL_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef void (*thread_task_fn)(void *arg);
+  typedef void (*parallel_for_fn)(int begin, int end, void *arg);
+
+  typedef struct thread_pool thread_pool_t;
+
+  // numThreads <= 0 creates one worker per online core
+  thread_pool_t *thread_pool_create(int numThreads);
+  void thread_pool_destroy(thread_pool_t *pool);
+
+  // Queue a task; it runs on the first free worker
+  void thread_pool_submit(thread_pool_t *pool, thread_task_fn fn, void *arg);
+
+  // Block until every submitted task has finished
+  void thread_pool_wait(thread_pool_t *pool);
+
+  int thread_pool_size(thread_pool_t *pool);
+  int thread_count_cores(void);
+
+  // Run fn over [0, count) in chunks of 'grain' items. The calling thread
+  // takes part, so this is safe to call from inside a pool task. A NULL pool
+  // runs everything on the calling thread.
+  void parallel_for(thread_pool_t *pool, int count, int grain, parallel_for_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
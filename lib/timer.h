@@ -0,0 +1,14 @@
+
+#ifndef _TIMER_
+#define _TIMER_
+
+#include <sys/time.h>
+
+// Wall-clock time in milliseconds
+static inline double timer_now_ms(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+#endif
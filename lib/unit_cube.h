@@ -0,0 +1,72 @@
+
+#ifndef _UNIT_CUBE_
+#define _UNIT_CUBE_
+
+// The cube drawn by the demo, shared with the software renderer
+// (tools/softrender.c) so both render exactly the same geometry.
+// Six faces of two triangles each.
+
+#include "vertex_format.h"
+
+// Unindexed; the demo welds and packs it (lib/mesh_opt.h, lib/vertex_format.h).
+// The tangents are what lib/tangent_space.h generates for it: every face
+// is flat, so the software renderer can use them as they are.
+static mesh_vertex_t UnitCube[] = {
+	//   x     y     z   	 tx    ty		 nx	   ny    nz		 tanx  tany  tanz  w
+
+	// FRONT
+	{ -0.5,  0.5,  0.5,  	 0.0,  1.0,		 0.0,  0.0,  1.0,		 1.0,  0.0,  0.0,  1.0 },
+	{ -0.5, -0.5,  0.5,  	 0.0,  0.0,		 0.0,  0.0,  1.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5,  0.5,  	 1.0,  0.0,		 0.0,  0.0,  1.0,		 1.0,  0.0,  0.0,  1.0 },
+
+	{ -0.5,  0.5,  0.5,  	 0.0,  1.0,		 0.0,  0.0,  1.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5,  0.5,  	 1.0,  0.0,		 0.0,  0.0,  1.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5,  0.5,  0.5,  	 1.0,  1.0,		 0.0,  0.0,  1.0,		 1.0,  0.0,  0.0,  1.0 },
+
+	// BACK
+	{ -0.5,  0.5, -0.5,  	 1.0,  1.0,		 0.0,  0.0, -1.0,		-1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5, -0.5,  	 0.0,  0.0,		 0.0,  0.0, -1.0,		-1.0,  0.0,  0.0,  1.0 },
+	{ -0.5, -0.5, -0.5,  	 1.0,  0.0,		 0.0,  0.0, -1.0,		-1.0,  0.0,  0.0,  1.0 },
+
+	{ -0.5,  0.5, -0.5,  	 1.0,  1.0,		 0.0,  0.0, -1.0,		-1.0,  0.0,  0.0,  1.0 },
+	{  0.5,  0.5, -0.5,  	 0.0,  1.0,		 0.0,  0.0, -1.0,		-1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5, -0.5,  	 0.0,  0.0,		 0.0,  0.0, -1.0,		-1.0,  0.0,  0.0,  1.0 },
+
+	// LEFT
+	{  0.5,  0.5, -0.5,  	 1.0,  1.0,		 1.0,  0.0,  0.0,		 0.0,  0.0, -1.0,  1.0 },
+	{  0.5, -0.5,  0.5,  	 0.0,  0.0,		 1.0,  0.0,  0.0,		 0.0,  0.0, -1.0,  1.0 },
+	{  0.5, -0.5, -0.5,  	 1.0,  0.0,		 1.0,  0.0,  0.0,		 0.0,  0.0, -1.0,  1.0 },
+
+	{  0.5,  0.5, -0.5,  	 1.0,  1.0,		 1.0,  0.0,  0.0,		 0.0,  0.0, -1.0,  1.0 },
+	{  0.5,  0.5,  0.5,  	 0.0,  1.0,		 1.0,  0.0,  0.0,		 0.0,  0.0, -1.0,  1.0 },
+	{  0.5, -0.5,  0.5,  	 0.0,  0.0,		 1.0,  0.0,  0.0,		 0.0,  0.0, -1.0,  1.0 },
+
+	// RIGHT
+	{ -0.5,  0.5, -0.5,  	 0.0,  1.0,		-1.0,  0.0,  0.0,		 0.0,  0.0,  1.0,  1.0 },
+	{ -0.5, -0.5, -0.5,  	 0.0,  0.0,		-1.0,  0.0,  0.0,		 0.0,  0.0,  1.0,  1.0 },
+	{ -0.5, -0.5,  0.5,  	 1.0,  0.0,		-1.0,  0.0,  0.0,		 0.0,  0.0,  1.0,  1.0 },
+
+	{ -0.5,  0.5, -0.5,  	 0.0,  1.0,		-1.0,  0.0,  0.0,		 0.0,  0.0,  1.0,  1.0 },
+	{ -0.5, -0.5,  0.5,  	 1.0,  0.0,		-1.0,  0.0,  0.0,		 0.0,  0.0,  1.0,  1.0 },
+	{ -0.5,  0.5,  0.5,  	 1.0,  1.0,		-1.0,  0.0,  0.0,		 0.0,  0.0,  1.0,  1.0 },
+
+	// TOP
+	{ -0.5,  0.5, -0.5,  	 0.0,  1.0,		 0.0,  1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{ -0.5,  0.5,  0.5,  	 0.0,  0.0,		 0.0,  1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5,  0.5, -0.5,  	 1.0,  1.0,		 0.0,  1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+
+	{ -0.5,  0.5,  0.5,  	 0.0,  0.0,		 0.0,  1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5,  0.5,  0.5,  	 1.0,  0.0,		 0.0,  1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5,  0.5, -0.5,  	 1.0,  1.0,		 0.0,  1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+
+	// BOTTOM
+	{ -0.5, -0.5, -0.5,  	 0.0,  0.0,		 0.0, -1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5, -0.5,  	 1.0,  0.0,		 0.0, -1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{ -0.5, -0.5,  0.5,  	 0.0,  1.0,		 0.0, -1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+
+	{ -0.5, -0.5,  0.5,  	 0.0,  1.0,		 0.0, -1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5, -0.5,  	 1.0,  0.0,		 0.0, -1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 },
+	{  0.5, -0.5,  0.5,  	 1.0,  1.0,		 0.0, -1.0,  0.0,		 1.0,  0.0,  0.0,  1.0 }
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "vertex_format.h"
+#include <string.h>
+#include <math.h>
+
+// Rounds to nearest; too large values become infinity, too small ones
+// denormals or zero
+uint16_t float_to_half(float f) {
+  uint32_t bits, sign, mantissa;
+  int exponent;
+
+  memcpy(&bits, &f, sizeof(bits));
+  sign = (bits >> 16) & 0x8000;
+  exponent = (int)((bits >> 23) & 0xff);
+  mantissa = bits & 0x7fffff;
+
+  if( exponent == 0xff )
+    return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));   // Inf or NaN
+
+  exponent += 15 - 127;
+  if( exponent >= 31 )
+    return (uint16_t)(sign | 0x7c00);
+
+  if( exponent <= 0 ){
+    int shift;
+    if( exponent < -10 )
+      return (uint16_t)sign;
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    return (uint16_t)(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+  }
+
+  // A carry out of the mantissa correctly bumps the exponent
+  return (uint16_t)((sign | ((uint32_t)exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+float half_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t bits;
+  float f;
+
+  if( exponent == 0 ){
+    f = ldexpf((float)mantissa, -24);
+    return sign ? -f : f;
+  }
+
+  if( exponent == 31 )
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  else
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static int to_snorm(float v, int max) {
+  if( v > 1.0f ) v = 1.0f;
+  if( v < -1.0f ) v = -1.0f;
+  return (int)floorf(v * max + 0.5f);
+}
+
+uint32_t pack_snorm10(const float v[3], float w) {
+  return ((uint32_t)to_snorm(v[0], 511) & 0x3ff) |
+         (((uint32_t)to_snorm(v[1], 511) & 0x3ff) << 10) |
+         (((uint32_t)to_snorm(v[2], 511) & 0x3ff) << 20) |
+         (((uint32_t)to_snorm(w, 1) & 0x3) << 30);
+}
+
+// Bytes in memory order x, y, z, w whatever the endianness
+uint32_t pack_snorm8(const float v[3], float w) {
+  uint32_t packed;
+  signed char bytes[4];
+
+  bytes[0] = (signed char)to_snorm(v[0], 127);
+  bytes[1] = (signed char)to_snorm(v[1], 127);
+  bytes[2] = (signed char)to_snorm(v[2], 127);
+  bytes[3] = (signed char)to_snorm(w, 127);
+  memcpy(&packed, bytes, sizeof(packed));
+  return packed;
+}
+
+void pack_vertices(const mesh_vertex_t *vertices, size_t count, int normalFormat, packed_vertex_t *packed) {
+  size_t i;
+
+  for( i = 0 ; i < count ; i++ ){
+    const mesh_vertex_t *v = &vertices[i];
+    packed_vertex_t *p = &packed[i];
+
+    memcpy(p->position, v->position, sizeof(p->position));
+    p->texCoord[0] = float_to_half(v->texCoord[0]);
+    p->texCoord[1] = float_to_half(v->texCoord[1]);
+    if( normalFormat == VERTEX_NORMAL_SNORM8 ){
+      p->normal = pack_snorm8(v->normal, 0.0f);
+      p->tangent = pack_snorm8(v->tangent, v->tangent[3]);
+    }
+    else {
+      p->normal = pack_snorm10(v->normal, 0.0f);
+      p->tangent = pack_snorm10(v->tangent, v->tangent[3]);
+    }
+  }
+}
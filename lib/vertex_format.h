@@ -0,0 +1,55 @@
+
+#ifndef _VERTEX_FORMAT_
+#define _VERTEX_FORMAT_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Vertices as they are authored or loaded, 48 bytes. w is always 1 and
+  // comes from the attribute default, so it isn't stored. The tangent is
+  // filled in by lib/tangent_space.h; its w is the handedness, +1 or -1.
+  typedef struct {
+    float position[3];
+    float texCoord[2];
+    float normal[3];
+    float tangent[4];
+  } mesh_vertex_t;
+
+  // The same vertex as the GPU reads it, 24 bytes:
+  //   position  3 x GL_FLOAT
+  //   texCoord  2 x GL_HALF_FLOAT
+  //   normal    GL_INT_2_10_10_10_REV, normalized (x in the low bits), or
+  //             with VERTEX_NORMAL_SNORM8 4 x GL_BYTE, normalized
+  //   tangent   the same as the normal, with the handedness in w
+  typedef struct {
+    float position[3];
+    uint16_t texCoord[2];
+    uint32_t normal;
+    uint32_t tangent;
+  } packed_vertex_t;
+
+  // How the normal is stored: 10 bits per component where the driver has
+  // ARB_vertex_type_2_10_10_10_rev, 8 bits otherwise. Same size either way.
+  enum {
+    VERTEX_NORMAL_SNORM10 = 0,
+    VERTEX_NORMAL_SNORM8
+  };
+
+  uint16_t float_to_half(float f);
+  float half_to_float(uint16_t h);
+
+  // x, y, z and w in [-1, 1]. w only gets 2 bits in the 10-bit format,
+  // enough for -1, 0 and 1.
+  uint32_t pack_snorm10(const float v[3], float w);
+  uint32_t pack_snorm8(const float v[3], float w);
+
+  void pack_vertices(const mesh_vertex_t *vertices, size_t count, int normalFormat, packed_vertex_t *packed);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
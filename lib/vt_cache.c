@@ -0,0 +1,406 @@
+#include "vt_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+// What a page that isn't in a slot is doing
+#define PAGE_ABSENT  -1
+#define PAGE_LOADING -2
+
+// lastUsed of the top level page, which is never evicted
+#define PINNED UINT_MAX
+
+typedef struct {
+  int level, x, y;          // The page in the slot, level -1 if free
+  unsigned int lastUsed;    // Frame of the last feedback that asked for it
+} vt_slot_t;
+
+typedef struct {
+  int level, x, y;
+} vt_page_t;
+
+typedef struct vt_load {
+  vt_cache_t *cache;
+  vt_page_t page;
+  int ok;
+  unsigned char *tile;
+  struct vt_load *next;
+} vt_load_t;
+
+struct vt_cache {
+  const vt_file_t *file;
+  thread_pool_t *pool;
+  int numLevels;
+  int slotsX, slotsY, numSlots;
+  int maxLoads;
+  int inFlight;             // Reads started and not yet placed
+  unsigned int frame;       // Of the last feedback
+
+  vt_slot_t *slots;
+  int *pages[VT_MAX_LEVELS];              // Slot of every page, or PAGE_ABSENT / PAGE_LOADING
+  unsigned int *requested[VT_MAX_LEVELS]; // Frame + 1 of the last feedback that asked for every page
+  unsigned char *pageTable[VT_MAX_LEVELS];
+  int pageTableDirty;
+
+  vt_page_t *missing;       // Of the last feedback
+  int numMissing, missingCapacity;
+
+  // Finished reads, handed over by the pool's threads
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+  vt_load_t *done;
+  int numDone;
+
+  vt_cache_stats_t stats;
+};
+
+static int level_pages(const vt_cache_t *cache, int level) {
+  return 1 << (cache->numLevels - 1 - level);
+}
+
+static int *page_state(vt_cache_t *cache, const vt_page_t *page) {
+  return &cache->pages[page->level][page->y * level_pages(cache, page->level) + page->x];
+}
+
+// Coarsest first: they cover the most and everything finer falls back to them
+static int compare_pages(const void *a, const void *b) {
+  const vt_page_t *p = (const vt_page_t*)a;
+  const vt_page_t *q = (const vt_page_t*)b;
+
+  if( p->level != q->level )
+    return q->level - p->level;
+  if( p->y != q->y )
+    return p->y - q->y;
+  return p->x - q->x;
+}
+
+static int compare_loads(const void *a, const void *b) {
+  return compare_pages(&(*(vt_load_t* const*)a)->page, &(*(vt_load_t* const*)b)->page);
+}
+
+static void read_tile(void *arg) {
+  vt_load_t *load = (vt_load_t*)arg;
+  vt_cache_t *cache = load->cache;
+
+  load->ok = vt_file_read_tile(cache->file, load->page.level, load->page.x, load->page.y, load->tile);
+
+  pthread_mutex_lock(&cache->lock);
+  load->next = cache->done;
+  cache->done = load;
+  cache->numDone++;
+  pthread_cond_signal(&cache->finished);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static vt_load_t *new_load(vt_cache_t *cache, const vt_page_t *page) {
+  vt_load_t *load = (vt_load_t*)malloc(sizeof(vt_load_t));
+
+  load->cache = cache;
+  load->page = *page;
+  load->ok = 0;
+  load->tile = (unsigned char*)malloc(cache->file->tileBytes);
+  load->next = NULL;
+
+  *page_state(cache, page) = PAGE_LOADING;
+  cache->inFlight++;
+  return load;
+}
+
+static void free_load(vt_load_t *load) {
+  free(load->tile);
+  free(load);
+}
+
+vt_cache_t *vt_cache_create(const vt_file_t *file, int slotsX, int slotsY, int maxLoads, thread_pool_t *pool) {
+  vt_cache_t *cache;
+  vt_load_t *top;
+  vt_page_t topPage;
+  int l, i;
+
+  if( slotsX <= 0 || slotsY <= 0 || slotsX > 256 || slotsY > 256 ){
+    fprintf( stderr, "A virtual texture cache has 1 to 256 slots on a side, not %dx%d.\n", slotsX, slotsY );
+    return NULL;
+  }
+
+  cache = (vt_cache_t*)calloc(1, sizeof(vt_cache_t));
+  cache->file = file;
+  cache->pool = pool;
+  cache->numLevels = file->header.numLevels;
+  cache->slotsX = slotsX;
+  cache->slotsY = slotsY;
+  cache->numSlots = slotsX * slotsY;
+  cache->maxLoads = maxLoads > 0 ? maxLoads : 1;
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->finished, NULL);
+
+  cache->slots = (vt_slot_t*)malloc(sizeof(vt_slot_t) * cache->numSlots);
+  for( i = 0 ; i < cache->numSlots ; i++ ){
+    cache->slots[i].level = -1;
+    cache->slots[i].lastUsed = 0;
+  }
+
+  for( l = 0 ; l < cache->numLevels ; l++ ){
+    size_t count = (size_t)level_pages(cache, l) * level_pages(cache, l);
+    cache->pages[l] = (int*)malloc(sizeof(int) * count);
+    for( i = 0 ; i < (int)count ; i++ )
+      cache->pages[l][i] = PAGE_ABSENT;
+    cache->requested[l] = (unsigned int*)calloc(count, sizeof(unsigned int));
+    cache->pageTable[l] = (unsigned char*)calloc(count, 4);
+  }
+
+  // Read right here, placed by the first vt_cache_upload()
+  topPage.level = cache->numLevels - 1;
+  topPage.x = topPage.y = 0;
+  top = new_load(cache, &topPage);
+  top->ok = vt_file_read_tile(file, topPage.level, 0, 0, top->tile);
+  if( !top->ok ){
+    fprintf( stderr, "Can't read the top level page of the virtual texture.\n" );
+    cache->inFlight--;
+    free_load(top);
+    vt_cache_destroy(cache);
+    return NULL;
+  }
+  cache->done = top;
+  cache->numDone = 1;
+
+  return cache;
+}
+
+void vt_cache_destroy(vt_cache_t *cache) {
+  vt_load_t *load, *next;
+  int l;
+
+  if( !cache )
+    return;
+
+  pthread_mutex_lock(&cache->lock);
+  while( cache->numDone < cache->inFlight )
+    pthread_cond_wait(&cache->finished, &cache->lock);
+  pthread_mutex_unlock(&cache->lock);
+
+  for( load = cache->done ; load ; load = next ){
+    next = load->next;
+    free_load(load);
+  }
+
+  for( l = 0 ; l < cache->numLevels ; l++ ){
+    free(cache->pages[l]);
+    free(cache->requested[l]);
+    free(cache->pageTable[l]);
+  }
+  free(cache->slots);
+  free(cache->missing);
+  pthread_cond_destroy(&cache->finished);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+void vt_feedback_encode(int level, int x, int y, unsigned char *texel) {
+  texel[0] = x & 255;
+  texel[1] = y & 255;
+  texel[2] = (x >> 8) | ((y >> 8) << 4);
+  texel[3] = level + 1;
+}
+
+static void add_missing(vt_cache_t *cache, int level, int x, int y) {
+  vt_page_t *page;
+
+  if( cache->numMissing == cache->missingCapacity ){
+    cache->missingCapacity = cache->missingCapacity ? cache->missingCapacity * 2 : 256;
+    cache->missing = (vt_page_t*)realloc(cache->missing, sizeof(vt_page_t) * cache->missingCapacity);
+  }
+  page = &cache->missing[cache->numMissing++];
+  page->level = level;
+  page->x = x;
+  page->y = y;
+}
+
+void vt_cache_feedback(vt_cache_t *cache, const unsigned char *texels, int count, unsigned int frame) {
+  unsigned int stamp = frame + 1;
+  int i;
+
+  cache->frame = frame;
+  cache->numMissing = 0;
+  cache->stats.requested = cache->stats.missing = 0;
+
+  for( i = 0 ; i < count ; i++ ){
+    const unsigned char *texel = texels + 4 * i;
+    int level = texel[3] - 1;
+    int x = texel[0] | ((texel[2] & 15) << 8);
+    int y = texel[1] | ((texel[2] >> 4) << 8);
+
+    if( level < 0 || level >= cache->numLevels || x >= level_pages(cache, level) || y >= level_pages(cache, level) )
+      continue;
+
+    // The ancestors are the fallbacks, so they are in use as well. Where
+    // a page was seen this frame its ancestors were too.
+    for( ; level < cache->numLevels ; level++, x >>= 1, y >>= 1 ){
+      int index = y * level_pages(cache, level) + x;
+      int state = cache->pages[level][index];
+
+      if( cache->requested[level][index] == stamp )
+        break;
+      cache->requested[level][index] = stamp;
+      cache->stats.requested++;
+
+      if( state >= 0 ){
+        if( cache->slots[state].lastUsed != PINNED )
+          cache->slots[state].lastUsed = frame;
+        continue;
+      }
+
+      cache->stats.missing++;
+      if( state == PAGE_ABSENT )
+        add_missing(cache, level, x, y);
+    }
+  }
+
+  qsort(cache->missing, cache->numMissing, sizeof(vt_page_t), compare_pages);
+  for( i = 0 ; i < cache->numMissing && cache->inFlight < cache->maxLoads ; i++ )
+    thread_pool_submit(cache->pool, read_tile, new_load(cache, &cache->missing[i]));
+
+  cache->stats.loading = cache->inFlight;
+}
+
+// A free slot, or that of the least recently used page not used by the
+// last feedback. A scan is cheap next to the upload that follows. -1 if
+// every page is in use.
+static int find_slot(const vt_cache_t *cache) {
+  unsigned int oldest = cache->frame;
+  int i, best = -1;
+
+  for( i = 0 ; i < cache->numSlots ; i++ ){
+    const vt_slot_t *slot = &cache->slots[i];
+    if( slot->level < 0 )
+      return i;
+    if( slot->lastUsed < oldest ){
+      oldest = slot->lastUsed;
+      best = i;
+    }
+  }
+  return best;
+}
+
+static int place_tile(vt_cache_t *cache, vt_load_t *load, vt_upload_fn fn, void *arg) {
+  int *state = page_state(cache, &load->page);
+  vt_slot_t *slot;
+  int index;
+
+  cache->inFlight--;
+  if( !load->ok ){
+    *state = PAGE_ABSENT;
+    return 0;
+  }
+
+  index = find_slot(cache);
+  if( index < 0 ){
+    // Asked for again by a later feedback if it is still needed
+    *state = PAGE_ABSENT;
+    cache->stats.dropped++;
+    return 0;
+  }
+
+  slot = &cache->slots[index];
+  if( slot->level >= 0 ){
+    cache->pages[slot->level][slot->y * level_pages(cache, slot->level) + slot->x] = PAGE_ABSENT;
+    cache->stats.evicted++;
+    cache->stats.resident--;
+  }
+
+  fn(index % cache->slotsX, index / cache->slotsX, load->tile, arg);
+
+  slot->level = load->page.level;
+  slot->x = load->page.x;
+  slot->y = load->page.y;
+  slot->lastUsed = slot->level == cache->numLevels - 1 ? PINNED : cache->frame;
+  *state = index;
+  cache->stats.resident++;
+  cache->pageTableDirty = 1;
+  return 1;
+}
+
+int vt_cache_upload(vt_cache_t *cache, int maxTiles, int wait, vt_upload_fn fn, void *arg) {
+  vt_load_t *list, *load, **loads;
+  int i, count, placed = 0;
+
+  pthread_mutex_lock(&cache->lock);
+  if( wait )
+    while( cache->numDone < cache->inFlight )
+      pthread_cond_wait(&cache->finished, &cache->lock);
+  list = cache->done;
+  count = cache->numDone;
+  cache->done = NULL;
+  cache->numDone = 0;
+  pthread_mutex_unlock(&cache->lock);
+
+  cache->stats.uploaded = 0;
+  if( count == 0 )
+    return 0;
+
+  // They finish in any order, place them in a fixed one
+  loads = (vt_load_t**)malloc(sizeof(vt_load_t*) * count);
+  for( i = 0, load = list ; load ; load = load->next )
+    loads[i++] = load;
+  qsort(loads, count, sizeof(vt_load_t*), compare_loads);
+
+  for( i = 0 ; i < count && i < maxTiles ; i++ ){
+    placed += place_tile(cache, loads[i], fn, arg);
+    free_load(loads[i]);
+  }
+
+  // The rest waits for the next frame
+  if( i < count ){
+    pthread_mutex_lock(&cache->lock);
+    for( ; i < count ; i++ ){
+      loads[i]->next = cache->done;
+      cache->done = loads[i];
+      cache->numDone++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+  }
+  free(loads);
+
+  cache->stats.uploaded = placed;
+  cache->stats.loading = cache->inFlight;
+  return placed;
+}
+
+int vt_cache_update_page_table(vt_cache_t *cache) {
+  int l, x, y;
+
+  if( !cache->pageTableDirty )
+    return 0;
+  cache->pageTableDirty = 0;
+
+  // Top down, so the entry of a page's parent is always ready
+  for( l = cache->numLevels - 1 ; l >= 0 ; l-- ){
+    int pages = level_pages(cache, l);
+
+    for( y = 0 ; y < pages ; y++ ){
+      for( x = 0 ; x < pages ; x++ ){
+        int state = cache->pages[l][y * pages + x];
+        unsigned char *entry = cache->pageTable[l] + 4 * (y * pages + x);
+
+        if( state >= 0 ){
+          entry[0] = state % cache->slotsX;
+          entry[1] = state / cache->slotsX;
+          entry[2] = l;
+          entry[3] = 255;
+        }
+        else if( l < cache->numLevels - 1 )
+          memcpy(entry, cache->pageTable[l + 1] + 4 * ((y / 2) * (pages / 2) + x / 2), 4);
+      }
+    }
+  }
+  return 1;
+}
+
+const unsigned char *vt_cache_page_table(const vt_cache_t *cache, int level) {
+  return cache->pageTable[level];
+}
+
+const vt_cache_stats_t *vt_cache_get_stats(const vt_cache_t *cache) {
+  return &cache->stats;
+}
@@ -0,0 +1,72 @@
+
+#ifndef _VT_CACHE_
+#define _VT_CACHE_
+
+#include "vt_file.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // Which pages of a virtual texture (lib/vt_file.h) are in the physical
+  // cache, a fixed grid of tile slots, and the page table that leads the
+  // shader to them. There is no GL in here: the caller uploads the tiles
+  // and the page table.
+  //
+  // Every frame the caller hands over the pages its feedback pass asked
+  // for. Missing ones are read from the file on the pool's threads, the
+  // coarsest first, and placed as they arrive in free slots or in those of
+  // the least recently used pages. A page that isn't resident falls back
+  // to its nearest resident ancestor; the top level page is read at
+  // creation and never evicted, so there always is one.
+
+  typedef struct vt_cache vt_cache_t;
+
+  typedef struct {
+    unsigned int requested;   // Pages the last feedback asked for, with their ancestors
+    unsigned int missing;     // Of which weren't resident
+    unsigned int loading;     // Tile reads in flight
+    unsigned int uploaded;    // Tiles placed by the last vt_cache_upload()
+    unsigned int dropped;     // Reads thrown away since every slot was in use
+    unsigned int evicted;     // Since creation
+    unsigned int resident;
+  } vt_cache_stats_t;
+
+  // 'maxLoads' caps the tile reads in flight. Returns NULL if the top
+  // level page can't be read.
+  vt_cache_t *vt_cache_create(const vt_file_t *file, int slotsX, int slotsY, int maxLoads, thread_pool_t *pool);
+
+  // Waits for the reads in flight
+  void vt_cache_destroy(vt_cache_t *cache);
+
+  // Takes the feedback of 'frame': RGBA8 texels, each a page encoded by
+  // vt_feedback_encode() or zero for none. The pages and their ancestors
+  // count as used in 'frame', and reads of the missing ones are started.
+  void vt_cache_feedback(vt_cache_t *cache, const unsigned char *texels, int count, unsigned int frame);
+
+  void vt_feedback_encode(int level, int x, int y, unsigned char *texel);
+
+  // Copies a tile (tileBytes, see lib/vt_file.h) into slot (slotX, slotY)
+  // of the physical cache
+  typedef void (*vt_upload_fn)(int slotX, int slotY, const unsigned char *tile, void *arg);
+
+  // Places up to 'maxTiles' finished reads, coarsest first, calling 'fn'
+  // for each. With 'wait' it first waits for every read in flight, which
+  // makes the result independent of thread timing. Returns the number
+  // placed.
+  int vt_cache_upload(vt_cache_t *cache, int maxTiles, int wait, vt_upload_fn fn, void *arg);
+
+  // The page table: one RGBA8 entry per page of every level, holding the
+  // slot x and y of the page or of its nearest resident ancestor, that
+  // page's level, and 255. Rebuilt if residency changed since the last
+  // call, which then returns nonzero.
+  int vt_cache_update_page_table(vt_cache_t *cache);
+  const unsigned char *vt_cache_page_table(const vt_cache_t *cache, int level);
+
+  const vt_cache_stats_t *vt_cache_get_stats(const vt_cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,153 @@
+#include "vt_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Tiles start at a multiple of this, after the header
+#define VT_FILE_ALIGNMENT 4096
+
+// Tiles handed to one parallel_for task at a time
+#define TILES_PER_TASK 4
+
+static uint64_t header_bytes(void) {
+  return (sizeof(vt_file_header_t) + VT_FILE_ALIGNMENT - 1) & ~(uint64_t)(VT_FILE_ALIGNMENT - 1);
+}
+
+static void init_layout(vt_file_t *file) {
+  uint64_t start = 0;
+  int l;
+
+  file->tileSize = file->header.pageSize + 2 * file->header.border;
+  file->tileBytes = (size_t)file->tileSize * file->tileSize * VT_FILE_CHANNELS;
+  for( l = 0 ; l < (int)file->header.numLevels ; l++ ){
+    uint64_t pages = vt_file_pages(file, l);
+    file->levelStart[l] = start;
+    start += pages * pages;
+  }
+}
+
+static uint64_t tile_offset(const vt_file_t *file, int level, int x, int y) {
+  uint64_t index = file->levelStart[level] + (uint64_t)y * vt_file_pages(file, level) + x;
+  return header_bytes() + index * file->tileBytes;
+}
+
+int vt_file_pages(const vt_file_t *file, int level) {
+  return 1 << (file->header.numLevels - 1 - level);
+}
+
+typedef struct {
+  vt_file_t *file;
+  int level;
+  vt_tile_fn fn;
+  void *arg;
+  int failed;
+} write_job_t;
+
+static void write_tiles(int begin, int end, void *arg) {
+  write_job_t *job = (write_job_t*)arg;
+  const vt_file_t *file = job->file;
+  int pages = vt_file_pages(file, job->level);
+  unsigned char *tile = (unsigned char*)malloc(file->tileBytes);
+  int i;
+
+  for( i = begin ; i < end ; i++ ){
+    int x = i % pages, y = i / pages;
+
+    job->fn(job->level, x, y, file->header.pageSize, file->header.border, tile, job->arg);
+    if( pwrite(file->fd, tile, file->tileBytes, tile_offset(file, job->level, x, y)) != (ssize_t)file->tileBytes )
+      job->failed = 1;
+  }
+  free(tile);
+}
+
+int vt_file_write(const char *filename, int pageSize, int border, int numLevels,
+                  vt_tile_fn fn, void *arg, thread_pool_t *pool) {
+  vt_file_t file;
+  write_job_t job;
+  int l;
+
+  if( pageSize <= 0 || border < 0 || border > pageSize || numLevels <= 0 || numLevels > VT_MAX_LEVELS ){
+    fprintf( stderr, "Bad virtual texture layout: pages of %d texels, border %d, %d levels.\n",
+             pageSize, border, numLevels );
+    return 0;
+  }
+
+  memset(&file, 0, sizeof(file));
+  file.header.magic = VT_FILE_MAGIC;
+  file.header.version = VT_FILE_VERSION;
+  file.header.pageSize = pageSize;
+  file.header.border = border;
+  file.header.numLevels = numLevels;
+  init_layout(&file);
+
+  file.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if( file.fd < 0 ){
+    fprintf( stderr, "Can't open virtual texture '%s' for writing.\n", filename );
+    return 0;
+  }
+
+  job.file = &file;
+  job.fn = fn;
+  job.arg = arg;
+  job.failed = pwrite(file.fd, &file.header, sizeof(file.header), 0) != (ssize_t)sizeof(file.header);
+
+  for( l = 0 ; l < numLevels && !job.failed ; l++ ){
+    int pages = vt_file_pages(&file, l);
+    job.level = l;
+    parallel_for(pool, pages * pages, TILES_PER_TASK, write_tiles, &job);
+  }
+
+  if( close(file.fd) != 0 || job.failed ){
+    fprintf( stderr, "Error while writing virtual texture '%s'.\n", filename );
+    return 0;
+  }
+  return 1;
+}
+
+vt_file_t *vt_file_open(const char *filename) {
+  vt_file_t *file;
+  struct stat st;
+  int l;
+
+  file = (vt_file_t*)calloc(1, sizeof(vt_file_t));
+  file->fd = open(filename, O_RDONLY);
+  if( file->fd < 0 ){
+    fprintf( stderr, "Can't open virtual texture '%s'.\n", filename );
+    free(file);
+    return NULL;
+  }
+
+  if( pread(file->fd, &file->header, sizeof(file->header), 0) != (ssize_t)sizeof(file->header) ||
+      file->header.magic != VT_FILE_MAGIC || file->header.version != VT_FILE_VERSION ||
+      file->header.pageSize == 0 || file->header.border > file->header.pageSize ||
+      file->header.numLevels == 0 || file->header.numLevels > VT_MAX_LEVELS ){
+    fprintf( stderr, "'%s' is not a version %d virtual texture.\n", filename, VT_FILE_VERSION );
+    vt_file_close(file);
+    return NULL;
+  }
+
+  init_layout(file);
+  l = file->header.numLevels - 1;
+  if( fstat(file->fd, &st) != 0 || (uint64_t)st.st_size < tile_offset(file, l, 0, 0) + file->tileBytes ){
+    fprintf( stderr, "Virtual texture '%s' is truncated.\n", filename );
+    vt_file_close(file);
+    return NULL;
+  }
+
+  return file;
+}
+
+void vt_file_close(vt_file_t *file) {
+  if( !file )
+    return;
+  if( file->fd >= 0 )
+    close(file->fd);
+  free(file);
+}
+
+int vt_file_read_tile(const vt_file_t *file, int level, int x, int y, unsigned char *tile) {
+  return pread(file->fd, tile, file->tileBytes, tile_offset(file, level, x, y)) == (ssize_t)file->tileBytes;
+}
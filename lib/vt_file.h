@@ -0,0 +1,74 @@
+
+#ifndef _VT_FILE_
+#define _VT_FILE_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // A virtual texture on disk: a mip chain cut into square pages, so a map
+  // far larger than video memory can be streamed a page at a time (see
+  // lib/vt_cache.h). Level 0 is pageSize * 2^(numLevels - 1) texels wide
+  // and high, every level halves that, and the top level is a single page.
+  //
+  // Each page is stored as a tile with a border of texels from its
+  // neighbours (wrapping around like GL_REPEAT), so it can be filtered in
+  // the physical cache without touching whatever tile lies next to it
+  // there. Texels are RGBA8 with the normal in RGB and the height in A, as
+  // in the shader's packed mode. Tiles are raw and all the same size, level
+  // after level, row after row; texel rows go bottom first like
+  // glTexImage2D expects them.
+
+#define VT_FILE_MAGIC    0x58455456  // "VTEX"
+#define VT_FILE_VERSION  1
+#define VT_FILE_CHANNELS 4
+#define VT_MAX_LEVELS    13          // 4096 pages on a side
+
+  typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;    // Texels on a side of a page, without the border
+    uint32_t border;
+    uint32_t numLevels;
+    uint32_t reserved;
+  } vt_file_header_t;
+
+  typedef struct {
+    int fd;
+    vt_file_header_t header;
+    int tileSize;                         // pageSize + 2 * border
+    size_t tileBytes;
+    uint64_t levelStart[VT_MAX_LEVELS];   // Index of the first tile of each level
+  } vt_file_t;
+
+  // Fills one tile of 'tileSize' x 'tileSize' texels for the page (x, y)
+  // of 'level'. Its first texel is 'border' texels left of and below the
+  // page's first. Called from the pool's threads.
+  typedef void (*vt_tile_fn)(int level, int x, int y, int pageSize, int border, unsigned char *tile, void *arg);
+
+  // Writes a virtual texture, asking 'fn' for every tile. Tiles are made
+  // and written concurrently on the pool (NULL runs serially), so only a
+  // few are in memory at once however large the texture. Returns 0 on
+  // failure.
+  int vt_file_write(const char *filename, int pageSize, int border, int numLevels,
+                    vt_tile_fn fn, void *arg, thread_pool_t *pool);
+
+  // Returns NULL if the file is missing or malformed
+  vt_file_t *vt_file_open(const char *filename);
+  void vt_file_close(vt_file_t *file);
+
+  // Pages on a side of a level
+  int vt_file_pages(const vt_file_t *file, int level);
+
+  // Reads a tile into 'tile' (tileBytes). Safe to call from several
+  // threads at once. Returns 0 on failure.
+  int vt_file_read_tile(const vt_file_t *file, int level, int x, int y, unsigned char *tile);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -10,11 +10,11 @@
 	# TODO
 		- Point light
 		- Mouse movement
-		- Load object from file
 
 	# DONE
 		- Textures
 		- Transformations 
+		- Load object from file
 
 */
 
@@ -22,40 +22,79 @@
 // Standard C++ headers
 #include <iostream>		// 
 #include <vector>		// 
+#include <string>
+#include <algorithm>	// for_each
+#include <string.h>	// memset
 #include <math.h>
 
 // Include header for OpenGL, GLUT and GLEW
 #include <GL/glew.h>	// Removes the need to include OpenGL headers
+#ifdef __APPLE__
 #include <GLUT/glut.h>	// Window handling system
+#else
+#include <GL/glut.h>
+#endif
 
 // Custom headers
 #include "lib/readfile.h"	// Reads from file to char*
 #include "lib/png_reader.h"	// Reads PNG files
+#include "lib/thread_pool.h"	// Worker threads
+#include "lib/texture_loader.h"	// Decodes textures on worker threads
+#include "lib/timer.h"		// Millisecond timer
+#include "lib/texture_pack.h"	// Baked materials
+#include "lib/mipmap.h"		// CPU mip chains
+#include "lib/material_pack.h"	// Normal + height packing
+#include "lib/unit_cube.h"		// Cube geometry
+#include "lib/headless_gl.h"	// Window-less GL context
+#include "lib/frame_stats.h"	// Frame time percentiles and CSV
+#include "lib/cone_map.h"		// Cone step mapping precomputation
+#include "lib/height_pyramid.h"	// Min/max height quadtree
+#include "lib/vertex_format.h"	// Packed vertices
+#include "lib/mesh_opt.h"		// Index buffer optimization
+#include "lib/obj_loader.h"		// Wavefront OBJ meshes
+#include "lib/tangent_space.h"	// Per-vertex tangent frames
+#include "lib/mat4.h"			// SSE matrix math
+#include "lib/bvh.h"			// Bounding volume hierarchy
+#include "lib/frustum.h"		// View frustum culling
+#include "lib/program_cache.h"	// Program binaries on disk
+#include "lib/render_backend.h"	// GL state cache and draw lists
+#include "lib/vt_file.h"		// Virtual textures on disk
+#include "lib/vt_cache.h"		// Virtual texture residency
+#include "lib/normal_map.h"		// Normals from heights
 
 
 #define ARRAY_COUNT( array ) (sizeof( array ) / (sizeof( array[0] ) * (sizeof( array ) != sizeof(void*) || sizeof( array[0] ) <= sizeof(void*))))
 
 
-// 
-GLuint LoadShader(GLenum eShaderType, const char* fileName)
+// Compiles the #defines followed by the source. With
+// KHR_parallel_shader_compile the driver does it in the background and this
+// returns right away; ShaderCompiled() is what waits.
+GLuint LoadShader(GLenum eShaderType, const char *defines, const char *source)
 {
 	// Create a shader object
 	GLuint shader = glCreateShader(eShaderType);
 
-	// Create a C-style character array string from C++ std::string object
-	const char *strFileData = readFile(fileName);
+	// The defines go first, the source is shared by every permutation
+	const char *strings[2] = { defines, source };
 
 	// Load shader string into shader object
 	glShaderSource(
 					shader,			// The shader object to load the string into
-					1,				// Number of string to put into shader: 1
-					&strFileData,	// An array of const char* strings
+					2,				// Number of string to put into shader: 2
+					strings,		// An array of const char* strings
 					NULL			// Array of lengths of the strings, or NULL som null-terminated strings
 				);
 
 	// Compile the shader
 	glCompileShader(shader);
 
+	// 
+	return shader;
+}
+
+// Prints the log of a shader that failed to compile
+bool ShaderCompiled(GLuint shader, GLenum eShaderType)
+{
 	// After compiling we need to see if there were any errors
 	GLint status;
 	glGetShaderiv(
@@ -95,10 +134,11 @@ GLuint LoadShader(GLenum eShaderType, const char* fileName)
 	}
 
 	// 
-	return shader;
+	return status == GL_TRUE;
 }
 
-// 
+// Links the shaders, again in the background with KHR_parallel_shader_compile.
+// The shaders stay attached until ProgramLinked() has checked the result.
 GLuint CreateProgram(const std::vector<GLuint> &shaderList)
 {
 	// 
@@ -113,13 +153,26 @@ GLuint CreateProgram(const std::vector<GLuint> &shaderList)
 
 	// 
 	glBindAttribLocation(program, 0, "vertexPosition");
-	glBindAttribLocation(program, 1, "vertexColor");
-	glBindAttribLocation(program, 2, "vertexTexCoords");
-	glBindAttribLocation(program, 3, "vertexNormal");
+	glBindAttribLocation(program, 1, "vertexTexCoord");
+	glBindAttribLocation(program, 2, "vertexNormal");
+	glBindAttribLocation(program, 3, "vertexTangent");
+	glBindAttribLocation(program, 4, "instanceModelView");	// Takes 4 to 7, one per column
+	glBindAttribLocation(program, 8, "instanceMaterial");
+
+	// Ask for a binary that can be stored in the program cache
+	if(GLEW_ARB_get_program_binary)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	// Link shader objects to shader program
 	glLinkProgram(program);
 
+	// 
+	return program;
+}
+
+// Prints the log of a program that failed to link
+bool ProgramLinked(GLuint program)
+{
 	// 
 	GLint status;
 	glGetProgramiv(
@@ -139,28 +192,40 @@ GLuint CreateProgram(const std::vector<GLuint> &shaderList)
 		GLchar *strInfoLog = new GLchar[infoLogLength + 1];
 		glGetProgramInfoLog(program, infoLogLength, NULL, strInfoLog);
 		fprintf(stderr, "Linker failure: %s\n", strInfoLog);
+		delete[] strInfoLog;
 	}
 
 	// 
-	for(size_t iLoop = 0; iLoop < shaderList.size(); iLoop++)
-		glDetachShader(program, shaderList[iLoop]);
-
-	// 
-	return program;
+	return status == GL_TRUE;
 }
 
-// 
+// The program of the current permutation (see SelectParallaxProgram())
 GLuint theProgram;
 GLuint perspectiveMatrixUni;
 
 const char* fnVertexShader = "vs.vert";
 const char* fnFragmentShader = "parallaxmapping.frag";
+const char* fnDepthShader = "depthonly.frag";
+
+// Draws only depth for the prepass and the coverage count
+GLuint depthProgram;
+GLint depthPerspectiveMatrixUni;
+
+// Counts the fragments of a parallax LOD tier for the stats, see
+// LOD_TIER_COUNT in parallaxmapping.frag
+GLuint lodTierProgram;
+GLint lodTierUniform;
 
 // Uniform location
-GLuint timeUniform;
+GLint timeUniform;
 
-// Allocate memory for perspective matrix
-float perspectiveMatrix[16];
+// Camera to clip space, column-major
+mat4_t perspectiveMatrix;
+const float nearPlane = 1.0f;
+const float farPlane = 10000.0f;
+
+// Seconds per turn of the objects
+const float loopDuration = 25.0f;
 
 float CalcFrustumScale(float fFovDeg)
 {
@@ -171,146 +236,113 @@ float CalcFrustumScale(float fFovDeg)
 
 float frustumScale = CalcFrustumScale(39.6);
 
-void createPerspectiveMatrix(float frustumScale, float zNear, float zFar, float* mat)
-{
-	/*
-		[  0  1  2  3 ]
-		[  4  5  6  7 ]
-		[  8  9 10 11 ]
-		[ 12 13 14 15 ]
-	*/
+// Worker threads shared by everything that decodes or processes assets
+thread_pool_t *threadPool;
 
-	mat[0] = frustumScale;
-	mat[5] = frustumScale;
-	mat[10] = (zNear + zFar) / (zNear - zFar);
-	mat[11]	= 2.0 * zNear * zFar / (zNear - zFar);
-	mat[14] = -1.0;
-}
+// MODELS
+// UnitCube lives in lib/unit_cube.h, the vertex formats in lib/vertex_format.h
 
-void InitializeProgram()
-{
-	// Create a vector to store all shader objects
-	std::vector<GLuint> shaderList;
+// Wavefront OBJ drawn instead of the cube (-obj)
+const char *meshFile = NULL;
 
-	// Load the shader objects
-	shaderList.push_back(LoadShader(GL_VERTEX_SHADER, fnVertexShader));
-	shaderList.push_back(LoadShader(GL_FRAGMENT_SHADER, fnFragmentShader));
+// Reference variables for the vertex and index buffer objects
+GLuint bufferObject;
+GLuint indexBufferObject;
+GLsizei indexCount;
+GLenum indexType;		// GL_UNSIGNED_SHORT unless there are too many vertices
+GLenum normalType;		// GL_INT_2_10_10_10_REV, or GL_BYTE without ARB_vertex_type_2_10_10_10_rev
+float meshRadius;		// Furthest vertex from the origin, bounds the mesh however it turns
 
-	// Create a shader program containing all shaders
-	theProgram = CreateProgram(shaderList);
-	
-	// Delete the shader objects - they are still in the compiled shader program
-	std:for_each(shaderList.begin(), shaderList.end(), glDeleteShader);
+// Vertex Array Object, records the vertex and instance attributes once
+GLuint vao;
 
-	// Get the location for the shader uniform "offset"
-	timeUniform = glGetUniformLocation(theProgram, "time");
-	GLuint loopDurationUniform = glGetUniformLocation(theProgram, "loopDuration");
-	perspectiveMatrixUni = glGetUniformLocation(theProgram, "perspectiveMatrix");
-	
-	// void * memset ( void * ptr, int value, size_t num );
-	// Fill block of memory
-	// Sets the first num bytes of the block of memory pointed by ptr to the specified value (interpreted as an unsigned char).
-	// 
-	// So... basically set all values to zero
-	memset(perspectiveMatrix, 0, sizeof(float) * 16);
+// The textures of the material, bound by the draws that use it
+render_material_t sceneMaterial;
 
-	createPerspectiveMatrix(
-							frustumScale,		// Frustum scale
-							1.0,				// Near clipping plane
-							10000.0,			// Far clipping plane
-							perspectiveMatrix	// The array to write to
-						);
+// The draws of the current frame
+render_list_t drawList;
 
-	// We need to bind the program to set uniforms
-	glUseProgram(theProgram);
+// Loads an OBJ file as indexed triangles, centered and scaled to fit in
+// the cube
+bool LoadMesh(const char *fileName, std::vector<mesh_vertex_t> &vertices, std::vector<unsigned int> &indices)
+{
+	obj_mesh_t mesh;
+	obj_stats_t stats;
 
-		glUniform1f(loopDurationUniform, 25.0);
-		glUniformMatrix4fv(
-							perspectiveMatrixUni,	// Uniform location
-							1,						// Number of matrixes (can be an array of matrices)
-							GL_TRUE,				// Is the array row-major? GL_TRUE / GL_FALSE
-							perspectiveMatrix				// The actual data
-						);
+	if(!obj_load(fileName, &mesh, &stats, threadPool))
+		return false;
 
-	glUseProgram(0);
-}
+	float size = 0.0f;
+	for(int i = 0; i < 3; i++)
+		size = std::max(size, mesh.boundsMax[i] - mesh.boundsMin[i]);
+	float scale = size > 0.0f ? 1.0f / size : 1.0f;
 
-// MODELS
-struct VertexData
-{
-	float position[4];
-	float color[4];
-	float textureCoordinate[2];
-	float normal[3];
-};
+	vertices.assign(mesh.vertices, mesh.vertices + mesh.numVertices);
+	indices.assign(mesh.indices, mesh.indices + mesh.numIndices);
+	for(size_t v = 0; v < vertices.size(); v++)
+		for(int i = 0; i < 3; i++)
+			vertices[v].position[i] = (vertices[v].position[i] - 0.5f * (mesh.boundsMin[i] + mesh.boundsMax[i])) * scale;
 
-struct VertexData UnitCube[] = {
-	//   x     y     z    w  	  r     g     b     a 		 tx    ty		 nx	   ny    nz
-
-	// FRONT
-	{ -0.5,  0.5,  0.5, 1.0,  	1.0,  0.0,  0.0,  1.0,  	0.0,  1.0,		0.0,  0.0,  1.0 },
-	{ -0.5, -0.5,  0.5, 1.0,  	1.0,  0.0,  0.0,  1.0,  	0.0,  0.0,		0.0,  0.0,  1.0 },
-	{  0.5, -0.5,  0.5, 1.0,  	1.0,  0.0,  0.0,  1.0,  	1.0,  0.0,		0.0,  0.0,  1.0 },
-
-	{ -0.5,  0.5,  0.5, 1.0,  	1.0,  0.0,  0.0,  1.0,  	0.0,  1.0,		0.0,  0.0,  1.0 },
-	{  0.5, -0.5,  0.5, 1.0,  	1.0,  0.0,  0.0,  1.0,  	1.0,  0.0,		0.0,  0.0,  1.0 },
-	{  0.5,  0.5,  0.5, 1.0,  	1.0,  0.0,  0.0,  1.0,  	1.0,  1.0,		0.0,  0.0,  1.0 },
-
-	// BACK
-	{ -0.5,  0.5, -0.5, 1.0,  	0.0,  1.0,  0.0,  1.0,  	1.0,  1.0,		0.0,  0.0, -1.0 },
-	{  0.5, -0.5, -0.5, 1.0,  	0.0,  1.0,  0.0,  1.0,  	0.0,  0.0,		0.0,  0.0, -1.0 },
-	{ -0.5, -0.5, -0.5, 1.0,  	0.0,  1.0,  0.0,  1.0,  	1.0,  0.0,		0.0,  0.0, -1.0 },
-
-	{ -0.5,  0.5, -0.5, 1.0,  	0.0,  1.0,  0.0,  1.0,  	1.0,  1.0,		0.0,  0.0, -1.0 },
-	{  0.5,  0.5, -0.5, 1.0,  	0.0,  1.0,  0.0,  1.0,  	0.0,  1.0,		0.0,  0.0, -1.0 },
-	{  0.5, -0.5, -0.5, 1.0,  	0.0,  1.0,  0.0,  1.0,  	0.0,  0.0,		0.0,  0.0, -1.0 },
-
-	// LEFT
-	{  0.5,  0.5, -0.5, 1.0,  	0.0,  0.0,  1.0,  1.0,  	1.0,  1.0,		1.0,  0.0,  0.0 },
-	{  0.5, -0.5,  0.5, 1.0,  	0.0,  0.0,  1.0,  1.0,  	0.0,  0.0,		1.0,  0.0,  0.0 },
-	{  0.5, -0.5, -0.5, 1.0,  	0.0,  0.0,  1.0,  1.0,  	1.0,  0.0,		1.0,  0.0,  0.0 },
-
-	{  0.5,  0.5, -0.5, 1.0,  	0.0,  0.0,  1.0,  1.0,  	1.0,  1.0,		1.0,  0.0,  0.0 },
-	{  0.5,  0.5,  0.5, 1.0,  	0.0,  0.0,  1.0,  1.0,  	0.0,  1.0,		1.0,  0.0,  0.0 },
-	{  0.5, -0.5,  0.5, 1.0,  	0.0,  0.0,  1.0,  1.0,  	0.0,  0.0,		1.0,  0.0,  0.0 },
-
-	// RIGHT
-	{ -0.5,  0.5, -0.5, 1.0,  	1.0,  1.0,  0.0,  1.0,  	0.0,  1.0,	   -1.0,  0.0,  0.0 },
-	{ -0.5, -0.5, -0.5, 1.0,  	1.0,  1.0,  0.0,  1.0,  	0.0,  0.0,	   -1.0,  0.0,  0.0 },
-	{ -0.5, -0.5,  0.5, 1.0,  	1.0,  1.0,  0.0,  1.0,  	1.0,  0.0,	   -1.0,  0.0,  0.0 },
-
-	{ -0.5,  0.5, -0.5, 1.0,  	1.0,  1.0,  0.0,  1.0,  	0.0,  1.0,	   -1.0,  0.0,  0.0 },
-	{ -0.5, -0.5,  0.5, 1.0,  	1.0,  1.0,  0.0,  1.0,  	1.0,  0.0,	   -1.0,  0.0,  0.0 },
-	{ -0.5,  0.5,  0.5, 1.0,  	1.0,  1.0,  0.0,  1.0,  	1.0,  1.0,	   -1.0,  0.0,  0.0 },
-
-	// TOP
-	{ -0.5,  0.5, -0.5, 1.0,  	0.0,  1.0,  1.0,  1.0,  	0.0,  1.0,		0.0,  1.0,  0.0 },
-	{ -0.5,  0.5,  0.5, 1.0,  	0.0,  1.0,  1.0,  1.0,  	0.0,  0.0,		0.0,  1.0,  0.0 },
-	{  0.5,  0.5, -0.5, 1.0,  	0.0,  1.0,  1.0,  1.0,  	1.0,  1.0,		0.0,  1.0,  0.0 },
-
-	{ -0.5,  0.5,  0.5, 1.0,  	0.0,  1.0,  1.0,  1.0,		0.0,  0.0,		0.0,  1.0,  0.0 },
-	{  0.5,  0.5,  0.5, 1.0,  	0.0,  1.0,  1.0,  1.0,  	1.0,  0.0,		0.0,  1.0,  0.0 },
-	{  0.5,  0.5, -0.5, 1.0,  	0.0,  1.0,  1.0,  1.0,  	1.0,  1.0,		0.0,  1.0,  0.0 },
-
-	// BOTTOM
-	{ -0.5, -0.5, -0.5, 1.0,  	1.0,  0.0,  1.0,  1.0,  	0.0,  0.0,		0.0, -1.0,  0.0 },
-	{  0.5, -0.5, -0.5, 1.0,  	1.0,  0.0,  1.0,  1.0,  	1.0,  0.0,		0.0, -1.0,  0.0 },
-	{ -0.5, -0.5,  0.5, 1.0,  	1.0,  0.0,  1.0,  1.0,  	0.0,  1.0,		0.0, -1.0,  0.0 },
-
-	{ -0.5, -0.5,  0.5, 1.0,  	1.0,  0.0,  1.0,  1.0,  	0.0,  1.0,		0.0, -1.0,  0.0 },
-	{  0.5, -0.5, -0.5, 1.0,  	1.0,  0.0,  1.0,  1.0,  	1.0,  0.0,		0.0, -1.0,  0.0 },
-	{  0.5, -0.5,  0.5, 1.0,  	1.0,  0.0,  1.0,  1.0,  	1.0,  1.0,		0.0, -1.0,  0.0 }
-};
+	fprintf(stderr, "Loaded %s: %.1f MB, %d triangles, %d vertices in %.1f ms (%.1f MB/s)\n",
+			fileName, stats.fileSize / 1048576.0, (int)stats.triangles, (int)mesh.numVertices,
+			stats.totalMs, stats.fileSize / 1048576.0 / (stats.totalMs / 1000.0));
 
+	obj_free(&mesh);
+	return true;
+}
 
+// Welds the cube into indexed triangles
+void WeldCube(std::vector<mesh_vertex_t> &vertices, std::vector<unsigned int> &indices)
+{
+	const size_t numVertices = ARRAY_COUNT(UnitCube);
 
-// Reference variable for the buffer object
-GLuint bufferObject;
+	vertices.resize(numVertices);
+	indices.resize(numVertices);
+	vertices.resize(mesh_weld(UnitCube, numVertices, sizeof(mesh_vertex_t), &vertices[0], &indices[0]));
+}
 
+// Loads the mesh (the cube without -obj), generates its tangent frames,
+// optimizes its triangles for the post-transform cache and vertex fetch,
+// and uploads them packed
 void InitializeVertexBuffer()
 {
-	GLuint dataSize = sizeof(UnitCube);
-	VertexData* data = UnitCube;
+	std::vector<mesh_vertex_t> vertices;
+	std::vector<unsigned int> indices;
+
+	if(!meshFile || !LoadMesh(meshFile, vertices, indices))
+		WeldCube(vertices, indices);
+
+	// Vertices on mirrored texture seams are split, at most doubling them
+	double startTime = timer_now_ms();
+	size_t numLoaded = vertices.size();
+	vertices.resize(numLoaded * 2);
+	vertices.resize(tangent_space_generate(&vertices[0], numLoaded, &indices[0], indices.size(), threadPool));
+	size_t numUnique = vertices.size();
+	double tangentMs = timer_now_ms() - startTime;
+
+	startTime = timer_now_ms();
+	mesh_cache_stats_t before = mesh_cache_stats(&indices[0], indices.size(), numUnique);
+	mesh_optimize_vertex_cache(&indices[0], indices.size(), numUnique);
+	numUnique = mesh_optimize_vertex_fetch(&vertices[0], numUnique, sizeof(mesh_vertex_t), &indices[0], indices.size());
+	mesh_cache_stats_t after = mesh_cache_stats(&indices[0], indices.size(), numUnique);
+	double optimizeMs = timer_now_ms() - startTime;
+
+	meshRadius = 0.0f;
+	for(size_t v = 0; v < numUnique; v++)
+	{
+		const float *p = vertices[v].position;
+		meshRadius = std::max(meshRadius, p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+	}
+	meshRadius = sqrtf(meshRadius);
+
+	int normalFormat = GLEW_ARB_vertex_type_2_10_10_10_rev ? VERTEX_NORMAL_SNORM10 : VERTEX_NORMAL_SNORM8;
+	normalType = normalFormat == VERTEX_NORMAL_SNORM10 ? GL_INT_2_10_10_10_REV : GL_BYTE;
+
+	std::vector<packed_vertex_t> packed(numUnique);
+	pack_vertices(&vertices[0], numUnique, normalFormat, &packed[0]);
+
+	GLuint dataSize = numUnique * sizeof(packed_vertex_t);
+	packed_vertex_t* data = &packed[0];
 
 	// Create a buffer object
 	glGenBuffers(
@@ -329,294 +361,2629 @@ void InitializeVertexBuffer()
 				GL_ARRAY_BUFFER,		// What context is the buffer bound to?
 				dataSize,		// How much memory to allocate
 				data,				// The actual data
-				GL_STREAM_DRAW			// We write to the buffer each frame for animation. GL_STATIC_DRAW expects that we never change the buffer object, or at least very seldom.
+				GL_STATIC_DRAW			// The animation happens in the vertex shader, so the buffer never changes
 				);
 
 	// Unbind the buffer object
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
 
-//
-void ComputePositionOffsets(float &fXOffset, float &fYOffset)
-{
-	const float fLoopDuration = 10.0f;
-	const float fScale = 3.14159f * 2.0f / fLoopDuration;
+	// Indices go into a buffer of their own, 16 bits each where that reaches
+	indexCount = indices.size();
+	glGenBuffers(1, &indexBufferObject);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
+	size_t indexSize;
+	if(numUnique <= 65536)
+	{
+		std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+		indexType = GL_UNSIGNED_SHORT;
+		indexSize = sizeof(GLushort);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, &shortIndices[0], GL_STATIC_DRAW);
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		indexSize = sizeof(GLuint);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, &indices[0], GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	float fElapsedTime = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+	fprintf(stderr, "Mesh: %d triangles, %d vertices, %d bytes each (%d unpacked), %d bytes in all (%d unindexed), ACMR %.2f -> %.2f in %.1f ms\n",
+			(int)(indexCount / 3), (int)numUnique, (int)sizeof(packed_vertex_t), (int)sizeof(mesh_vertex_t),
+			(int)(dataSize + indexCount * indexSize), (int)(indexCount * sizeof(mesh_vertex_t)), before.acmr, after.acmr, optimizeMs);
+	fprintf(stderr, "Tangents: %d vertices split at mirrored seams, %.1f ms\n", (int)(numUnique - numLoaded), tangentMs);
+}
 
-	float fCurrTimeThroughLoop = fmodf(fElapsedTime, fLoopDuration);
+// INSTANCES
+// Every object is a copy of the mesh with its own place and phase of the
+// spin. Each frame the objects outside the view are culled with a BVH over
+// their bounding boxes, and the model-view matrices of the rest are
+// computed on the CPU and drawn with one instanced draw call.
 
-	fXOffset = cosf(fCurrTimeThroughLoop * fScale) * 0.5f;
-	fYOffset = sinf(fCurrTimeThroughLoop * fScale) * 0.5f;
-}
+// Number of objects (-instances); more than one are laid out in a lattice
+int numInstances = 1;
 
-/*
-void AdjustVertexData(float fXOffset, float fYOffset)
-{
-	// Allocate a new array to hold adjusted vertex data
-    std::vector<VertexData> fNewData(ARRAY_COUNT(vertexData));
+// Where the camera is (-camera): backed off until the whole lattice is in
+// view, or in the middle of it turning around, where most of it is behind
+enum CameraMode { CAMERA_OVERVIEW, CAMERA_INSIDE, NUM_CAMERA_MODES };
+const char *cameraModeNames[NUM_CAMERA_MODES] = { "overview", "inside" };
+int cameraMode = CAMERA_OVERVIEW;
 
-    // Copy block of memory
-    // void * memcpy ( void * destination, const void * source, size_t num );
-	memcpy(&fNewData[0], vertexData, sizeof(vertexData));
-    
-    for(int iVertex = 0; iVertex < ARRAY_COUNT(vertexData); iVertex++)
-    { 
-        fNewData[iVertex].position[0] += fXOffset;
-        fNewData[iVertex].position[1] += fYOffset;
-    }
-    
-    glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
-    // glBufferSubData: Write the new data into an existing buffer object without reinitializing it
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertexData), &fNewData[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
-*/
-// Vertex Array Object
-GLuint vao;
+// The materials of the material library (-library), see LoadMaterialLibrary().
+// Empty without one.
+std::vector<std::string> libraryMaterials;
 
-// 
-void init()
-{	
-	// 
-	InitializeProgram();
-	// 
-	InitializeVertexBuffer();
+struct SceneObject
+{
+	float position[3];
+	float phase;		// Added to the spin angle, in radians
+	int material;		// Index into libraryMaterials
+};
 
-    // 
-	glGenVertexArrays(1, &vao);
-	// 
-	glBindVertexArray(vao);
+std::vector<SceneObject> sceneObjects;
+std::vector<mat4_t> instanceMatrices;	// Of the visible objects, in the order of visibleObjects
+std::vector<float> instanceLayers;		// Their materials' texture array layers, in the same order
+mat4_t viewMatrix;				// World to camera space
+float cameraPosition[3];
+
+// The boxes are around the spheres the objects turn in, so the tree is
+// built once and never refitted
+std::vector<aabb_t> objectBounds;
+bvh_t objectTree;
+std::vector<int> visibleObjects;	// Indices into sceneObjects
+int numVisible;
+bool frustumCulling = true;		// 'u' draws everything
+bool depthPrepass = false;		// -prepass or 'z' lays down depth before shading
+GLuint instanceBufferObject;
+GLuint instanceLayerBufferObject;
+bool hardwareInstancing;		// ARB_instanced_arrays and ARB_draw_instanced
+
+// Lays the objects out in a cube lattice around the origin and backs the
+// camera off until the front of it fits the view. A single object sits
+// where the cube always has been.
+void InitializeInstances()
+{
+	int side = (int)ceilf(cbrtf((float)numInstances));
+	const float spacing = 2.0f;
+	float extent = 0.5f * (side - 1) * spacing + 1.0f;
+
+	sceneObjects.resize(numInstances);
+	instanceMatrices.resize(numInstances);
+	instanceLayers.resize(numInstances);
+	objectBounds.resize(numInstances);
+	visibleObjects.resize(numInstances);
+	for(int i = 0; i < numInstances; i++)
+	{
+		SceneObject &object = sceneObjects[i];
+		object.position[0] = (i % side - 0.5f * (side - 1)) * spacing;
+		object.position[1] = (i / side % side - 0.5f * (side - 1)) * spacing;
+		object.position[2] = (i / (side * side) - 0.5f * (side - 1)) * spacing;
+		object.phase = i * 2.39996f;	// Golden angle, so neighbours differ
+		object.material = libraryMaterials.empty() ? 0 : i % (int)libraryMaterials.size();
+
+		for(int a = 0; a < 3; a++)
+		{
+			objectBounds[i].min[a] = object.position[a] - meshRadius;
+			objectBounds[i].max[a] = object.position[a] + meshRadius;
+		}
+	}
 
+	double startTime = timer_now_ms();
+	bvh_build(&objectTree, &objectBounds[0], numInstances, 4);
+	fprintf(stderr, "BVH: %d objects, %d nodes in %.1f ms\n", numInstances, objectTree.numNodes, timer_now_ms() - startTime);
+
+	// Inside, the camera sits between the objects in the middle of the
+	// lattice; with an odd side one of them is at the centre
+	float offset = side % 2 ? 0.5f * spacing : 0.0f;
+	float distance = numInstances > 1 ? extent * (1.0f + frustumScale) : 2.0f;
+	cameraPosition[0] = cameraMode == CAMERA_INSIDE ? offset : 0.0f;
+	cameraPosition[1] = cameraMode == CAMERA_INSIDE ? offset : 0.0f;
+	cameraPosition[2] = cameraMode == CAMERA_INSIDE ? offset : distance;
+	mat4_translation(&viewMatrix, -cameraPosition[0], -cameraPosition[1], -cameraPosition[2]);
+
+	glGenBuffers(1, &instanceBufferObject);
+	glGenBuffers(1, &instanceLayerBufferObject);
+	hardwareInstancing = GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced;
+	if(!hardwareInstancing && numInstances > 1)
+		fprintf(stderr, "No instanced arrays, drawing %d objects one by one\n", numInstances);
+}
 
-	// Enable backface culling with counter-clockwise triangles
-	glEnable(GL_CULL_FACE);		// Enable culling
-	glCullFace(GL_BACK);		// Cull faces facing away from camera (GL_FRONT / GL_BACK / GL_FRONT_AND_BACK)
-	// NOTE: Figure out why the triangles face into the cube (probably something with the perspective transform).
-	glFrontFace(GL_CCW);		// Triangles are defined counter-clockwise (GL_CW / GL_CCW)
-	
-	// Set the texture maps
-	glUseProgram(theProgram);
-		// TEXTURE MAP
-		GLuint diffuseMapUniform = glGetUniformLocation(theProgram, "diffuseMap");
-		glUniform1i(diffuseMapUniform, 0);
-
-		GLuint diffuseMapID;
-		glActiveTexture(GL_TEXTURE0);
-		glGenTextures(1, &diffuseMapID); // Generate a unique texture ID
-		glBindTexture(GL_TEXTURE_2D, diffuseMapID); // Activate the texture
-
-		png_data_t *image = read_png((char*)"assets/photosculpt-graystonewall-diffuse.png");
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 
-		0, 
-		image->has_alpha ? GL_RGBA : GL_RGB,
-		image->width,
-		image->height, 
-		0, 
-		image->has_alpha ? GL_RGBA : GL_RGB,
-		GL_UNSIGNED_BYTE,
-		image->pixelData);
+// Turns the camera around once a loop when it is inside the lattice
+void UpdateCamera(float time)
+{
+	if(cameraMode != CAMERA_INSIDE)
+		return;
+
+	mat4_t rotation, translation;
+	float angle = fmodf(time, loopDuration) * (3.14159f * 2.0f / loopDuration);
+	mat4_rotation_y(&rotation, -angle);
+	mat4_translation(&translation, -cameraPosition[0], -cameraPosition[1], -cameraPosition[2]);
+	mat4_multiply(&viewMatrix, &rotation, &translation);
+}
 
+// Collects the objects whose bounds are in the view into visibleObjects.
+// Returns the time it took in milliseconds.
+double CullInstances()
+{
+	double startTime = timer_now_ms();
 
+	if(frustumCulling)
+	{
+		mat4_t clip;
+		frustum_t frustum;
 
-		// NORMAL MAP
-		GLuint normalMapUniform = glGetUniformLocation(theProgram, "normalMap");
-		glUniform1i(normalMapUniform, 1);
+		mat4_multiply(&clip, &perspectiveMatrix, &viewMatrix);
+		frustum_from_matrix(&frustum, &clip);
+		numVisible = frustum_cull_bvh(&frustum, &objectTree, &objectBounds[0], &visibleObjects[0], threadPool);
+	}
+	else
+	{
+		for(int i = 0; i < numInstances; i++)
+			visibleObjects[i] = i;
+		numVisible = numInstances;
+	}
 
-		GLuint normalMapID;
-		glActiveTexture(GL_TEXTURE1);
-		glGenTextures(1, &normalMapID); // Generate a unique texture ID
-		glBindTexture(GL_TEXTURE_2D, normalMapID); // Activate the texture
+	return timer_now_ms() - startTime;
+}
 
-		image = read_png((char*)"assets/photosculpt-graystonewall-normal.png");
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 
-		0, 
-		image->has_alpha ? GL_RGBA : GL_RGB,
-		image->width,
-		image->height, 
-		0, 
-		image->has_alpha ? GL_RGBA : GL_RGB,
-		GL_UNSIGNED_BYTE,
-		image->pixelData);
+// translation * rotY * rotX, then the view in front
+void UpdateInstanceRange(int begin, int end, void *arg)
+{
+	float angle = *(float*)arg;
 
+	for(int i = begin; i < end; i++)
+	{
+		const SceneObject &object = sceneObjects[visibleObjects[i]];
+		mat4_t rotY, rotX;
+
+		mat4_translation(&instanceMatrices[i], object.position[0], object.position[1], object.position[2]);
+		mat4_rotation_y(&rotY, angle + object.phase);
+		mat4_rotation_x(&rotX, angle + object.phase);
+		mat4_multiply(&instanceMatrices[i], &instanceMatrices[i], &rotY);
+		mat4_multiply(&instanceMatrices[i], &instanceMatrices[i], &rotX);
+		instanceLayers[i] = (float)object.material;
+	}
+	mat4_multiply_many(&instanceMatrices[begin], &viewMatrix, &instanceMatrices[begin], end - begin);
+}
 
-		// DISPLACEMENT MAP
-		GLuint displacementMapUniform = glGetUniformLocation(theProgram, "displacementMap");
-		glUniform1i(displacementMapUniform, 2);
+// Computes the model-view matrix of every visible object for the given
+// time and uploads them. Returns the time it took in milliseconds.
+double UpdateInstances(float time)
+{
+	double startTime = timer_now_ms();
 
-		GLuint displacementMapID;
-		glActiveTexture(GL_TEXTURE2);
-		glGenTextures(1, &displacementMapID); // Generate a unique texture ID
-		glBindTexture(GL_TEXTURE_2D, displacementMapID); // Activate the texture
+	// One turn per loopDuration seconds
+	float angle = fmodf(time, loopDuration) * (3.14159f * 2.0f / loopDuration);
+	parallel_for(threadPool, numVisible, 1024, UpdateInstanceRange, &angle);
 
-		image = read_png((char*)"assets/photosculpt-graystonewall-displace.png");
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 
-		0, 
-		image->has_alpha ? GL_RGBA : GL_RGB,
-		image->width,
-		image->height, 
-		0, 
-		image->has_alpha ? GL_RGBA : GL_RGB,
-		GL_UNSIGNED_BYTE,
-		image->pixelData);
+	// Orphan last frame's matrices rather than wait for the GPU to finish with them
+	render_stream_buffer(GL_ARRAY_BUFFER, instanceBufferObject, numInstances * sizeof(mat4_t),
+			numVisible * sizeof(mat4_t), &instanceMatrices[0]);
+	if(!libraryMaterials.empty())
+		render_stream_buffer(GL_ARRAY_BUFFER, instanceLayerBufferObject, numInstances * sizeof(float),
+				numVisible * sizeof(float), &instanceLayers[0]);
 
-	glUseProgram(0);
+	return timer_now_ms() - startTime;
 }
 
-void display()
+// Records where the vertex and instance attributes come from in the
+// vertex array, once instead of every frame
+void InitializeVertexArray()
 {
+	glGenVertexArrays(1, &vao);
+	render_bind_vertex_array(vao);
 
-	// Set the default color of the viewport
-	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-	// Tell OpenGL to clear the viewport to the specified clear color
-	glClear(GL_COLOR_BUFFER_BIT); // The glClear() call affects the color buffer
-
-	// Tell OpenGL to user the shader program at "theProgram"
-	glUseProgram(theProgram);
-
-	// Send the offset values to the shader - move vertices in shader
-	glUniform1f(timeUniform, glutGet(GLUT_ELAPSED_TIME) / 1000.0f);
+	// The element buffer binding is part of the vertex array
+	render_bind_buffer(GL_ARRAY_BUFFER, bufferObject);
+	render_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
 
-	// Bind the buffer object
-	glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
-	
 	// 
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 	glEnableVertexAttribArray(2);
 	glEnableVertexAttribArray(3);
 
-	//fprintf(stderr, "%i\n", (int)sizeof(VertexData));
-
 	// Tell OpenGL how the data in memory is formatted
 	glVertexAttribPointer(
 							0,			// 
-							4,			// How many values represent a single piece of data?
+							3,			// How many values represent a single piece of data? w defaults to 1
 							GL_FLOAT,	// What base type does the data have?
 							GL_FALSE,	// 
-							sizeof(VertexData),			// Spacing from start to start; 4*4*2; sizeof(float) * n_floats * stream_offset
-							0			// At what byte offset does the data begin?
+							sizeof(packed_vertex_t),	// Spacing from start to start
+							(void*)offsetof(packed_vertex_t, position)	// At what byte offset does the data begin?
 						);
 
 	// Tell OpenGL how the data in memory is formatted
 	glVertexAttribPointer(
 							1,			// 
-							4,			// How many values represent a single piece of data?
-							GL_FLOAT,	// What base type does the data have?
+							2,			// How many values represent a single piece of data?
+							GL_HALF_FLOAT,	// What base type does the data have?
 							GL_FALSE,	// 
-							sizeof(VertexData),			// How much spacing is there between each set of values?
-							(void*)16	// The data begins at 4*4*1; float_size * n_floats * stream_offset
+							sizeof(packed_vertex_t),	// How much spacing is there between each set of values?
+							(void*)offsetof(packed_vertex_t, texCoord)
 						);
 
 	// Tell OpenGL how the data in memory is formatted
 	glVertexAttribPointer(
 							2,			// 
-							2,			// How many values represent a single piece of data?
-							GL_FLOAT,	// What base type does the data have?
-							GL_FALSE,	// 
-							sizeof(VertexData),			// How much spacing is there between each set of values?
-							(void*)32	// The data begins at 4*4*1; float_size * n_floats * stream_offset
+							4,			// How many values represent a single piece of data? The shader reads xyz
+							normalType,	// What base type does the data have?
+							GL_TRUE,	// Signed normalized, [-1, 1]
+							sizeof(packed_vertex_t),	// How much spacing is there between each set of values?
+							(void*)offsetof(packed_vertex_t, normal)
 						);
 
 	// Tell OpenGL how the data in memory is formatted
 	glVertexAttribPointer(
 							3,			// 
-							3,			// How many values represent a single piece of data?
-							GL_FLOAT,	// What base type does the data have?
-							GL_FALSE,	// 
-							sizeof(VertexData),			// How much spacing is there between each set of values?
-							(void*)40	// The data begins at 4*4*1; float_size * n_floats * stream_offset
+							4,			// How many values represent a single piece of data? w is the handedness
+							normalType,	// Same format as the normal
+							GL_TRUE,	// Signed normalized, [-1, 1]
+							sizeof(packed_vertex_t),	// How much spacing is there between each set of values?
+							(void*)offsetof(packed_vertex_t, tangent)
 						);
 
-	// Tell OpenGL to draw the contents of the vertex buffer
-	glDrawArrays(
-				GL_TRIANGLES,	// The vertex data should be assembled into triangles
-				0,				// Begin to read at position
-				36				// Number of values to read
-				);
+	// The matrix takes four attributes, one column each, that advance once
+	// per instance. Orphaning the buffer keeps its name, so this holds.
+	if(hardwareInstancing)
+	{
+		render_bind_buffer(GL_ARRAY_BUFFER, instanceBufferObject);
+		for(int c = 0; c < 4; c++)
+		{
+			glEnableVertexAttribArray(4 + c);
+			glVertexAttribPointer(4 + c, 4, GL_FLOAT, GL_FALSE, sizeof(mat4_t), (void*)(sizeof(float) * 4 * c));
+			glVertexAttribDivisorARB(4 + c, 1);
+		}
 
-	// Clean up the OpenGL "workspace" where we've changed stuff
-	glDisableVertexAttribArray(0);	// 
-	glDisableVertexAttribArray(1);	// 
-	glDisableVertexAttribArray(2);	// 
-	glDisableVertexAttribArray(3);	// 
-	glUseProgram(0);				// Unbind the shader program
+		// The material library's layer, the same way
+		if(!libraryMaterials.empty())
+		{
+			render_bind_buffer(GL_ARRAY_BUFFER, instanceLayerBufferObject);
+			glEnableVertexAttribArray(8);
+			glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+			glVertexAttribDivisorARB(8, 1);
+		}
+	}
 
-	// We use double buffering, so glutSwapBuffers() shows the rendered image
-	glutSwapBuffers();
-	glutPostRedisplay();
+	render_list_init(&drawList);
 }
 
-void reshape(int w, int h)
+// Adds the draws of the visible objects to the draw list, with the given
+// program and material (-1 for none)
+void DrawInstances(GLuint program, int material)
 {
-	// 
-	perspectiveMatrix[0] = frustumScale / (w / (float)h);
-	perspectiveMatrix[5] = frustumScale;
+	if(numVisible == 0)
+		return;
 
-	glUseProgram(theProgram);
-		glUniformMatrix4fv(perspectiveMatrixUni, 1, GL_TRUE, perspectiveMatrix);
-	glUseProgram(0);
+	if(hardwareInstancing)
+	{
+		render_command_t *command = render_list_add(&drawList);
+		command->program = program;
+		command->material = material;
+		command->vertexArray = vao;
+		command->indexType = indexType;
+		command->indexCount = indexCount;
+		command->instances = numVisible;
+		return;
+	}
 
-	// Tell OpenGL what area of the available area we are rendering to
-	// Note: This is bottom-left oriented, so (0,0) is at the bottom-left corner
-	glViewport(
-				0,				// Starting width-coordinate
-				0,				// Starting height-coordinate
-				(GLsizei) w,	// The width (here we use the whole window width)
-				(GLsizei) h		// The height (here we use the whole window height)
-			);
+	// Without instanced arrays the matrix and the layer are constant
+	// attributes per draw
+	for(int i = 0; i < numVisible; i++)
+	{
+		render_command_t *command = render_list_add(&drawList);
+		command->program = program;
+		command->material = material;
+		command->vertexArray = vao;
+		command->indexType = indexType;
+		command->indexCount = indexCount;
+		command->matrixAttrib = 4;
+		command->matrix = instanceMatrices[i].m;
+		command->layerAttrib = 8;
+		command->layer = libraryMaterials.empty() ? NULL : &instanceLayers[i];
+	}
 }
 
-//Called whenever a key on the keyboard was pressed.
-//The key is given by the ''key'' parameter, which is in ASCII.
-//It's often a good idea to have the escape key (ASCII value 27) call glutLeaveMainLoop() to 
-//exit the program.
-void keyboard(unsigned char key, int x, int y)
-{	
-	switch (key)
-	{
-		case 27:
-			exit(1);
+//
+void ComputePositionOffsets(float &fXOffset, float &fYOffset)
+{
+	const float fLoopDuration = 10.0f;
+	const float fScale = 3.14159f * 2.0f / fLoopDuration;
 
-		default:
-			fprintf(stderr, "Key: %i\n", (int)key);
-	}
+	float fElapsedTime = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+
+	float fCurrTimeThroughLoop = fmodf(fElapsedTime, fLoopDuration);
+
+	fXOffset = cosf(fCurrTimeThroughLoop * fScale) * 0.5f;
+	fYOffset = sinf(fCurrTimeThroughLoop * fScale) * 0.5f;
 }
 
+/*
+void AdjustVertexData(float fXOffset, float fYOffset)
+{
+	// Allocate a new array to hold adjusted vertex data
+    std::vector<VertexData> fNewData(ARRAY_COUNT(vertexData));
 
-// Diskutera denna skit!
-int main(int argc, char *argv[]){
+    // Copy block of memory
+    // void * memcpy ( void * destination, const void * source, size_t num );
+	memcpy(&fNewData[0], vertexData, sizeof(vertexData));
+    
+    for(int iVertex = 0; iVertex < ARRAY_COUNT(vertexData); iVertex++)
+    { 
+        fNewData[iVertex].position[0] += fXOffset;
+        fNewData[iVertex].position[1] += fYOffset;
+    }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
+    // glBufferSubData: Write the new data into an existing buffer object without reinitializing it
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertexData), &fNewData[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+*/
 
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_ALPHA);
+// The maps that make up the material, one texture unit each
+struct MaterialMap
+{
+	const char *uniformName;
+	GLenum textureUnit;
+	const char *fileName;		// PNG or JPEG
+	const char *fileSuffix;		// After the material's name, see SetMaterialFiles()
+	unsigned int packMapType;	// Which map of a baked texture pack to use
+	int mipFilter;				// How to build the mip chain from the image
+};
 
-	
-	glutInitWindowPosition(850, 20);
-	glutInitWindowSize(560, 315);
-	glutCreateWindow("Demo");
+MaterialMap materialMaps[] = {
+	{ "diffuseMap",			GL_TEXTURE0,	"assets/photosculpt-graystonewall-diffuse.png",		"-diffuse",		TEXPACK_MAP_DIFFUSE,		MIP_FILTER_SRGB },
+	{ "normalMap",			GL_TEXTURE1,	"assets/photosculpt-graystonewall-normal.png",		"-normal",		TEXPACK_MAP_NORMAL,			MIP_FILTER_NORMAL },
+	{ "displacementMap",	GL_TEXTURE2,	"assets/photosculpt-graystonewall-displace.png",	"-displace",	TEXPACK_MAP_DISPLACEMENT,	MIP_FILTER_BOX }
+};
 
-	// ?!?!?!
-	glewExperimental = GL_TRUE;
-	glewInit();
+// Compare the CPU mip builder against glGenerateMipmap at startup (-mipbench)
+bool benchmarkMipmaps = false;
+
+// Material binding mode: normal and height in one RGBA texture (-packed)
+bool packNormalHeight = false;
+
+// Derive the normal map from the displacement map instead of reading its
+// file, and keep the heights at 16 bits (-heightnormals [sobel|scharr]).
+// The strength is the height range in texels; 0 takes the shader's
+// depth scale times the map's width (-normalstrength). The material
+// library still reads its normal maps.
+bool normalsFromHeight = false;
+int normalKernel = NORMAL_KERNEL_SCHARR;
+float normalStrength = 0.0f;
+const float pomDepthScale = 0.03f;		// As in parallaxmapping.frag
+
+// Tangent frames from the vertex stream, or rebuilt per fragment from
+// screen-space derivatives (-derivativetbn, 't' toggles)
+bool vertexTangents = true;
+
+// Mip chains built from the decoded maps, one per map
+mip_chain_t materialMips[ARRAY_COUNT(materialMaps)];
+
+// Cone ratios of the displacement map for cone step mapping (see
+// lib/cone_map.h). Built along with the displacement mips or taken from
+// the texture pack, one level on a unit of its own.
+#define CONE_MAP_UNIT GL_TEXTURE3
+unsigned char *coneMapData = NULL;
+int coneMapWidth, coneMapHeight;
+double coneMapMs;
+bool coneMapLoaded = false;
+
+// Min/max pyramid of the displacement map for the maximum mipmap mode (see
+// lib/height_pyramid.h). Kept after the upload so 'e' can edit it.
+#define HEIGHT_PYRAMID_UNIT GL_TEXTURE4
+height_pyramid_t heightPyramid;
+double heightPyramidMs;
+GLuint heightPyramidTexture = 0;
+
+// Virtual texture of the normal and height maps, made by tools/vtbake.c
+// (-virtual file.vtex). Only the pages the view needs are in video memory,
+// in a physical cache of -vtbudget megabytes (see lib/vt_cache.h). A
+// feedback pass at a fraction of the window size tells which pages those
+// are; it is read back a frame later so the GPU is never waited for.
+#define VT_PAGE_TABLE_UNIT GL_TEXTURE5
+#define VT_CACHE_UNIT GL_TEXTURE6
+#define VT_FEEDBACK_SCALE 4
+#define VT_UPLOADS_PER_FRAME 16
+#define VT_MAX_LOADS 64
+const char *virtualTextureFile = NULL;
+int virtualTextureBudget = 64;		// Megabytes
+bool vtWaitForLoads = false;		// Wait for every tile read, so frames repeat
+vt_file_t *vtFile = NULL;
+vt_cache_t *vtCache = NULL;
+GLuint vtPageTableTexture, vtCacheTexture;
+int vtCacheWidth, vtCacheHeight;
+GLuint vtFeedbackProgram;
+GLuint vtFeedbackFbo, vtFeedbackColor, vtFeedbackDepth;
+int vtFeedbackWidth, vtFeedbackHeight;
+GLuint vtFeedbackBuffers[2];		// Pixel buffers, one being written while the other is read
+bool vtFeedbackPending[2];
+unsigned int vtFeedbackFrame = 0;
+
+// The specular maps of a material library (-library), which the single
+// material doesn't have
+#define SPECULAR_MAP_UNIT GL_TEXTURE7
+
+// How the shader finds the shifted texture coordinates, cycled with 'p'
+// (-parallax offset|occlusion|cone|pyramid|none). None is plain normal
+// mapping.
+enum ParallaxMode { PARALLAX_OFFSET, PARALLAX_OCCLUSION, PARALLAX_CONE, PARALLAX_PYRAMID, PARALLAX_NONE, NUM_PARALLAX_MODES };
+const char *parallaxModeNames[NUM_PARALLAX_MODES] = { "offset", "occlusion", "cone", "pyramid", "none" };
+int parallaxMode = PARALLAX_OFFSET;
+
+// Step counts of the occlusion mapping, cone step and maximum mipmap ray
+// marches, and where the parallax LOD fades out, keys 1-3
+// (-quality low|medium|high)
+struct ParallaxQuality
+{
+	const char *name;
+	int minSteps;		// Looking straight at the surface
+	int maxSteps;		// At grazing angles
+	int refineSteps;	// Binary search steps after the hit
+	int coneSteps;		// Cone steps, never past the surface so no search
+	int pyramidSteps;	// Texel visits of the maximum mipmap traversal
+	float lodMinPixels;	// Parallax shift on screen below which only the
+	float lodMaxPixels;	// normal map is used, and from which it is in full
+};
 
-	// 
-	init();
+ParallaxQuality parallaxQualities[] = {
+	{ "low",	4,	12,	2,	8,	32,		1.0f,	4.0f },
+	{ "medium",	8,	24,	4,	16,	64,		0.5f,	2.0f },
+	{ "high",	16,	48,	6,	32,	128,	0.25f,	1.0f }
+};
+int parallaxQuality = 1;
 
-	glutDisplayFunc(display);
-	glutReshapeFunc(reshape);
-	glutKeyboardFunc(keyboard);
+// Fade the parallax out to plain normal mapping where its shift is too
+// small to see (-nolod, 'l' toggles). See calcParallaxWeight() in
+// parallaxmapping.frag.
+bool parallaxLod = true;
 
-	glutMainLoop();
-}
\ No newline at end of file
+// Window size, also the size of the headless frames (-size WxH)
+int windowWidth = 560;
+int windowHeight = 315;
+
+// Simulated seconds per frame (-timestep). With 0 the animation follows
+// the wall clock; otherwise every frame advances time by exactly this much
+// so runs can be repeated.
+float fixedTimestep = 0.0f;
+int frameNumber = 0;
+
+// Render this many frames into an FBO without a window and exit (-headless)
+int headlessFrames = 0;
+
+// Write every rendered frame to <prefix>NNNN.png (-dump)
+const char *frameDumpPrefix = NULL;
+
+// Frame timing (-stats [file.csv]): CPU time of every frame and GPU time of
+// every pass, summarized as percentiles at exit. 'o' shows the running
+// averages in the window title.
+bool collectStats = false;
+const char *statsFile = NULL;
+bool statsOverlay = false;
+
+// The parts of a frame that get their own GL_TIME_ELAPSED query
+enum GpuPass { GPU_PASS_DEPTH, GPU_PASS_SCENE, NUM_GPU_PASSES };
+
+// Fragments that ran the parallax shader, the pixels of the first two LOD
+// tiers and the pixels the scene covers, counted with GL_SAMPLES_PASSED
+// in this order. Shaded over covered is the overdraw.
+enum SampleCount { SAMPLES_SHADED, SAMPLES_LOD_PARALLAX, SAMPLES_LOD_BLEND, SAMPLES_COVERED, NUM_SAMPLE_COUNTS };
+
+// Query results are read back this many frames late, so reading them
+// never makes the CPU wait for the GPU
+#define GPU_TIMER_FRAMES 2
+
+enum { STAT_INTERVAL, STAT_CPU, STAT_CULL, STAT_CULLED, STAT_INSTANCES, STAT_GL_CALLS, STAT_STATE_CHANGES, STAT_OVERDRAW, STAT_LOD_PARALLAX, STAT_LOD_BLEND, STAT_LOD_NORMAL, STAT_VT, STAT_VT_UPLOADS, STAT_VT_MISSING, STAT_GPU_FIRST, NUM_STATS = STAT_GPU_FIRST + NUM_GPU_PASSES };
+const char *statNames[NUM_STATS] = { "interval_ms", "cpu_ms", "cull_ms", "culled_pct", "instances_ms", "gl_calls", "gl_state_changes", "overdraw", "lod_parallax_pct", "lod_blend_pct", "lod_normal_pct", "vt_ms", "vt_uploads", "vt_missing", "gpu_depth_ms", "gpu_scene_ms" };
+
+struct FrameTiming
+{
+	int frame;
+	bool pending;				// Still waiting for its GPU queries
+	double values[NUM_STATS];
+	GLuint queries[NUM_GPU_PASSES];
+	GLuint sampleQueries[NUM_SAMPLE_COUNTS];
+};
+
+frame_stats_t *frameStats = NULL;
+FrameTiming frameTimings[GPU_TIMER_FRAMES];
+bool gpuTimers = false;
+int timingFrame = 0;
+double frameStartMs = 0.0;
+double lastFrameStartMs = -1.0;
+
+// Sums for the title overlay since it was last updated
+double overlayStartMs = 0.0;
+double overlaySums[NUM_STATS];
+int overlayCounts[NUM_STATS];
+
+// Baked version of the material above, made with bin/bake. Used instead of
+// the PNG or JPEG maps when it exists.
+const char *materialPackFile = "assets/photosculpt-graystonewall.texpack";
+
+// The file of one of a material's maps: <name><suffix>.png, or .jpg where
+// there is no PNG
+std::string MaterialMapFile(const char *name, const char *suffix)
+{
+	std::string fileName = std::string(name) + suffix + ".png";
+	FILE *file = fopen(fileName.c_str(), "rb");
+	if(file)
+		fclose(file);
+	else
+		fileName = std::string(name) + suffix + ".jpg";
+	return fileName;
+}
+
+// Switches to another material (-material), e.g.
+// assets/photosculpt/photosculpt-mud: its maps are <name>-diffuse.png and
+// so on, and its pack <name>.texpack.
+void SetMaterialFiles(const char *name)
+{
+	static std::string fileNames[ARRAY_COUNT(materialMaps)];
+	static std::string packFile;
+
+	for(unsigned int i = 0; i < ARRAY_COUNT(materialMaps); i++)
+	{
+		fileNames[i] = MaterialMapFile(name, materialMaps[i].fileSuffix);
+		materialMaps[i].fileName = fileNames[i].c_str();
+	}
+
+	packFile = std::string(name) + ".texpack";
+	materialPackFile = packFile.c_str();
+}
+
+// Reads the manifest of a material library (-library): one material per
+// line, named as for -material. Blank lines and lines starting with # are
+// skipped.
+bool ReadMaterialManifest(const char *fileName)
+{
+	FILE *file = fopen(fileName, "r");
+	if(!file)
+	{
+		fprintf(stderr, "Can't open material manifest %s\n", fileName);
+		return false;
+	}
+
+	char line[1024];
+	while(fgets(line, sizeof(line), file))
+	{
+		char *name = line + strspn(line, " \t");
+		size_t length = strcspn(name, "\r\n");
+		while(length > 0 && (name[length - 1] == ' ' || name[length - 1] == '\t'))
+			length--;
+		if(length > 0 && name[0] != '#')
+			libraryMaterials.push_back(std::string(name, length));
+	}
+	fclose(file);
+
+	if(libraryMaterials.empty())
+		fprintf(stderr, "Material manifest %s lists no materials\n", fileName);
+	return !libraryMaterials.empty();
+}
+
+// Pixel format for tightly packed 8-bit data with the given channel count
+GLenum GetPixelFormat(int channels)
+{
+	switch(channels)
+	{
+		case 1: return GL_RED;
+		case 2: return GL_RG;
+		case 4: return GL_RGBA;
+	}
+	return GL_RGB;
+}
+
+// Generates a texture on the given unit and sets the sampling state
+GLuint GenTexture(GLenum textureUnit, int numLevels, GLenum target = GL_TEXTURE_2D)
+{
+	GLuint textureID;
+	glGenTextures(1, &textureID); // Generate a unique texture ID
+	render_bind_texture(textureUnit, target, textureID); // Activate the texture
+
+	// Draws with the material bind it here again
+	render_material_set_texture(&sceneMaterial, textureUnit, target, textureID);
+
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, numLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+	// Rows are tightly packed, whatever their width
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	return textureID;
+}
+
+// Creates a texture on the given unit and uploads every level of a mip
+// chain. Chains of GL_UNSIGNED_SHORT (see mip_chain_build16()) stay at 16
+// bits on the GPU.
+GLuint CreateTexture(GLenum textureUnit, const mip_chain_t *chain, GLenum type = GL_UNSIGNED_BYTE)
+{
+	GLuint textureID = GenTexture(textureUnit, chain->numLevels);
+
+	GLenum format = GetPixelFormat(chain->channels);
+	GLenum internalFormat = type == GL_UNSIGNED_SHORT && chain->channels == 1 ? GL_R16 : format;
+	for(int level = 0; level < chain->numLevels; level++)
+		glTexImage2D(GL_TEXTURE_2D, 
+		level, 
+		internalFormat,
+		chain->levels[level].width,
+		chain->levels[level].height, 
+		0, 
+		format,
+		type,
+		chain->levels[level].data);
+
+	return textureID;
+}
+
+// Finds the cone ratios of a decoded displacement map, spread over the pool
+void BuildConeMap(png_data_t *image)
+{
+	double startTime = timer_now_ms();
+
+	coneMapWidth = image->width;
+	coneMapHeight = image->height;
+	coneMapData = (unsigned char*)malloc((size_t)image->width * image->height);
+	cone_map_build(image->pixelData, image->width, image->height, image->channels, coneMapData, threadPool);
+
+	coneMapMs = timer_now_ms() - startTime;
+}
+
+// Uploads and releases the cone map made by BuildConeMap()
+void UploadConeMap()
+{
+	GenTexture(CONE_MAP_UNIT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, coneMapWidth, coneMapHeight, 0, GL_RED, GL_UNSIGNED_BYTE, coneMapData);
+
+	free(coneMapData);
+	coneMapData = NULL;
+	coneMapLoaded = true;
+
+	fprintf(stderr, "Built the %dx%d cone map in %.1f ms\n", coneMapWidth, coneMapHeight, coneMapMs);
+}
+
+// Builds the height pyramid of a decoded displacement map on the pool
+void BuildHeightPyramid(const unsigned char *heights, int width, int height, int channels)
+{
+	double startTime = timer_now_ms();
+	height_pyramid_build(&heightPyramid, heights, width, height, channels, threadPool);
+	heightPyramidMs = timer_now_ms() - startTime;
+}
+
+// Uploads the height pyramid with nearest sampling, since the traversal
+// treats every texel as a flat box
+void UploadHeightPyramid()
+{
+	heightPyramidTexture = CreateTexture(HEIGHT_PYRAMID_UNIT, &heightPyramid.chain);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+
+	const mip_level_t *base = &heightPyramid.chain.levels[0];
+	fprintf(stderr, "Built the %dx%d height pyramid in %.1f ms\n", base->width, base->height, heightPyramidMs);
+}
+
+// Re-uploads the texels of the height pyramid that changed since the last
+// call, level by level
+void UploadHeightPyramidChanges()
+{
+	render_bind_texture(HEIGHT_PYRAMID_UNIT, GL_TEXTURE_2D, heightPyramidTexture);
+
+	for(int level = 0; level < heightPyramid.chain.numLevels; level++)
+	{
+		const height_rect_t *rect = &heightPyramid.dirty[level];
+		const mip_level_t *data = &heightPyramid.chain.levels[level];
+		if(rect->width == 0 || rect->height == 0)
+			continue;
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, data->width);
+		glTexSubImage2D(GL_TEXTURE_2D, level, rect->x, rect->y, rect->width, rect->height, GL_RG, GL_UNSIGNED_BYTE,
+						data->data + ((size_t)rect->y * data->width + rect->x) * 2);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	height_pyramid_clear_dirty(&heightPyramid);
+}
+
+// Presses a crater into the height pyramid at a random spot, rebuilding and
+// uploading only what it touches ('e'). Only the maximum mipmap mode sees
+// it; the other maps stay as they are.
+void EditHeightPyramid()
+{
+	if(heightPyramidTexture == 0)
+		return;
+
+	const int radius = 24, size = radius * 2;
+	const mip_level_t *base = &heightPyramid.chain.levels[0];
+	if(base->width < size || base->height < size)
+		return;
+
+	int x0 = rand() % (base->width - size + 1);
+	int y0 = rand() % (base->height - size + 1);
+
+	unsigned char patch[size * size];
+	for(int y = 0; y < size; y++)
+		for(int x = 0; x < size; x++)
+		{
+			float dx = (x + 0.5f - radius) / radius, dy = (y + 0.5f - radius) / radius;
+			float depth = 1.0f - (dx * dx + dy * dy);
+			int h = height_pyramid_height(&heightPyramid, x0 + x, y0 + y);
+			if(depth > 0.0f)
+				h = (int)(h * (1.0f - 0.8f * depth));
+			patch[y * size + x] = (unsigned char)h;
+		}
+
+	double startTime = timer_now_ms();
+	height_pyramid_update(&heightPyramid, patch, 1, size, x0, y0, size, size, threadPool);
+	double updateMs = timer_now_ms() - startTime;
+
+	startTime = timer_now_ms();
+	UploadHeightPyramidChanges();
+	double uploadMs = timer_now_ms() - startTime;
+
+	fprintf(stderr, "Crater at %d,%d: pyramid update %.3f ms, upload %.3f ms (full build %.1f ms)\n",
+			x0, y0, updateMs, uploadMs, heightPyramidMs);
+}
+
+// Opens the virtual texture and creates its page table and physical cache.
+// Without one, or if it can't be read, the material maps are used.
+void InitializeVirtualTexture()
+{
+	if(!virtualTextureFile)
+		return;
+
+	vtFile = vt_file_open(virtualTextureFile);
+	if(!vtFile)
+		return;
+
+	// As many slots as the budget holds, in a square that fits a texture
+	GLint maxTextureSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	int numSlots = (int)(virtualTextureBudget * 1048576.0 / vtFile->tileBytes);
+	int slotsX = (int)sqrtf((float)numSlots);
+	slotsX = std::max(1, std::min(slotsX, std::min(256, maxTextureSize / vtFile->tileSize)));
+	int slotsY = std::max(1, std::min(numSlots / slotsX, std::min(256, maxTextureSize / vtFile->tileSize)));
+
+	vtCache = vt_cache_create(vtFile, slotsX, slotsY, VT_MAX_LOADS, threadPool);
+	if(!vtCache)
+	{
+		vt_file_close(vtFile);
+		vtFile = NULL;
+		return;
+	}
+
+	// Filtered within a tile, the borders keep it from reaching the next
+	vtCacheWidth = slotsX * vtFile->tileSize;
+	vtCacheHeight = slotsY * vtFile->tileSize;
+	vtCacheTexture = GenTexture(VT_CACHE_UNIT, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, vtCacheWidth, vtCacheHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	// One level per level of the virtual texture, one texel per page
+	int numLevels = vtFile->header.numLevels;
+	vtPageTableTexture = GenTexture(VT_PAGE_TABLE_UNIT, numLevels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	for(int level = 0; level < numLevels; level++)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, vt_file_pages(vtFile, level), vt_file_pages(vtFile, level), 0,
+					GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	glGenBuffers(2, vtFeedbackBuffers);
+
+	int size = vtFile->header.pageSize << (numLevels - 1);
+	fprintf(stderr, "Virtual texture %s: %dx%d texels in %d levels, cache of %dx%d pages (%.1f MB)\n",
+			virtualTextureFile, size, size, numLevels, slotsX, slotsY,
+			(double)slotsX * slotsY * vtFile->tileBytes / 1048576.0);
+}
+
+// (Re)creates the feedback framebuffer and the pixel buffers it is read
+// into for a window size
+void ResizeVirtualTextureFeedback(int w, int h)
+{
+	if(vtFeedbackFbo)
+	{
+		glDeleteFramebuffers(1, &vtFeedbackFbo);
+		glDeleteRenderbuffers(1, &vtFeedbackColor);
+		glDeleteRenderbuffers(1, &vtFeedbackDepth);
+	}
+
+	vtFeedbackWidth = std::max(1, w / VT_FEEDBACK_SCALE);
+	vtFeedbackHeight = std::max(1, h / VT_FEEDBACK_SCALE);
+
+	glGenRenderbuffers(1, &vtFeedbackColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, vtFeedbackColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, vtFeedbackWidth, vtFeedbackHeight);
+	glGenRenderbuffers(1, &vtFeedbackDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, vtFeedbackDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, vtFeedbackWidth, vtFeedbackHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLint framebuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	glGenFramebuffers(1, &vtFeedbackFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, vtFeedbackFbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, vtFeedbackColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, vtFeedbackDepth);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		fprintf(stderr, "Virtual texture feedback framebuffer is incomplete\n");
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	// What is in them is for the old size
+	for(int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, vtFeedbackBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, vtFeedbackWidth * vtFeedbackHeight * 4, NULL, GL_STREAM_READ);
+		vtFeedbackPending[i] = false;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Copies a tile read by the cache into its slot of the physical cache
+void UploadVirtualTile(int slotX, int slotY, const unsigned char *tile, void *arg)
+{
+	int tileSize = vtFile->tileSize;
+	glTexSubImage2D(GL_TEXTURE_2D, 0, slotX * tileSize, slotY * tileSize, tileSize, tileSize, GL_RGBA, GL_UNSIGNED_BYTE, tile);
+}
+
+// Streams the virtual texture: hands the feedback of the last frame to the
+// cache, uploads the tiles read since, and draws this frame's feedback.
+// Returns the CPU time it took in ms.
+double UpdateVirtualTexture()
+{
+	double startTime = timer_now_ms();
+	int current = vtFeedbackFrame % 2, previous = 1 - current;
+
+	if(vtFeedbackPending[previous])
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, vtFeedbackBuffers[previous]);
+		const unsigned char *texels = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if(texels)
+			vt_cache_feedback(vtCache, texels, vtFeedbackWidth * vtFeedbackHeight, vtFeedbackFrame - 1);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		vtFeedbackPending[previous] = false;
+	}
+
+	render_bind_texture(VT_CACHE_UNIT, GL_TEXTURE_2D, vtCacheTexture);
+	vt_cache_upload(vtCache, VT_UPLOADS_PER_FRAME, vtWaitForLoads, UploadVirtualTile, NULL);
+
+	if(vt_cache_update_page_table(vtCache))
+	{
+		render_bind_texture(VT_PAGE_TABLE_UNIT, GL_TEXTURE_2D, vtPageTableTexture);
+		for(int level = 0; level < (int)vtFile->header.numLevels; level++)
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, vt_file_pages(vtFile, level), vt_file_pages(vtFile, level),
+							GL_RGBA, GL_UNSIGNED_BYTE, vt_cache_page_table(vtCache, level));
+	}
+
+	// The pages this frame needs, drawn small. The clear color is zero,
+	// which stands for no page.
+	GLint framebuffer, viewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, vtFeedbackFbo);
+	glViewport(0, 0, vtFeedbackWidth, vtFeedbackHeight);
+
+	render_color_write(GL_TRUE);
+	render_depth_state(GL_LESS, GL_TRUE);
+	render_clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	render_list_clear(&drawList);
+	DrawInstances(vtFeedbackProgram, -1);
+	render_list_submit(&drawList, &sceneMaterial);
+
+	// Into a pixel buffer, so this returns before the GPU gets to it
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, vtFeedbackBuffers[current]);
+	glReadPixels(0, 0, vtFeedbackWidth, vtFeedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	vtFeedbackPending[current] = true;
+	vtFeedbackFrame++;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	return timer_now_ms() - startTime;
+}
+
+// Index of the material map of a texture pack map type
+int FindMaterialMap(unsigned int packMapType)
+{
+	for(int i = 0; i < (int)ARRAY_COUNT(materialMaps); i++)
+		if(materialMaps[i].packMapType == packMapType)
+			return i;
+	return -1;
+}
+
+// Normal map derived from the heights by DeriveNormalMap(), kept until it
+// has been uploaded
+unsigned char *derivedNormals = NULL;
+float derivedNormalStrength;
+double derivedNormalsMs;
+
+// Derives the normal map from 16-bit heights and builds its mips in the
+// normal map's chain, on the pool
+void DeriveNormalMap(const png_data_t *heights)
+{
+	double startTime = timer_now_ms();
+	int width = heights->width, height = heights->height;
+
+	derivedNormalStrength = normalStrength > 0.0f ? normalStrength : pomDepthScale * width;
+	derivedNormals = (unsigned char*)malloc((size_t)width * height * 3);
+	normal_map_build((const unsigned short*)heights->pixelData, width, height, derivedNormalStrength, normalKernel,
+					 derivedNormals, threadPool);
+	derivedNormalsMs = timer_now_ms() - startTime;
+
+	mip_chain_build(&materialMips[FindMaterialMap(TEXPACK_MAP_NORMAL)], derivedNormals, width, height, 3,
+					MIP_FILTER_NORMAL, threadPool);
+}
+
+// 16-bit heights (-heightnormals) keep all their bits in their own chain
+// and give the normal map. The cone map and height pyramid are 8-bit
+// maps, so they are built from a rounded copy.
+void BuildHeightMaps16(mip_chain_t *chain, png_data_t *image)
+{
+	const unsigned short *heights = (const unsigned short*)image->pixelData;
+	size_t numTexels = (size_t)image->width * image->height;
+
+	mip_chain_build16(chain, (unsigned short*)image->pixelData, image->width, image->height, threadPool);
+	DeriveNormalMap(image);
+
+	png_data_t heights8 = *image;
+	heights8.pixelData = (unsigned char*)malloc(numTexels);
+	heights8.bit_depth = 8;
+	for(size_t i = 0; i < numTexels; i++)
+		heights8.pixelData[i] = (unsigned char)((heights[i] + 128) / 257);
+
+	BuildConeMap(&heights8);
+	BuildHeightPyramid(heights8.pixelData, heights8.width, heights8.height, 1);
+	free(heights8.pixelData);
+}
+
+// Runs on a worker thread right after a map has been decoded
+void BuildMaterialMips(texture_load_t *load)
+{
+	MaterialMap *map = (MaterialMap*)load->userData;
+	mip_chain_t *chain = &materialMips[map - materialMaps];
+	png_data_t *image = load->image;
+
+	if(image->bit_depth == 16)
+	{
+		BuildHeightMaps16(chain, image);
+		return;
+	}
+
+	mip_chain_build(chain, image->pixelData, image->width, image->height, image->channels, map->mipFilter, threadPool);
+
+	if(map->packMapType == TEXPACK_MAP_DISPLACEMENT)
+	{
+		BuildConeMap(image);
+		BuildHeightPyramid(image->pixelData, image->width, image->height, image->channels);
+	}
+}
+
+// Times the CPU mip builder, on one thread and on the pool, against the
+// driver's glGenerateMipmap for the same image
+void BenchmarkMipmaps(const char *fileName, png_data_t *image, int filter)
+{
+	mip_chain_t chain;
+
+	double start = timer_now_ms();
+	mip_chain_build(&chain, image->pixelData, image->width, image->height, image->channels, filter, NULL);
+	double cpuSingleMs = timer_now_ms() - start;
+	mip_chain_free(&chain);
+
+	start = timer_now_ms();
+	mip_chain_build(&chain, image->pixelData, image->width, image->height, image->channels, filter, threadPool);
+	double cpuPoolMs = timer_now_ms() - start;
+	mip_chain_free(&chain);
+
+	// Level 0 is uploaded first so only the mip generation is timed
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	GLenum format = GetPixelFormat(image->channels);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->pixelData);
+	glFinish();
+
+	start = timer_now_ms();
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glFinish();
+	double gpuMs = timer_now_ms() - start;
+
+	glDeleteTextures(1, &textureID);
+
+	fprintf(stderr, "Mip benchmark %s: CPU %.2f ms (1 thread), %.2f ms (%d threads), glGenerateMipmap %.2f ms\n",
+			fileName, cpuSingleMs, cpuPoolMs, thread_pool_size(threadPool), gpuMs);
+}
+
+// OpenGL format of a block compressed map, or 0 if the map is uncompressed
+// or the driver cannot sample it
+GLenum GetCompressedFormat(unsigned int packFormat)
+{
+	switch(packFormat)
+	{
+		case TEXPACK_FORMAT_BC1: return GLEW_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+		case TEXPACK_FORMAT_BC4: return GLEW_ARB_texture_compression_rgtc ? GL_COMPRESSED_RED_RGTC1 : 0;
+		case TEXPACK_FORMAT_BC5: return GLEW_ARB_texture_compression_rgtc ? GL_COMPRESSED_RG_RGTC2 : 0;
+	}
+	return 0;
+}
+
+// Creates a texture with every mip level of a baked map. The pixels are
+// handed to OpenGL directly from the mapped file.
+GLuint CreateTextureFromPack(GLenum textureUnit, const texpack_t *pack, const texpack_entry_t *entry)
+{
+	GLuint textureID = GenTexture(textureUnit, entry->numLevels);
+
+	if(texpack_format_is_compressed(entry->format))
+	{
+		GLenum compressedFormat = GetCompressedFormat(entry->format);
+		for(unsigned int level = 0; level < entry->numLevels; level++)
+			glCompressedTexImage2D(GL_TEXTURE_2D,
+			level,
+			compressedFormat,
+			entry->levels[level].width,
+			entry->levels[level].height,
+			0,
+			entry->levels[level].size,
+			texpack_level_data(pack, entry, level));
+
+		return textureID;
+	}
+
+	GLenum format = GetPixelFormat(texpack_format_channels(entry->format));
+	for(unsigned int level = 0; level < entry->numLevels; level++)
+		glTexImage2D(GL_TEXTURE_2D,
+		level,
+		format,
+		entry->levels[level].width,
+		entry->levels[level].height,
+		0,
+		format,
+		GL_UNSIGNED_BYTE,
+		texpack_level_data(pack, entry, level));
+
+	return textureID;
+}
+
+// A normal map with only two channels stores x and y, and the shader
+// rebuilds z. Sent to the program by ApplyProgramUniforms().
+bool normalMapXY = false;
+
+void SetNormalMapChannels(int channels)
+{
+	normalMapXY = channels == 2;
+}
+
+// The height lives in the normal map's alpha in the packed binding mode
+// instead of in its own texture
+bool heightInNormalAlpha = false;
+
+void SetHeightInNormalAlpha(bool packed)
+{
+	heightInNormalAlpha = packed;
+}
+
+// The cone step and maximum mipmap modes need maps a texture pack may lack
+bool ParallaxModeAvailable(int mode)
+{
+	// Neither is made for the heights of a virtual texture
+	if(vtFile && (mode == PARALLAX_CONE || mode == PARALLAX_PYRAMID))
+		return false;
+	if(mode == PARALLAX_CONE)
+		return coneMapLoaded;
+	if(mode == PARALLAX_PYRAMID)
+		return heightPyramidTexture != 0;
+	return true;
+}
+
+// PROGRAM PERMUTATIONS
+// One program per parallax mode and quality tier, with the mode and the
+// step counts as #defines (see the top of parallaxmapping.frag). All of
+// them are created at startup: from the program cache where it has a
+// binary for them, the rest compiled and linked in the background with
+// KHR_parallel_shader_compile. Only the program drawn with first is waited
+// for, the others are picked up as they finish and added to the cache.
+#define NUM_PARALLAX_QUALITIES ARRAY_COUNT(parallaxQualities)
+
+struct ProgramPermutation
+{
+	GLuint program;
+	GLuint shaders[2];		// Until the link has been checked
+	uint64_t cacheKey;
+	bool issued;			// Loaded from the cache or compiling
+	bool ready;				// Linked and checked
+	bool cached;			// Came from the program cache
+};
+
+ProgramPermutation programPermutations[NUM_PARALLAX_MODES][NUM_PARALLAX_QUALITIES];
+
+// Where the program binaries are kept, NULL to always compile
+// (-programcache dir|off)
+const char *programCacheDir = "programcache";
+
+bool parallelShaderCompile;		// KHR_parallel_shader_compile
+char *vertexShaderSource = NULL;
+char *fragmentShaderSource = NULL;
+char driverString[1024];		// Part of the cache key; a new driver compiles anew
+double programsStartMs;
+int programsPending = 0;
+
+// The offset limiting and normal mapping modes have no steps, so every
+// quality tier shares one program
+ProgramPermutation &GetPermutation(int mode, int quality)
+{
+	if(mode == PARALLAX_OFFSET || mode == PARALLAX_NONE)
+		quality = 0;
+	return programPermutations[mode][quality];
+}
+
+// What every program made from parallaxmapping.frag is built with
+const char *MaterialDefines()
+{
+	if(vtFile)
+		return "#define VIRTUAL_TEXTURE\n";
+	return libraryMaterials.empty() ? "" : "#define MATERIAL_ARRAY\n";
+}
+
+void PermutationDefines(char *defines, size_t size, int mode, int quality)
+{
+	const ParallaxQuality &q = parallaxQualities[quality];
+
+	if(mode == PARALLAX_OFFSET || mode == PARALLAX_NONE)
+		snprintf(defines, size, "%s#define PARALLAX_MODE %d\n", MaterialDefines(), mode);
+	else
+		snprintf(defines, size,
+				"%s#define PARALLAX_MODE %d\n#define POM_MIN_STEPS %d\n#define POM_MAX_STEPS %d\n"
+				"#define POM_REFINE_STEPS %d\n#define CONE_STEPS %d\n#define PYRAMID_STEPS %d\n",
+				MaterialDefines(), mode, q.minSteps, q.maxSteps, q.refineSteps, q.coneSteps, q.pyramidSteps);
+}
+
+// Loads the program from the cache, or starts compiling it
+void IssueProgram(int mode, int quality)
+{
+	ProgramPermutation &perm = GetPermutation(mode, quality);
+	char defines[512];
+
+	if(perm.issued)
+		return;
+	perm.issued = true;
+
+	PermutationDefines(defines, sizeof(defines), mode, quality);
+	const char *keyStrings[] = { defines, vertexShaderSource, fragmentShaderSource, driverString };
+	perm.cacheKey = program_cache_key(keyStrings, ARRAY_COUNT(keyStrings));
+
+	if(programCacheDir && GLEW_ARB_get_program_binary)
+	{
+		uint32_t format;
+		size_t size;
+		void *binary = program_cache_load(programCacheDir, perm.cacheKey, &format, &size);
+
+		if(binary)
+		{
+			GLint status;
+
+			perm.program = glCreateProgram();
+			glProgramBinary(perm.program, format, binary, size);
+			free(binary);
+
+			glGetProgramiv(perm.program, GL_LINK_STATUS, &status);
+			if(status == GL_TRUE)
+			{
+				perm.cached = perm.ready = true;
+				return;
+			}
+
+			// The driver can turn down its own binaries, e.g. after an
+			// update that kept the version string
+			glDeleteProgram(perm.program);
+		}
+	}
+
+	// The vertex shader has no permutations
+	perm.shaders[0] = LoadShader(GL_VERTEX_SHADER, "", vertexShaderSource);
+	perm.shaders[1] = LoadShader(GL_FRAGMENT_SHADER, defines, fragmentShaderSource);
+	perm.program = CreateProgram(std::vector<GLuint>(perm.shaders, perm.shaders + 2));
+	programsPending++;
+}
+
+// Waits for a compiling program, prints its errors and stores its binary
+void FinishProgram(ProgramPermutation &perm)
+{
+	if(perm.ready)
+		return;
+	perm.ready = true;
+	programsPending--;
+
+	bool compiled = ShaderCompiled(perm.shaders[0], GL_VERTEX_SHADER);
+	compiled = ShaderCompiled(perm.shaders[1], GL_FRAGMENT_SHADER) && compiled;
+	bool linked = compiled && ProgramLinked(perm.program);
+
+	// Delete the shader objects - they are still in the compiled shader program
+	for(int i = 0; i < 2; i++)
+	{
+		glDetachShader(perm.program, perm.shaders[i]);
+		glDeleteShader(perm.shaders[i]);
+	}
+
+	if(linked && programCacheDir && GLEW_ARB_get_program_binary)
+	{
+		GLint size = 0;
+		glGetProgramiv(perm.program, GL_PROGRAM_BINARY_LENGTH, &size);
+		if(size > 0)
+		{
+			std::vector<char> binary(size);
+			GLenum format;
+			glGetProgramBinary(perm.program, size, &size, &format, &binary[0]);
+			program_cache_store(programCacheDir, perm.cacheKey, format, &binary[0], size);
+		}
+	}
+
+	if(programsPending == 0)
+		fprintf(stderr, "All programs ready after %.1f ms\n", timer_now_ms() - programsStartMs);
+}
+
+// Finishes the programs the driver is done with, without waiting for any
+void PollPrograms()
+{
+	if(!parallelShaderCompile || programsPending == 0)
+		return;
+
+	for(int mode = 0; mode < NUM_PARALLAX_MODES; mode++)
+	{
+		for(int quality = 0; quality < (int)NUM_PARALLAX_QUALITIES; quality++)
+		{
+			ProgramPermutation &perm = programPermutations[mode][quality];
+			GLint done = GL_FALSE;
+
+			if(!perm.issued || perm.ready)
+				continue;
+			glGetProgramiv(perm.program, GL_COMPLETION_STATUS_KHR, &done);
+			if(done)
+				FinishProgram(perm);
+		}
+	}
+}
+
+// Compiles and links a program with the vertex shader, waiting for it
+GLuint BuildProgram(const char *defines, const char *fragmentSource)
+{
+	GLuint shaders[2];
+	shaders[0] = LoadShader(GL_VERTEX_SHADER, "", vertexShaderSource);
+	shaders[1] = LoadShader(GL_FRAGMENT_SHADER, defines, fragmentSource);
+	GLuint program = CreateProgram(std::vector<GLuint>(shaders, shaders + 2));
+
+	bool compiled = ShaderCompiled(shaders[0], GL_VERTEX_SHADER);
+	compiled = ShaderCompiled(shaders[1], GL_FRAGMENT_SHADER) && compiled;
+	if(compiled)
+		ProgramLinked(program);
+
+	for(int i = 0; i < 2; i++)
+	{
+		glDetachShader(program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+	return program;
+}
+
+// Reads the shaders and sets every permutation going
+void InitializeProgram()
+{
+	programsStartMs = timer_now_ms();
+
+	vertexShaderSource = readFile(fnVertexShader);
+	fragmentShaderSource = readFile(fnFragmentShader);
+	snprintf(driverString, sizeof(driverString), "%s\n%s\n%s\n%s",
+			(const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER),
+			(const char*)glGetString(GL_VERSION), (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+	// Square until reshape() knows the window size
+	mat4_perspective(
+							&perspectiveMatrix,	// The matrix to write to
+							frustumScale,		// Frustum scale
+							1.0f,				// Aspect ratio
+							nearPlane,			// Near clipping plane
+							farPlane			// Far clipping plane
+						);
+
+	// The depth-only and LOD tier programs are small enough to build right away
+	char *depthShaderSource = readFile(fnDepthShader);
+	depthProgram = BuildProgram("", depthShaderSource);
+	free(depthShaderSource);
+	depthPerspectiveMatrixUni = glGetUniformLocation(depthProgram, "perspectiveMatrix");
+
+	char defines[128];
+	snprintf(defines, sizeof(defines), "%s#define PARALLAX_MODE %d\n#define LOD_TIER_COUNT\n", MaterialDefines(), PARALLAX_NONE);
+	lodTierProgram = BuildProgram(defines, fragmentShaderSource);
+	lodTierUniform = glGetUniformLocation(lodTierProgram, "lodTier");
+
+	if(vtFile)
+	{
+		snprintf(defines, sizeof(defines), "%s#define PARALLAX_MODE %d\n#define VT_FEEDBACK\n", MaterialDefines(), PARALLAX_NONE);
+		vtFeedbackProgram = BuildProgram(defines, fragmentShaderSource);
+	}
+
+	// Without parallel compiles this would compile them all one after the
+	// other, so then they wait until they are first selected
+	parallelShaderCompile = GLEW_KHR_parallel_shader_compile;
+	if(!parallelShaderCompile)
+		return;
+
+	// As many compiler threads as the driver likes
+	glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
+	int numCached = 0, numPrograms = 0;
+	for(int mode = 0; mode < NUM_PARALLAX_MODES; mode++)
+	{
+		for(int quality = 0; quality < (int)NUM_PARALLAX_QUALITIES; quality++)
+		{
+			ProgramPermutation &perm = GetPermutation(mode, quality);
+			if(perm.issued)
+				continue;
+
+			IssueProgram(mode, quality);
+			numPrograms++;
+			numCached += perm.cached;
+		}
+	}
+
+	fprintf(stderr, "Programs: %d permutations, %d from the cache, %d compiling in the background (%.1f ms)\n",
+			numPrograms, numCached, numPrograms - numCached, timer_now_ms() - programsStartMs);
+}
+
+// Sends the uniforms that don't depend on the permutation to a program
+// built from parallaxmapping.frag
+void ApplyProgramUniforms(GLuint program)
+{
+	const ParallaxQuality &quality = parallaxQualities[parallaxQuality];
+
+	render_use_program(program);
+	// Tell the samplers which texture unit to read from
+	for(int i = 0; i < (int)ARRAY_COUNT(materialMaps); i++)
+		glUniform1i(glGetUniformLocation(program, materialMaps[i].uniformName), materialMaps[i].textureUnit - GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(program, "specularMap"), SPECULAR_MAP_UNIT - GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(program, "coneMap"), CONE_MAP_UNIT - GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(program, "heightPyramid"), HEIGHT_PYRAMID_UNIT - GL_TEXTURE0);
+
+	glUniform1i(glGetUniformLocation(program, "normalMapXY"), normalMapXY);
+	glUniform1i(glGetUniformLocation(program, "heightInNormalAlpha"), heightInNormalAlpha);
+	if(heightPyramidTexture)
+	{
+		const mip_level_t *base = &heightPyramid.chain.levels[0];
+		glUniform2f(glGetUniformLocation(program, "heightPyramidSize"), (float)base->width, (float)base->height);
+		glUniform1f(glGetUniformLocation(program, "heightPyramidTop"), (float)(heightPyramid.chain.numLevels - 1));
+	}
+
+	glUniform1f(glGetUniformLocation(program, "loopDuration"), loopDuration);
+	glUniformMatrix4fv(glGetUniformLocation(program, "perspectiveMatrix"), 1, GL_FALSE, perspectiveMatrix.m);
+	glUniform1i(glGetUniformLocation(program, "vertexTangents"), vertexTangents);
+
+	glUniform1i(glGetUniformLocation(program, "parallaxLod"), parallaxLod);
+	glUniform2f(glGetUniformLocation(program, "parallaxLodPixels"), quality.lodMinPixels, quality.lodMaxPixels);
+
+	if(vtFile)
+	{
+		const vt_file_header_t *header = &vtFile->header;
+		glUniform1i(glGetUniformLocation(program, "vtPageTable"), VT_PAGE_TABLE_UNIT - GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(program, "vtCache"), VT_CACHE_UNIT - GL_TEXTURE0);
+		glUniform4f(glGetUniformLocation(program, "vtLayout"), (float)header->pageSize, (float)header->border,
+					(float)vtFile->tileSize, (float)(header->numLevels - 1));
+		glUniform2f(glGetUniformLocation(program, "vtCacheSize"), (float)vtCacheWidth, (float)vtCacheHeight);
+		glUniform1f(glGetUniformLocation(program, "vtLodBias"), program == vtFeedbackProgram ? -log2f(VT_FEEDBACK_SCALE) : 0.0f);
+	}
+}
+
+// Makes the program of the parallax mode and quality tier current, waiting
+// for it if it is still compiling, and sends it the tangent frame source
+void SelectParallaxProgram()
+{
+	const ParallaxQuality &quality = parallaxQualities[parallaxQuality];
+
+	if(!ParallaxModeAvailable(parallaxMode))
+	{
+		fprintf(stderr, "No %s map, using occlusion mapping instead\n", parallaxModeNames[parallaxMode]);
+		parallaxMode = PARALLAX_OCCLUSION;
+	}
+
+	double startTime = timer_now_ms();
+	ProgramPermutation &perm = GetPermutation(parallaxMode, parallaxQuality);
+	IssueProgram(parallaxMode, parallaxQuality);
+	FinishProgram(perm);
+
+	theProgram = perm.program;
+	timeUniform = glGetUniformLocation(theProgram, "time");
+	perspectiveMatrixUni = glGetUniformLocation(theProgram, "perspectiveMatrix");
+	ApplyProgramUniforms(theProgram);
+	ApplyProgramUniforms(lodTierProgram);
+	if(vtFile)
+		ApplyProgramUniforms(vtFeedbackProgram);
+
+	fprintf(stderr, "Parallax: %s, %s quality, %s tangents, LOD %s (program %s, %.1f ms)\n", parallaxModeNames[parallaxMode], quality.name,
+			vertexTangents ? "vertex" : "derivative", parallaxLod ? "on" : "off", perm.cached ? "from the cache" : "compiled", timer_now_ms() - startTime);
+}
+
+// Index of 'name' in 'names', or -1
+int FindName(const char *name, const char *const *names, int count)
+{
+	for(int i = 0; i < count; i++)
+		if(strcmp(name, names[i]) == 0)
+			return i;
+	return -1;
+}
+
+// The pack entry to upload for a map. With a packed normal+height map the
+// normal unit gets that and the displacement map is not needed.
+const texpack_entry_t *GetPackEntry(const texpack_t *pack, const texpack_entry_t *normalHeight, unsigned int mapType)
+{
+	if(normalHeight && mapType == TEXPACK_MAP_NORMAL)
+		return normalHeight;
+	if(normalHeight && mapType == TEXPACK_MAP_DISPLACEMENT)
+		return NULL;
+	return texpack_find(pack, mapType);
+}
+
+// A virtual texture brings its own normals and heights, so only the
+// diffuse map is loaded next to it
+bool MaterialMapNeeded(const MaterialMap &map)
+{
+	return !vtFile || map.packMapType == TEXPACK_MAP_DIFFUSE;
+}
+
+// Uploads the material from its texture pack. Returns false if there is no
+// usable pack, in which case the PNGs should be loaded instead.
+bool LoadMaterialPack(const char *fileName)
+{
+	double startTime = timer_now_ms();
+
+	texpack_t *pack = texpack_open(fileName);
+	if(pack == NULL)
+		return false;
+
+	// A pack baked with -packed has the height in the alpha of the normal map
+	const texpack_entry_t *normalHeight = texpack_find(pack, TEXPACK_MAP_NORMAL_HEIGHT);
+
+	for(int i = 0; i < (int)ARRAY_COUNT(materialMaps); i++)
+	{
+		if(!MaterialMapNeeded(materialMaps[i]))
+			continue;
+
+		const texpack_entry_t *entry = GetPackEntry(pack, normalHeight, materialMaps[i].packMapType);
+		if(entry == NULL && normalHeight && materialMaps[i].packMapType == TEXPACK_MAP_DISPLACEMENT)
+			continue;
+		if(entry == NULL)
+		{
+			fprintf(stderr, "Texture pack %s has no map for %s, using PNGs\n", fileName, materialMaps[i].uniformName);
+			texpack_close(pack);
+			return false;
+		}
+		if(texpack_format_is_compressed(entry->format) && GetCompressedFormat(entry->format) == 0)
+		{
+			fprintf(stderr, "Texture pack %s uses a compressed format the driver lacks, using PNGs\n", fileName);
+			texpack_close(pack);
+			return false;
+		}
+	}
+
+	for(int i = 0; i < (int)ARRAY_COUNT(materialMaps); i++)
+	{
+		const texpack_entry_t *entry = GetPackEntry(pack, normalHeight, materialMaps[i].packMapType);
+		if(entry == NULL || !MaterialMapNeeded(materialMaps[i]))
+			continue;
+
+		CreateTextureFromPack(materialMaps[i].textureUnit, pack, entry);
+
+		if(materialMaps[i].packMapType == TEXPACK_MAP_NORMAL)
+			SetNormalMapChannels(texpack_format_channels(entry->format));
+	}
+	SetHeightInNormalAlpha(normalHeight != NULL);
+
+	// The cone step and maximum mipmap modes are off with a virtual texture
+	if(!vtFile)
+	{
+		const texpack_entry_t *cones = texpack_find(pack, TEXPACK_MAP_CONE);
+		if(cones)
+		{
+			CreateTextureFromPack(CONE_MAP_UNIT, pack, cones);
+			coneMapLoaded = true;
+		}
+		else
+			fprintf(stderr, "Texture pack %s has no cone map, bake it again for cone step mapping\n", fileName);
+
+		// The maximum mip chain starts with the plain heights
+		const texpack_entry_t *maxHeights = texpack_find(pack, TEXPACK_MAP_DISPLACEMENT_MAX);
+		if(maxHeights)
+		{
+			BuildHeightPyramid((const unsigned char*)texpack_level_data(pack, maxHeights, 0),
+							   maxHeights->levels[0].width, maxHeights->levels[0].height, 1);
+			UploadHeightPyramid();
+		}
+	}
+
+	// OpenGL has copied everything, so the mapping can go
+	texpack_close(pack);
+
+	fprintf(stderr, "Material loaded from %s in %.1f ms\n", fileName, timer_now_ms() - startTime);
+	return true;
+}
+
+// Packs the normal and displacement maps into one RGBA texture on the
+// normal map's unit (the -packed binding mode)
+void UploadPackedNormalHeight(png_data_t *normal, png_data_t *height)
+{
+	double startTime = timer_now_ms();
+
+	png_data_t *packed = pack_normal_height(normal, height, threadPool);
+	if(packed == NULL)
+		return;
+
+	mip_chain_t chain;
+	mip_chain_build(&chain, packed->pixelData, packed->width, packed->height, 4, MIP_FILTER_NORMAL, threadPool);
+	CreateTexture(materialMaps[FindMaterialMap(TEXPACK_MAP_NORMAL)].textureUnit, &chain);
+	mip_chain_free(&chain);
+	free_png(packed);
+
+	SetNormalMapChannels(3);
+	SetHeightInNormalAlpha(true);
+
+	fprintf(stderr, "Packed normal and height maps in %.1f ms\n", timer_now_ms() - startTime);
+}
+
+// Uploads and releases the normal map made by DeriveNormalMap()
+void UploadDerivedNormalMap()
+{
+	int normalMap = FindMaterialMap(TEXPACK_MAP_NORMAL);
+	mip_chain_t *chain = &materialMips[normalMap];
+
+	CreateTexture(materialMaps[normalMap].textureUnit, chain);
+	SetNormalMapChannels(3);
+
+	fprintf(stderr, "Derived the %dx%d normal map from the heights in %.1f ms (%s, strength %.1f texels)\n",
+			chain->levels[0].width, chain->levels[0].height, derivedNormalsMs,
+			normalKernel == NORMAL_KERNEL_SOBEL ? "Sobel" : "Scharr", derivedNormalStrength);
+
+	mip_chain_free(chain);
+	free(derivedNormals);
+	derivedNormals = NULL;
+}
+
+// The load of a material map, or NULL if the map isn't loaded from its
+// own file
+texture_load_t *FindMapLoad(texture_load_t *loads, int numLoads, unsigned int packMapType)
+{
+	for(int i = 0; i < numLoads; i++)
+		if(((MaterialMap*)loads[i].userData)->packMapType == packMapType)
+			return &loads[i];
+	return NULL;
+}
+
+// Decodes all material maps concurrently on the thread pool and uploads
+// each one as soon as it is ready. GL calls stay on this (the GL) thread.
+// Requires the program to be bound.
+void LoadMaterialTextures()
+{
+	const int numMaps = ARRAY_COUNT(materialMaps);
+	texture_load_t loads[ARRAY_COUNT(materialMaps)];
+	int numLoads = 0;
+
+	for(int i = 0; i < numMaps; i++)
+	{
+		// Comes from the heights instead
+		if(normalsFromHeight && materialMaps[i].packMapType == TEXPACK_MAP_NORMAL)
+			continue;
+		// Comes from the virtual texture, and so does everything built from
+		// the heights
+		if(!MaterialMapNeeded(materialMaps[i]))
+			continue;
+
+		// In the packed mode the normal and height maps are combined after
+		// both are decoded, so only the diffuse map gets its mips right away
+		bool combineLater = packNormalHeight && materialMaps[i].packMapType != TEXPACK_MAP_DIFFUSE;
+
+		texture_load_t &mapLoad = loads[numLoads++];
+		mapLoad.fileName = materialMaps[i].fileName;
+		mapLoad.gray16 = normalsFromHeight && materialMaps[i].packMapType == TEXPACK_MAP_DISPLACEMENT;
+		mapLoad.process = combineLater ? NULL : BuildMaterialMips;
+		mapLoad.userData = &materialMaps[i];
+	}
+
+	// The benchmark needs the source images, so it always uses the PNGs,
+	// and so do derived normals
+	if(!benchmarkMipmaps && !normalsFromHeight && LoadMaterialPack(materialPackFile))
+		return;
+
+	SetHeightInNormalAlpha(false);
+
+	double startTime = timer_now_ms();
+
+	texture_batch_t *batch = texture_batch_begin(threadPool, loads, numLoads);
+
+	texture_load_t *load;
+	while((load = texture_batch_next(batch)) != NULL)
+	{
+		int i = (MaterialMap*)load->userData - materialMaps;
+
+		if(load->image == NULL || load->process == NULL)
+			continue;
+
+		double uploadStart = timer_now_ms();
+		bool heights16 = load->image->bit_depth == 16;
+		CreateTexture(materialMaps[i].textureUnit, &materialMips[i], heights16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE);
+		if(heights16)
+			UploadDerivedNormalMap();
+
+		if(materialMaps[i].packMapType == TEXPACK_MAP_NORMAL)
+			SetNormalMapChannels(load->image->channels);
+		if(materialMaps[i].packMapType == TEXPACK_MAP_DISPLACEMENT)
+		{
+			UploadConeMap();
+			UploadHeightPyramid();
+		}
+
+		fprintf(stderr, "Loaded %s: decode %.1f ms, mips %.1f ms, upload %.1f ms\n",
+				load->fileName, load->decodeMs, load->processMs, timer_now_ms() - uploadStart);
+
+		// The CPU builder it times is the 8-bit one
+		if(benchmarkMipmaps && !heights16)
+			BenchmarkMipmaps(load->fileName, load->image, materialMaps[i].mipFilter);
+
+		// OpenGL has its own copy now
+		mip_chain_free(&materialMips[i]);
+		free_png(load->image);
+		load->image = NULL;
+	}
+
+	texture_batch_end(batch);
+
+	texture_load_t *normalLoad = FindMapLoad(loads, numLoads, TEXPACK_MAP_NORMAL);
+	texture_load_t *heightLoad = FindMapLoad(loads, numLoads, TEXPACK_MAP_DISPLACEMENT);
+
+	if(packNormalHeight && normalLoad && normalLoad->image && heightLoad && heightLoad->image)
+		UploadPackedNormalHeight(normalLoad->image, heightLoad->image);
+
+	// The packed mode skipped the displacement map's hook
+	if(packNormalHeight && heightLoad && heightLoad->image)
+	{
+		png_data_t *heights = heightLoad->image;
+		BuildConeMap(heights);
+		UploadConeMap();
+		BuildHeightPyramid(heights->pixelData, heights->width, heights->height, heights->channels);
+		UploadHeightPyramid();
+	}
+
+	// Whatever is left was kept for packing
+	for(int i = 0; i < numLoads; i++)
+		free_png(loads[i].image);
+
+	fprintf(stderr, "Material loaded in %.1f ms on %d threads\n",
+			timer_now_ms() - startTime, thread_pool_size(threadPool));
+}
+
+// MATERIAL LIBRARY
+// With -library every material of a manifest is loaded into one texture
+// array per map, a layer per material, and each object reads the layer of
+// its own material (see InitializeInstances()). Objects with different
+// materials then share their textures and are still drawn with a single
+// instanced call.
+
+// The maps of the material above and a specular map, which only the
+// library has
+struct LibraryMap
+{
+	const char *uniformName;
+	GLenum textureUnit;
+	const char *fileSuffix;
+	int mipFilter;
+};
+
+LibraryMap libraryMaps[] = {
+	{ "diffuseMap",			GL_TEXTURE0,		"-diffuse",		MIP_FILTER_SRGB },
+	{ "normalMap",			GL_TEXTURE1,		"-normal",		MIP_FILTER_NORMAL },
+	{ "displacementMap",	GL_TEXTURE2,		"-displace",	MIP_FILTER_BOX },
+	{ "specularMap",		SPECULAR_MAP_UNIT,	"-specular",	MIP_FILTER_BOX }
+};
+
+// Every layer of an array has the size and channels of the first
+// material's map
+struct LibraryArray
+{
+	GLuint texture;
+	int width, height, channels;
+	int numLevels;
+};
+
+LibraryArray libraryArrays[ARRAY_COUNT(libraryMaps)];
+
+// One map of one material on its way into its layer
+struct LibraryLoad
+{
+	int map, layer;
+	std::string fileName;
+	mip_chain_t chain;
+};
+
+// Sizes the arrays from the first material's maps and allocates them.
+// Without texture arrays, or if those maps can't be read, the library is
+// dropped and the single material used instead. Runs before the programs
+// are built, which depend on it.
+void InitializeMaterialLibrary()
+{
+	if(libraryMaterials.empty())
+		return;
+
+	const int numLayers = (int)libraryMaterials.size();
+	GLint maxLayers = 0;
+	if(GLEW_EXT_texture_array)
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS_EXT, &maxLayers);
+
+	bool usable = GLEW_EXT_texture_array && GLEW_EXT_gpu_shader4 && numLayers <= maxLayers;
+	if(!usable)
+		fprintf(stderr, "No texture arrays of %d layers, using the single material\n", numLayers);
+
+	for(int i = 0; usable && i < (int)ARRAY_COUNT(libraryMaps); i++)
+	{
+		LibraryArray &array = libraryArrays[i];
+		std::string fileName = MaterialMapFile(libraryMaterials[0].c_str(), libraryMaps[i].fileSuffix);
+		usable = read_image_header((char*)fileName.c_str(), &array.width, &array.height, &array.channels);
+		if(!usable)
+			fprintf(stderr, "Can't read %s, using the single material\n", fileName.c_str());
+	}
+
+	if(!usable)
+	{
+		libraryMaterials.clear();
+		return;
+	}
+
+	double bytes = 0.0;
+	for(int i = 0; i < (int)ARRAY_COUNT(libraryMaps); i++)
+	{
+		LibraryArray &array = libraryArrays[i];
+		GLenum format = GetPixelFormat(array.channels);
+
+		array.numLevels = mip_count_levels(array.width, array.height);
+		array.texture = GenTexture(libraryMaps[i].textureUnit, array.numLevels, GL_TEXTURE_2D_ARRAY_EXT);
+		for(int level = 0; level < array.numLevels; level++)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY_EXT, level, format, std::max(1, array.width >> level),
+						std::max(1, array.height >> level), numLayers, 0, format, GL_UNSIGNED_BYTE, NULL);
+		bytes += 4.0 / 3.0 * array.width * array.height * array.channels * numLayers;
+	}
+
+	fprintf(stderr, "Material library: %d materials in %d texture arrays of %dx%d (%.1f MB)\n",
+			numLayers, (int)ARRAY_COUNT(libraryMaps), libraryArrays[0].width, libraryArrays[0].height, bytes / 1048576.0);
+}
+
+// Runs on a worker thread right after a library map has been decoded
+void BuildLibraryMips(texture_load_t *load)
+{
+	LibraryLoad *item = (LibraryLoad*)load->userData;
+	png_data_t *image = load->image;
+
+	mip_chain_build(&item->chain, image->pixelData, image->width, image->height, image->channels,
+			libraryMaps[item->map].mipFilter, threadPool);
+}
+
+// Decodes every map of every material concurrently on the thread pool and
+// copies each into its layer as soon as it is ready. A map that doesn't
+// match its array is left out, and its layer stays black.
+void LoadMaterialLibrary()
+{
+	const int numMaps = ARRAY_COUNT(libraryMaps);
+	const int numLoads = numMaps * (int)libraryMaterials.size();
+	std::vector<LibraryLoad> items(numLoads);
+	std::vector<texture_load_t> loads(numLoads);
+
+	for(int i = 0; i < numLoads; i++)
+	{
+		items[i].map = i % numMaps;
+		items[i].layer = i / numMaps;
+		items[i].fileName = MaterialMapFile(libraryMaterials[items[i].layer].c_str(), libraryMaps[items[i].map].fileSuffix);
+		loads[i].fileName = items[i].fileName.c_str();
+		loads[i].process = BuildLibraryMips;
+		loads[i].userData = &items[i];
+	}
+
+	double startTime = timer_now_ms();
+	double decodeMs = 0.0, mipsMs = 0.0, uploadMs = 0.0;
+	int numLoaded = 0;
+
+	texture_batch_t *batch = texture_batch_begin(threadPool, &loads[0], numLoads);
+
+	texture_load_t *load;
+	while((load = texture_batch_next(batch)) != NULL)
+	{
+		LibraryLoad &item = items[load - &loads[0]];
+		const LibraryArray &array = libraryArrays[item.map];
+		png_data_t *image = load->image;
+
+		// The decoder has said what went wrong
+		if(image == NULL)
+			continue;
+
+		decodeMs += load->decodeMs;
+		mipsMs += load->processMs;
+
+		if(image->width != array.width || image->height != array.height || image->channels != array.channels)
+			fprintf(stderr, "Leaving out %s: %dx%d with %d channels, the library's are %dx%d with %d\n", load->fileName,
+					image->width, image->height, image->channels, array.width, array.height, array.channels);
+		else
+		{
+			double uploadStart = timer_now_ms();
+			GLenum format = GetPixelFormat(array.channels);
+
+			// Directly, the backend skips the unit switch when the array is
+			// already bound there; init() resets it afterwards
+			glActiveTexture(libraryMaps[item.map].textureUnit);
+			glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, array.texture);
+			for(int level = 0; level < item.chain.numLevels; level++)
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT, level, 0, 0, item.layer, item.chain.levels[level].width,
+								item.chain.levels[level].height, 1, format, GL_UNSIGNED_BYTE, item.chain.levels[level].data);
+			uploadMs += timer_now_ms() - uploadStart;
+			numLoaded++;
+		}
+
+		mip_chain_free(&item.chain);
+		free_png(image);
+		load->image = NULL;
+	}
+
+	texture_batch_end(batch);
+
+	fprintf(stderr, "Material library loaded: %d of %d maps in %.1f ms on %d threads (decode %.1f ms, mips %.1f ms, upload %.1f ms in all)\n",
+			numLoaded, numLoads, timer_now_ms() - startTime, thread_pool_size(threadPool), decodeMs, mipsMs, uploadMs);
+}
+
+// 
+void init()
+{	
+	// Before the programs, which are built for them
+	InitializeVirtualTexture();
+	InitializeMaterialLibrary();
+	// 
+	InitializeProgram();
+	// 
+	InitializeVertexBuffer();
+	// 
+	InitializeInstances();
+	// 
+	InitializeVertexArray();
+
+	// Set the default color of the viewport
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+	// Enable backface culling with counter-clockwise triangles
+	glEnable(GL_CULL_FACE);		// Enable culling
+	glCullFace(GL_BACK);		// Cull faces facing away from camera (GL_FRONT / GL_BACK / GL_FRONT_AND_BACK)
+	// NOTE: Figure out why the triangles face into the cube (probably something with the perspective transform).
+	glFrontFace(GL_CCW);		// Triangles are defined counter-clockwise (GL_CW / GL_CCW)
+
+	// Objects hide each other once there is more than one
+	glEnable(GL_DEPTH_TEST);
+	
+	// Set the texture maps
+	if(!libraryMaterials.empty())
+		LoadMaterialLibrary();
+	else
+		LoadMaterialTextures();
+
+	SelectParallaxProgram();
+
+	// Loading bound textures and buffers behind the backend's back
+	render_state_reset();
+}
+
+void reshape(int w, int h);
+
+void InitFrameStats()
+{
+	frameStats = frame_stats_create(statsFile, statNames, NUM_STATS);
+	if(!frameStats)
+		return;
+
+	// GL_TIME_ELAPSED is core in OpenGL 3.3
+	gpuTimers = GLEW_ARB_timer_query;
+	if(gpuTimers)
+	{
+		for(int i = 0; i < GPU_TIMER_FRAMES; i++)
+			glGenQueries(NUM_GPU_PASSES, frameTimings[i].queries);
+	}
+	else
+		fprintf(stderr, "No GL_ARB_timer_query, only CPU times are recorded\n");
+
+	// Occlusion queries are core since OpenGL 1.5
+	for(int i = 0; i < GPU_TIMER_FRAMES; i++)
+		glGenQueries(NUM_SAMPLE_COUNTS, frameTimings[i].sampleQueries);
+
+	overlayStartMs = timer_now_ms();
+}
+
+void AddFrameTiming(FrameTiming *timing)
+{
+	frame_stats_add(frameStats, timing->frame, timing->values);
+	timing->pending = false;
+
+	for(int i = 0; i < NUM_STATS; i++)
+	{
+		if(!isnan(timing->values[i]))
+		{
+			overlaySums[i] += timing->values[i];
+			overlayCounts[i]++;
+		}
+	}
+}
+
+// Records a finished frame once its GPU queries have results. Returns false
+// if they aren't available yet and 'wait' isn't set.
+bool ResolveFrameTiming(FrameTiming *timing, bool wait)
+{
+	if(!timing->pending)
+		return true;
+
+	// Queries finish in order, and the coverage count is issued last, so it
+	// tells about all of them
+	GLint available = 0;
+	glGetQueryObjectiv(timing->sampleQueries[SAMPLES_COVERED], GL_QUERY_RESULT_AVAILABLE, &available);
+	if(!available && !wait)
+		return false;
+
+	if(gpuTimers)
+	{
+		for(int pass = 0; pass < NUM_GPU_PASSES; pass++)
+		{
+			GLuint64 elapsedNs = 0;
+			glGetQueryObjectui64v(timing->queries[pass], GL_QUERY_RESULT, &elapsedNs);
+			timing->values[STAT_GPU_FIRST + pass] = elapsedNs / 1.0e6;
+		}
+	}
+
+	GLuint shaded = 0, covered = 0;
+	glGetQueryObjectuiv(timing->sampleQueries[SAMPLES_SHADED], GL_QUERY_RESULT, &shaded);
+	glGetQueryObjectuiv(timing->sampleQueries[SAMPLES_COVERED], GL_QUERY_RESULT, &covered);
+	timing->values[STAT_OVERDRAW] = covered ? (double)shaded / covered : NAN;
+
+	// The pixels of the last tier are those left over
+	GLuint parallaxTier = 0, blendTier = 0;
+	glGetQueryObjectuiv(timing->sampleQueries[SAMPLES_LOD_PARALLAX], GL_QUERY_RESULT, &parallaxTier);
+	glGetQueryObjectuiv(timing->sampleQueries[SAMPLES_LOD_BLEND], GL_QUERY_RESULT, &blendTier);
+	timing->values[STAT_LOD_PARALLAX] = covered ? 100.0 * parallaxTier / covered : NAN;
+	timing->values[STAT_LOD_BLEND] = covered ? 100.0 * blendTier / covered : NAN;
+	timing->values[STAT_LOD_NORMAL] = covered ? 100.0 * (covered - parallaxTier - blendTier) / covered : NAN;
+
+	AddFrameTiming(timing);
+	return true;
+}
+
+void BeginFrameTiming()
+{
+	if(!frameStats)
+		return;
+
+	FrameTiming *timing = &frameTimings[timingFrame % GPU_TIMER_FRAMES];
+
+	// Whatever used this slot before is GPU_TIMER_FRAMES frames old. If the
+	// GPU still isn't done with it, keep its CPU times and drop the GPU ones
+	// instead of stalling.
+	if(!ResolveFrameTiming(timing, false))
+		AddFrameTiming(timing);
+
+	frameStartMs = timer_now_ms();
+
+	timing->frame = timingFrame;
+	timing->values[STAT_INTERVAL] = lastFrameStartMs < 0.0 ? NAN : frameStartMs - lastFrameStartMs;
+	for(int stat = STAT_CPU; stat < STAT_GPU_FIRST; stat++)
+		timing->values[stat] = NAN;
+	for(int pass = 0; pass < NUM_GPU_PASSES; pass++)
+		timing->values[STAT_GPU_FIRST + pass] = NAN;
+
+	lastFrameStartMs = frameStartMs;
+}
+
+// Records one of the CPU times of the current frame
+void SetFrameStat(int stat, double value)
+{
+	if(frameStats)
+		frameTimings[timingFrame % GPU_TIMER_FRAMES].values[stat] = value;
+}
+
+void BeginGpuPass(GpuPass pass)
+{
+	if(frameStats && gpuTimers)
+		glBeginQuery(GL_TIME_ELAPSED, frameTimings[timingFrame % GPU_TIMER_FRAMES].queries[pass]);
+}
+
+void EndGpuPass()
+{
+	if(frameStats && gpuTimers)
+		glEndQuery(GL_TIME_ELAPSED);
+}
+
+// Counts the fragments that pass the depth test between these. Can't be
+// nested in another sample count, but can in a GPU pass.
+void BeginSampleCount(SampleCount count)
+{
+	if(frameStats)
+		glBeginQuery(GL_SAMPLES_PASSED, frameTimings[timingFrame % GPU_TIMER_FRAMES].sampleQueries[count]);
+}
+
+void EndSampleCount()
+{
+	if(frameStats)
+		glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void UpdateStatsOverlay()
+{
+	char title[256];
+
+	// The GPU time of a frame is that of all its passes
+	double gpuMs = 0.0;
+	for(int pass = 0; pass < NUM_GPU_PASSES; pass++)
+		if(overlayCounts[STAT_GPU_FIRST + pass])
+			gpuMs += overlaySums[STAT_GPU_FIRST + pass] / overlayCounts[STAT_GPU_FIRST + pass];
+
+	snprintf(title, sizeof(title), "Demo | %.1f fps | CPU %.2f ms | GPU %.2f ms | %.0f%% culled | %.2fx overdraw",
+			overlayCounts[STAT_INTERVAL] ? 1000.0 * overlayCounts[STAT_INTERVAL] / overlaySums[STAT_INTERVAL] : 0.0,
+			overlayCounts[STAT_CPU] ? overlaySums[STAT_CPU] / overlayCounts[STAT_CPU] : 0.0,
+			gpuMs,
+			overlayCounts[STAT_CULLED] ? overlaySums[STAT_CULLED] / overlayCounts[STAT_CULLED] : 0.0,
+			overlayCounts[STAT_OVERDRAW] ? overlaySums[STAT_OVERDRAW] / overlayCounts[STAT_OVERDRAW] : 0.0);
+	glutSetWindowTitle(title);
+}
+
+void EndFrameTiming()
+{
+	if(!frameStats)
+		return;
+
+	FrameTiming *timing = &frameTimings[timingFrame % GPU_TIMER_FRAMES];
+	timing->values[STAT_CPU] = timer_now_ms() - frameStartMs;
+	timing->pending = true;
+	timingFrame++;
+
+	// Pick up older frames the GPU has finished in the meantime, oldest first
+	for(int i = 1; i < GPU_TIMER_FRAMES; i++)
+		if(!ResolveFrameTiming(&frameTimings[(timingFrame + i - 1) % GPU_TIMER_FRAMES], false))
+			break;
+
+	// Refresh the overlay twice a second
+	if(frameStartMs - overlayStartMs >= 500.0)
+	{
+		if(statsOverlay)
+			UpdateStatsOverlay();
+
+		overlayStartMs = frameStartMs;
+		memset(overlaySums, 0, sizeof(overlaySums));
+		memset(overlayCounts, 0, sizeof(overlayCounts));
+	}
+}
+
+// Waits for the outstanding queries and prints the summary
+void FinishFrameStats()
+{
+	if(!frameStats)
+		return;
+
+	for(int i = 0; i < GPU_TIMER_FRAMES; i++)
+		ResolveFrameTiming(&frameTimings[(timingFrame + i) % GPU_TIMER_FRAMES], true);
+
+	frame_stats_print_summary(frameStats, stderr);
+	frame_stats_destroy(frameStats);
+	frameStats = NULL;
+}
+
+// Counts the pixels the visible objects cover by drawing their depth again
+// with GL_EQUAL, for the overdraw stat, and the pixels in each parallax
+// LOD tier. Only run with -stats, it costs three depth-only passes.
+void MeasureCoverage()
+{
+	if(!frameStats)
+		return;
+
+	render_color_write(GL_FALSE);
+	render_depth_state(GL_EQUAL, GL_FALSE);
+
+	// Plain normal mapping has no LOD, all of it is in the last tier
+	for(int tier = 0; tier < 2; tier++)
+	{
+		render_use_program(lodTierProgram);
+		glUniform1i(lodTierUniform, parallaxMode == PARALLAX_NONE ? -1 : tier);
+
+		BeginSampleCount((SampleCount)(SAMPLES_LOD_PARALLAX + tier));
+		render_list_clear(&drawList);
+		DrawInstances(lodTierProgram, -1);
+		render_list_submit(&drawList, &sceneMaterial);
+		EndSampleCount();
+	}
+
+	BeginSampleCount(SAMPLES_COVERED);
+	render_list_clear(&drawList);
+	DrawInstances(depthProgram, -1);
+	render_list_submit(&drawList, &sceneMaterial);
+	EndSampleCount();
+
+	render_color_write(GL_TRUE);
+	render_depth_state(GL_LESS, GL_TRUE);
+}
+
+// Draws one frame of the animation at the given time (in seconds) into
+// the bound framebuffer
+void drawScene(float time)
+{
+	render_counters_reset();
+
+	// Tell OpenGL to clear the viewport to the clear color set in init(), and the depth buffer.
+	// The depth buffer is only cleared while it is written.
+	render_depth_state(GL_LESS, GL_TRUE);
+	render_clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Pick up the programs that finished compiling in the background
+	PollPrograms();
+
+	// Which objects are in view and where they are this frame
+	UpdateCamera(time);
+	SetFrameStat(STAT_CULL, CullInstances());
+	SetFrameStat(STAT_CULLED, 100.0 * (numInstances - numVisible) / numInstances);
+	SetFrameStat(STAT_INSTANCES, UpdateInstances(time));
+
+	// Bring in the pages of the virtual texture the last frames needed
+	if(vtCache)
+	{
+		SetFrameStat(STAT_VT, UpdateVirtualTexture());
+		SetFrameStat(STAT_VT_UPLOADS, vt_cache_get_stats(vtCache)->uploaded);
+		SetFrameStat(STAT_VT_MISSING, vt_cache_get_stats(vtCache)->missing);
+	}
+
+	// With the prepass the depth buffer holds the nearest surface before
+	// anything is shaded, so the parallax shader runs only where the depth
+	// test then passes with GL_EQUAL: at most once per pixel. The vertex
+	// shader is the same and its position invariant, so the depths match
+	// exactly.
+	BeginGpuPass(GPU_PASS_DEPTH);
+	if(depthPrepass)
+	{
+		render_color_write(GL_FALSE);
+		render_list_clear(&drawList);
+		DrawInstances(depthProgram, -1);
+		render_list_submit(&drawList, &sceneMaterial);
+		render_color_write(GL_TRUE);
+		render_depth_state(GL_EQUAL, GL_FALSE);
+	}
+	EndGpuPass();
+
+	BeginGpuPass(GPU_PASS_SCENE);
+	BeginSampleCount(SAMPLES_SHADED);
+
+	// Send the time to the shader
+	render_use_program(theProgram);
+	render_uniform_1f(timeUniform, time);
+
+	// Draw the indexed triangles once per object. The vertex array holds
+	// the attribute setup, so a draw only binds what changed since the last.
+	render_list_clear(&drawList);
+	DrawInstances(theProgram, 0);
+	render_list_submit(&drawList, &sceneMaterial);
+
+	EndSampleCount();
+	EndGpuPass();
+
+	render_depth_state(GL_LESS, GL_TRUE);
+
+	const render_counters_t *counters = render_get_counters();
+	SetFrameStat(STAT_GL_CALLS, counters->calls);
+	SetFrameStat(STAT_STATE_CHANGES, counters->stateChanges);
+
+	MeasureCoverage();
+}
+
+// Time of the current frame, in seconds
+float FrameTime()
+{
+	if(fixedTimestep > 0.0f)
+		return frameNumber * fixedTimestep;
+
+	return glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+}
+
+// Reads back the bound framebuffer and writes it to <prefix><frame>.png
+void DumpFrame(const char *prefix, int frame, int w, int h)
+{
+	char fileName[1024];
+	png_data_t image;
+
+	image.width = w;
+	image.height = h;
+	image.channels = 4;
+	image.has_alpha = 1;
+	image.bit_depth = 8;
+	image.owns_pixels = 0;
+	image.pixelData = (unsigned char*)malloc((size_t)w * h * 4);
+
+	// glReadPixels() returns the bottom row first, which is how png_data_t stores images
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, image.pixelData);
+
+	snprintf(fileName, sizeof(fileName), "%s%04d.png", prefix, frame);
+	if(!write_png(fileName, &image))
+		fprintf(stderr, "Couldn't write frame %d\n", frame);
+
+	free(image.pixelData);
+}
+
+void display()
+{
+	BeginFrameTiming();
+	drawScene(FrameTime());
+	EndFrameTiming();
+
+	if(frameDumpPrefix)
+		DumpFrame(frameDumpPrefix, frameNumber, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+	frameNumber++;
+
+	// We use double buffering, so glutSwapBuffers() shows the rendered image
+	glutSwapBuffers();
+	glutPostRedisplay();
+}
+
+// Renders 'numFrames' frames into an offscreen framebuffer at fixed time
+// steps, without a window. Needs a current context from headless_gl_init().
+void RunHeadless(int numFrames)
+{
+	GLuint fbo, colorBuffer, depthBuffer;
+	double start, frameStart, drawMs = 0.0;
+
+	// There is no window, so render into a framebuffer object of the same size
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, windowWidth, windowHeight);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, windowWidth, windowHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+		exit(1);
+	}
+
+	reshape(windowWidth, windowHeight);
+
+	if(fixedTimestep <= 0.0f)
+		fixedTimestep = 1.0f / 60.0f;
+
+	// Frames at fixed time steps repeat exactly, so tiles may not arrive
+	// whenever the threads get to them
+	vtWaitForLoads = true;
+
+	fprintf(stderr, "Rendering %d frames of %dx%d, %.4f s apart, on %s\n",
+			numFrames, windowWidth, windowHeight, fixedTimestep, (const char*)glGetString(GL_RENDERER));
+
+	start = timer_now_ms();
+	for(frameNumber = 0; frameNumber < numFrames; frameNumber++)
+	{
+		frameStart = timer_now_ms();
+		BeginFrameTiming();
+		drawScene(FrameTime());
+		EndFrameTiming();
+		glFinish();	// Count the whole frame, not just the command submission
+		drawMs += timer_now_ms() - frameStart;
+
+		if(frameDumpPrefix)
+			DumpFrame(frameDumpPrefix, frameNumber, windowWidth, windowHeight);
+	}
+
+	fprintf(stderr, "%d frames in %.1f ms: %.2f ms/frame drawing (%.1f ms total with dumps)\n",
+			numFrames, drawMs, drawMs / numFrames, timer_now_ms() - start);
+	FinishFrameStats();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	glDeleteRenderbuffers(1, &colorBuffer);
+}
+
+
+void reshape(int w, int h)
+{
+	// 
+	mat4_perspective(&perspectiveMatrix, frustumScale, w / (float)h, nearPlane, farPlane);
+
+	render_use_program(theProgram);
+		glUniformMatrix4fv(perspectiveMatrixUni, 1, GL_FALSE, perspectiveMatrix.m);
+	render_use_program(depthProgram);
+		glUniformMatrix4fv(depthPerspectiveMatrixUni, 1, GL_FALSE, perspectiveMatrix.m);
+	render_use_program(lodTierProgram);
+		glUniformMatrix4fv(glGetUniformLocation(lodTierProgram, "perspectiveMatrix"), 1, GL_FALSE, perspectiveMatrix.m);
+	if(vtFile)
+	{
+		render_use_program(vtFeedbackProgram);
+			glUniformMatrix4fv(glGetUniformLocation(vtFeedbackProgram, "perspectiveMatrix"), 1, GL_FALSE, perspectiveMatrix.m);
+		ResizeVirtualTextureFeedback(w, h);
+	}
+
+	// Tell OpenGL what area of the available area we are rendering to
+	// Note: This is bottom-left oriented, so (0,0) is at the bottom-left corner
+	glViewport(
+				0,				// Starting width-coordinate
+				0,				// Starting height-coordinate
+				(GLsizei) w,	// The width (here we use the whole window width)
+				(GLsizei) h		// The height (here we use the whole window height)
+			);
+}
+
+//Called whenever a key on the keyboard was pressed.
+//The key is given by the ''key'' parameter, which is in ASCII.
+//It's often a good idea to have the escape key (ASCII value 27) call glutLeaveMainLoop() to 
+//exit the program.
+void keyboard(unsigned char key, int x, int y)
+{	
+	switch (key)
+	{
+		case 27:
+			FinishFrameStats();
+			exit(1);
+
+		case 'p':
+			do
+				parallaxMode = (parallaxMode + 1) % NUM_PARALLAX_MODES;
+			while(!ParallaxModeAvailable(parallaxMode));
+			SelectParallaxProgram();
+			break;
+
+		case '1':
+		case '2':
+		case '3':
+			parallaxQuality = key - '1';
+			SelectParallaxProgram();
+			break;
+
+		case 'e':
+			EditHeightPyramid();
+			break;
+
+		case 't':
+			vertexTangents = !vertexTangents;
+			SelectParallaxProgram();
+			break;
+
+		case 'l':
+			parallaxLod = !parallaxLod;
+			SelectParallaxProgram();
+			break;
+
+		case 'u':
+			frustumCulling = !frustumCulling;
+			fprintf(stderr, "Frustum culling %s\n", frustumCulling ? "on" : "off");
+			break;
+
+		case 'z':
+			depthPrepass = !depthPrepass;
+			fprintf(stderr, "Depth prepass %s\n", depthPrepass ? "on" : "off");
+			break;
+
+		case 'o':
+			statsOverlay = !statsOverlay;
+			if(!frameStats)
+				fprintf(stderr, "Run with -stats to get the overlay\n");
+			else if(!statsOverlay)
+				glutSetWindowTitle("Demo");
+			break;
+
+		default:
+			fprintf(stderr, "Key: %i\n", (int)key);
+	}
+}
+
+
+// Diskutera denna skit!
+int main(int argc, char *argv[]){
+
+	// A headless run must not touch GLUT, which needs a display
+	bool headless = false;
+	for(int i = 1; i < argc; i++)
+		if(strcmp(argv[i], "-headless") == 0)
+			headless = true;
+
+	if(!headless)
+		glutInit(&argc, argv);
+
+	// glutInit() has removed its own arguments, the rest are ours
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-mipbench") == 0)
+			benchmarkMipmaps = true;
+		else if(strcmp(argv[i], "-packed") == 0)
+			packNormalHeight = true;
+		else if(strcmp(argv[i], "-heightnormals") == 0)
+		{
+			normalsFromHeight = true;
+			if(i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				const char *kernelNames[] = { "sobel", "scharr" };
+				normalKernel = FindName(argv[++i], kernelNames, ARRAY_COUNT(kernelNames));
+				if(normalKernel < 0)
+				{
+					fprintf(stderr, "Unknown normal kernel: %s\n", argv[i]);
+					return 1;
+				}
+			}
+		}
+		else if(strcmp(argv[i], "-normalstrength") == 0 && i + 1 < argc)
+		{
+			normalStrength = (float)atof(argv[++i]);
+			if(normalStrength <= 0.0f)
+			{
+				fprintf(stderr, "Invalid normal strength: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "-derivativetbn") == 0)
+			vertexTangents = false;
+		else if(strcmp(argv[i], "-prepass") == 0)
+			depthPrepass = true;
+		else if(strcmp(argv[i], "-nolod") == 0)
+			parallaxLod = false;
+		else if(strcmp(argv[i], "-virtual") == 0 && i + 1 < argc)
+			virtualTextureFile = argv[++i];
+		else if(strcmp(argv[i], "-vtbudget") == 0 && i + 1 < argc)
+		{
+			virtualTextureBudget = atoi(argv[++i]);
+			if(virtualTextureBudget <= 0)
+			{
+				fprintf(stderr, "Invalid virtual texture budget: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "-material") == 0 && i + 1 < argc)
+			SetMaterialFiles(argv[++i]);
+		else if(strcmp(argv[i], "-library") == 0 && i + 1 < argc)
+		{
+			if(!ReadMaterialManifest(argv[++i]))
+				return 1;
+		}
+		else if(strcmp(argv[i], "-obj") == 0 && i + 1 < argc)
+			meshFile = argv[++i];
+		else if(strcmp(argv[i], "-instances") == 0 && i + 1 < argc)
+		{
+			numInstances = atoi(argv[++i]);
+			if(numInstances <= 0)
+			{
+				fprintf(stderr, "Invalid instance count: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "-programcache") == 0 && i + 1 < argc)
+		{
+			programCacheDir = argv[++i];
+			if(strcmp(programCacheDir, "off") == 0)
+				programCacheDir = NULL;
+		}
+		else if(strcmp(argv[i], "-camera") == 0 && i + 1 < argc)
+		{
+			cameraMode = FindName(argv[++i], cameraModeNames, NUM_CAMERA_MODES);
+			if(cameraMode < 0)
+			{
+				fprintf(stderr, "Unknown camera mode: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "-headless") == 0 && i + 1 < argc)
+			headlessFrames = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-timestep") == 0 && i + 1 < argc)
+			fixedTimestep = atof(argv[++i]);
+		else if(strcmp(argv[i], "-dump") == 0 && i + 1 < argc)
+			frameDumpPrefix = argv[++i];
+		else if(strcmp(argv[i], "-parallax") == 0 && i + 1 < argc)
+		{
+			parallaxMode = FindName(argv[++i], parallaxModeNames, NUM_PARALLAX_MODES);
+			if(parallaxMode < 0)
+			{
+				fprintf(stderr, "Unknown parallax mode: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "-quality") == 0 && i + 1 < argc)
+		{
+			const char *names[ARRAY_COUNT(parallaxQualities)];
+			for(unsigned int q = 0; q < ARRAY_COUNT(parallaxQualities); q++)
+				names[q] = parallaxQualities[q].name;
+
+			parallaxQuality = FindName(argv[++i], names, ARRAY_COUNT(parallaxQualities));
+			if(parallaxQuality < 0)
+			{
+				fprintf(stderr, "Unknown quality: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "-stats") == 0)
+		{
+			collectStats = true;
+			if(i + 1 < argc && argv[i + 1][0] != '-')
+				statsFile = argv[++i];
+		}
+		else if(strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+		{
+			if(sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2 || windowWidth <= 0 || windowHeight <= 0)
+			{
+				fprintf(stderr, "Invalid size: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+	}
+
+	if(virtualTextureFile && !libraryMaterials.empty())
+	{
+		fprintf(stderr, "A virtual texture and a material library can't be used together\n");
+		return 1;
+	}
+
+	// Packing needs a decoded normal map to put the heights into
+	if(normalsFromHeight && packNormalHeight)
+	{
+		fprintf(stderr, "-packed can't be used with -heightnormals, ignoring it\n");
+		packNormalHeight = false;
+	}
+
+	if(headless)
+	{
+		if(headlessFrames <= 0)
+		{
+			fprintf(stderr, "Usage: %s -headless <frames> [-timestep seconds] [-dump prefix] [-size WxH]\n", argv[0]);
+			return 1;
+		}
+
+		if(!headless_gl_init())
+			return 1;
+	}
+	else
+	{
+		glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_ALPHA);
+
+		glutInitWindowPosition(850, 20);
+		glutInitWindowSize(windowWidth, windowHeight);
+		glutCreateWindow("Demo");
+	}
+
+	// ?!?!?!
+	glewExperimental = GL_TRUE;
+	glewInit();
+
+	// Every program samples with explicit gradients or levels, so without
+	// this none of them would compile
+	if(!GLEW_ARB_shader_texture_lod)
+	{
+		fprintf(stderr, "This demo needs GL_ARB_shader_texture_lod, which %s doesn't have\n",
+				(const char*)glGetString(GL_RENDERER));
+		return 1;
+	}
+
+	// Start the worker threads before loading any assets
+	threadPool = thread_pool_create(0);
+
+	// 
+	init();
+
+	if(collectStats)
+		InitFrameStats();
+
+	if(headless)
+	{
+		RunHeadless(headlessFrames);
+		thread_pool_destroy(threadPool);
+		headless_gl_shutdown();
+		return 0;
+	}
+
+	glutDisplayFunc(display);
+	glutReshapeFunc(reshape);
+	glutKeyboardFunc(keyboard);
+
+	glutMainLoop();
+}
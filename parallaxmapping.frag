@@ -1,3 +1,65 @@
+// Needed for texture2DGradARB() inside the occlusion mapping loop, where
+// implicit derivatives are undefined, for the gradients of the shifted
+// coordinates in the other modes and for texture2DLod() in the fragment
+// shader. main() refuses to start without it.
+#extension GL_ARB_shader_texture_lod : require
+
+// MATERIAL_ARRAY reads the maps from texture arrays holding a whole
+// material library (-library in the demo), a layer per material, and each
+// object picks its layer. The library also has a specular map.
+#ifdef MATERIAL_ARRAY
+#extension GL_EXT_texture_array : require
+#extension GL_EXT_gpu_shader4 : require	// texture2DArrayGrad()
+#endif
+
+// Program permutations: main.cpp builds one program per parallax mode and
+// quality tier with these defined in front of the source (see
+// InitializeProgram()), so the loops below have constant bounds and the
+// other modes compile away. The defaults are medium offset limiting.
+
+// 0: offset limiting (calcNewTexCoords), 1: parallax occlusion mapping,
+// 2: cone step mapping, 3: maximum mipmap traversal, 4: normal mapping only
+#ifndef PARALLAX_MODE
+#define PARALLAX_MODE 0
+#endif
+
+// Occlusion mapping quality: the ray-march step count goes from min (head-on)
+// to max (grazing), followed by a binary search of POM_REFINE_STEPS steps
+#ifndef POM_MIN_STEPS
+#define POM_MIN_STEPS 8
+#define POM_MAX_STEPS 24
+#define POM_REFINE_STEPS 4
+#endif
+
+// Cone step mapping quality: the number of cone steps
+#ifndef CONE_STEPS
+#define CONE_STEPS 16
+#endif
+
+// Maximum mipmap traversal: how many texel visits a fragment may make
+#ifndef PYRAMID_STEPS
+#define PYRAMID_STEPS 64
+#endif
+
+// LOD_TIER_COUNT builds the program that counts the fragments of each LOD
+// tier for the stats: it draws nothing, and discards every fragment that
+// isn't in the tier 'lodTier' (0 parallax, 1 blended, 2 normal mapping)
+#ifdef LOD_TIER_COUNT
+uniform int lodTier;
+#endif
+
+// VIRTUAL_TEXTURE reads the packed normal and height from a virtual
+// texture (see lib/vt_cache.h in the demo) instead of normalMap.
+// VT_FEEDBACK builds the program for its feedback pass, which writes the
+// page every fragment needs instead of a color.
+#ifdef VIRTUAL_TEXTURE
+uniform sampler2D vtPageTable;	// Slot x, slot y and level of the page to use, per page
+uniform sampler2D vtCache;		// The physical cache, a grid of tiles
+uniform vec4 vtLayout;			// Page size, border and tile size in texels, top level
+uniform vec2 vtCacheSize;		// In texels
+uniform float vtLodBias;		// Added to the level, the feedback is drawn smaller
+#endif
+
 // NOTES ON CONVERTING shader #version 330 TO OPENGL 2.1
 //
 // In the fragment program, in becomes varying.
@@ -5,16 +67,48 @@
 // In the fragment program, texture() becomes texture2D() or texture1D() as appropriate.
 
 // in parameter from the vertex shader stage
-varying vec4 theColor;
 varying vec2 tc;
 varying vec3 n;
+varying vec4 t;			// Tangent, w is the handedness
 varying vec4 vec2Camera;
 
 // uniforms
 uniform float time;
 uniform float loopDuration;
 
+#ifdef MATERIAL_ARRAY
+uniform sampler2DArray diffuseMap, normalMap, displacementMap, specularMap;
+varying float materialLayer;
+#define SAMPLE_MAP(map, texCoord) texture2DArray(map, vec3(texCoord, materialLayer))
+#define SAMPLE_MAP_GRAD(map, texCoord, dx, dy) texture2DArrayGrad(map, vec3(texCoord, materialLayer), dx, dy)
+#else
 uniform sampler2D diffuseMap, normalMap, displacementMap; 
+#define SAMPLE_MAP(map, texCoord) texture2D(map, texCoord)
+#define SAMPLE_MAP_GRAD(map, texCoord, dx, dy) texture2DGradARB(map, texCoord, dx, dy)
+#endif
+uniform sampler2D coneMap; // Cone ratios of the displacement map, see lib/cone_map.h
+uniform sampler2D heightPyramid; // Max height in .r, min in .g, see lib/height_pyramid.h
+uniform bool normalMapXY; // The normal map only stores x and y (e.g. BC5)
+uniform bool heightInNormalAlpha; // Packed mode: height is the normal map's alpha
+uniform bool vertexTangents; // Tangent frames from the vertex stream instead of derivatives
+
+// Parallax LOD: how far the deepest point of the height field can appear
+// shifted, in pixels. Below x there is nothing to see and only the normal
+// map is used, from y up the parallax is done in full, in between the two
+// are blended.
+uniform bool parallaxLod;
+uniform vec2 parallaxLodPixels;
+
+// CONE_MAP_MAX_RATIO of lib/cone_map.h, the cone map stores sqrt(ratio / max)
+const float coneMaxRatio = 0.05;
+
+// Maximum mipmap traversal: the size of level 0 in texels and the index of
+// the 1x1 level
+uniform vec2 heightPyramidSize;
+uniform float heightPyramidTop;
+
+// Depth of the height field in texture coordinates at 45 degrees
+const float pomDepthScale = 0.03;
 
 // constant colors
 const vec4 white = vec4(1.0, 1.0, 1.0, 1.0);
@@ -40,10 +134,213 @@ mat3 calcTangentMatrix(vec3 normal, vec3 vec2cam, vec2 texCoord)
 	return mat3(tangent, cotangent, normal);
 }
 
-vec2 calcNewTexCoords(sampler2D displacementMap, vec2 tc, vec3 tsVec2Camera)
+// The same matrix from the interpolated vertex tangent. The bitangent is
+// rebuilt the MikkTSpace way: handedness * cross(normal, tangent).
+mat3 calcVertexTangentMatrix(vec3 normal)
+{
+	vec3 tangent	= normalize(t.xyz);
+	vec3 cotangent	= t.w * cross(normal, tangent);
+
+	return mat3(tangent, cotangent, normal);
+}
+
+#ifdef VIRTUAL_TEXTURE
+// The level of the virtual texture whose texels are nearest a pixel in size,
+// picked as GL_NEAREST_MIPMAP_LINEAR would
+float calcVirtualLevel(vec2 dx, vec2 dy)
+{
+	float texels = max(length(dx), length(dy)) * vtLayout.x * exp2(vtLayout.w);
+	return clamp(floor(log2(max(texels, 1e-8)) + vtLodBias + 0.5), 0.0, vtLayout.w);
+}
+
+// Looks the page up in the page table, which points at the page's slot or,
+// if it isn't resident, at that of its nearest resident ancestor, and reads
+// the physical cache there. Tiles have a border so filtering within a page
+// never reaches the next tile.
+vec4 sampleVirtual(vec2 texCoord, vec2 dx, vec2 dy)
+{
+	vec3 entry = floor(texture2DLod(vtPageTable, texCoord, calcVirtualLevel(dx, dy)).rgb * 255.0 + 0.5);
+	vec2 inPage = fract(texCoord * exp2(vtLayout.w - entry.b));
+	vec2 texel = entry.rg * vtLayout.z + vtLayout.y + inPage * vtLayout.x;
+
+	return texture2DLod(vtCache, texel / vtCacheSize, 0.0);
+}
+#endif
+
+// Height of the surface at a texture coordinate, in [0,1]. The derivatives
+// are explicit because the parallax runs in loops and behind the LOD
+// branch, where implicit ones are undefined.
+float sampleHeightGrad(vec2 texCoord, vec2 dx, vec2 dy)
+{
+#ifdef VIRTUAL_TEXTURE
+	return sampleVirtual(texCoord, dx, dy).a;
+#endif
+
+	// In the packed mode the height comes along with the normal, so the
+	// parallax steps and the final normal fetch all hit the same texture
+	if(heightInNormalAlpha)
+		return SAMPLE_MAP_GRAD(normalMap, texCoord, dx, dy).a;
+
+	return SAMPLE_MAP_GRAD(displacementMap, texCoord, dx, dy).r; // .r because the displacement map is monochromatic
+}
+
+// How much of the parallax to do, from 0 (normal mapping only) to 1. The
+// shift of the deepest point in texture coordinates grows with the angle
+// to the surface, the texture coordinates per pixel grow with the distance
+// and the angle; together they give the shift on screen.
+float calcParallaxWeight(vec3 tsVec2Camera, vec2 dx, vec2 dy)
+{
+	vec3 view = normalize(tsVec2Camera);
+	float shift = length(view.xy) / max(view.z, 0.1) * pomDepthScale;
+	float texCoordsPerPixel = max(length(dx), length(dy));
+
+	return smoothstep(parallaxLodPixels.x, parallaxLodPixels.y, shift / max(texCoordsPerPixel, 1e-8));
+}
+
+// Parallax occlusion mapping: march the view ray down through the height
+// field until it passes below the surface, then refine the hit with a
+// binary search between the last two steps
+vec2 calcOcclusionTexCoords(vec2 tc, vec3 tsVec2Camera, vec2 dx, vec2 dy)
+{
+	vec3 view = normalize(tsVec2Camera);
+
+	// Head-on the ray crosses few texels, at grazing angles many
+	float numSteps = floor(mix(float(POM_MAX_STEPS), float(POM_MIN_STEPS), abs(view.z)));
+	float stepDepth = 1.0 / numSteps;
+	vec2 stepOffset = -view.xy / max(view.z, 0.1) * pomDepthScale / numSteps;
+
+	// Depth is measured down from the top of the height field
+	vec2 coords = tc;
+	float rayDepth = 0.0;
+	float surfaceDepth = 1.0 - sampleHeightGrad(coords, dx, dy);
+
+	for(int i = 0; i < POM_MAX_STEPS; i++)
+	{
+		if(rayDepth >= surfaceDepth || float(i) >= numSteps)
+			break;
+
+		coords += stepOffset;
+		rayDepth += stepDepth;
+		surfaceDepth = 1.0 - sampleHeightGrad(coords, dx, dy);
+	}
+
+	// The ray is now just below the surface, halve the step back and forth
+	for(int i = 0; i < POM_REFINE_STEPS; i++)
+	{
+		stepOffset *= 0.5;
+		stepDepth *= 0.5;
+
+		if(rayDepth >= surfaceDepth)
+		{
+			coords -= stepOffset;
+			rayDepth -= stepDepth;
+		}
+		else
+		{
+			coords += stepOffset;
+			rayDepth += stepDepth;
+		}
+		surfaceDepth = 1.0 - sampleHeightGrad(coords, dx, dy);
+	}
+
+	return coords;
+}
+
+// Cone step mapping: the cone map gives, for every texel, an upward cone
+// that holds no part of the height field. The ray can jump to where it
+// leaves the cone of the texel below it without ever passing the surface,
+// so it closes in on the hit without a fixed step size or a search.
+vec2 calcConeTexCoords(vec2 tc, vec3 tsVec2Camera, vec2 dx, vec2 dy)
+{
+	vec3 view = normalize(tsVec2Camera);
+
+	// Same ray as calcOcclusionTexCoords(), per unit of depth
+	vec2 rayOffset = -view.xy / max(view.z, 0.1) * pomDepthScale;
+	float rayLength = length(rayOffset);
+
+	vec2 coords = tc;
+	float rayDepth = 0.0;
+
+	for(int i = 0; i < CONE_STEPS; i++)
+	{
+		float gap = 1.0 - sampleHeightGrad(coords, dx, dy) - rayDepth;
+		if(gap <= 0.0)
+			break;
+
+		float cone = texture2DGradARB(coneMap, coords, dx, dy).r;
+		float ratio = cone * cone * coneMaxRatio;
+
+		// Head-on the ray drops straight onto the surface
+		float advance = rayLength > 0.0001 ? gap * ratio / (rayLength + ratio) : gap;
+		coords += rayOffset * advance;
+		rayDepth += advance;
+	}
+
+	return coords;
+}
+
+// Maximum mipmap traversal: the heights are flat-topped texels, and every
+// texel of a coarser level is as high as the highest one below it. The ray
+// starts on the 1x1 level. Where it passes over a texel it moves on to the
+// next one and climbs a level, where it reaches the top of one it descends
+// to look closer. On level 0 that top is the exact hit, so empty space is
+// skipped in O(log n) fetches however flat the angle.
+vec2 calcPyramidTexCoords(vec2 tc, vec3 tsVec2Camera)
+{
+	vec3 view = normalize(tsVec2Camera);
+
+	// Same ray as calcOcclusionTexCoords(), per unit of depth
+	vec3 ray = vec3(-view.xy / max(view.z, 0.1) * pomDepthScale, 1.0);
+
+	// Avoid dividing by zero when looking along an axis
+	vec2 dir = vec2(abs(ray.x) < 1e-6 ? 1e-6 : ray.x, abs(ray.y) < 1e-6 ? 1e-6 : ray.y);
+
+	// Just enough to leave a texel for the next one
+	vec2 nudge = sign(dir) * 0.01 / heightPyramidSize;
+
+	vec3 pos = vec3(tc, 0.0);
+	float level = heightPyramidTop;
+
+	for(int i = 0; i < PYRAMID_STEPS; i++)
+	{
+		if(level < 0.0)
+			break;
+
+		float surfaceDepth = 1.0 - texture2DLod(heightPyramid, pos.xy, level).r;
+		if(pos.z >= surfaceDepth)
+		{
+			// Below this texel's top: the hit is inside it
+			level -= 1.0;
+			continue;
+		}
+
+		// Ray lengths to the texel's top and out through its sides
+		vec2 cells = max(floor(heightPyramidSize / exp2(level)), 1.0);
+		vec2 side = (floor(pos.xy * cells) + step(0.0, dir)) / cells;
+		vec2 toSides = (side - pos.xy) / dir;
+		float toTop = surfaceDepth - pos.z;
+		float toSide = min(toSides.x, toSides.y);
+
+		if(toTop <= toSide)
+		{
+			pos += ray * toTop;
+			level -= 1.0;
+		}
+		else
+		{
+			pos += ray * toSide;
+			pos.xy += nudge;
+			level = min(level + 1.0, heightPyramidTop);
+		}
+	}
+
+	return pos.xy;
+}
+
+vec2 calcNewTexCoords(vec2 tc, vec3 tsVec2Camera, vec2 dx, vec2 dy)
 { 
 	// Get height from height map
-	float height = texture2D(displacementMap, tc).r; // .r because the displacement map is monochromatic
+	float height = sampleHeightGrad(tc, dx, dy);
 
 	// Calculate new height based on surface thickness and bias
 	float surfaceThickness = 0.015; // Thickness relative to width and height
@@ -56,6 +353,19 @@ vec2 calcNewTexCoords(sampler2D displacementMap, vec2 tc, vec3 tsVec2Camera)
 	return parallaxTextureOffset;
 }
 
+// Get the surface normal from the normal map and change range from [0,1] to [-1,1]
+vec3 sampleNormal(vec2 texCoord)
+{
+	if(normalMapXY)
+	{
+		// Rebuild z from the unit length of the normal
+		vec2 xy = 2.0 * SAMPLE_MAP(normalMap, texCoord).rg - 1.0;
+		return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+	}
+
+	return 2.0 * SAMPLE_MAP(normalMap, texCoord).xyz - 1.0;
+}
+
 void main()
 {
 	float currTime = mod(time, loopDuration);
@@ -68,7 +378,11 @@ void main()
 	// Calculate the TBN matrix with normalized vectors
 	vec3 toCam 	= -vec2Camera.xyz;
 	vec3 normal = normalize(n);
-	mat3 TBN	= calcTangentMatrix(normal, toCam, tc);
+	mat3 TBN;
+	if(vertexTangents)
+		TBN = calcVertexTangentMatrix(normal);
+	else
+		TBN = calcTangentMatrix(normal, toCam, tc);
 	mat3 TBNi	= mat3( // Inverse of TBN = transpose of TBN
 						TBN[0][0], TBN[1][0], TBN[2][0],
 						TBN[0][1], TBN[1][1], TBN[2][1],
@@ -78,19 +392,66 @@ void main()
 	// Transform to tangent-space coordinates
 	vec3 tsVec2Camera = TBNi * vec2Camera.xyz;
 
+	// Derivatives of the unshifted coordinates pick the mip level of the
+	// height fetches. Taken out here, before any branch.
+	vec2 dx = dFdx(tc);
+	vec2 dy = dFdy(tc);
+
+	float parallaxWeight = parallaxLod ? calcParallaxWeight(tsVec2Camera, dx, dy) : 1.0;
+
+#ifdef VT_FEEDBACK
+	// The page of the unshifted coordinates, packed as vt_feedback_encode()
+	// does it. Zero (the clear color) means no page.
+	float level = calcVirtualLevel(dx, dy);
+	vec2 page = floor(fract(tc) * exp2(vtLayout.w - level));
+	vec2 high = floor(page / 256.0);
+	gl_FragColor = vec4(page - high * 256.0, high.x + high.y * 16.0, level + 1.0) / 255.0;
+	return;
+#endif
+
+#ifdef LOD_TIER_COUNT
+	int tier = parallaxWeight >= 1.0 ? 0 : (parallaxWeight > 0.0 ? 1 : 2);
+	if(tier != lodTier)
+		discard;
+	gl_FragColor = vec4(0.0);
+	return;
+#endif
+
 	// Calculate new texture coordinates for the parallax mapping effect.
 	// It's done a couple of times to exaggerate the effect. The exaggeration
 	// makes the effect look more realistic since it comes closer to a correct
 	// approximation of where the geometry should have been, if it existed.
-	vec2 newCoords = tc + calcNewTexCoords(displacementMap, tc, tsVec2Camera); 
-	newCoords += calcNewTexCoords(displacementMap, newCoords, tsVec2Camera);
-	newCoords += calcNewTexCoords(displacementMap, newCoords, tsVec2Camera);
-	newCoords += calcNewTexCoords(displacementMap, newCoords, tsVec2Camera);
+	// Past the LOD fade the height map isn't touched at all, and the surface
+	// stays where the triangle is like with plain normal mapping.
+	vec2 newCoords = tc;
+#if PARALLAX_MODE != 4
+	if(parallaxWeight > 0.0)
+	{
+		vec2 shiftedCoords;
+#if PARALLAX_MODE == 1
+		shiftedCoords = calcOcclusionTexCoords(tc, tsVec2Camera, dx, dy);
+#elif PARALLAX_MODE == 2
+		shiftedCoords = calcConeTexCoords(tc, tsVec2Camera, dx, dy);
+#elif PARALLAX_MODE == 3
+		shiftedCoords = calcPyramidTexCoords(tc, tsVec2Camera);
+#else
+		shiftedCoords = tc + calcNewTexCoords(tc, tsVec2Camera, dx, dy); 
+		shiftedCoords += calcNewTexCoords(shiftedCoords, tsVec2Camera, dx, dy);
+		shiftedCoords += calcNewTexCoords(shiftedCoords, tsVec2Camera, dx, dy);
+		shiftedCoords += calcNewTexCoords(shiftedCoords, tsVec2Camera, dx, dy);
+#endif
+		newCoords = mix(tc, shiftedCoords, parallaxWeight);
+	}
+#endif
 
 
 
-	// Get the surface normal from the normal map and change range from [0,1] to [-1,1]
-	vec3 bump = 2.0 * texture2D(normalMap, newCoords.xy).xyz - 1.0;
+	// Get the surface normal from the normal map
+#ifdef VIRTUAL_TEXTURE
+	vec3 bump = 2.0 * sampleVirtual(newCoords, dx, dy).xyz - 1.0;
+#else
+	vec3 bump = sampleNormal(newCoords.xy);
+#endif
 
 	// Transform surface normal from tangent space to camera space
 	normal = normalize(TBNi * bump);
@@ -103,11 +464,17 @@ void main()
 
 	if(NdotL > 0.0)
 	{
-		color = NdotL * texture2D(diffuseMap, newCoords) * 0.8;
+		color = NdotL * SAMPLE_MAP(diffuseMap, newCoords) * 0.8;
+
+#ifdef MATERIAL_ARRAY
+		// Blinn-Phong highlight, as strong as the specular map has it
+		vec3 halfway = normalize(normalize(lightDir) + normalize(vec2Camera.xyz));
+		color.rgb += SAMPLE_MAP(specularMap, newCoords).rgb * pow(max(dot(normal, halfway), 0.0), 32.0);
+#endif
 	}
 
 	// Add ambient light
-	color += vec4(0.2, 0.2, 0.2, 1.0) * texture2D(diffuseMap, newCoords);
+	color += vec4(0.2, 0.2, 0.2, 1.0) * SAMPLE_MAP(diffuseMap, newCoords);
 
 	// Set the color of the currently processed fragment
 	gl_FragColor = color;
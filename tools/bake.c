@@ -0,0 +1,282 @@
+/*
+	Material baker
+
+	Turns the diffuse, normal and displacement maps (PNG or JPEG) into a
+	single texture pack (see lib/texture_pack.h) with full mip chains, so
+	the demo can map it and upload without decoding anything.
+
+	Each map gets the mip filter that suits it: the diffuse map is averaged
+	in linear space, normals are renormalized on every level, and the
+	displacement map is stored twice, once averaged and once with the
+	maximum height of each footprint. Its cone map for cone step mapping
+	(see lib/cone_map.h) is stored as well.
+
+	With -compress the maps are block compressed: BC1 for the diffuse map,
+	BC5 (x and y only) for the normal map and BC4 for the displacement map.
+	The PSNR and encode throughput of each map are reported.
+
+	With -packed the normal and displacement maps are stored as one RGBA map
+	with the height in alpha, for the shader's packed binding mode. That map
+	is never compressed.
+
+	Usage: bake [-compress] [-packed] <output.texpack> <diffuse.png> <normal.png> <displacement.png>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/image_decoder.h"
+#include "../lib/thread_pool.h"
+#include "../lib/texture_loader.h"
+#include "../lib/texture_pack.h"
+#include "../lib/mipmap.h"
+#include "../lib/bc_encode.h"
+#include "../lib/material_pack.h"
+#include "../lib/cone_map.h"
+#include "../lib/timer.h"
+
+#define NUM_MAPS 3
+
+typedef struct {
+  thread_pool_t *pool;
+  uint32_t mapType;
+  int filter;
+  mip_chain_t chain;
+  mip_chain_t maxChain;   // Displacement only
+  mip_chain_t coneChain;  // Displacement only, a single level
+  double coneMs;
+
+  int packed;
+  int compress;
+  int bcFormat;
+  mip_chain_t encoded;    // Every level holds encoded blocks
+  double encodeMs, psnr;
+} bake_job_t;
+
+static const char *mapNames[NUM_MAPS] = { "diffuse", "normal", "displacement" };
+
+// The displacement map is grey, so only its first channel is kept
+static void keep_first_channel(png_data_t *image) {
+  unsigned char *src = image->pixelData, *dst = image->pixelData;
+  size_t i, n = (size_t)image->width * image->height;
+
+  for( i = 0 ; i < n ; i++, src += image->channels )
+    *dst++ = *src;
+
+  image->channels = 1;
+  image->has_alpha = 0;
+}
+
+static void encode_chain(bake_job_t *job) {
+  const mip_chain_t *chain = &job->chain;
+  double start = timer_now_ms();
+  int l;
+
+  job->encoded = *chain;
+  for( l = 0 ; l < chain->numLevels ; l++ ){
+    const mip_level_t *level = &chain->levels[l];
+    job->encoded.levels[l].data = (unsigned char*)malloc(bc_encoded_size(job->bcFormat, level->width, level->height));
+    bc_encode_image(job->bcFormat, level->data, level->width, level->height, chain->channels,
+                    job->encoded.levels[l].data, job->pool);
+  }
+  job->encodeMs = timer_now_ms() - start;
+
+  job->psnr = bc_psnr(job->bcFormat, chain->levels[0].data, chain->levels[0].width, chain->levels[0].height,
+                      chain->channels, job->encoded.levels[0].data);
+}
+
+static void free_encoded(bake_job_t *job) {
+  int l;
+  for( l = 0 ; l < job->encoded.numLevels ; l++ )
+    free(job->encoded.levels[l].data);
+  job->encoded.numLevels = 0;
+}
+
+static void build_cone_map(bake_job_t *job, const png_data_t *image) {
+  mip_level_t *level = &job->coneChain.levels[0];
+  double start = timer_now_ms();
+
+  level->width = image->width;
+  level->height = image->height;
+  level->data = (unsigned char*)malloc((size_t)image->width * image->height);
+  cone_map_build(image->pixelData, image->width, image->height, image->channels, level->data, job->pool);
+
+  job->coneChain.channels = 1;
+  job->coneChain.numLevels = 1;
+  job->coneMs = timer_now_ms() - start;
+}
+
+// Runs on a worker as soon as the map is decoded
+static void build_chains(texture_load_t *load) {
+  bake_job_t *job = (bake_job_t*)load->userData;
+  png_data_t *image = load->image;
+
+  if( job->mapType == TEXPACK_MAP_DISPLACEMENT ){
+    keep_first_channel(image);
+    mip_chain_build(&job->maxChain, image->pixelData, image->width, image->height, 1, MIP_FILTER_MAX, job->pool);
+    build_cone_map(job, image);
+  }
+
+  // Packed normal and height maps are combined once both are decoded
+  if( job->packed && job->mapType != TEXPACK_MAP_DIFFUSE )
+    return;
+
+  mip_chain_build(&job->chain, image->pixelData, image->width, image->height, image->channels, job->filter, job->pool);
+
+  if( job->compress )
+    encode_chain(job);
+}
+
+static uint32_t format_for_channels(int channels) {
+  switch( channels ){
+  case 1: return TEXPACK_FORMAT_R8;
+  case 2: return TEXPACK_FORMAT_RG8;
+  case 4: return TEXPACK_FORMAT_RGBA8;
+  }
+  return TEXPACK_FORMAT_RGB8;
+}
+
+int main(int argc, char *argv[]) {
+  static const int filters[NUM_MAPS] = { MIP_FILTER_SRGB, MIP_FILTER_NORMAL, MIP_FILTER_BOX };
+  static const int bcFormats[NUM_MAPS] = { BC_FORMAT_BC1, BC_FORMAT_BC5, BC_FORMAT_BC4 };
+  static const uint32_t packFormats[NUM_MAPS] = { TEXPACK_FORMAT_BC1, TEXPACK_FORMAT_BC5, TEXPACK_FORMAT_BC4 };
+  const char *outFile;
+  texture_load_t loads[NUM_MAPS];
+  texpack_source_t sources[NUM_MAPS + 3];
+  png_data_t *packedImage = NULL;
+  mip_chain_t packedChain;
+  bake_job_t jobs[NUM_MAPS];
+  texture_batch_t *batch;
+  texture_load_t *load;
+  thread_pool_t *pool;
+  double start, stepStart;
+  int i, numSources = 0, ok = 1, compress = 0, packed = 0, firstArg = 1;
+
+  for( ; firstArg < argc && argv[firstArg][0] == '-' ; firstArg++ ){
+    if( strcmp(argv[firstArg], "-compress") == 0 )
+      compress = 1;
+    else if( strcmp(argv[firstArg], "-packed") == 0 )
+      packed = 1;
+    else
+      break;
+  }
+
+  if( argc != firstArg + 1 + NUM_MAPS ){
+    fprintf( stderr, "Usage: %s [-compress] [-packed] <output.texpack> <diffuse.png> <normal.png> <displacement.png>\n", argv[0] );
+    return 1;
+  }
+  outFile = argv[firstArg];
+
+  start = timer_now_ms();
+  pool = thread_pool_create(0);
+
+  // Decode and build the mip chains, one map per task
+  for( i = 0 ; i < NUM_MAPS ; i++ ){
+    jobs[i].pool = pool;
+    jobs[i].mapType = TEXPACK_MAP_DIFFUSE + i;
+    jobs[i].filter = filters[i];
+    jobs[i].chain.numLevels = 0;
+    jobs[i].maxChain.numLevels = 0;
+    jobs[i].coneChain.numLevels = 0;
+    jobs[i].packed = packed;
+    jobs[i].compress = compress;
+    jobs[i].bcFormat = bcFormats[i];
+    jobs[i].encoded.numLevels = 0;
+
+    loads[i].fileName = argv[firstArg + 1 + i];
+    loads[i].gray16 = 0;
+    loads[i].process = build_chains;
+    loads[i].userData = &jobs[i];
+  }
+
+  batch = texture_batch_begin(pool, loads, NUM_MAPS);
+  while( (load = texture_batch_next(batch)) != NULL ){
+    if( !load->image )
+      ok = 0;
+    else
+      fprintf( stderr, "Decoded %s in %.1f ms, mips in %.1f ms\n", load->fileName, load->decodeMs, load->processMs );
+  }
+  texture_batch_end(batch);
+
+  packedChain.numLevels = 0;
+  if( ok && packed ){
+    stepStart = timer_now_ms();
+    packedImage = pack_normal_height(loads[1].image, loads[2].image, pool);
+    if( packedImage ){
+      mip_chain_build(&packedChain, packedImage->pixelData, packedImage->width, packedImage->height, 4,
+                      MIP_FILTER_NORMAL, pool);
+      fprintf( stderr, "Packed normal and height maps in %.1f ms\n", timer_now_ms() - stepStart );
+    } else
+      ok = 0;
+  }
+
+  // Write
+  if( ok ){
+    stepStart = timer_now_ms();
+    for( i = 0 ; i < NUM_MAPS ; i++ ){
+      png_data_t *image = loads[i].image;
+
+      if( jobs[i].chain.numLevels > 0 ){
+        sources[numSources].mapType = jobs[i].mapType;
+        if( compress ){
+          sources[numSources].format = packFormats[i];
+          sources[numSources].chain = &jobs[i].encoded;
+        } else {
+          sources[numSources].format = format_for_channels(image->channels);
+          sources[numSources].chain = &jobs[i].chain;
+        }
+        numSources++;
+      }
+
+      if( jobs[i].maxChain.numLevels > 0 ){
+        sources[numSources].mapType = TEXPACK_MAP_DISPLACEMENT_MAX;
+        sources[numSources].format = TEXPACK_FORMAT_R8;
+        sources[numSources].chain = &jobs[i].maxChain;
+        numSources++;
+      }
+
+      if( jobs[i].coneChain.numLevels > 0 ){
+        sources[numSources].mapType = TEXPACK_MAP_CONE;
+        sources[numSources].format = TEXPACK_FORMAT_R8;
+        sources[numSources].chain = &jobs[i].coneChain;
+        numSources++;
+      }
+
+      fprintf( stderr, "  %-12s %dx%d, %d channels, %d levels\n", mapNames[i],
+               image->width, image->height, image->channels, jobs[i].chain.numLevels );
+      if( compress && jobs[i].encoded.numLevels > 0 )
+        fprintf( stderr, "               %s: PSNR %.2f dB, encoded in %.1f ms (%.1f Mpixels/s)\n",
+                 packFormats[i] == TEXPACK_FORMAT_BC1 ? "BC1" : packFormats[i] == TEXPACK_FORMAT_BC4 ? "BC4" : "BC5",
+                 jobs[i].psnr, jobs[i].encodeMs,
+                 image->width * (double)image->height * 4.0 / 3.0 / (jobs[i].encodeMs * 1000.0) );
+      if( jobs[i].coneChain.numLevels > 0 )
+        fprintf( stderr, "               cone map built in %.1f ms\n", jobs[i].coneMs );
+    }
+    if( packedImage ){
+      sources[numSources].mapType = TEXPACK_MAP_NORMAL_HEIGHT;
+      sources[numSources].format = TEXPACK_FORMAT_RGBA8;
+      sources[numSources].chain = &packedChain;
+      numSources++;
+      fprintf( stderr, "  %-12s %dx%d, 4 channels, %d levels\n", "normal+height",
+               packedImage->width, packedImage->height, packedChain.numLevels );
+    }
+    ok = texpack_write(outFile, sources, numSources);
+    fprintf( stderr, "Wrote %s in %.1f ms (total %.1f ms)\n", outFile,
+             timer_now_ms() - stepStart, timer_now_ms() - start );
+  }
+
+  for( i = 0 ; i < NUM_MAPS ; i++ ){
+    mip_chain_free(&jobs[i].chain);
+    mip_chain_free(&jobs[i].maxChain);
+    if( jobs[i].coneChain.numLevels > 0 )
+      free(jobs[i].coneChain.levels[0].data);
+    free_encoded(&jobs[i]);
+    free_png(loads[i].image);
+  }
+  mip_chain_free(&packedChain);
+  free_png(packedImage);
+  thread_pool_destroy(pool);
+
+  return ok ? 0 : 1;
+}
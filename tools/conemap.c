@@ -0,0 +1,156 @@
+/*
+	Cone map generator
+
+	Computes the cone ratio map that the cone step mapping mode of
+	parallaxmapping.frag needs (see lib/cone_map.h) from a displacement map
+	and writes it as a grey PNG.
+
+	With -bench it instead times the generator on the displacement map
+	scaled to every power of two from 64 up to twice its size (the largest
+	one is the map tiled 2x2), checks the small sizes against the brute
+	force search and reports how long that takes.
+
+	Usage: conemap [-threads n] <displacement.png> <cones.png>
+	       conemap [-threads n] -bench <displacement.png>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/image_decoder.h"
+#include "../lib/thread_pool.h"
+#include "../lib/mipmap.h"
+#include "../lib/cone_map.h"
+#include "../lib/timer.h"
+
+// Sizes up to this are also run through the brute force search
+#define MAX_REFERENCE_SIZE 128
+
+// The first channel of every texel
+static unsigned char *first_channel(const png_data_t *image) {
+  size_t i, n = (size_t)image->width * image->height;
+  unsigned char *heights = (unsigned char*)malloc(n);
+
+  for( i = 0 ; i < n ; i++ )
+    heights[i] = image->pixelData[i * image->channels];
+  return heights;
+}
+
+static unsigned char *tile_2x2(const unsigned char *src, int width, int height) {
+  unsigned char *dst = (unsigned char*)malloc((size_t)width * height * 4);
+  int y;
+
+  for( y = 0 ; y < 2 * height ; y++ ){
+    unsigned char *row = dst + (size_t)y * width * 2;
+    memcpy(row, src + (size_t)(y % height) * width, width);
+    memcpy(row + width, src + (size_t)(y % height) * width, width);
+  }
+  return dst;
+}
+
+static void bench_size(const unsigned char *heights, int width, int height, thread_pool_t *pool) {
+  unsigned char *cones = (unsigned char*)malloc((size_t)width * height);
+  double start = timer_now_ms(), ms;
+
+  cone_map_build(heights, width, height, 1, cones, pool);
+  ms = timer_now_ms() - start;
+  fprintf( stderr, "%5dx%-5d %10.1f ms %8.2f Mtexels/s", width, height, ms,
+           width * (double)height / (ms * 1000.0) );
+
+  if( width <= MAX_REFERENCE_SIZE && height <= MAX_REFERENCE_SIZE ){
+    unsigned char *reference = (unsigned char*)malloc((size_t)width * height);
+    size_t i, mismatches = 0;
+
+    start = timer_now_ms();
+    cone_map_build_reference(heights, width, height, 1, reference);
+    ms = timer_now_ms() - start;
+
+    for( i = 0 ; i < (size_t)width * height ; i++ )
+      mismatches += cones[i] != reference[i];
+    fprintf( stderr, "   brute force %.1f ms, %lu mismatches", ms, (unsigned long)mismatches );
+    free(reference);
+  }
+  fprintf( stderr, "\n" );
+
+  free(cones);
+}
+
+static int run_bench(const png_data_t *image, thread_pool_t *pool) {
+  unsigned char *heights = first_channel(image);
+  unsigned char *tiled;
+  mip_chain_t chain;
+  int l;
+
+  mip_chain_build(&chain, heights, image->width, image->height, 1, MIP_FILTER_BOX, pool);
+
+  fprintf( stderr, "Cone map generation on %d threads\n", pool ? thread_pool_size(pool) + 1 : 1 );
+  for( l = chain.numLevels - 1 ; l >= 0 ; l-- ){
+    const mip_level_t *level = &chain.levels[l];
+    if( level->width >= 64 && level->height >= 64 )
+      bench_size(level->data, level->width, level->height, pool);
+  }
+
+  tiled = tile_2x2(heights, image->width, image->height);
+  bench_size(tiled, image->width * 2, image->height * 2, pool);
+
+  free(tiled);
+  mip_chain_free(&chain);
+  free(heights);
+  return 1;
+}
+
+static int run_build(const png_data_t *image, const char *outFile, thread_pool_t *pool) {
+  png_data_t cones;
+  double start = timer_now_ms();
+  int ok;
+
+  cones.width = image->width;
+  cones.height = image->height;
+  cones.channels = 1;
+  cones.has_alpha = 0;
+  cones.bit_depth = 8;
+  cones.owns_pixels = 0;
+  cones.pixelData = (unsigned char*)malloc((size_t)image->width * image->height);
+
+  cone_map_build(image->pixelData, image->width, image->height, image->channels, cones.pixelData, pool);
+  fprintf( stderr, "Built the %dx%d cone map in %.1f ms\n", image->width, image->height, timer_now_ms() - start );
+
+  ok = write_png((char*)outFile, &cones);
+  free(cones.pixelData);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  thread_pool_t *pool;
+  png_data_t *image;
+  int argi, bench = 0, numThreads = 0, ok;
+
+  for( argi = 1 ; argi < argc && argv[argi][0] == '-' ; argi++ ){
+    if( strcmp(argv[argi], "-bench") == 0 )
+      bench = 1;
+    else if( strcmp(argv[argi], "-threads") == 0 && argi + 1 < argc )
+      numThreads = atoi(argv[++argi]);
+    else
+      break;
+  }
+
+  if( argc != argi + (bench ? 1 : 2) ){
+    fprintf( stderr, "Usage: %s [-threads n] <displacement.png> <cones.png>\n"
+                     "       %s [-threads n] -bench <displacement.png>\n", argv[0], argv[0] );
+    return 1;
+  }
+
+  image = read_image(argv[argi]);
+  if( !image )
+    return 1;
+
+  // -threads 1 runs on the calling thread only
+  pool = numThreads == 1 ? NULL : thread_pool_create(numThreads);
+
+  ok = bench ? run_bench(image, pool) : run_build(image, argv[argi + 1], pool);
+
+  free_png(image);
+  thread_pool_destroy(pool);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/*
+	Image decoder benchmark
+
+	Decodes every given file with lib/image_decoder.c a number of times on
+	one thread and reports the best time of each, in MB/s of decoded pixels
+	and of the file itself, then the totals of each format. Every repeat
+	decodes into the same buffer, as the loader does with read_image_into(),
+	so allocation isn't part of the time. The first repeat also reads the
+	file from disk unless it is already cached.
+
+	For example, the PNG maps of a material against its JPEG ones:
+	    imagebench assets/photosculpt-graystonewall-*.png assets/photosculpt/photosculpt-graystonewall-*.jpg
+
+	Usage: imagebench [-repeat n] <image>...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../lib/image_decoder.h"
+#include "../lib/timer.h"
+
+#define MAX_FORMATS 8
+
+typedef struct {
+  const char *name;
+  int files;
+  double fileBytes;
+  double pixelBytes;
+  double ms;
+} format_total_t;
+
+static format_total_t *find_total(format_total_t *totals, int *numTotals, const char *name) {
+  int i;
+
+  for( i = 0 ; i < *numTotals ; i++ )
+    if( strcmp(totals[i].name, name) == 0 )
+      return &totals[i];
+  if( *numTotals == MAX_FORMATS )
+    return NULL;
+
+  memset(&totals[*numTotals], 0, sizeof(format_total_t));
+  totals[*numTotals].name = name;
+  return &totals[(*numTotals)++];
+}
+
+// Returns the best decode time in ms, or a negative number on failure
+static double bench_file(char *filename, const image_decoder_t *decoder, int repeat, double fileBytes, size_t *pixelBytes) {
+  int width, height, channels, r;
+  double best = -1.0;
+  unsigned char *buffer;
+
+  *pixelBytes = 0;
+  if( !decoder->read_header(filename, &width, &height, &channels) )
+    return -1.0;
+  *pixelBytes = (size_t)width * height * channels;
+  buffer = (unsigned char*)malloc(*pixelBytes);
+
+  for( r = 0 ; r < repeat ; r++ ){
+    double start = timer_now_ms(), ms;
+    png_data_t *image = decoder->decode_into(filename, buffer, *pixelBytes);
+
+    ms = timer_now_ms() - start;
+    if( !image ){
+      best = -1.0;
+      break;
+    }
+    free_png(image);
+    if( best < 0.0 || ms < best )
+      best = ms;
+  }
+
+  free(buffer);
+  if( best >= 0.0 )
+    fprintf( stderr, "%-4s %5dx%-5d x%d %8.1f KB %8.1f ms %8.1f MB/s decoded %7.1f MB/s of file  %s\n",
+             decoder->name, width, height, channels, fileBytes / 1024.0, best,
+             *pixelBytes / 1048576.0 / (best / 1000.0), fileBytes / 1048576.0 / (best / 1000.0), filename );
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  format_total_t totals[MAX_FORMATS];
+  int argi, repeat = 5, numTotals = 0, failed = 0, i;
+
+  for( argi = 1 ; argi < argc && argv[argi][0] == '-' ; argi++ ){
+    if( strcmp(argv[argi], "-repeat") == 0 && argi + 1 < argc )
+      repeat = atoi(argv[++argi]);
+    else
+      break;
+  }
+
+  if( argi == argc || repeat < 1 ){
+    fprintf( stderr, "Usage: %s [-repeat n] <image>...\n", argv[0] );
+    return 1;
+  }
+
+  for( ; argi < argc ; argi++ ){
+    const image_decoder_t *decoder = image_find_decoder(argv[argi]);
+    format_total_t *total;
+    struct stat st;
+    size_t pixelBytes = 0;
+    double ms;
+
+    if( !decoder || stat(argv[argi], &st) != 0 ){
+      failed = 1;
+      continue;
+    }
+
+    ms = bench_file(argv[argi], decoder, repeat, (double)st.st_size, &pixelBytes);
+    total = find_total(totals, &numTotals, decoder->name);
+    if( ms < 0.0 || !total ){
+      failed = 1;
+      continue;
+    }
+
+    total->files++;
+    total->fileBytes += st.st_size;
+    total->pixelBytes += pixelBytes;
+    total->ms += ms;
+  }
+
+  for( i = 0 ; i < numTotals ; i++ )
+    fprintf( stderr, "%-4s %d files, %.1f MB on disk, %.1f MB decoded in %.1f ms: %.1f MB/s decoded, %.1f MB/s of file\n",
+             totals[i].name, totals[i].files, totals[i].fileBytes / 1048576.0, totals[i].pixelBytes / 1048576.0,
+             totals[i].ms, totals[i].pixelBytes / 1048576.0 / (totals[i].ms / 1000.0),
+             totals[i].fileBytes / 1048576.0 / (totals[i].ms / 1000.0) );
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+/*
+	Software reference renderer
+
+	Renders the demo's cube with the parallax mapping shader on the CPU (see
+	lib/soft_render.h) at a given time and writes the frame to a PNG. It
+	needs no GPU or display, so it can produce golden images and measure
+	fragment throughput anywhere.
+
+	The window size, field of view, clip planes and loop duration are the
+	same as in main.cpp, so a frame matches the demo at the same time.
+
+	With -bench the frame is rendered that many more times and the average
+	frame time and fragment rate are reported.
+
+	The tangent frames come from the vertices like in the demo, or with
+	-derivativetbn from screen-space derivatives like its -derivativetbn.
+	The parallax fades out by its shift on screen at the demo's default
+	(medium) quality, or not at all with -nolod like the demo's -nolod.
+
+	Usage: softrender [-t seconds] [-size WxH] [-threads n] [-bench frames] [-derivativetbn] [-nolod] <output.png>
+	                  [<diffuse.png> <normal.png> <displacement.png>]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/png_reader.h"
+#include "../lib/thread_pool.h"
+#include "../lib/texture_loader.h"
+#include "../lib/mipmap.h"
+#include "../lib/soft_render.h"
+#include "../lib/unit_cube.h"
+#include "../lib/timer.h"
+
+#define NUM_MAPS 3
+
+typedef struct {
+  thread_pool_t *pool;
+  int filter;
+  mip_chain_t chain;
+} map_job_t;
+
+static const char *defaultMaps[NUM_MAPS] = {
+  "assets/photosculpt-graystonewall-diffuse.png",
+  "assets/photosculpt-graystonewall-normal.png",
+  "assets/photosculpt-graystonewall-displace.png"
+};
+
+// Runs on a worker as soon as the map is decoded
+static void build_chain(texture_load_t *load) {
+  map_job_t *job = (map_job_t*)load->userData;
+  png_data_t *image = load->image;
+
+  mip_chain_build(&job->chain, image->pixelData, image->width, image->height, image->channels,
+                  job->filter, job->pool);
+}
+
+static void usage(const char *name) {
+  fprintf( stderr, "Usage: %s [-t seconds] [-size WxH] [-threads n] [-bench frames] [-derivativetbn] [-nolod] "
+                   "<output.png> "
+                   "[<diffuse.png> <normal.png> <displacement.png>]\n", name );
+}
+
+int main(int argc, char *argv[]) {
+  // Same filters as the demo uses for its maps
+  static const int filters[NUM_MAPS] = { MIP_FILTER_SRGB, MIP_FILTER_NORMAL, MIP_FILTER_BOX };
+  const char *outFile;
+  texture_load_t loads[NUM_MAPS];
+  map_job_t jobs[NUM_MAPS];
+  texture_batch_t *batch;
+  texture_load_t *load;
+  thread_pool_t *pool;
+  sr_vertex_t vertices[sizeof(UnitCube) / sizeof(UnitCube[0])];
+  int numVertices = sizeof(UnitCube) / sizeof(UnitCube[0]);
+  sr_material_t material;
+  sr_uniforms_t uniforms;
+  sr_framebuffer_t fb;
+  sr_stats_t stats;
+  png_data_t frame;
+  double start, renderMs;
+  float time = 0.0f;
+  int width = 560, height = 315, numThreads = 0, benchFrames = 0, vertexTangents = 1;
+  int parallaxLod = 1;
+  int i, argi, ok = 1;
+
+  for( argi = 1 ; argi < argc && argv[argi][0] == '-' ; argi++ ){
+    if( strcmp(argv[argi], "-t") == 0 && argi + 1 < argc )
+      time = (float)atof(argv[++argi]);
+    else if( strcmp(argv[argi], "-size") == 0 && argi + 1 < argc ){
+      if( sscanf(argv[++argi], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0 ){
+        fprintf( stderr, "Invalid size: %s\n", argv[argi] );
+        return 1;
+      }
+    } else if( strcmp(argv[argi], "-threads") == 0 && argi + 1 < argc )
+      numThreads = atoi(argv[++argi]);
+    else if( strcmp(argv[argi], "-bench") == 0 && argi + 1 < argc )
+      benchFrames = atoi(argv[++argi]);
+    else if( strcmp(argv[argi], "-derivativetbn") == 0 )
+      vertexTangents = 0;
+    else if( strcmp(argv[argi], "-nolod") == 0 )
+      parallaxLod = 0;
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if( argc != argi + 1 && argc != argi + 1 + NUM_MAPS ){
+    usage(argv[0]);
+    return 1;
+  }
+  outFile = argv[argi];
+
+  // -threads 1 renders on the calling thread only
+  pool = numThreads == 1 ? NULL : thread_pool_create(numThreads);
+
+  for( i = 0 ; i < NUM_MAPS ; i++ ){
+    jobs[i].pool = pool;
+    jobs[i].filter = filters[i];
+    jobs[i].chain.numLevels = 0;
+
+    loads[i].fileName = argc > argi + 1 ? argv[argi + 1 + i] : defaultMaps[i];
+    loads[i].gray16 = 0;
+    loads[i].process = build_chain;
+    loads[i].userData = &jobs[i];
+  }
+
+  batch = texture_batch_begin(pool, loads, NUM_MAPS);
+  while( (load = texture_batch_next(batch)) != NULL )
+    if( !load->image )
+      ok = 0;
+  texture_batch_end(batch);
+
+  if( ok ){
+    for( i = 0 ; i < numVertices ; i++ ){
+      memcpy(vertices[i].position, UnitCube[i].position, sizeof(UnitCube[i].position));
+      vertices[i].position[3] = 1.0f;
+      memcpy(vertices[i].texCoord, UnitCube[i].texCoord, sizeof(vertices[i].texCoord));
+      memcpy(vertices[i].normal, UnitCube[i].normal, sizeof(vertices[i].normal));
+      memcpy(vertices[i].tangent, UnitCube[i].tangent, sizeof(vertices[i].tangent));
+    }
+
+    material.diffuseMap = &jobs[0].chain;
+    material.normalMap = &jobs[1].chain;
+    material.displacementMap = &jobs[2].chain;
+
+    uniforms.time = time;
+    uniforms.loopDuration = 25.0f;
+    uniforms.vertexTangents = vertexTangents;
+    // The demo's medium quality tier
+    uniforms.parallaxLod = parallaxLod;
+    uniforms.parallaxLodPixels[0] = 0.5f;
+    uniforms.parallaxLodPixels[1] = 2.0f;
+    sr_perspective(uniforms.perspectiveMatrix, 39.6f, width / (float)height, 1.0f, 10000.0f);
+
+    ok = sr_framebuffer_init(&fb, width, height);
+  }
+
+  if( ok ){
+    memset(&stats, 0, sizeof(stats));
+    sr_clear(&fb, 0.0f, 0.0f, 0.0f, 0.0f);
+    sr_draw(&fb, vertices, numVertices, &material, &uniforms, pool, &stats);
+
+    frame.width = width;
+    frame.height = height;
+    frame.channels = 4;
+    frame.has_alpha = 1;
+    frame.bit_depth = 8;
+    frame.pixelData = fb.color;
+    frame.owns_pixels = 0;
+    ok = write_png((char*)outFile, &frame);
+    fprintf( stderr, "Rendered t = %.2f s at %dx%d: %lld of %lld triangles, %lld fragments -> %s\n",
+             time, width, height, stats.rasterized, stats.triangles, stats.fragments, outFile );
+
+    if( benchFrames > 0 ){
+      memset(&stats, 0, sizeof(stats));
+      start = timer_now_ms();
+      for( i = 0 ; i < benchFrames ; i++ ){
+        sr_clear(&fb, 0.0f, 0.0f, 0.0f, 0.0f);
+        sr_draw(&fb, vertices, numVertices, &material, &uniforms, pool, &stats);
+      }
+      renderMs = timer_now_ms() - start;
+
+      fprintf( stderr, "%d frames on %d threads: %.2f ms/frame, %.1f Mfragments/s (%.1f%% helper pixels)\n",
+               benchFrames, pool ? thread_pool_size(pool) + 1 : 1, renderMs / benchFrames,
+               stats.fragments / (renderMs * 1000.0),
+               stats.quads > 0 ? 100.0 * (1.0 - stats.fragments / (4.0 * stats.quads)) : 0.0 );
+    }
+
+    sr_framebuffer_free(&fb);
+  }
+
+  for( i = 0 ; i < NUM_MAPS ; i++ ){
+    mip_chain_free(&jobs[i].chain);
+    free_png(loads[i].image);
+  }
+  thread_pool_destroy(pool);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*
+	Virtual texture baker
+
+	Cuts a normal and a displacement map into the pages of a virtual
+	texture (see lib/vt_file.h) for the demo's -virtual mode. The maps are
+	packed into one RGBA map with the height in alpha, as the shader's
+	packed mode reads them, given a full mip chain and tiled level by level.
+	Their size must be the page size times a power of two.
+
+	With -terrain the maps are made up instead: a fractal height field of
+	the given size (tens of thousands of texels on a side, far more than
+	would fit in memory) and the normals of its slopes. Every tile is made
+	on its own, so only a few are in memory at once. Each level leaves out
+	the octaves too fine for its texels, which stands in for averaging the
+	level below.
+
+	Usage: vtbake [-page texels] [-border texels] <output.vtex> <normal.png> <displacement.png>
+	       vtbake [-page texels] [-border texels] -terrain <size> <output.vtex>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../lib/image_decoder.h"
+#include "../lib/thread_pool.h"
+#include "../lib/mipmap.h"
+#include "../lib/material_pack.h"
+#include "../lib/vt_file.h"
+#include "../lib/timer.h"
+
+// pomDepthScale of parallaxmapping.frag: the depth of the height field in
+// texture coordinates, which sets how steep the terrain's slopes are
+#define DEPTH_SCALE 0.03
+
+// Lattice cells of the coarsest noise octave on a side
+#define TERRAIN_BASE_CELLS 4
+
+typedef struct {
+  int size;             // Of level 0
+  int octaves;          // With level 0
+  double amplitude;     // Scales the octaves' sum to [0,1]
+} terrain_t;
+
+typedef struct {
+  const mip_chain_t *chain;
+} image_source_t;
+
+// Levels down to a single page, or 0 if 'size' isn't the page size times
+// a power of two
+static int count_levels(int size, int pageSize) {
+  int levels = 1;
+
+  if( size < pageSize || size % pageSize != 0 )
+    return 0;
+  for( size /= pageSize ; size > 1 ; size /= 2, levels++ )
+    if( size % 2 != 0 )
+      return 0;
+  return levels <= VT_MAX_LEVELS ? levels : 0;
+}
+
+
+// MAPS FROM IMAGES
+
+static void copy_image_tile(int level, int px, int py, int pageSize, int border, unsigned char *tile, void *arg) {
+  const mip_level_t *src = &((const image_source_t*)arg)->chain->levels[level];
+  int tileSize = pageSize + 2 * border;
+  int x, y;
+
+  for( y = 0 ; y < tileSize ; y++ ){
+    // The border wraps around like GL_REPEAT
+    int sy = ((py * pageSize - border + y) % src->height + src->height) % src->height;
+    for( x = 0 ; x < tileSize ; x++ ){
+      int sx = ((px * pageSize - border + x) % src->width + src->width) % src->width;
+      memcpy(tile + ((size_t)y * tileSize + x) * 4, src->data + ((size_t)sy * src->width + sx) * 4, 4);
+    }
+  }
+}
+
+
+// TERRAIN
+
+static double lattice_value(int64_t x, int64_t y, int octave) {
+  uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull ^ (uint64_t)y * 0xC2B2AE3D27D4EB4Full ^ (uint64_t)octave * 0x165667B19E3779F9ull;
+  h ^= h >> 29;
+  h *= 0xBF58476D1CE4E5B9ull;
+  h ^= h >> 32;
+  return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Value noise that repeats every 'cells' lattice cells, a power of two
+static double value_noise(double x, double y, int64_t cells, int octave) {
+  int64_t x0 = (int64_t)floor(x), y0 = (int64_t)floor(y);
+  double fx = x - x0, fy = y - y0;
+  int64_t xa = x0 & (cells - 1), ya = y0 & (cells - 1);
+  int64_t xb = (xa + 1) & (cells - 1), yb = (ya + 1) & (cells - 1);
+  double v00 = lattice_value(xa, ya, octave), v10 = lattice_value(xb, ya, octave);
+  double v01 = lattice_value(xa, yb, octave), v11 = lattice_value(xb, yb, octave);
+  double a, b;
+
+  fx = fx * fx * (3.0 - 2.0 * fx);
+  fy = fy * fy * (3.0 - 2.0 * fy);
+  a = v00 + (v10 - v00) * fx;
+  b = v01 + (v11 - v01) * fx;
+  return a + (b - a) * fy;
+}
+
+// Height in [0,1] at a point of level 0, in texels, with the octaves a
+// level's texels can show
+static double terrain_height(const terrain_t *terrain, double x, double y, int octaves) {
+  double sum = 0.0, weight = 1.0;
+  int64_t cells = TERRAIN_BASE_CELLS;
+  int o;
+
+  for( o = 0 ; o < octaves ; o++, cells *= 2, weight *= 0.5 ){
+    double scale = (double)cells / terrain->size;
+    sum += weight * value_noise(x * scale, y * scale, cells, o);
+  }
+  return sum * terrain->amplitude;
+}
+
+// Octaves at least two texels of 'level' apart
+static int level_octaves(const terrain_t *terrain, int level) {
+  double spacing = (double)terrain->size / TERRAIN_BASE_CELLS;
+  int octaves = 0;
+
+  while( octaves < terrain->octaves && spacing >= 2.0 * (1 << level) ){
+    spacing /= 2.0;
+    octaves++;
+  }
+  return octaves > 0 ? octaves : 1;
+}
+
+static void make_terrain_tile(int level, int px, int py, int pageSize, int border, unsigned char *tile, void *arg) {
+  const terrain_t *terrain = (const terrain_t*)arg;
+  int tileSize = pageSize + 2 * border;
+  int rowLength = tileSize + 2;
+  int octaves = level_octaves(terrain, level);
+  double texel = (double)(1 << level);
+  // Height field depth in texels of this level
+  double depth = DEPTH_SCALE * terrain->size / texel;
+  double *heights;
+  int x, y;
+
+  // One more texel around the tile for the slopes at its edges
+  heights = (double*)malloc(sizeof(double) * rowLength * rowLength);
+  for( y = 0 ; y < rowLength ; y++ )
+    for( x = 0 ; x < rowLength ; x++ )
+      heights[y * rowLength + x] = terrain_height(terrain, (px * pageSize - border - 1 + x + 0.5) * texel,
+                                                  (py * pageSize - border - 1 + y + 0.5) * texel, octaves);
+
+  for( y = 0 ; y < tileSize ; y++ ){
+    for( x = 0 ; x < tileSize ; x++ ){
+      const double *h = heights + (y + 1) * rowLength + x + 1;
+      unsigned char *out = tile + ((size_t)y * tileSize + x) * 4;
+      double dx = (h[1] - h[-1]) * 0.5 * depth;
+      double dy = (h[rowLength] - h[-rowLength]) * 0.5 * depth;
+      double length = sqrt(dx * dx + dy * dy + 1.0);
+
+      out[0] = (unsigned char)((-dx / length * 0.5 + 0.5) * 255.0 + 0.5);
+      out[1] = (unsigned char)((-dy / length * 0.5 + 0.5) * 255.0 + 0.5);
+      out[2] = (unsigned char)((1.0 / length * 0.5 + 0.5) * 255.0 + 0.5);
+      out[3] = (unsigned char)(h[0] * 255.0 + 0.5);
+    }
+  }
+  free(heights);
+}
+
+static void init_terrain(terrain_t *terrain, int size) {
+  double sum = 0.0, weight = 1.0;
+  int o;
+
+  // Every octave level 0 can show
+  terrain->size = size;
+  terrain->octaves = 64;
+  terrain->octaves = level_octaves(terrain, 0);
+  for( o = 0 ; o < terrain->octaves ; o++, weight *= 0.5 )
+    sum += weight;
+  terrain->amplitude = 1.0 / sum;
+}
+
+
+int main(int argc, char *argv[]) {
+  int pageSize = 128, border = 2, terrainSize = 0;
+  int firstArg = 1, numLevels, ok;
+  const char *outFile;
+  thread_pool_t *pool;
+  double start;
+
+  while( firstArg < argc && argv[firstArg][0] == '-' ){
+    if( strcmp(argv[firstArg], "-page") == 0 && firstArg + 1 < argc )
+      pageSize = atoi(argv[++firstArg]);
+    else if( strcmp(argv[firstArg], "-border") == 0 && firstArg + 1 < argc )
+      border = atoi(argv[++firstArg]);
+    else if( strcmp(argv[firstArg], "-terrain") == 0 && firstArg + 1 < argc )
+      terrainSize = atoi(argv[++firstArg]);
+    else
+      break;
+    firstArg++;
+  }
+
+  if( argc != firstArg + (terrainSize > 0 ? 1 : 3) ){
+    fprintf( stderr, "Usage: %s [-page texels] [-border texels] <output.vtex> <normal.png> <displacement.png>\n"
+                     "       %s [-page texels] [-border texels] -terrain <size> <output.vtex>\n", argv[0], argv[0] );
+    return 1;
+  }
+  outFile = argv[firstArg];
+
+  start = timer_now_ms();
+  pool = thread_pool_create(0);
+
+  if( terrainSize > 0 ){
+    terrain_t terrain;
+
+    numLevels = count_levels(terrainSize, pageSize);
+    if( numLevels == 0 ){
+      fprintf( stderr, "The terrain size must be the page size (%d) times a power of two.\n", pageSize );
+      thread_pool_destroy(pool);
+      return 1;
+    }
+
+    init_terrain(&terrain, terrainSize);
+    ok = vt_file_write(outFile, pageSize, border, numLevels, make_terrain_tile, &terrain, pool);
+  }
+  else {
+    png_data_t *normal = read_image(argv[firstArg + 1]);
+    png_data_t *height = read_image(argv[firstArg + 2]);
+    png_data_t *packed = normal && height ? pack_normal_height(normal, height, pool) : NULL;
+    mip_chain_t chain;
+    image_source_t source;
+
+    ok = 0;
+    numLevels = packed ? count_levels(packed->width, pageSize) : 0;
+    if( packed && (packed->width != packed->height || numLevels == 0) )
+      fprintf( stderr, "The maps must be square, the page size (%d) times a power of two.\n", pageSize );
+    else if( packed ){
+      mip_chain_build(&chain, packed->pixelData, packed->width, packed->height, 4, MIP_FILTER_NORMAL, pool);
+      source.chain = &chain;
+      ok = vt_file_write(outFile, pageSize, border, numLevels, copy_image_tile, &source, pool);
+      mip_chain_free(&chain);
+    }
+
+    free_png(packed);
+    free_png(normal);
+    free_png(height);
+  }
+
+  thread_pool_destroy(pool);
+  if( !ok )
+    return 1;
+
+  fprintf( stderr, "Wrote %s: %d levels of %d texel pages (border %d) in %.1f ms\n",
+           outFile, numLevels, pageSize, border, timer_now_ms() - start );
+  return 0;
+}
@@ -1,3 +1,7 @@
+// 1.20 for invariant: the depth prepass and the shading pass draw with
+// different programs and must agree on depth to the bit (GL_EQUAL)
+#version 120
+
 // NOTES ON CONVERTING shader #version 330 TO OPENGL 2.1
 //
 // In the vertex program, in becomes attribute.
@@ -6,56 +10,33 @@
 
 // VBO inputs
 attribute vec4 vertexPosition;
-attribute vec4 vertexColor;
 attribute vec2 vertexTexCoord;
 attribute vec3 vertexNormal;
+attribute vec4 vertexTangent;	// w is the handedness, see lib/tangent_space.h
+
+// Model-view matrix of the object, one per instance. UpdateInstances() in
+// main.cpp computes them on the CPU once per frame.
+attribute mat4 instanceModelView;
+
+// Layer of the object's material in the texture arrays of a material
+// library (MATERIAL_ARRAY in parallaxmapping.frag), also one per instance
+attribute float instanceMaterial;
+
+invariant gl_Position;
 
 // out parameter going into the fragment shader stage
-varying vec4 theColor;
 varying vec2 tc;
 varying vec3 n;
+varying vec4 t;
 varying vec4 vec2Camera;
+varying float materialLayer;
 
 // uniforms
-uniform float time;
-uniform float loopDuration;
 uniform mat4 perspectiveMatrix;
 
 void main()
 {
-	// Divide 2*PI by the loopDuration to control movement speed
-	float timeScale = 3.14159 * 2.0 / loopDuration;
-
-	// Calculate looptime from [0, loopDuration]
-	float currTime = mod(time, loopDuration);
-
-	// Calculate offset position of vertex (COLUMN-MAJOR MATRIX)
-	mat4 offset = mat4(
-							1.0, 						0.0, 						0.0, 	0.0,
-							0.0, 						1.0, 						0.0, 	0.0,
-							0.0, 						0.0, 						1.0, 	0.0,
-							0.0,						0.0,						-2.0,	1.0
-							/*cos(currTime * timeScale), 	sin(currTime * timeScale), 	-5.0, 	1.0*/
-						);
-
-	// 
-	mat4 rotY = mat4(
-						cos(currTime * timeScale),		0.0,	-sin(currTime * timeScale), 0.0,
-						0.0,							1.0,						0.0,	0.0,
-						sin(currTime * timeScale),		0.0,	cos(currTime * timeScale),	0.0,
-						0.0,							0.0,						0.0,	1.0
-					);
-
-	mat4 rotX = mat4(
-						1.0,							0.0,						0.0, 	0.0,
-						0.0,		cos(currTime * timeScale),	sin(currTime * timeScale),	0.0,
-						0.0,		-sin(currTime * timeScale),	cos(currTime * timeScale),	0.0,
-						0.0,							0.0,						0.0,	1.0
-					);
-
-	// Create a matrix describing the transformation of a
-	// vertex position from model space to camera (view) space
-	mat4 modelViewMatrix = offset * rotY * rotX;
+	mat4 modelViewMatrix = instanceModelView;
 
 	// Transform the coordinate system to camera space
 	vec4 cameraSpacePos = modelViewMatrix * vertexPosition;
@@ -66,9 +47,8 @@ void main()
 
 	// BELOW: Prepare some variables for the fragment shader
 
-	// Pass the vertex' color value and texture coordinates
-	// (from the Vertex Array Object) to the fragment shader
-	theColor = vertexColor;
+	// Pass the texture coordinates (from the Vertex Array Object)
+	// to the fragment shader
 	tc = vertexTexCoord;
 
 	// The normal matrix is a 3x3 matrix (instead of 4x4)
@@ -79,7 +59,10 @@ void main()
 						modelViewMatrix[2][0], modelViewMatrix[2][1], modelViewMatrix[2][2]
 					);
 	n = normalize(normalMatrix * vertexNormal);
+	t = vec4(normalMatrix * vertexTangent.xyz, vertexTangent.w);
 
 
 	vec2Camera = -cameraSpacePos;
+
+	materialLayer = instanceMaterial;
 }
\ No newline at end of file